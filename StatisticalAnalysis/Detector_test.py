@@ -1,4 +1,5 @@
 import numpy as np
+from ResultReader import ResultFile
 import matplotlib.pyplot as plt
 
 det_idx = 5 # NOTE: Detector indexing start at 0
@@ -26,10 +27,14 @@ pull_mesmo_t = []
 pull_mesmo_x = []
 pull_mesmo_y = []
 
-for particle_index in range(PARTICLE_NUMBER):
+results = ResultFile(f"../results/Run {RUN_INDEX} Detector test.t4d")
+for particle_index in range(min(PARTICLE_NUMBER, len(results))):
     if (particle_index % 100 == 0):
         print(particle_index)
-    data = np.loadtxt(f"../results/Run {RUN_INDEX} Detector test part {particle_index}.csv", skiprows=2, unpack=True, delimiter=",", dtype=float)
+    data = results.particle(particle_index)
+    # NOTE: a particle that was not reconstructed, or that stopped before the detector, has no row for it
+    if len(data[0]) <= det_idx:
+        continue
     z, rea_t, rea_x, rea_y, rea_v, rea_xz, rea_yz, mes_t, mes_x, mes_y, smo_t, smo_st, smo_x, smo_sx, smo_y, smo_sy, smo_v, smo_sv, smo_xz, smo_sxz, smo_yz, smo_syz = data
     mes_t_dif.append(mes_t[det_idx] - rea_t[det_idx])
     mes_x_dif.append(mes_x[det_idx] - rea_x[det_idx])
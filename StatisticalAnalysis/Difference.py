@@ -1,4 +1,5 @@
 import numpy as np
+from ResultReader import ResultFile
 from scipy.stats import chi2
 import matplotlib.pyplot as plt
 from scipy.odr import ODR, Model, RealData
@@ -37,10 +38,14 @@ pull_y = []
 
 pull_mesmo_t = []
 
-for particle_index in range(PARTICLE_NUMBER):
+results = ResultFile(f"../results/Run {RUN_INDEX}.t4d")
+for particle_index in range(min(PARTICLE_NUMBER, len(results))):
     if (particle_index % 100 == 0):
         print(particle_index)
-    data = np.loadtxt(f"../results/Run {RUN_INDEX} Particle {particle_index}.csv", skiprows=2, unpack=True, delimiter=",", dtype=float)
+    data = results.particle(particle_index)
+    # NOTE: a particle that was not reconstructed, or that stopped before the detector, has no row for it
+    if len(data[0]) <= det_idx:
+        continue
     z, _, _, _, _, _, _, rea_t, rea_x, rea_y, rea_v, rea_xz, rea_yz, mes_t, mes_x, mes_y, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, smo_t, smo_st, smo_x, smo_sx, smo_y, smo_sy, smo_v, smo_sv, smo_xz, smo_sxz, smo_yz, smo_syz = data
     mes_t_dif.append(mes_t[det_idx] - rea_t[det_idx])
     mes_x_dif.append(mes_x[det_idx] - rea_x[det_idx])
@@ -0,0 +1,46 @@
+import numpy as np
+
+# NOTE: it must match the layout written by BinaryResultFile (see include/BinaryResultFile.hpp)
+MAGIC = b"T4DCOLS1"
+VERSION = 1
+COLUMN_NAME_SIZE = 32
+HEADER = np.dtype([("magic", "S8"), ("version", "<u4"), ("columns_number", "<u4"), ("particles_number", "<u8"),
+                   ("rows_number", "<u8"), ("rows_capacity", "<u8"), ("offsets_position", "<u8"), ("data_position", "<u8")])
+
+
+class ResultFile:
+    """Columnar binary results of a run, mapped in memory without being read."""
+
+    def __init__(self, path):
+        header = np.fromfile(path, dtype=HEADER, count=1)[0]
+        if header["magic"] != MAGIC or header["version"] != VERSION:
+            raise ValueError(f"{path} is not a result file")
+
+        columns_number = int(header["columns_number"])
+        names = np.fromfile(path, dtype=f"S{COLUMN_NAME_SIZE}", count=columns_number, offset=HEADER.itemsize)
+        self.names = [name.decode() for name in names]
+        self.particles_number = int(header["particles_number"])
+        self.rows_number = int(header["rows_number"])
+
+        # Particle j owns the rows in [offsets[j], offsets[j + 1])
+        self.offsets = np.memmap(path, dtype="<u8", mode="r", offset=int(header["offsets_position"]), shape=(self.particles_number + 1,))
+
+        self.columns = {}
+        column_size = int(header["rows_capacity"]) * 8
+        for j, name in enumerate(self.names):
+            position = int(header["data_position"]) + j * column_size
+            self.columns[name] = np.memmap(path, dtype="<f8", mode="r", offset=position, shape=(self.rows_number,)) if self.rows_number > 0 else np.empty(0)
+
+    def __len__(self):
+        return self.particles_number
+
+    def column(self, name):
+        """All the rows of a column, particle after particle."""
+        return self.columns[name]
+
+    def particle(self, index):
+        """The columns of a particle, in the order of the file (as np.loadtxt with unpack=True on the CSV files).
+
+        The values are copied, since the file is mapped read-only and the callers may modify them."""
+        begin, end = int(self.offsets[index]), int(self.offsets[index + 1])
+        return [np.array(self.columns[name][begin:end]) for name in self.names]
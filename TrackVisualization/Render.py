@@ -1,5 +1,8 @@
 from matplotlib.patches import Circle
 import numpy as np
+import sys
+sys.path.append("../StatisticalAnalysis")
+from ResultReader import ResultFile
 import matplotlib.pyplot as plt
 from mpl_toolkits.mplot3d import Axes3D
 from mpl_toolkits.mplot3d import art3d
@@ -29,8 +32,9 @@ xs = []
 ys = []
 zs = []
 max = 0
+results = ResultFile(f"../results/Run {run_index}.t4d")
 for particle in particle_index:
-    extraction = np.loadtxt(f"../results/Run {run_index} Particle {particle}.csv", skiprows=2, unpack=True, delimiter=",", dtype=float)
+    extraction = results.particle(particle)
     z,_,_,_,_,_,_,_,x,y,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_,_ = extraction
     x *= 1e3
     y *= 1e3
@@ -0,0 +1,430 @@
+// Header files needed
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Custom classes
+#include "DataFile.hpp"
+#include "DataGenerator.hpp"
+#include "Detector.hpp"
+#include "EventBuilder.hpp"
+#include "HitIndex.hpp"
+#include "MeasuresAndStates.hpp"
+#include "ModelTracker.hpp"
+#include "Particle.hpp"
+#include "PhysicalParameters.hpp"
+#include "RandomGenerator.hpp"
+#include "SetupFactory.hpp"
+#include "StateModels.hpp"
+#include "TrackFinder.hpp"
+#include "Tracker.hpp"
+#include "Utils.hpp"
+
+// Namespaces
+using namespace std;
+
+/**
+ * Microbenchmarks of the tracking and generation kernels.
+ *
+ * Every benchmark works on the same particles, generated with RANDOM_SEED, and
+ * is timed on whole iterations over them. The iterations are repeated until
+ * they take at least the minimum time, and the median of a few repetitions is
+ * reported, as time per track (i.e. per particle) and tracks per second. The
+ * results are printed and saved in a JSON file, to compare different versions.
+ *
+ * Usage: Tracking_benchmarks [--particles N] [--min-time SECONDS] [--filter TEXT] [--json FILE] (or --help)
+ *
+ * NOTE: the benchmarks of the output write their files in the data and results
+ * folders, like the simulation, with run number -1.
+ */
+
+struct BenchmarkOptions {
+  int particlesNumber = 1000;
+  double minTime = 0.5;
+  string filter;
+  string jsonFileName = "../results/Benchmarks.json";
+  // Set by "--help": the usage has been printed and nothing should run
+  bool helpRequested = false;
+};
+
+struct BenchmarkResult {
+  string name;
+  long long tracks;
+  long long iterations;
+  double nsPerTrack;
+  double tracksPerSecond;
+};
+
+// Number of timed repetitions of each benchmark, the median is reported
+constexpr int BENCHMARK_REPETITIONS = 5;
+
+// Run number of the files written by the benchmarks
+constexpr int BENCHMARK_RUN = -1;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// keepValue
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// NOTE: the compiler must assume that the value is read, otherwise it could skip the computation of results never used
+template <typename T>
+static void keepValue(const T &value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// runBenchmark
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void runBenchmark(const BenchmarkOptions &options, vector<BenchmarkResult> &results, const string &name, int tracksPerIteration,
+                         const function<void()> &iteration) {
+  if (name.find(options.filter) == string::npos)
+    return;
+
+  // Warm up, and number of iterations lasting the minimum time
+  const auto warmUpBegin = chrono::steady_clock::now();
+  iteration();
+  const double warmUpTime = chrono::duration<double>(chrono::steady_clock::now() - warmUpBegin).count();
+  const long long iterationsNumber = max(1LL, (long long)(options.minTime / max(warmUpTime, 1e-9)));
+
+  vector<double> nsPerTrack;
+  for (int repetition = 0; repetition < BENCHMARK_REPETITIONS; repetition++) {
+    const auto begin = chrono::steady_clock::now();
+    for (long long i = 0; i < iterationsNumber; i++)
+      iteration();
+    const double time = chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count();
+
+    nsPerTrack.push_back(time / (iterationsNumber * tracksPerIteration));
+  }
+
+  sort(nsPerTrack.begin(), nsPerTrack.end());
+  const double medianNsPerTrack = nsPerTrack[BENCHMARK_REPETITIONS / 2];
+  results.push_back(BenchmarkResult{name, (long long)tracksPerIteration * iterationsNumber * BENCHMARK_REPETITIONS,
+                                    iterationsNumber * BENCHMARK_REPETITIONS, medianNsPerTrack, 1e9 / medianNsPerTrack});
+
+  cout << left << setw(40) << name << right << setw(14) << fixed << setprecision(1) << medianNsPerTrack << " ns/track"
+       << setw(16) << setprecision(0) << 1e9 / medianNsPerTrack << " tracks/s" << endl;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// runModelTrackerBenchmarks
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// NOTE: a model tracker needs at least two measures, hence its tracks are the particles with two measures or more
+template <typename ModelTrackerType>
+static void runModelTrackerBenchmarks(const BenchmarkOptions &options, vector<BenchmarkResult> &results, const string &name,
+                                      const ModelTrackerType &modelTracker, const vector<vector<Measurement>> &allParticlesMeasures) {
+  vector<const vector<Measurement> *> tracksMeasures;
+  for (const vector<Measurement> &measures : allParticlesMeasures) {
+    if (measures.size() >= 2)
+      tracksMeasures.push_back(&measures);
+  }
+
+  vector<typename ModelTrackerType::FilterResult> filterResults;
+  for (const vector<Measurement> *measures : tracksMeasures)
+    filterResults.push_back(modelTracker.kalmanFilter(*measures));
+
+  runBenchmark(options, results, name + "::kalmanFilter", (int)tracksMeasures.size(), [&]() {
+    for (const vector<Measurement> *measures : tracksMeasures)
+      keepValue(modelTracker.kalmanFilter(*measures));
+  });
+
+  runBenchmark(options, results, name + "::kalmanSmoother", (int)tracksMeasures.size(), [&]() {
+    for (const typename ModelTrackerType::FilterResult &filterResult : filterResults)
+      keepValue(modelTracker.kalmanSmoother(filterResult));
+  });
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// saveResults
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void saveResults(const BenchmarkOptions &options, const vector<BenchmarkResult> &results) {
+  ofstream jsonFile(options.jsonFileName);
+  if (!jsonFile)
+    throw std::invalid_argument("saveResults: the file " + options.jsonFileName + " can not be opened");
+
+  const time_t now = chrono::system_clock::to_time_t(chrono::system_clock::now());
+  char date[32];
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+  jsonFile << setprecision(10);
+  jsonFile << "{\n";
+  jsonFile << "  \"context\": {\"date\": \"" << date << "\", \"seed\": " << RANDOM_SEED << ", \"particles\": " << options.particlesNumber
+           << ", \"detectors\": " << NUMBER_OF_DETECTORS << ", \"repetitions\": " << BENCHMARK_REPETITIONS << "},\n";
+  jsonFile << "  \"benchmarks\": [";
+  for (int i = 0; i < (int)results.size(); i++) {
+    jsonFile << (i == 0 ? "\n" : ",\n");
+    jsonFile << "    {\"name\": \"" << results[i].name << "\", \"tracks\": " << results[i].tracks << ", \"iterations\": " << results[i].iterations
+             << ", \"nsPerTrack\": " << results[i].nsPerTrack << ", \"tracksPerSecond\": " << results[i].tracksPerSecond << "}";
+  }
+  jsonFile << "\n  ]\n}\n";
+
+  cout << "\nResults saved in " << options.jsonFileName << endl;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// parseOptions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void printUsage(const string &programName) {
+  cout << "Usage: " << programName << " [--particles N] [--min-time SECONDS] [--filter TEXT] [--json FILE]" << endl
+       << endl
+       << "  --particles  number of particles of the benchmarks (default " << BenchmarkOptions().particlesNumber << ")" << endl
+       << "  --min-time   minimum time of each repetition [s] (default " << BenchmarkOptions().minTime << ")" << endl
+       << "  --filter     run only the benchmarks whose name contains the text" << endl
+       << "  --json       file of the results (default " << BenchmarkOptions().jsonFileName << ")" << endl;
+}
+
+static BenchmarkOptions parseOptions(int argc, char **argv) {
+  BenchmarkOptions options;
+
+  for (int i = 1; i < argc; i++) {
+    const string option = argv[i];
+    if (option == "--help") {
+      options.helpRequested = true;
+      return options;
+    }
+    if (i + 1 == argc)
+      throw std::invalid_argument("parseOptions: missing value of " + option);
+
+    const string value = argv[++i];
+    size_t parsed = 0;
+    if (option == "--particles" || option == "--min-time") {
+      try {
+        if (option == "--particles")
+          options.particlesNumber = stoi(value, &parsed);
+        else
+          options.minTime = stod(value, &parsed);
+      } catch (const exception &) {
+        parsed = 0;
+      }
+      if (parsed == 0 || parsed != value.size())
+        throw std::invalid_argument("parseOptions: the value of " + option + " is not a number: " + value);
+    } else if (option == "--filter")
+      options.filter = value;
+    else if (option == "--json")
+      options.jsonFileName = value;
+    else
+      throw std::invalid_argument("parseOptions: unknown option " + option);
+  }
+
+  if (options.particlesNumber < 1)
+    throw std::invalid_argument("parseOptions: the number of particles must be positive");
+
+  return options;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// main
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int main(int argc, char **argv) {
+  BenchmarkOptions options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const exception &error) {
+    cerr << error.what() << endl << endl;
+    printUsage(argv[0]);
+    return 1;
+  }
+  if (options.helpRequested) {
+    printUsage(argv[0]);
+    return 0;
+  }
+
+  const int particlesNumber = options.particlesNumber;
+  vector<BenchmarkResult> results;
+
+  // --- Fixtures
+  const SimulationSetup setup = SetupFactory().generateExperiment();
+  const vector<Detector> &detectors = setup.detectors;
+  const DataGenerator dataGenerator(setup, RANDOM_SEED);
+  const Tracker tracker(detectors);
+
+  const GeneratedData generatedData = dataGenerator.generateAllData(particlesNumber, false, true);
+  const vector<Measurement> allMeasures = Utils::concatenateMeasures(generatedData.allParticlesMeasures);
+
+  // NOTE: a particle that missed the first detector has no measure, hence it is not a track of the tracking benchmarks
+  vector<Particle> particles;
+  vector<int> reconstructedIndices;
+  vector<kalmanFilterResult> filterResults;
+  vector<vector<MatrixStateEstimate>> allPredictedStates(particlesNumber), allFilteredStates(particlesNumber), allSmoothedStates(particlesNumber);
+  for (int i = 0; i < particlesNumber; i++) {
+    particles.push_back(dataGenerator.generateParticle(i));
+    if (generatedData.allParticlesMeasures[i].empty())
+      continue;
+
+    reconstructedIndices.push_back(i);
+    filterResults.push_back(tracker.kalmanFilter(generatedData.allParticlesMeasures[i]));
+    allPredictedStates[i] = filterResults.back().predictedStates;
+    allFilteredStates[i] = filterResults.back().filteredStates;
+    allSmoothedStates[i] = tracker.kalmanSmoother(filterResults.back());
+  }
+  const int tracksNumber = (int)reconstructedIndices.size();
+
+  cout << "Benchmarks on " << particlesNumber << " particles, " << tracksNumber << " tracks (seed " << RANDOM_SEED << ")\n" << endl;
+
+  // --- Tracking
+  runBenchmark(options, results, "Tracker::estimateNextState", tracksNumber, [&]() {
+    for (int i : reconstructedIndices) {
+      for (int layer = 0; layer + 1 < (int)allFilteredStates[i].size(); layer++)
+        keepValue(tracker.estimateNextState(allFilteredStates[i][layer], tracker.getLayerGeometry(layer)));
+    }
+  });
+
+  runBenchmark(options, results, "Tracker::kalmanFilter", tracksNumber, [&]() {
+    for (int i : reconstructedIndices)
+      keepValue(tracker.kalmanFilter(generatedData.allParticlesMeasures[i]));
+  });
+
+  runBenchmark(options, results, "Tracker::kalmanSmoother", tracksNumber, [&]() {
+    for (const kalmanFilterResult &filterResult : filterResults)
+      keepValue(tracker.kalmanSmoother(filterResult));
+  });
+
+  runBenchmark(options, results, "Tracker::computeChi2s", tracksNumber, [&]() {
+    for (int i : reconstructedIndices)
+      keepValue(tracker.computeChi2s(generatedData.allParticlesRealStates[i], allSmoothedStates[i], false, true));
+  });
+
+  // NOTE: the batch filter fits all the tracks at once, in blocks of BATCH_BLOCK_SIZE
+  vector<vector<Measurement>> tracksMeasures;
+  for (int i : reconstructedIndices)
+    tracksMeasures.push_back(generatedData.allParticlesMeasures[i]);
+  const kalmanFilterBatchResult batchFilterResults = tracker.kalmanFilterBatch(tracksMeasures);
+
+  runBenchmark(options, results, "Tracker::kalmanFilterBatch", tracksNumber, [&]() {
+    keepValue(tracker.kalmanFilterBatch(tracksMeasures));
+  });
+
+  runBenchmark(options, results, "Tracker::kalmanSmootherBatch", tracksNumber, [&]() {
+    keepValue(tracker.kalmanSmootherBatch(batchFilterResults));
+  });
+
+  // --- Model trackers, with the noise of the tracker
+  runModelTrackerBenchmarks(options, results, "ModelTracker", ModelTracker<StraightLine4DModel>(detectors, tracker.getParameters()),
+                            generatedData.allParticlesMeasures);
+  runModelTrackerBenchmarks(options, results, "SpatialTracker", SpatialTracker(detectors, tracker.getParameters()),
+                            generatedData.allParticlesMeasures);
+  runModelTrackerBenchmarks(options, results, "FixedVelocityTracker", FixedVelocityTracker(detectors, tracker.getParameters()),
+                            generatedData.allParticlesMeasures);
+
+  // --- Event building and track finding, on the measures of all the particles mixed together
+  const EventBuilder eventBuilder(detectors, setup.particleGun.getPosition());
+  runBenchmark(options, results, "EventBuilder::buildEvents", particlesNumber, [&]() {
+    keepValue(eventBuilder.buildEvents(allMeasures));
+  });
+
+  HitIndex hitIndex(detectors);
+  runBenchmark(options, results, "HitIndex::build", particlesNumber, [&]() {
+    hitIndex.build(allMeasures);
+    keepValue(hitIndex);
+  });
+
+  // NOTE: a window around each measure, as wide as the ones of the event builder
+  vector<pair<int, HitWindow>> hitWindows;
+  for (const Measurement &measure : allMeasures) {
+    const int layer = hitIndex.getLayerIndex(measure);
+    const MeasureCovariance measureUncertainty = detectors[layer].getMeasureUncertainty();
+    hitWindows.emplace_back(layer, HitWindow::around(measure.x, measure.y, measure.t, EVENT_WINDOW_SIGMAS * sqrt(measureUncertainty(1, 1)),
+                                                     EVENT_WINDOW_SIGMAS * sqrt(measureUncertainty(0, 0))));
+  }
+
+  runBenchmark(options, results, "LayerHitIndex::findInWindow", particlesNumber, [&]() {
+    vector<int> hitIndices;
+    for (const auto &[layer, window] : hitWindows) {
+      hitIndices.clear();
+      hitIndex.getLayer(layer).findInWindow(window, hitIndices);
+      keepValue(hitIndices);
+    }
+  });
+
+  const TrackFinder trackFinder(detectors, setup.particleGun.getPosition(), tracker.getParameters());
+  runBenchmark(options, results, "TrackFinder::findTracks", particlesNumber, [&]() {
+    keepValue(trackFinder.findTracks(allMeasures));
+  });
+
+  // --- Generation
+  runBenchmark(options, results, "Particle::zSpaceEvolve", particlesNumber, [&]() {
+    for (int i = 0; i < particlesNumber; i++) {
+      RandomGenerator randomGenerator(RANDOM_SEED, i, RandomStream::EVOLUTION);
+      ParticleState state = particles[i].getInitialState();
+      for (const Detector &detector : detectors) {
+        state = particles[i].zSpaceEvolve(state, detector.getBottmLeftPosition().z(), randomGenerator, true, detector.getId());
+        keepValue(state);
+      }
+    }
+  });
+
+  runBenchmark(options, results, "Detector::measure", particlesNumber, [&]() {
+    for (int i = 0; i < particlesNumber; i++) {
+      RandomGenerator randomGenerator(RANDOM_SEED, i, RandomStream::MEASURE);
+      const vector<ParticleState> &realStates = generatedData.allParticlesRealStates[i];
+      for (int layer = 0; layer < (int)detectors.size(); layer++)
+        keepValue(detectors[layer].measure(realStates[layer + 1], randomGenerator));
+    }
+  });
+
+  // NOTE: the gaussian numbers of the multiple scattering of each particle, one at a time and all at once
+  const int evolutionGaussiansNumber = (int)detectors.size() * EVOLUTION_GAUSSIANS_NUMBER;
+  runBenchmark(options, results, "RandomGenerator::generateGaussian", particlesNumber, [&]() {
+    for (int i = 0; i < particlesNumber; i++) {
+      RandomGenerator randomGenerator(RANDOM_SEED, i, RandomStream::EVOLUTION);
+      for (int j = 0; j < evolutionGaussiansNumber; j++)
+        keepValue(randomGenerator.generateGaussian());
+    }
+  });
+
+  runBenchmark(options, results, "RandomGenerator::fillGaussian", particlesNumber, [&]() {
+    vector<double> gaussians(evolutionGaussiansNumber);
+    for (int i = 0; i < particlesNumber; i++) {
+      RandomGenerator randomGenerator(RANDOM_SEED, i, RandomStream::EVOLUTION);
+      randomGenerator.fillGaussian(gaussians.data(), gaussians.size());
+      keepValue(gaussians);
+    }
+  });
+
+  runBenchmark(options, results, "DataGenerator::generateAllData", particlesNumber,
+               [&]() { keepValue(dataGenerator.generateAllData(particlesNumber, false, true)); });
+
+  // --- Input and output
+  const string dataFileName = "../data/GeneratedData_run" + to_string(BENCHMARK_RUN) + ".root";
+  runBenchmark(options, results, "DataFile::SaveMultipleMeasures", particlesNumber, [&]() {
+    DataFile dataFile(dataFileName.c_str(), "DataTree", false);
+    dataFile.SaveMultipleMeasures(allMeasures);
+  });
+
+  runBenchmark(options, results, "DataFile::readMeasures", particlesNumber, [&]() {
+    DataFile dataFile(dataFileName.c_str(), "DataTree", true);
+    keepValue(dataFile.readMeasures());
+  });
+
+  runBenchmark(options, results, "Utils::saveDataToCSV", particlesNumber, [&]() {
+    Utils::saveDataToCSV(detectors, generatedData.allParticlesTheoreticalStates, generatedData.allParticlesRealStates,
+                         generatedData.allParticlesMeasures, allPredictedStates, allFilteredStates, allSmoothedStates, BENCHMARK_RUN, 0);
+  });
+
+  try {
+    saveResults(options, results);
+  } catch (const exception &error) {
+    cerr << error.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -70,7 +70,7 @@ compile_run() {
     echo ""
     echo " ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~"
     echo " --- Executing"
-    ./Tracking_simulation
+    ./Tracking_simulation "$@"
 
     echo ""
     echo " ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~"
@@ -97,7 +97,7 @@ compile_run_show() {
     echo " ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~"
     echo " --- Executing the code"
     echo " Executing"
-    ./Tracking_simulation
+    ./Tracking_simulation "$@"
 
     # --- Visualisation of data and results
     echo " ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~"
@@ -203,4 +203,4 @@ show() {
     echo " Thank you for your patience!"
 }
 
-$1
\ No newline at end of file
+$1 "${@:2}"
\ No newline at end of file
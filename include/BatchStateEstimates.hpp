@@ -0,0 +1,101 @@
+#pragma once
+
+#include "FixedMatrix.hpp"
+#include "MeasuresAndStates.hpp"
+
+#include <vector>
+
+// Number of tracks processed in lockstep by the batch Kalman filter and smoother.
+// NOTE: it is a multiple of the AVX-512 width and small enough for the working set of a block to stay in L1 cache
+constexpr int BATCH_BLOCK_SIZE = 32;
+
+/**
+ * The structure-of-arrays representation of the states of many tracks.
+ *
+ * Every element of the state vector and of its covariance is stored
+ * contiguously across tracks, i.e. as [layer][element][track]. In this way the
+ * same operation applied to consecutive tracks maps onto consecutive SIMD lanes.
+ * The number of tracks is padded to a multiple of BATCH_BLOCK_SIZE. Tracks may
+ * have a different number of valid states (e.g. a particle that left the
+ * acceptance): the elements past the last valid state are meaningless.
+ */
+class BatchStateEstimates {
+public:
+  BatchStateEstimates() : tracksNumber(0), layersNumber(0), stride(0) {}
+
+  /**
+   * The constructor.
+   *
+   * @param tracksNumber the number of tracks stored.
+   * @param layersNumber the maximum number of states of a track.
+   */
+  BatchStateEstimates(int tracksNumber, int layersNumber);
+
+  int getTracksNumber() const { return tracksNumber; }
+  int getLayersNumber() const { return layersNumber; }
+  int getStride() const { return stride; }
+  int getStatesNumber(int track) const { return statesNumber[track]; }
+  void setStatesNumber(int track, int newValue) { statesNumber[track] = newValue; }
+
+  /**
+   * Access the values of a layer.
+   *
+   * @return a pointer to the first track of the first element of the state
+   * vector. Element i of track j is at [i * getStride() + j].
+   */
+  double *getValues(int layer) { return &values[layer * STATE_DIMENSION * stride]; }
+  const double *getValues(int layer) const { return &values[layer * STATE_DIMENSION * stride]; }
+
+  /**
+   * Access the uncertainties of a layer.
+   *
+   * @return a pointer to the first track of the first element of the
+   * covariance. Element (r, c) of track j is at [(r * 6 + c) * getStride() + j].
+   */
+  double *getUncertainties(int layer) { return &uncertainties[layer * STATE_DIMENSION * STATE_DIMENSION * stride]; }
+  const double *getUncertainties(int layer) const { return &uncertainties[layer * STATE_DIMENSION * STATE_DIMENSION * stride]; }
+
+  /**
+   * Store the state of a single track.
+   *
+   * @param layer the index of the state along the track.
+   * @param track the index of the track.
+   * @param state the state to be stored.
+   */
+  void setState(int layer, int track, const MatrixStateEstimate &state);
+
+  /**
+   * Store the same state for all the tracks (padding included).
+   *
+   * @param layer the index of the state along the tracks.
+   * @param state the state to be stored.
+   */
+  void fillLayer(int layer, const MatrixStateEstimate &state);
+
+  /**
+   * Extract the state of a single track.
+   *
+   * @param layer the index of the state along the track.
+   * @param track the index of the track.
+   * @return the state stored.
+   */
+  MatrixStateEstimate getState(int layer, int track) const;
+
+  /**
+   * Extract all the valid states of a single track.
+   *
+   * @param track the index of the track.
+   * @return a vector with the states, in the same format returned by the
+   * single track Kalman filter.
+   */
+  std::vector<MatrixStateEstimate> getTrackStates(int track) const;
+
+private:
+  int tracksNumber;
+  int layersNumber;
+  int stride;
+
+  std::vector<int> statesNumber;
+  std::vector<double> values;
+  std::vector<double> uncertainties;
+};
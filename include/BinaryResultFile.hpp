@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * The content of a binary result file, as read by BinaryResultFile::read.
+ *
+ * The rows of particle j are those in [offsets[j], offsets[j + 1]) of every
+ * column.
+ */
+struct BinaryResultData {
+  std::vector<std::string> columnNames;
+  std::vector<std::uint64_t> offsets;
+  std::vector<std::vector<double>> columns;
+
+  /**
+   * Return the values of a column.
+   *
+   * @param name the name of the column.
+   * @return the values of all the rows (std::invalid_argument if the column is missing).
+   */
+  const std::vector<double> &getColumn(const std::string &name) const;
+};
+
+/**
+ * The binary result file class.
+ *
+ * It stores the results of a whole run in a single columnar file, which can be
+ * mapped in memory as it is (e.g. with numpy.memmap). The layout, all
+ * little-endian, is:
+ *  - a header: the magic "T4DCOLS1", the version and the number of columns
+ *    (uint32), the number of particles, of rows and the capacity of a column
+ *    in rows (uint64), the positions of the offsets and of the first column
+ *    (uint64) and the names of the columns (32 bytes each, null padded);
+ *  - the offsets: for each particle the index of its first row, plus the
+ *    total number of rows (uint64);
+ *  - the columns: each one is a contiguous array of doubles, starting at the
+ *    position of the first column plus its index times the capacity.
+ *
+ * The rows of particle j are those in [offsets[j], offsets[j + 1]). Since the
+ * capacities are fixed at construction, the particles are appended with large
+ * sequential writes of each column, and the memory used does not depend on the
+ * number of particles.
+ */
+class BinaryResultFile {
+public:
+  /**
+   * The constructor.
+   *
+   * @param fileName the name of the file (it is overwritten).
+   * @param columnNames the names of the columns of the file.
+   * @param particlesCapacity the maximum number of particles stored.
+   * @param rowsCapacity the maximum number of rows stored.
+   */
+  BinaryResultFile(const std::string &fileName, const std::vector<std::string> &columnNames, std::uint64_t particlesCapacity,
+                   std::uint64_t rowsCapacity);
+
+  /**
+   * The destructor.
+   *
+   * Writes the pending data and the header before closing.
+   */
+  ~BinaryResultFile();
+
+  BinaryResultFile(const BinaryResultFile &) = delete;
+  BinaryResultFile &operator=(const BinaryResultFile &) = delete;
+
+  int getColumnsNumber() const { return (int)columnNames.size(); }
+  std::uint64_t getParticlesNumber() const { return particlesNumber; }
+  std::uint64_t getRowsNumber() const { return rowsNumber; }
+
+  /**
+   * Append the rows of a particle.
+   *
+   * @param rows the values of the rows of the particle, row by row (a
+   *             particle may have no rows at all).
+   */
+  void addParticle(const std::vector<double> &rows);
+
+  /**
+   * Write the pending data and the header and close the file.
+   */
+  void close();
+
+  /**
+   * Read a whole binary result file.
+   *
+   * @param fileName the name of the file.
+   * @return the names of the columns, the offsets of the particles and the values of the columns.
+   */
+  static BinaryResultData read(const std::string &fileName);
+
+private:
+  std::ofstream file;
+  std::vector<std::string> columnNames;
+
+  std::uint64_t particlesCapacity;
+  std::uint64_t rowsCapacity;
+  std::uint64_t particlesNumber = 0;
+  std::uint64_t rowsNumber = 0;
+
+  std::uint64_t offsetsPosition;
+  std::uint64_t dataPosition;
+
+  // Data not yet written to the file
+  std::vector<std::vector<double>> columnBuffers;
+  std::vector<std::uint64_t> offsetsBuffer;
+  std::uint64_t writtenRows = 0;
+  std::uint64_t writtenOffsets = 0;
+
+  void flush();
+  void writeHeader();
+};
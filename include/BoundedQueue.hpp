@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+/**
+ * The bounded queue class.
+ *
+ * It connects the stages of a pipeline running on different threads. The
+ * producer blocks when the queue is full, so that a fast stage cannot pile up
+ * an unbounded amount of data in front of a slow one. Once closed, the queue
+ * refuses new elements and the consumers drain the remaining ones.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+  /**
+   * The constructor.
+   *
+   * @param capacity the maximum number of elements stored at the same time.
+   */
+  explicit BoundedQueue(std::size_t capacity) : capacity(capacity) {
+    if (capacity == 0)
+      throw std::invalid_argument("The capacity of a queue must be positive");
+  }
+
+  /**
+   * Add an element, waiting for a free slot if the queue is full.
+   *
+   * @param element the element to be added.
+   * @return false if the queue has been closed (the element is discarded).
+   */
+  bool push(T element) {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    notFull.wait(lock, [this] { return closed || elements.size() < capacity; });
+    if (closed)
+      return false;
+
+    elements.push_back(std::move(element));
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+  }
+
+  /**
+   * Remove the oldest element, waiting for one if the queue is empty.
+   *
+   * @return the element, or nullopt if the queue is closed and empty.
+   */
+  std::optional<T> pop() {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    notEmpty.wait(lock, [this] { return closed || !elements.empty(); });
+    if (elements.empty())
+      return std::nullopt;
+
+    std::optional<T> element{std::move(elements.front())};
+    elements.pop_front();
+    lock.unlock();
+    notFull.notify_one();
+    return element;
+  }
+
+  /**
+   * Close the queue, waking up all the waiting threads.
+   */
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      closed = true;
+    }
+    notFull.notify_all();
+    notEmpty.notify_all();
+  }
+
+private:
+  const std::size_t capacity;
+  bool closed = false;
+  std::deque<T> elements;
+
+  std::mutex queueMutex;
+  std::condition_variable notFull;
+  std::condition_variable notEmpty;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "PhysicalParameters.hpp"
+#include "SetupFactory.hpp"
+#include "Tracker.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What the program does
+enum class RunMode { SIMULATE, DETECTOR_TEST, RECONSTRUCT_ONLY, SWEEP, UNBIASED_PULLS, DETECTOR_SCAN, TRACK_FINDING };
+
+// Format of the files of the results
+enum class OutputFormat { BINARY, CSV, ROOT };
+
+/**
+ * The parameters of a run, chosen at startup instead of at compile time.
+ *
+ * The defaults are the values in PhysicalParameters.hpp. They are overridden
+ * by a configuration file, with one "key = value" per line ("#" starts a
+ * comment), and then by the command line options "--key value" (or
+ * "--key=value"), with the same keys. The keys are listed by printUsage.
+ *
+ * NOTE: the physics of the data generation (the evolution sigmas of the
+ * particles) and the constants of the event building are still fixed at
+ * compile time.
+ */
+struct Configuration {
+  RunMode mode = RunMode::DETECTOR_TEST;
+  int particlesNumber = NUMBER_OF_PARTICLES;
+  // If not positive, one per hardware thread
+  int threadsNumber = NUMBER_OF_THREADS;
+  std::uint64_t seed = RANDOM_SEED;
+  OutputFormat outputFormat = OutputFormat::BINARY;
+  // Particles of each chunk of the streaming simulation (if not positive, the particles are simulated all at once)
+  int particlesPerChunk = 0;
+  // Detector masked by the detector test
+  int testedDetector = DETECTOR_WITHOUT_TIME;
+  // Detectors masked together by the detector scan (1 or 2)
+  int maskedDetectorsNumber = 1;
+  // Measures reconstructed by the reconstruct-only mode (if empty, the cached data of the same seed, experiment and particles)
+  std::string dataFileName = "";
+  // Truth of those measures (if empty, the sidecar of the data file, when there is one)
+  std::string truthFileName = "";
+  // Directory of the cache of the generated data (if empty, the data are always generated)
+  std::string dataCacheDirectory = DATA_CACHE_DIRECTORY;
+  // Grid of the evolution sigmas of the Kalman filter tried by the sweep
+  std::vector<double> sweepVelocitySigmas = {VELOCITY_EVOLUTION_SIGMA, 2. * VELOCITY_EVOLUTION_SIGMA, 3. * VELOCITY_EVOLUTION_SIGMA,
+                                             4. * VELOCITY_EVOLUTION_SIGMA, 6. * VELOCITY_EVOLUTION_SIGMA};
+  std::vector<double> sweepDirectionSigmas = {0.5 * DIRECTION_EVOLUTION_SIGMA, DIRECTION_EVOLUTION_SIGMA, 2. * DIRECTION_EVOLUTION_SIGMA,
+                                              4. * DIRECTION_EVOLUTION_SIGMA};
+  // Set by "--help": the usage has been printed and nothing should run
+  bool helpRequested = false;
+
+  ExperimentParameters experiment;
+  TrackerParameters tracker;
+  // Limits of the chi2 beyond which the reconstruction gives a track up (by default none)
+  FilterAbortPolicy abortPolicy;
+
+  /**
+   * Read the configuration from the command line.
+   *
+   * The file given with "--config" is read first, whatever its position, then
+   * the other options override its values. The configuration is validated.
+   *
+   * @param argc the number of arguments.
+   * @param argv the arguments, the first one being the name of the program.
+   * @return the configuration.
+   */
+  static Configuration fromArguments(int argc, const char *const argv[]);
+
+  /**
+   * Read the values of a configuration file, overriding the current ones.
+   *
+   * @param fileName the name of the file.
+   */
+  void readFile(const std::string &fileName);
+
+  /**
+   * Set the value of a key.
+   *
+   * @param key the name of the parameter (e.g. "particles").
+   * @param value the value, as written in the file or on the command line.
+   */
+  void set(const std::string &key, const std::string &value);
+
+  /**
+   * Check that the values are consistent, throwing std::invalid_argument otherwise.
+   */
+  void validate() const;
+
+  /**
+   * Print the values of all the keys.
+   */
+  void print() const;
+
+  /**
+   * Print the options of the command line and the keys of the configuration file.
+   *
+   * @param programName the name of the program.
+   */
+  static void printUsage(const std::string &programName);
+};
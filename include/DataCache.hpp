@@ -0,0 +1,96 @@
+#pragma once
+
+#include "DataGenerator.hpp"
+#include "MeasuresAndStates.hpp"
+#include "PhysicalParameters.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * The cache of the generated data, addressed by their content.
+ *
+ * The data are stored in two files named after a hash of everything they
+ * depend on (the seed, the detectors, the particle gun, the physical
+ * parameters of the generation and the number of particles):
+ *  - <key>.root, the measures in the format of DataFile;
+ *  - <key>.truth, the truth sidecar: a binary result file (see
+ *    BinaryResultFile) with the theoretical and the real states of each
+ *    particle, and for each state the index of its measure in the measures
+ *    file (-1 if none).
+ * The sidecar is written last, under a temporary name renamed at the end,
+ * hence an entry is complete if its sidecar exists.
+ *
+ * NOTE: the key does not depend on the code of the generation. Any change of
+ * the code that alters the generated data must increase GENERATED_DATA_VERSION
+ * in DataCache.cpp, otherwise the old data are reused.
+ */
+class DataCache {
+public:
+  /**
+   * The constructor.
+   *
+   * @param directory the directory of the cache, created if missing.
+   */
+  DataCache(const std::string &directory = DATA_CACHE_DIRECTORY);
+
+  /**
+   * Return the key of the data that a generator would generate.
+   *
+   * @param dataGenerator the generator, with its setup and its seed.
+   * @param particlesNumber the number of particles.
+   * @param useMultipleScattering whether the multiple scattering is used.
+   * @return the hash of the parameters of the generation, in hexadecimal.
+   */
+  static std::string computeKey(const DataGenerator &dataGenerator, int particlesNumber, bool useMultipleScattering);
+
+  std::string getMeasuresFileName(const std::string &key) const { return directory + "/" + key + ".root"; }
+  std::string getTruthFileName(const std::string &key) const { return directory + "/" + key + ".truth"; }
+
+  /**
+   * Whether the data of a key are in the cache.
+   *
+   * @param key the key of the data.
+   * @return true if the entry is complete.
+   */
+  bool contains(const std::string &key) const;
+
+  /**
+   * Store the data of a key in the cache.
+   *
+   * @param key the key of the data.
+   * @param generatedData the data generated.
+   */
+  void store(const std::string &key, const GeneratedData &generatedData) const;
+
+  /**
+   * Write the measures of the generated data and their truth sidecar.
+   *
+   * @param measuresFileName the name of the file of the measures.
+   * @param truthFileName the name of the truth sidecar.
+   * @param generatedData the data generated.
+   */
+  static void saveData(const std::string &measuresFileName, const std::string &truthFileName, const GeneratedData &generatedData);
+
+  /**
+   * Read the measures of a file and their truth sidecar.
+   *
+   * @param measuresFileName the name of the file of the measures.
+   * @param truthFileName the name of the truth sidecar.
+   * @param allMeasures the measures, in the order of the file.
+   * @return the states and the measures of each particle, as generated.
+   */
+  static GeneratedData loadData(const std::string &measuresFileName, const std::string &truthFileName,
+                                std::vector<Measurement> &allMeasures);
+
+  /**
+   * Return the name of the truth sidecar of a file of measures (".root" replaced by ".truth").
+   *
+   * @param measuresFileName the name of the file of the measures.
+   * @return the name of the sidecar.
+   */
+  static std::string getTruthFileNameOf(const std::string &measuresFileName);
+
+private:
+  std::string directory;
+};
@@ -1,11 +1,30 @@
 #pragma once
 
 #include "MeasuresAndStates.hpp"
+#include "PhysicalParameters.hpp"
 
+#include <TBranch.h>
 #include <TFile.h>
 #include <TTree.h>
+#include <cstddef>
 #include <vector>
 
+/**
+ * The measures of a range of entries of a data file, stored by column.
+ */
+struct MeasuresColumns {
+  Long64_t firstEntry = 0;
+  std::vector<double> t;
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<int> id;
+
+  std::size_t size() const { return t.size(); }
+  Measurement getMeasure(std::size_t index) const { return Measurement{t[index], x[index], y[index], id[index]}; }
+};
+
+class MeasuresChunks;
+
 class DataFile {
 public:
   /**
@@ -41,9 +60,37 @@ public:
   /**
    * Read measures from the tree
    *
+   * The tree is read in ranges of entries (see readMeasuresChunks), hence
+   * only the columns of one range are in memory besides the measures.
+   *
+   * @param entriesPerChunk the maximum number of entries read at once.
    * @return a vector containg all the measurements in the file
    */
-  std::vector<Measurement> readMeasures();
+  std::vector<Measurement> readMeasures(Long64_t entriesPerChunk = DATA_FILE_CHUNK_ENTRIES);
+
+  /**
+   * Read a range of entries of the tree into contiguous columns.
+   *
+   * The baskets of the range are fetched by the read-ahead cache in a few
+   * large requests, instead of one entry at a time.
+   *
+   * @param firstEntry the first entry to be read.
+   * @param entriesNumber the number of entries to be read (if negative or past
+   *                      the end, up to the last entry).
+   * @return the measures of the range.
+   */
+  MeasuresColumns readMeasuresColumns(Long64_t firstEntry = 0, Long64_t entriesNumber = -1);
+
+  /**
+   * Iterate over the file in ranges of entries, e.g.
+   * for (const MeasuresColumns &chunk : dataFile.readMeasuresChunks(n)) ...
+   *
+   * @param entriesPerChunk the maximum number of entries of each range.
+   * @return the sequence of ranges, read only when they are reached.
+   */
+  MeasuresChunks readMeasuresChunks(Long64_t entriesPerChunk = DATA_FILE_CHUNK_ENTRIES);
+
+  Long64_t getEntriesNumber() const { return dataTree->GetEntries(); }
 
 private:
   double tBuffer;
@@ -56,4 +103,44 @@ private:
 
   TFile *rootFile;
   TTree *dataTree;
+  TBranch *tBranch;
+  TBranch *xBranch;
+  TBranch *yBranch;
+  TBranch *idBranch;
+};
+
+/**
+ * The sequence of ranges of entries of a data file.
+ *
+ * The ranges are read one at a time while iterating, so that only one of them
+ * is in memory.
+ */
+class MeasuresChunks {
+public:
+  class Iterator {
+  public:
+    Iterator(DataFile *dataFile, Long64_t firstEntry, Long64_t entriesPerChunk)
+        : dataFile(dataFile), firstEntry(firstEntry), entriesPerChunk(entriesPerChunk) {}
+
+    MeasuresColumns operator*() const { return dataFile->readMeasuresColumns(firstEntry, entriesPerChunk); }
+    Iterator &operator++() {
+      firstEntry += entriesPerChunk;
+      return *this;
+    }
+    bool operator!=(const Iterator &other) const { return firstEntry < other.firstEntry; }
+
+  private:
+    DataFile *dataFile;
+    Long64_t firstEntry;
+    Long64_t entriesPerChunk;
+  };
+
+  MeasuresChunks(DataFile *dataFile, Long64_t entriesPerChunk) : dataFile(dataFile), entriesPerChunk(entriesPerChunk) {}
+
+  Iterator begin() const { return Iterator(dataFile, 0, entriesPerChunk); }
+  Iterator end() const { return Iterator(dataFile, dataFile->getEntriesNumber(), entriesPerChunk); }
+
+private:
+  DataFile *dataFile;
+  Long64_t entriesPerChunk;
 };
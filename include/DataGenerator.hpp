@@ -2,8 +2,12 @@
 
 #include "MeasuresAndStates.hpp"
 #include "Particle.hpp"
+#include "PhysicalParameters.hpp"
+#include "RandomGenerator.hpp"
 #include "SetupFactory.hpp"
+#include "ThreadPool.hpp"
 
+#include <cstdint>
 #include <vector>
 
 struct GeneratedData {
@@ -15,22 +19,37 @@ struct GeneratedData {
 class DataGenerator {
 public:
   DataGenerator(){};
-  DataGenerator(SimulationSetup simulationSetup)
-      : simulationSetup(simulationSetup){};
+  DataGenerator(SimulationSetup simulationSetup, std::uint64_t seed = RANDOM_SEED)
+      : simulationSetup(simulationSetup), seed(seed){};
 
-  Particle generateParticle() {
-    return simulationSetup.particleGun.generateParticle();
+  void setSeed(std::uint64_t newValue) { seed = newValue; }
+  std::uint64_t getSeed() const { return seed; }
+  const SimulationSetup &getSimulationSetup() const { return simulationSetup; }
+
+  /**
+   * Generate a particle from the particle gun.
+   *
+   * NOTE: all the random numbers of a particle depend only on the seed and on
+   * its index, hence the particles can be generated in any order.
+   *
+   * @param particleIndex the index of the particle within the run.
+   * @return the particle generated.
+   */
+  Particle generateParticle(int particleIndex) const {
+    RandomGenerator randomGenerator(seed, particleIndex, RandomStream::PARTICLE_GUN);
+    return simulationSetup.particleGun.generateParticle(randomGenerator, particleIndex);
   };
 
   /**
    * Generate the states of a given particle.
    *
    * @param particle the particle to be evolved.
+   * @param particleIndex the index of the particle within the run.
    * @param multipleScattering whether to use multiple scattering.
    * @return a vector containing the particles.
    */
   std::vector<ParticleState>
-  generateParticleStates(Particle particle,
+  generateParticleStates(Particle particle, int particleIndex,
                          bool multipleScattering = true) const;
   /**
    * Generate the measures from the states.
@@ -40,24 +59,48 @@ public:
    * measure.
    *
    * @param particleStates the states to be measured
+   * @param particleIndex the index of the particle within the run.
    * @return a vector containing the measurements generated
    */
   std::vector<Measurement>
-  generateParticleMeasures(std::vector<ParticleState> &ParticleStates) const;
+  generateParticleMeasures(std::vector<ParticleState> &ParticleStates, int particleIndex) const;
 
   /**
    * Generate all the data for a given number of particles
    *
+   * If a thread pool is given, the particles are split in chunks generated
+   * concurrently. Since the random numbers of each particle depend only on its
+   * index, the data are identical for any number of threads.
+   *
    * @param numberOfParticles the number of particles to be generated
    * @param logging whether or not to show log messages
    * @param useMultipleScattering whether or not to use multiple scattering during the evolution
+   * @param threadPool the threads used for the generation (serial generation if nullptr)
    * @return a vector containing all the data of all the particles
    */
   GeneratedData generateAllData(int numberOfParticles, bool logging = false,
-                                bool useMultipleScattering = true);
+                                bool useMultipleScattering = true,
+                                ThreadPool *threadPool = nullptr) const;
+
+  /**
+   * Generate the data for a contiguous range of particles of the run
+   *
+   * The particles are identical to those with the same indices generated by
+   * generateAllData, hence a run can be generated one chunk at a time.
+   *
+   * @param firstParticleIndex the index of the first particle of the range
+   * @param particlesNumber the number of particles to be generated
+   * @param useMultipleScattering whether or not to use multiple scattering during the evolution
+   * @param threadPool the threads used for the generation (serial generation if nullptr)
+   * @return the data of the particles of the range, the first one at index 0
+   */
+  GeneratedData generateParticlesData(int firstParticleIndex, int particlesNumber,
+                                      bool useMultipleScattering = true,
+                                      ThreadPool *threadPool = nullptr) const;
 
 private:
   SimulationSetup simulationSetup;
+  std::uint64_t seed = RANDOM_SEED;
 
   void logData(const GeneratedData &generatedData) const;
 };
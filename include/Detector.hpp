@@ -1,12 +1,18 @@
 #pragma once
 
+#include "FixedMatrix.hpp"
 #include "MeasuresAndStates.hpp"
+#include "PhysicalParameters.hpp"
+#include "RandomGenerator.hpp"
 
 #include <TLorentzVector.h>
 #include <TMatrixD.h>
 #include <TVector3.h>
 #include <optional>
 
+// Number of standard gaussian numbers of the smearing of each measure
+constexpr int MEASURE_GAUSSIANS_NUMBER = 3;
+
 /**
  * The detector class.
  *
@@ -19,53 +25,77 @@ public:
    * The constructor.
    * It determines the position from the zPosition (since they are all aligned to
    * the z-axis i.d. position=(0,0,z))
+   *
+   * @param spaceUncertainty the standard deviation of the measures of x and y.
+   * @param timeUncertainty the standard deviation of the measures of t.
    */
-  Detector(double zPosition, double width, double height);
+  Detector(double zPosition, double width, double height, double spaceUncertainty = DETECTOR_SPACE_UNCERTAINTY,
+           double timeUncertainty = DETECTOR_TIME_UNCERTAINTY);
 
   int getId() const { return id; }
   TVector3 getBottmLeftPosition() const { return bottomLeftPosition; }
   double getWidth() const { return width; }
   double getHeight() const { return height; }
+  double getSpaceUncertainty() const { return spaceUncertainty; }
+  double getTimeUncertainty() const { return timeUncertainty; }
+  bool isTimeMeasured() const { return timeMeasured; }
+  void setTimeMeasured(bool newValue) { timeMeasured = newValue; }
 
   /**
    * Creates a Measurement from a particlePosition, if the particle is inside the
    * area of the detector.
    *
    * @param particlePosition the position of the particle.
+   * @param randomGenerator the generator of the gaussian smearing.
+   *
+   * @return an optional measurement. It contains the measure if the particle was
+   * inside, nullopt otherwise.
+   */
+  std::optional<Measurement> measure(TLorentzVector particlePosition, RandomGenerator &randomGenerator) const;
+
+  /**
+   * Creates a Measurement from a particlePosition, if the particle is inside the
+   * area of the detector, with the random numbers already drawn.
+   *
+   * @param particlePosition the position of the particle.
+   * @param gaussians the MEASURE_GAUSSIANS_NUMBER standard gaussian numbers of
+   * the smearing of t, x and y.
    *
    * @return an optional measurement. It contains the measure if the particle was
    * inside, nullopt otherwise.
    */
-  std::optional<Measurement> measure(TLorentzVector particlePosition) const;
+  std::optional<Measurement> measure(TLorentzVector particlePosition, const double *gaussians) const;
 
   /**
    * Creates a Measurement from a particlePosition, if the particle is inside the
    * area of the detector.
    *
    * @param particlePosition the position of the particle.
+   * @param randomGenerator the generator of the gaussian smearing.
    *
    * @return an optional measurement. It contains the measure if the particle was
    * inside, nullopt otherwise.
    */
-  std::optional<Measurement> measure(TMatrixD particleState) const;
+  std::optional<Measurement> measure(TMatrixD particleState, RandomGenerator &randomGenerator) const;
 
   /**
    * Creates a Measurement from a ParticleState, if the particle is inside the
    * area of the detector.
    *
    * @param particlePosition the position of the particle.
+   * @param randomGenerator the generator of the gaussian smearing.
    *
    * @return an optional measurement. It contains the measure if the particle was
    * inside, nullopt otherwise.
    */
-  std::optional<Measurement> measure(ParticleState particleState) const;
+  std::optional<Measurement> measure(ParticleState particleState, RandomGenerator &randomGenerator) const;
 
   /**
    * Return the uncertainty of the detector
    *
    * @return the covariance matrix of the detector
    */
-  TMatrixD getMeasureUncertainty() const;
+  MeasureCovariance getMeasureUncertainty() const;
 
 private:
   /**
@@ -78,4 +108,9 @@ private:
   double width;
   double height;
   TVector3 bottomLeftPosition;
+  double spaceUncertainty;
+  double timeUncertainty;
+
+  // Whether the detector measures the time (otherwise the time of its measures is always 0)
+  bool timeMeasured = true;
 };
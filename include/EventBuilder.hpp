@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Detector.hpp"
+#include "HitIndex.hpp"
+#include "MeasuresAndStates.hpp"
+#include "ThreadPool.hpp"
+
+#include <TVector3.h>
+#include <vector>
+
+/**
+ * The event builder class.
+ *
+ * It divides a stream of measures of many particles, in any order, into the
+ * measures of each particle. The measures are sorted by time and cut into time
+ * slices, which are processed independently: hence the particles can overlap
+ * in time, and the slices can be processed in parallel.
+ *
+ * Each measure on the first detector starts a particle, which is followed
+ * detector after detector looking for a measure within the time of flight
+ * allowed by the speed of the particles (between EVENT_MIN_SPEED and the speed
+ * of light). When more measures are allowed, the one closest to the straight
+ * line through the preavious measures (or through the origin of the particles
+ * and the first measure) is chosen. The measures of the detectors that do not
+ * measure the time are added afterwards, by position only.
+ *
+ * NOTE: the measures of a particle are on consecutive detectors from the first
+ * one, as required by the Tracker. The measures that do not belong to any
+ * particle (e.g. the noise) are discarded. The measures of the detectors
+ * without time can be exchanged between close particles, since all of them
+ * are candidates for every particle.
+ */
+class EventBuilder {
+public:
+  EventBuilder(){};
+
+  /**
+   * The constructor.
+   *
+   * @param detectors the detectors of the experiment, ordered along z. The first one must measure the time.
+   * @param originPosition the point where the particles come from (e.g. the particle gun).
+   */
+  EventBuilder(const std::vector<Detector> &detectors, TVector3 originPosition = TVector3());
+
+  /**
+   * Sort measures by time.
+   *
+   * It uses a least significant digit radix sort, which is stable and whose
+   * passes are split among the threads.
+   *
+   * @param measures the measures to be sorted.
+   * @param threadPool the threads used for the sorting (serial sorting if nullptr).
+   */
+  static void sortByTime(std::vector<Measurement> &measures, ThreadPool *threadPool = nullptr);
+
+  /**
+   * Divide the measures into the particles.
+   *
+   * @param measures the measures of all the particles, in any order.
+   * @param threadPool the threads used for the time slices (serial building if nullptr).
+   * @return the measures of each particle, ordered by detector, the particles
+   *         ordered by the time of their first measure.
+   */
+  std::vector<std::vector<Measurement>> buildEvents(std::vector<Measurement> measures, ThreadPool *threadPool = nullptr) const;
+
+  /**
+   * Divide the measures into the particles starting in a time interval.
+   *
+   * Only the particles whose measure on the first detector is in
+   * [seedsBegin, seedsEnd) are built, e.g. the particles of a chunk of a
+   * stream. The measures with time up to a time of flight window around the
+   * interval (see selectTimedMeasures) must be given too: the particles of the
+   * neighbouring chunks are rebuilt to reserve their measures, as in the whole
+   * stream. The measures without time are only matched to the particles built,
+   * hence they must belong to the interval.
+   *
+   * @param measures the measures, in any order.
+   * @param seedsBegin the beginning of the interval.
+   * @param seedsEnd the end of the interval.
+   * @param threadPool the threads used for the time slices (serial building if nullptr).
+   * @return the measures of each particle built, as in buildEvents.
+   */
+  std::vector<std::vector<Measurement>> buildEvents(std::vector<Measurement> measures, double seedsBegin, double seedsEnd,
+                                                    ThreadPool *threadPool = nullptr) const;
+
+  /**
+   * Select the measures with time in a time interval.
+   *
+   * @param measures the measures, in any order.
+   * @param begin the beginning of the interval.
+   * @param end the end of the interval.
+   * @return the measures of the detectors measuring the time in [begin, end), in the same order.
+   */
+  std::vector<Measurement> selectTimedMeasures(const std::vector<Measurement> &measures, double begin, double end) const;
+
+  /**
+   * Return the longest time between the first and the last measure of a particle.
+   *
+   * It is the overlap between consecutive time slices.
+   *
+   * @return the time of flight window.
+   */
+  double getTimeOfFlightWindow() const { return timeOfFlightWindow; }
+
+private:
+  TVector3 originPosition;
+
+  // Position, time measure and uncertainties of each detector
+  std::vector<double> layersZ;
+  std::vector<bool> layersTimeMeasured;
+  std::vector<double> layersTimeSigma;
+  std::vector<double> layersSpaceSigma;
+  double timeOfFlightWindow = 0.;
+
+  // The grids of the detectors, copied and filled for each group of measures
+  HitIndex emptyHitIndex;
+
+  std::vector<std::vector<Measurement>> buildSliceEvents(const std::vector<Measurement> &sortedMeasures, double sliceBegin,
+                                                         double sliceEnd) const;
+  void addUntimedMeasures(std::vector<std::vector<Measurement>> &events, const std::vector<Measurement> &untimedMeasures) const;
+};
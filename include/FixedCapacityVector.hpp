@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+/**
+ * The fixed capacity vector class.
+ *
+ * It is a sequence whose maximum size is known at compile time: the elements
+ * are stored inline, so it never touches the heap. It offers the subset of the
+ * std::vector interface used by the trackers.
+ */
+template <typename T, int Capacity>
+class FixedCapacityVector {
+public:
+  static_assert(Capacity > 0, "FixedCapacityVector capacity must be positive");
+
+  static constexpr std::size_t capacity() { return Capacity; }
+  std::size_t size() const { return elementsNumber; }
+  bool empty() const { return elementsNumber == 0; }
+
+  void reserve(std::size_t elements) const {
+    if (elements > Capacity)
+      throw std::invalid_argument("FixedCapacityVector::reserve: more elements than the capacity");
+  }
+
+  void push_back(const T &element) {
+    if (elementsNumber == Capacity)
+      throw std::invalid_argument("FixedCapacityVector::push_back: the vector is full");
+    elements[elementsNumber++] = element;
+  }
+
+  T &operator[](std::size_t index) { return elements[index]; }
+  const T &operator[](std::size_t index) const { return elements[index]; }
+  T &back() { return elements[elementsNumber - 1]; }
+  const T &back() const { return elements[elementsNumber - 1]; }
+
+  T *begin() { return elements.data(); }
+  T *end() { return elements.data() + elementsNumber; }
+  const T *begin() const { return elements.data(); }
+  const T *end() const { return elements.data() + elementsNumber; }
+
+private:
+  std::array<T, Capacity> elements{};
+  std::size_t elementsNumber = 0;
+};
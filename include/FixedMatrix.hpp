@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+/**
+ * The fixed size matrix class.
+ *
+ * It represents a dense row-major matrix whose dimensions are known at compile
+ * time. The elements are stored inline, so copies never touch the heap and the
+ * compiler is free to unroll every operation.
+ */
+template <int Rows, int Cols>
+class FixedMatrix {
+public:
+  static_assert(Rows > 0 && Cols > 0, "FixedMatrix dimensions must be positive");
+
+  /**
+   * The default constructor.
+   *
+   * It initializes all the elements to zero.
+   */
+  FixedMatrix() : data{} {}
+
+  /**
+   * The constructor from a row-major array.
+   *
+   * @param values the Rows * Cols elements of the matrix, row by row.
+   */
+  explicit FixedMatrix(const double *values) { std::copy(values, values + Rows * Cols, data.begin()); }
+
+  /**
+   * Generate the identity matrix.
+   *
+   * @return a square matrix with ones on the diagonal.
+   */
+  static FixedMatrix identity() {
+    static_assert(Rows == Cols, "The identity is defined only for square matrices");
+    FixedMatrix result;
+    for (int i = 0; i < Rows; i++)
+      result(i, i) = 1.;
+    return result;
+  }
+
+  static constexpr int getNrows() { return Rows; }
+  static constexpr int getNcols() { return Cols; }
+  const double *getArray() const { return data.data(); }
+
+  double &operator()(int row, int col) { return data[row * Cols + col]; }
+  double operator()(int row, int col) const { return data[row * Cols + col]; }
+
+  FixedMatrix &operator+=(const FixedMatrix &other) {
+    for (int i = 0; i < Rows * Cols; i++)
+      data[i] += other.data[i];
+    return *this;
+  }
+
+  FixedMatrix &operator-=(const FixedMatrix &other) {
+    for (int i = 0; i < Rows * Cols; i++)
+      data[i] -= other.data[i];
+    return *this;
+  }
+
+  /**
+   * Compute the transpose of the matrix.
+   *
+   * @return the transposed matrix.
+   */
+  FixedMatrix<Cols, Rows> transpose() const {
+    FixedMatrix<Cols, Rows> result;
+    for (int i = 0; i < Rows; i++)
+      for (int j = 0; j < Cols; j++)
+        result(j, i) = (*this)(i, j);
+    return result;
+  }
+
+  /**
+   * Invert the matrix in place.
+   *
+   * It uses a Gauss-Jordan elimination with partial pivoting. If a pivot is
+   * not larger than the tolerance the matrix is considered singular and it is
+   * left untouched.
+   *
+   * @param tolerance the minimum absolute value accepted for a pivot.
+   * @return whether or not the inversion succeeded.
+   */
+  bool invert(double tolerance = 0.) {
+    static_assert(Rows == Cols, "Only square matrices can be inverted");
+    FixedMatrix work = *this;
+    FixedMatrix inverse = identity();
+
+    for (int col = 0; col < Rows; col++) {
+      // Selection of the pivot
+      int pivot = col;
+      for (int i = col + 1; i < Rows; i++)
+        if (std::fabs(work(i, col)) > std::fabs(work(pivot, col)))
+          pivot = i;
+
+      if (std::fabs(work(pivot, col)) <= tolerance)
+        return false;
+
+      for (int j = 0; j < Rows; j++) {
+        std::swap(work(col, j), work(pivot, j));
+        std::swap(inverse(col, j), inverse(pivot, j));
+      }
+
+      // Normalization of the pivot row
+      const double pivotValue = work(col, col);
+      for (int j = 0; j < Rows; j++) {
+        work(col, j) /= pivotValue;
+        inverse(col, j) /= pivotValue;
+      }
+
+      // Elimination of the column from the other rows
+      for (int i = 0; i < Rows; i++) {
+        if (i == col)
+          continue;
+        const double factor = work(i, col);
+        for (int j = 0; j < Rows; j++) {
+          work(i, j) -= factor * work(col, j);
+          inverse(i, j) -= factor * inverse(col, j);
+        }
+      }
+    }
+
+    *this = inverse;
+    return true;
+  }
+
+  /**
+   * Solve the system (this matrix) * solution = rhs, for a symmetric positive
+   * definite matrix (e.g. a covariance).
+   *
+   * It uses an LDL^T decomposition, which needs neither square roots nor the
+   * inverse and is not affected by the scale of the variables, hence it is
+   * accurate also when the variances span many orders of magnitude. If a pivot
+   * is not positive the matrix is not positive definite and the solution is
+   * left untouched.
+   *
+   * @param rhs the right hand side of the system.
+   * @param solution the solution of the system.
+   * @return whether or not the system was solved.
+   */
+  template <int RhsCols>
+  bool solveSymmetric(const FixedMatrix<Rows, RhsCols> &rhs, FixedMatrix<Rows, RhsCols> &solution) const {
+    static_assert(Rows == Cols, "Only square systems can be solved");
+    FixedMatrix lower = identity();
+    std::array<double, Rows> diagonal;
+
+    // Decomposition
+    for (int col = 0; col < Rows; col++) {
+      double pivot = (*this)(col, col);
+      for (int k = 0; k < col; k++)
+        pivot -= lower(col, k) * lower(col, k) * diagonal[k];
+
+      if (!(pivot > 0.))
+        return false;
+      diagonal[col] = pivot;
+
+      for (int row = col + 1; row < Rows; row++) {
+        double element = (*this)(row, col);
+        for (int k = 0; k < col; k++)
+          element -= lower(row, k) * lower(col, k) * diagonal[k];
+        lower(row, col) = element / pivot;
+      }
+    }
+
+    // Forward substitution, scaling and backward substitution
+    FixedMatrix<Rows, RhsCols> result = rhs;
+    for (int col = 0; col < RhsCols; col++) {
+      for (int row = 1; row < Rows; row++)
+        for (int k = 0; k < row; k++)
+          result(row, col) -= lower(row, k) * result(k, col);
+
+      for (int row = 0; row < Rows; row++)
+        result(row, col) /= diagonal[row];
+
+      for (int row = Rows - 2; row >= 0; row--)
+        for (int k = row + 1; k < Rows; k++)
+          result(row, col) -= lower(k, row) * result(k, col);
+    }
+
+    solution = result;
+    return true;
+  }
+
+private:
+  std::array<double, Rows * Cols> data;
+};
+
+template <int Rows, int Cols>
+FixedMatrix<Rows, Cols> operator+(FixedMatrix<Rows, Cols> lhs, const FixedMatrix<Rows, Cols> &rhs) {
+  return lhs += rhs;
+}
+
+template <int Rows, int Cols>
+FixedMatrix<Rows, Cols> operator-(FixedMatrix<Rows, Cols> lhs, const FixedMatrix<Rows, Cols> &rhs) {
+  return lhs -= rhs;
+}
+
+template <int Rows, int Inner, int Cols>
+FixedMatrix<Rows, Cols> operator*(const FixedMatrix<Rows, Inner> &lhs, const FixedMatrix<Inner, Cols> &rhs) {
+  FixedMatrix<Rows, Cols> result;
+  for (int i = 0; i < Rows; i++)
+    for (int j = 0; j < Cols; j++) {
+      double sum = 0.;
+      for (int k = 0; k < Inner; k++)
+        sum += lhs(i, k) * rhs(k, j);
+      result(i, j) = sum;
+    }
+  return result;
+}
+
+/**
+ * Compute lhs * rhs^T without building the transpose.
+ *
+ * @param lhs the left matrix.
+ * @param rhs the right matrix, used transposed.
+ * @return the product.
+ */
+template <int Rows, int Inner, int Cols>
+FixedMatrix<Rows, Cols> multiplyTranspose(const FixedMatrix<Rows, Inner> &lhs, const FixedMatrix<Cols, Inner> &rhs) {
+  FixedMatrix<Rows, Cols> result;
+  for (int i = 0; i < Rows; i++)
+    for (int j = 0; j < Cols; j++) {
+      double sum = 0.;
+      for (int k = 0; k < Inner; k++)
+        sum += lhs(i, k) * rhs(j, k);
+      result(i, j) = sum;
+    }
+  return result;
+}
+
+// Dimensions of the tracking problem: (t, x, y, 1/v, xz, yz) and (t, x, y)
+constexpr int STATE_DIMENSION = 6;
+constexpr int MEASURE_DIMENSION = 3;
+
+using StateVector = FixedMatrix<STATE_DIMENSION, 1>;
+using StateCovariance = FixedMatrix<STATE_DIMENSION, STATE_DIMENSION>;
+using MeasureVector = FixedMatrix<MEASURE_DIMENSION, 1>;
+using MeasureCovariance = FixedMatrix<MEASURE_DIMENSION, MEASURE_DIMENSION>;
+using ProjectionMatrix = FixedMatrix<MEASURE_DIMENSION, STATE_DIMENSION>;
+using EvolutionMatrix = FixedMatrix<STATE_DIMENSION, STATE_DIMENSION>;
+using KalmanGain = FixedMatrix<STATE_DIMENSION, MEASURE_DIMENSION>;
+using SmootherGain = FixedMatrix<STATE_DIMENSION, STATE_DIMENSION>;
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Detector.hpp"
+#include "MeasuresAndStates.hpp"
+#include "PhysicalParameters.hpp"
+
+#include <vector>
+
+/**
+ * A rectangular window in space and time, where the hits are searched.
+ *
+ * The limits are included in the window.
+ */
+struct HitWindow {
+  double xMin, xMax;
+  double yMin, yMax;
+  double tMin, tMax;
+
+  /**
+   * Return the window centered in a point.
+   *
+   * @param x the x of the center.
+   * @param y the y of the center.
+   * @param t the time of the center.
+   * @param spaceTolerance the half width and height of the window.
+   * @param timeTolerance the half duration of the window.
+   * @return the window.
+   */
+  static HitWindow around(double x, double y, double t, double spaceTolerance, double timeTolerance) {
+    return HitWindow{x - spaceTolerance, x + spaceTolerance, y - spaceTolerance, y + spaceTolerance, t - timeTolerance, t + timeTolerance};
+  }
+};
+
+/**
+ * The hit index of a detector layer.
+ *
+ * It divides the area of the detector in a uniform grid of square cells. The
+ * hits are stored cell by cell, ordered by time within each cell, hence a
+ * window is searched only in the cells it overlaps and, in each of them, only
+ * from its starting time. The hits outside the area of the detector are stored
+ * in the cells on its border.
+ *
+ * NOTE: if the detector does not measure the time, the time limits of the
+ * windows are ignored.
+ */
+class LayerHitIndex {
+public:
+  LayerHitIndex(){};
+
+  /**
+   * The constructor.
+   *
+   * @param detector the detector of the layer.
+   * @param cellSize the side of the cells of the grid.
+   */
+  LayerHitIndex(const Detector &detector, double cellSize);
+
+  /**
+   * Replace the hits of the index.
+   *
+   * @param measures the hits of the layer, in any order (the index is faster to build if they are ordered by time).
+   */
+  void build(const std::vector<Measurement> &measures);
+
+  /**
+   * Find the hits in a window.
+   *
+   * @param window the window where the hits are searched.
+   * @param (out) hitIndices the indices of the hits found are appended to it.
+   */
+  void findInWindow(const HitWindow &window, std::vector<int> &hitIndices) const;
+
+  int getHitsNumber() const { return (int)hits.size(); }
+  const Measurement &getHit(int hitIndex) const { return hits[hitIndex]; }
+
+private:
+  double xOrigin = 0.;
+  double yOrigin = 0.;
+  double cellSize = 1.;
+  int columnsNumber = 1;
+  int rowsNumber = 1;
+  bool timeMeasured = true;
+
+  // The hits of the cell i are those from cellsBegin[i] to cellsBegin[i + 1]
+  std::vector<int> cellsBegin;
+  std::vector<Measurement> hits;
+
+  int getColumn(double x) const;
+  int getRow(double y) const;
+};
+
+/**
+ * The hit index class.
+ *
+ * It holds the hit index of each detector layer, built at once from the hits
+ * of an event (or of a readout window), to find the hits compatible with a
+ * prediction in a time proportional to the number of hits found.
+ */
+class HitIndex {
+public:
+  HitIndex(){};
+
+  /**
+   * The constructor.
+   *
+   * @param detectors the detectors of the experiment, ordered along z.
+   * @param cellSize the side of the cells of the grids.
+   */
+  HitIndex(const std::vector<Detector> &detectors, double cellSize = HIT_INDEX_CELL_SIZE);
+
+  /**
+   * Replace the hits of the index.
+   *
+   * @param measures the hits of all the layers, in any order.
+   */
+  void build(const std::vector<Measurement> &measures);
+
+  /**
+   * Return the layer of a measure.
+   *
+   * @param measure the measure.
+   * @return the index of the detector of the measure.
+   */
+  int getLayerIndex(const Measurement &measure) const;
+
+  int getLayersNumber() const { return (int)layers.size(); }
+  const LayerHitIndex &getLayer(int layer) const { return layers[layer]; }
+
+private:
+  std::vector<LayerHitIndex> layers;
+  std::vector<int> layerOfDetectorId;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 // Header files needed
+#include "FixedMatrix.hpp"
+
 #include <TLorentzVector.h>
 #include <TMatrixD.h>
 #include <TVector3.h>
@@ -22,11 +24,12 @@ struct Measurement {
  * The matrix rapresentation of the estimated state.
  *
  * It contains the value and the uncertainty of the estimate.
+ * Both are fixed size matrices, so an estimate never allocates on the heap.
  */
 struct MatrixStateEstimate {
 public:
-  TMatrixD value;
-  TMatrixD uncertainty;
+  StateVector value;
+  StateCovariance uncertainty;
   std::optional<int> detectorID = std::nullopt;
 };
 
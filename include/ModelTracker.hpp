@@ -0,0 +1,296 @@
+#pragma once
+
+#include "Detector.hpp"
+#include "FixedCapacityVector.hpp"
+#include "FixedMatrix.hpp"
+#include "MeasuresAndStates.hpp"
+#include "PhysicalParameters.hpp"
+#include "StateModels.hpp"
+
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/**
+ * The model tracker class.
+ *
+ * It applies the kalman filter and smoother of Tracker to the state model
+ * given as policy (see StateModels.hpp), e.g. to run fast pre-fits with fewer
+ * parameters. All the dimensions are known at compile time, so the compiler
+ * can unroll every matrix operation of the model. If LayersNumber is positive
+ * the states of a track are stored inline, up to that number of layers,
+ * instead of in a std::vector.
+ *
+ * NOTE: unlike Tracker, the state i is the one on the layer of the measure i
+ * (there is no state at the particle gun), and the filter needs at least two
+ * measures. As in Tracker, the measures of a track must belong to the first
+ * detectors, in order, and the time of the detectors without a time measure
+ * is left out of the updates. The filter computes neither the chi2 nor the
+ * degrees of freedom, and it has no abort policy: with StraightLine4DModel it
+ * gives the states of Tracker only for the tracks that Tracker does not give up.
+ */
+template <typename Model, int LayersNumber = 0>
+class ModelTracker {
+public:
+  static constexpr int stateDimension = Model::stateDimension;
+  static constexpr int measureDimension = Model::measureDimension;
+
+  using Estimate = ModelStateEstimate<stateDimension>;
+  using States = std::conditional_t<(LayersNumber > 0), FixedCapacityVector<Estimate, LayersNumber>, std::vector<Estimate>>;
+
+  // NOTE: a track whose residual covariance is singular is given up, and its states end before that update
+  struct FilterResult {
+    States predictedStates;
+    States filteredStates;
+    bool aborted = false;
+  };
+
+  /**
+   * The constructor.
+   *
+   * @param detectors the detectors of the experiment, ordered along z.
+   * @param parameters the noise of the evolution model, as in Tracker.
+   */
+  ModelTracker(const std::vector<Detector> &detectors, const TrackerParameters &parameters = TrackerParameters())
+      : parameters(parameters) {
+    if (LayersNumber > 0 && (int)detectors.size() > LayersNumber)
+      throw std::invalid_argument("ModelTracker: more detectors than the layers of the model tracker");
+
+    layers.reserve(detectors.size());
+    for (int i = 0; i < (int)detectors.size(); i++) {
+      const double deltaZ = i != 0
+                              ? detectors[i].getBottmLeftPosition().Z() - detectors[i - 1].getBottmLeftPosition().Z()
+                              : detectors[i].getBottmLeftPosition().Z();
+
+      const MeasureCovariance detectorUncertainty = detectors[i].getMeasureUncertainty();
+      ModelMeasureCovariance measureUncertainty;
+      for (int row = 0; row < measureDimension; row++)
+        for (int col = 0; col < measureDimension; col++)
+          measureUncertainty(row, col) = detectorUncertainty(Model::measuredQuantities[row], Model::measuredQuantities[col]);
+
+      layers.push_back(Layer{deltaZ, Model::evolutionJacobian(deltaZ), measureUncertainty, detectors[i].isTimeMeasured()});
+    }
+  }
+
+  /**
+   * Apply the Kalman filter
+   *
+   * @param measures the vector containing the measures
+   * @return the predicted states and the filtered states (the first predicted state is the initial one), and whether
+   *         the track has been given up
+   */
+  FilterResult kalmanFilter(const std::vector<Measurement> &measures) const {
+    if (measures.size() < 2)
+      throw std::invalid_argument("ModelTracker::kalmanFilter: at least two measures are needed");
+    if (measures.size() > layers.size())
+      throw std::invalid_argument("ModelTracker::kalmanFilter: more measures than detectors");
+
+    FilterResult result;
+    result.predictedStates.reserve(measures.size());
+    result.filteredStates.reserve(measures.size());
+
+    const Estimate initialState = initializeFilter(measures[0], measures[1]);
+    result.predictedStates.push_back(initialState);
+    result.filteredStates.push_back(initialState);
+
+    const ModelProjectionMatrix projectionMatrix = projection();
+
+    for (int i = 1; i < (int)measures.size(); i++) {
+      const Layer &layer = layers[i];
+
+      // Estimate next state
+      const Estimate estimatedNextState = estimateNextState(result.filteredStates.back(), layer);
+      const StateVector &estimatedStateValue = estimatedNextState.value;
+      const StateCovariance &estimatedStateError = estimatedNextState.uncertainty;
+
+      // Residual
+      ModelMeasureVector residual = measureVector(measures[i]) - projectionMatrix * estimatedStateValue;
+      if (!layer.timeMeasured && timeComponent >= 0)
+        residual(timeComponent, 0) = 0.;
+
+      // Kalman Gain
+      const ModelKalmanGain projectedStateError = multiplyTranspose(estimatedStateError, projectionMatrix);
+      ModelMeasureCovariance kalmanGainDenominator = projectionMatrix * projectedStateError;
+
+      kalmanGainDenominator += layer.measureUncertainty;
+      if (!invertResidualCovariance(kalmanGainDenominator, layer.timeMeasured)) {
+        result.aborted = true;
+        break;
+      }
+
+      const ModelKalmanGain kalmanGain = projectedStateError * kalmanGainDenominator;
+
+      // Filtered state
+      StateVector filteredStateValue = kalmanGain * residual;
+      filteredStateValue += estimatedStateValue;
+      const StateCovariance filteredStateError = estimatedStateError - kalmanGain * (projectionMatrix * estimatedStateError);
+
+      result.predictedStates.push_back(estimatedNextState);
+      result.filteredStates.push_back(Estimate{filteredStateValue, filteredStateError});
+    }
+
+    return result;
+  }
+
+  /**
+   * Apply the Kalman smoother
+   *
+   * A singular covariance of a predicted state throws std::runtime_error.
+   *
+   * @param filterResult the predicted and filtered states obtained from the kalman filter
+   * @return the smoothed states
+   */
+  States kalmanSmoother(const FilterResult &filterResult) const {
+    const States &filteredStates = filterResult.filteredStates;
+    const States &predictedStates = filterResult.predictedStates;
+    States smoothedStates = filteredStates;
+
+    for (int i = (int)filteredStates.size() - 2; i > -1; i--) {
+      const Estimate &smoothedNextState = smoothedStates[i + 1];
+      const Estimate &estimatedNextState = predictedStates[i + 1];
+      const Jacobian &evolutionJacobian = layers[i + 1].evolutionJacobian;
+
+      // Smoother Gain, solving E G^T = F P as in Tracker
+      const StateCovariance gainSystemRhs = evolutionJacobian * filteredStates[i].uncertainty;
+      StateCovariance smootherGainTransposed;
+
+      if (!estimatedNextState.uncertainty.solveSymmetric(gainSystemRhs, smootherGainTransposed)) {
+        StateCovariance estimatedNextStateErrorInverted = estimatedNextState.uncertainty;
+        if (!estimatedNextStateErrorInverted.invert(DETERMINANT_TOLERANCE))
+          throw std::runtime_error("ModelTracker::kalmanSmoother: singular predicted covariance");
+        smootherGainTransposed = estimatedNextStateErrorInverted * gainSystemRhs;
+      }
+
+      const StateCovariance smootherGain = smootherGainTransposed.transpose();
+
+      // Smoothed state
+      StateVector smoothedStateValue = smootherGain * (smoothedNextState.value - estimatedNextState.value);
+      smoothedStateValue += filteredStates[i].value;
+
+      const StateCovariance residualError = smoothedNextState.uncertainty - estimatedNextState.uncertainty;
+      StateCovariance smoothedStateError = smootherGain * multiplyTranspose(residualError, smootherGain);
+      smoothedStateError += filteredStates[i].uncertainty;
+
+      smoothedStates[i] = Estimate{smoothedStateValue, smoothedStateError};
+    }
+
+    return smoothedStates;
+  }
+
+private:
+  using StateVector = typename Model::Vector;
+  using StateCovariance = typename Model::Covariance;
+  using Jacobian = typename Model::Jacobian;
+  using ModelMeasureVector = FixedMatrix<measureDimension, 1>;
+  using ModelMeasureCovariance = FixedMatrix<measureDimension, measureDimension>;
+  using ModelProjectionMatrix = FixedMatrix<measureDimension, stateDimension>;
+  using ModelKalmanGain = FixedMatrix<stateDimension, measureDimension>;
+
+  static constexpr int slopesNumber = (int)Model::slopeQuantities.size();
+  static_assert(measureDimension + slopesNumber == stateDimension, "The state must be made of the measured quantities and of their slopes");
+
+  // The quantities of a layer that depend only on the geometry (see LayerGeometry in Tracker.hpp)
+  struct Layer {
+    double deltaZ;
+    Jacobian evolutionJacobian;
+    ModelMeasureCovariance measureUncertainty;
+    bool timeMeasured = true;
+  };
+
+  TrackerParameters parameters;
+  std::conditional_t<(LayersNumber > 0), FixedCapacityVector<Layer, LayersNumber>, std::vector<Layer>> layers;
+
+  // The measured quantities are the first components of the state
+  static ModelProjectionMatrix projection() {
+    ModelProjectionMatrix projectionMatrix;
+    for (int row = 0; row < measureDimension; row++)
+      projectionMatrix(row, row) = 1.;
+    return projectionMatrix;
+  }
+
+  static ModelMeasureVector measureVector(const Measurement &measure) {
+    ModelMeasureVector vector;
+    for (int row = 0; row < measureDimension; row++)
+      vector(row, 0) = Model::measuredValue(measure, Model::measuredQuantities[row]);
+    return vector;
+  }
+
+  // Component of the measures holding the time, -1 if the model does not measure it
+  static constexpr int findTimeComponent() {
+    for (int row = 0; row < measureDimension; row++)
+      if (Model::measuredQuantities[row] == 0)
+        return row;
+    return -1;
+  }
+
+  static constexpr int timeComponent = findTimeComponent();
+
+  // Inverse of the covariance of a residual, as in Tracker: without a time measure the time row is left out of the
+  // update, hence the inverse is the one of the other components, with zeros in the time row and column
+  static bool invertResidualCovariance(ModelMeasureCovariance &residualCovariance, bool timeMeasured) {
+    if (timeMeasured || timeComponent < 0)
+      return residualCovariance.invert(DETERMINANT_TOLERANCE);
+
+    residualCovariance(timeComponent, timeComponent) = 1.;
+    for (int i = 0; i < measureDimension; i++) {
+      if (i == timeComponent)
+        continue;
+      residualCovariance(timeComponent, i) = 0.;
+      residualCovariance(i, timeComponent) = 0.;
+    }
+
+    const bool inverted = residualCovariance.invert(DETERMINANT_TOLERANCE);
+    residualCovariance(timeComponent, timeComponent) = 0.;
+    return inverted;
+  }
+
+  static int measuredComponent(int quantity) {
+    for (int row = 0; row < measureDimension; row++)
+      if (Model::measuredQuantities[row] == quantity)
+        return row;
+    throw std::invalid_argument("ModelTracker: the slope of a quantity that is not measured");
+  }
+
+  // Same as Tracker::initializeFilter: the measured quantities from the first measure, the slopes from the first two.
+  // Without a time measure the time is unknown, and so is its slope without the time measures of both layers
+  Estimate initializeFilter(const Measurement &measure, const Measurement &nextMeasure) const {
+    const double deltaZ = layers[1].deltaZ;
+    const ModelMeasureCovariance &measureError = layers[0].measureUncertainty;
+    const ModelMeasureCovariance &nextMeasureError = layers[1].measureUncertainty;
+    const ModelMeasureVector firstValue = measureVector(measure);
+    const ModelMeasureVector nextValue = measureVector(nextMeasure);
+
+    Estimate state;
+    for (int row = 0; row < measureDimension; row++) {
+      const bool unknown = row == timeComponent && !layers[0].timeMeasured;
+      state.value(row, 0) = unknown ? 0. : firstValue(row, 0);
+      state.uncertainty(row, row) = unknown ? VERY_HIGH_TIME_ERROR * VERY_HIGH_TIME_ERROR : measureError(row, row);
+    }
+
+    for (int slope = 0; slope < slopesNumber; slope++) {
+      const int row = measuredComponent(Model::slopeQuantities[slope]);
+      if (row == timeComponent && !(layers[0].timeMeasured && layers[1].timeMeasured)) {
+        state.value(measureDimension + slope, 0) = 1. / LIGHT_SPEED;
+        state.uncertainty(measureDimension + slope, measureDimension + slope) = VERY_HIGH_VELOCITY_INVERSE_ERROR * VERY_HIGH_VELOCITY_INVERSE_ERROR;
+        continue;
+      }
+
+      const double sDelta2 = measureError(row, row) + nextMeasureError(row, row);
+      state.value(measureDimension + slope, 0) = (nextValue(row, 0) - firstValue(row, 0)) / deltaZ;
+      state.uncertainty(measureDimension + slope, measureDimension + slope) = sDelta2 / (deltaZ * deltaZ);
+    }
+
+    return state;
+  }
+
+  Estimate estimateNextState(const Estimate &preaviousState, const Layer &layer) const {
+    const StateVector estimatedStateValue = Model::evolve(preaviousState.value, layer.deltaZ);
+    StateCovariance estimatedStateError = layer.evolutionJacobian * multiplyTranspose(preaviousState.uncertainty, layer.evolutionJacobian);
+    estimatedStateError += Model::evolutionUncertainty(estimatedStateValue, parameters);
+    return Estimate{estimatedStateValue, estimatedStateError};
+  }
+};
+
+// Trackers of the pre-fits, with the states of the tracks stored inline
+using SpatialTracker = ModelTracker<SpatialModel, NUMBER_OF_DETECTORS>;
+using FixedVelocityTracker = ModelTracker<FixedVelocityModel, NUMBER_OF_DETECTORS>;
@@ -1,10 +1,14 @@
 #pragma once
 
 #include "MeasuresAndStates.hpp"
+#include "RandomGenerator.hpp"
 #include <TLorentzVector.h>
 #include <TMatrixD.h>
 #include <TVector3.h>
 
+// Number of standard gaussian numbers of each step of the evolution with multiple scattering
+constexpr int EVOLUTION_GAUSSIANS_NUMBER = 6;
+
 /**
  * The particle class.
  *
@@ -37,14 +41,31 @@ public:
    *
    * @param preaviousState the state before the evolution.
    * @param finalZ the position in meters.
+   * @param randomGenerator the generator of the multiple scattering variations.
    *
    * @return the new state after the evolution.
    */
   ParticleState
   zSpaceEvolve(ParticleState preaviousState, double finalZ,
+               RandomGenerator &randomGenerator,
                bool multipleScattering = true,
                std::optional<int> detectorId = std::nullopt) const;
 
+  /**
+   * The space evolution function, with the random numbers already drawn.
+   *
+   * @param preaviousState the state before the evolution.
+   * @param finalZ the position in meters.
+   * @param gaussians the EVOLUTION_GAUSSIANS_NUMBER standard gaussian numbers
+   * of the multiple scattering (nullptr without multiple scattering).
+   *
+   * @return the new state after the evolution.
+   */
+  ParticleState
+  zSpaceEvolve(ParticleState preaviousState, double finalZ,
+               const double *gaussians,
+               std::optional<int> detectorId = std::nullopt) const;
+
 private:
   ParticleState initialState;
 
@@ -6,6 +6,7 @@
 
 #include "Detector.hpp"
 #include "Particle.hpp"
+#include "RandomGenerator.hpp"
 
 /**
  * The particle generator.
@@ -36,22 +37,29 @@ public:
 
   void setMaxColatitude(double newValue) { maxColatitude = newValue; }
   void setPosition(TVector3 newPosition) { position = newPosition; }
+  void setTimeBetweenParticles(double newValue) { timeBetweenParticles = newValue; }
   double getMaxColatitude() const { return maxColatitude; }
   TVector3 getPosition() const { return position; }
+  double getTimeOfEmission() const { return timeOfEmission; }
+  double getTimeBetweenParticles() const { return timeBetweenParticles; }
 
   /**
    * Generate a random particle
    *
    * It generates a particle in the position of the gun with a momentum directed
-   * to a random angle in the range of valid angles.
+   * to a random angle in the range of valid angles. The particles are shot one
+   * after the other, every timeBetweenParticles.
    *
+   * @param randomGenerator the generator of the direction, speed and mass.
+   * @param particleIndex the index of the particle within the run.
    * @return the particle generated
    */
-  Particle generateParticle();
+  Particle generateParticle(RandomGenerator &randomGenerator, int particleIndex = 0) const;
 
 private:
   TVector3 position;
   double timeOfEmission;
+  double timeBetweenParticles = 0.;
 
   double maxColatitude;
 };
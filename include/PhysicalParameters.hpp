@@ -1,8 +1,29 @@
 #pragma once
 
+#include <cstdint>
+
+// NOTE: the values of the run, the detectors and the Kalman filter below are the defaults of the configuration, which
+// can be changed at startup without recompiling (see Configuration.hpp)
+
 // Number of particles
 constexpr int NUMBER_OF_PARTICLES = 10000;
 
+// Number of threads used for the reconstruction (0 means one per hardware thread)
+constexpr int NUMBER_OF_THREADS = 0;
+
+// Number of particles processed together by the streaming simulation
+constexpr int STREAMING_CHUNK_SIZE = 4096;
+
+// Seed of the random numbers (each run derives its own seed from it)
+constexpr std::uint64_t RANDOM_SEED = 20240201;
+
+// Size in bytes of the read-ahead cache of the data files, and number of entries read at once by default
+constexpr long long DATA_FILE_CACHE_SIZE = 64LL * 1024 * 1024;
+constexpr long long DATA_FILE_CHUNK_ENTRIES = 1LL << 20;
+
+// Directory where the generated data are cached, to be reused by the runs with the same parameters (empty for no cache)
+constexpr const char *DATA_CACHE_DIRECTORY = "../data/cache";
+
 // Enabling logs
 const bool LOGS = false;
 
@@ -40,11 +61,31 @@ constexpr double DETECTOR_DIMENSION_WIDTH = 1.e-3;
 constexpr double DETECTOR_DIMENSION_HEIGHT = 1.e-3;
 constexpr double DETECTOR_SPACE_UNCERTAINTY = 1e-6;
 constexpr double DETECTOR_TIME_UNCERTAINTY = 1e-11;
+// Index of the detector with a broken clock (it always measures t = 0), found by the detector test. Negative for none
+constexpr int DETECTOR_WITHOUT_TIME = 5;
 
-// GUN PARAMETERS (not used in this version)
+// GUN PARAMETERS
+// Time between two consecutive particles shot by the gun
 constexpr double MIN_TIME_BETWEEN_PARTICLE =
     (NUMBER_OF_DETECTORS * DISTANCE_BETWEEN_DETECTORS * 1.1) / LIGHT_SPEED;
 
+// EVENT BUILDING PARAMETERS
+// NOTE: the particles slower than MIN_BETA * LIGHT_SPEED (because of the energy loss) can overlap in time with the next
+// ones, hence the hits of a particle are searched down to EVENT_MIN_SPEED, within EVENT_WINDOW_SIGMAS time uncertainties
+constexpr double EVENT_MIN_SPEED = 0.5 * LIGHT_SPEED;
+constexpr double EVENT_WINDOW_SIGMAS = 5.;
+// Duration of the time slices of the hits processed independently
+constexpr double EVENT_SLICE_DURATION = 1024 * MIN_TIME_BETWEEN_PARTICLE;
+// Side of the cells of the grids used to search the hits on the detectors
+constexpr double HIT_INDEX_CELL_SIZE = 20 * DETECTOR_SPACE_UNCERTAINTY;
+
+// TRACK FINDING PARAMETERS
+// Largest chi squared of a hit compatible with the prediction of a track, and number of candidates kept for each seed
+constexpr double TRACK_FINDING_CHI2_GATE = 25.;
+constexpr int TRACK_FINDING_MAX_CANDIDATES = 8;
+// Smallest number of measures of a found track
+constexpr int TRACK_FINDING_MIN_MEASURES = 3;
+
 /**
  * EVOLUTION PARAMETERS
  * NOTE: The following parameters are used both in the data generation and in
@@ -82,3 +123,6 @@ constexpr double VELOCITY_EVOLUTION_SIGMA = 0.01468 * LIGHT_SPEED;
 constexpr double V_EVOLUTION_SIGMA_KALMAN = 3. * VELOCITY_EVOLUTION_SIGMA;
 /*constexpr double INVERSE_VELOCITY_EVOLUTION_SIGMA = 0.065 / LIGHT_SPEED;*/
 constexpr double DIRECTION_EVOLUTION_SIGMA = 0.5e-4; // TODO: Check value
+
+// Inverse velocity along z assumed by the fixed velocity model of the pre-fits
+constexpr double PREFIT_INVERSE_VELOCITY = 1. / LIGHT_SPEED;
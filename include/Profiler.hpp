@@ -0,0 +1,105 @@
+#pragma once
+
+/**
+ * Instrumentation of the stages of the simulation.
+ *
+ * PROFILE_SCOPE(name) times the enclosing scope with a RAII timer, and
+ * PROFILE_COUNT(name, value) adds a value to a counter (e.g. the tracks fitted
+ * or the bytes written). Each thread accumulates its own times and counters,
+ * with relaxed atomic operations on memory owned by that thread only, hence
+ * the instrumented code never waits for other threads. PROFILE_REPORT(fileName)
+ * sums the threads, prints the breakdown of the stages and writes it to a
+ * file, then starts again from zero (e.g. at the end of each run).
+ *
+ * The names must be string literals. The same name used in different places
+ * refers to the same timer or counter.
+ *
+ * NOTE: everything compiles out unless TRACKING_PROFILING is defined (CMake
+ * option TRACKING_PROFILING): without it the macros expand to nothing and the
+ * values given to PROFILE_COUNT are not even computed. The times of the
+ * stages are summed over the threads, hence a stage running in parallel
+ * takes more time than the wall clock. The values added after a report (e.g.
+ * by the destructors of the files of a run) are in the next one.
+ */
+
+#ifdef TRACKING_PROFILING
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace Profiler {
+
+enum class EntryType { TIMER, COUNTER };
+
+/**
+ * Return the index of the timer or counter with a given name, creating it the first time.
+ *
+ * @param name the name of the timer or counter.
+ * @param type whether it is a timer or a counter.
+ * @return the index of the entry.
+ */
+int registerEntry(const char *name, EntryType type);
+
+/**
+ * Add a value to an entry, in the accumulators of the calling thread.
+ *
+ * @param entry the index of the entry.
+ * @param value the value added (nanoseconds for the timers).
+ */
+void add(int entry, std::int64_t value);
+
+/**
+ * Print the times and the counters summed over the threads, and write them to a file.
+ *
+ * All the accumulators are set to zero afterwards.
+ *
+ * @param fileName the name of the file (nothing is written if empty).
+ */
+void report(const std::string &fileName);
+
+/**
+ * The scoped timer, adding the time from its construction to its destruction to a timer.
+ */
+class ScopedTimer {
+public:
+  explicit ScopedTimer(int entry) : entry(entry), begin(std::chrono::steady_clock::now()) {}
+  ~ScopedTimer() { add(entry, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count()); }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+  int entry;
+  std::chrono::steady_clock::time_point begin;
+};
+
+} // namespace Profiler
+
+#define PROFILER_CONCATENATE_IMPL(first, second) first##second
+#define PROFILER_CONCATENATE(first, second) PROFILER_CONCATENATE_IMPL(first, second)
+
+// NOTE: the entry is registered once per call site, by the initialization of a local static variable
+#define PROFILE_SCOPE(name)                                                                                                   \
+  static const int PROFILER_CONCATENATE(profilerEntry, __LINE__) = Profiler::registerEntry(name, Profiler::EntryType::TIMER); \
+  const Profiler::ScopedTimer PROFILER_CONCATENATE(profilerTimer, __LINE__)(PROFILER_CONCATENATE(profilerEntry, __LINE__))
+
+#define PROFILE_COUNT(name, value)                                                                        \
+  do {                                                                                                    \
+    static const int profilerEntry = Profiler::registerEntry(name, Profiler::EntryType::COUNTER);         \
+    Profiler::add(profilerEntry, (std::int64_t)(value));                                                  \
+  } while (false)
+
+#define PROFILE_REPORT(fileName) Profiler::report(fileName)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(name, value) \
+  do {                             \
+  } while (false)
+#define PROFILE_REPORT(fileName) \
+  do {                           \
+  } while (false)
+
+#endif
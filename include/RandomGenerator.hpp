@@ -1,20 +1,58 @@
 #pragma once
 
-#include <TRandom3.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 
+/**
+ * The independent random streams used for each particle.
+ *
+ * Each source of randomness of the simulation draws from its own stream, so
+ * that e.g. turning off multiple scattering does not change the measurement
+ * smearing of the same particle.
+ */
+enum class RandomStream : std::uint32_t {
+  PARTICLE_GUN = 0,
+  EVOLUTION = 1,
+  MEASURE = 2,
+};
+
+/**
+ * The random generator class.
+ *
+ * It is a counter-based generator (Philox4x32-10): the n-th random number of a
+ * sequence is a pure function of the key, i.e. the seed of the run, and of the
+ * counter, i.e. (particle index, stream, n). Hence every particle owns its own
+ * independent sequence, which can be rebuilt in O(1) from any thread and in
+ * any order, and a run is reproducible given its seed.
+ *
+ * The objects are cheap to construct and are not shared: each particle creates
+ * the generators it needs and hands them to the functions drawing numbers.
+ *
+ * The numbers can be drawn one at a time or in arrays: fillUniform and
+ * fillGaussian give the same numbers as the same calls one at a time, but they
+ * compute the blocks of Philox several at a time, in loops that the compiler
+ * vectorizes.
+ */
 class RandomGenerator {
 public:
   /**
-   * Static method for accessing the singleton instance.
+   * The constructor.
    *
-   * @return the reference to the instance of the random generator (singletor)
+   * @param seed the seed of the run.
+   * @param particleIndex the index of the particle within the run.
+   * @param stream the stream of the particle to be generated.
    */
-  static RandomGenerator &getInstance();
+  RandomGenerator(std::uint64_t seed, std::uint64_t particleIndex, RandomStream stream);
 
-  RandomGenerator(const RandomGenerator &) = delete;
-  RandomGenerator(const RandomGenerator &&) = delete;
-  RandomGenerator operator=(const RandomGenerator &) = delete;
-  RandomGenerator operator=(const RandomGenerator &&) = delete;
+  /**
+   * Derive a well mixed seed from a base seed and an index (e.g. of a run).
+   *
+   * @param seed the base seed.
+   * @param index the index to be combined with the seed.
+   * @return the derived seed.
+   */
+  static std::uint64_t deriveSeed(std::uint64_t seed, std::uint64_t index);
 
   /**
    * Generate a random number in a uniform distribution
@@ -34,6 +72,22 @@ public:
    */
   double generateGaussian(double mean = 0., double sigma = 1.);
 
+  /**
+   * Fill an array with random numbers in a uniform distribution in [0, 1)
+   *
+   * @param values the array to be filled.
+   * @param count the number of values.
+   */
+  void fillUniform(double *values, std::size_t count);
+
+  /**
+   * Fill an array with random numbers in a standard gaussian distribution
+   *
+   * @param values the array to be filled.
+   * @param count the number of values.
+   */
+  void fillGaussian(double *values, std::size_t count);
+
   /**
    * Generate a random number corresponding to the longitude so that direction
    * is uniform in the selected area
@@ -55,7 +109,16 @@ public:
   double generateColatitude(double minimumAngle, double maximumAngle);
 
 private:
-  RandomGenerator();
+  std::array<std::uint32_t, 2> key;
+  std::array<std::uint32_t, 4> counter;
+  std::array<std::uint32_t, 4> block;
+  int blockPosition;
+
+  // NOTE: the Box-Muller transform produces gaussian numbers in pairs
+  bool hasSpareGaussian;
+  double spareGaussian;
 
-  TRandom3 rootGenerator;
+  std::uint32_t generateRaw();
+  void fillRaw(std::uint32_t *values, std::size_t count);
+  double generateUnit();
 };
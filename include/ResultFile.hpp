@@ -3,10 +3,25 @@
 #include "Detector.hpp"
 #include "MeasuresAndStates.hpp"
 
+#include <ROOT/TBufferMerger.hxx>
 #include <TFile.h>
 #include <TTree.h>
+#include <memory>
+#include <string>
 #include <vector>
 
+/**
+ * The result file class.
+ *
+ * All the particles of a run are saved in a single tree, where each row also
+ * holds the index of its particle. The rows are not written directly to the
+ * file but through ResultFileWriter objects, one for each thread, whose trees
+ * are merged into the file: hence many threads can save results at the same
+ * time, and the rows of different writers can interleave (the particle index
+ * identifies them).
+ *
+ * NOTE: all the writers must be destroyed before the file.
+ */
 class ResultFile {
 public:
   /**
@@ -21,28 +36,80 @@ public:
   /**
    * The destructor
    *
-   * Saves the tree in the file before closing.
+   * Writes the merged tree in the file before closing.
    */
-  ~ResultFile();
+  ~ResultFile() = default;
+
+  ResultFile(const ResultFile &) = delete;
+  ResultFile &operator=(const ResultFile &) = delete;
+
+private:
+  friend class ResultFileWriter;
+
+  std::string treeName;
+  ROOT::TBufferMerger merger;
+};
+
+/**
+ * The writer of a thread to a result file.
+ *
+ * It fills its own tree in memory, which is merged into the file when the
+ * writer is flushed or destroyed. A writer must be used by one thread at a
+ * time, while different writers of the same file can be used concurrently.
+ */
+class ResultFileWriter {
+public:
+  /**
+   * The constructor.
+   *
+   * @param resultFile the file where the rows are merged.
+   */
+  ResultFileWriter(ResultFile &resultFile);
 
   /**
-   * Save a single measuremet to the file
+   * The destructor.
    *
-   * @param measure the measure to be saved
+   * Merges the rows not yet flushed into the file.
    */
-  void SaveSingleValue(double z, ParticleState theoreticalState,
-                       ParticleState realState, Measurement measure,
-                       MatrixStateEstimate predictedState,
-                       MatrixStateEstimate filteredState,
-                       MatrixStateEstimate smoothedState);
+  ~ResultFileWriter();
+
+  ResultFileWriter(const ResultFileWriter &) = delete;
+  ResultFileWriter &operator=(const ResultFileWriter &) = delete;
 
   /**
-   * Save a vector of measuremets to the file.
+   * Save a single row to the file
    *
-   * @param measures the vector of measures to be saved.
+   * @param particleIndex the index of the particle within the run
+   * @param z the position of the layer
+   * @param theoreticalState the state without multiple scattering
+   * @param realState the state with multiple scattering
+   * @param measure the measure of the layer
+   * @param predictedState the state predicted by the kalman filter
+   * @param filteredState the state filtered by the kalman filter
+   * @param smoothedState the state smoothed by the kalman smoother
+   */
+  void SaveSingleValue(int particleIndex, double z,
+                       const ParticleState &theoreticalState,
+                       const ParticleState &realState,
+                       const Measurement &measure,
+                       const MatrixStateEstimate &predictedState,
+                       const MatrixStateEstimate &filteredState,
+                       const MatrixStateEstimate &smoothedState);
+
+  /**
+   * Save all the rows of a particle to the file.
+   *
+   * @param particleIndex the index of the particle within the run
+   * @param detectors the detectors of the experiment
+   * @param theoreticalStates the states without multiple scattering
+   * @param realStates the states with multiple scattering
+   * @param measures the measures of the particle
+   * @param predictedStates the states predicted by the kalman filter
+   * @param filteredStates the states filtered by the kalman filter
+   * @param smoothedStates the states smoothed by the kalman smoother
    */
   void SaveMultipleValues(
-      const std::vector<Detector> &detectors,
+      int particleIndex, const std::vector<Detector> &detectors,
       const std::vector<ParticleState> &theoreticalStates,
       const std::vector<ParticleState> &realStates,
       const std::vector<Measurement> &measures,
@@ -50,7 +117,13 @@ public:
       const std::vector<MatrixStateEstimate> &filteredStates,
       const std::vector<MatrixStateEstimate> &smoothedStates);
 
+  /**
+   * Merge the rows saved so far into the file.
+   */
+  void flush();
+
 private:
+  int particleBuffer;
   double zBuffer;
   double ttBuffer, txBuffer, tyBuffer, tvBuffer, txzBuffer, tyzBuffer;
   double rtBuffer, rxBuffer, ryBuffer, rvBuffer, rxzBuffer, ryzBuffer;
@@ -61,9 +134,8 @@ private:
       fvBuffer, fsvBuffer, fxzBuffer, fsxzBuffer, fyzBuffer, fsyzBuffer;
   double stBuffer, sstBuffer, sxBuffer, ssxBuffer, syBuffer, ssyBuffer,
       svBuffer, ssvBuffer, sxzBuffer, ssxzBuffer, syzBuffer, ssyzBuffer;
- 
-  const char *treeName;
 
-  TFile *rootFile;
+  std::shared_ptr<ROOT::TBufferMergerFile> file;
   TTree *dataTree;
+  bool hasPendingRows;
 };
@@ -2,6 +2,7 @@
 
 #include "Detector.hpp"
 #include "ParticleGun.hpp"
+#include "PhysicalParameters.hpp"
 
 #include <vector>
 
@@ -11,15 +12,30 @@ public:
   std::vector<Detector> detectors;
 };
 
+// The geometry and the resolution of the detectors (by default, the values in PhysicalParameters.hpp)
+struct ExperimentParameters {
+  int detectorsNumber = NUMBER_OF_DETECTORS;
+  double distanceBetweenDetectors = DISTANCE_BETWEEN_DETECTORS;
+  double detectorWidth = DETECTOR_DIMENSION_WIDTH;
+  double detectorHeight = DETECTOR_DIMENSION_HEIGHT;
+  double detectorSpaceUncertainty = DETECTOR_SPACE_UNCERTAINTY;
+  double detectorTimeUncertainty = DETECTOR_TIME_UNCERTAINTY;
+  int detectorWithoutTime = DETECTOR_WITHOUT_TIME;
+};
+
 class SetupFactory {
 public:
   SetupFactory() {}
+  SetupFactory(const ExperimentParameters &parameters) : parameters(parameters) {}
 
   /**
-   * Generate the simulation setup according to values specified in
-   * Phisical_parameters.hpp
+   * Generate the simulation setup according to the experiment parameters
+   * (by default, the values specified in PhysicalParameters.hpp)
    *
    * @return the simulation setup generated
    */
   SimulationSetup generateExperiment() const;
+
+private:
+  ExperimentParameters parameters;
 };
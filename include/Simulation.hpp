@@ -3,23 +3,62 @@
 #include <TLorentzVector.h>
 #include <TMatrixD.h>
 #include <TMatrixDfwd.h>
+#include <cstdint>
+#include <string>
 #include <vector>
 
+#include "Configuration.hpp"
 #include "DataGenerator.hpp"
 #include "Detector.hpp"
+#include "EventBuilder.hpp"
+#include "PhysicalParameters.hpp"
+#include "ThreadPool.hpp"
+#include "TrackFinder.hpp"
 #include "Tracker.hpp"
 
 class Simulation {
 public:
-  Simulation();
+  /**
+   * The constructor.
+   *
+   * The configuration gives the number of threads used to reconstruct the
+   * particles, the seed from which the random numbers of every run are
+   * derived, the experiment, the parameters of the tracker and the limits
+   * beyond which it gives a track up, the format of the results and the
+   * cache of the generated data.
+   *
+   * @param configuration the configuration of the runs (already validated).
+   */
+  Simulation(const Configuration &configuration = Configuration());
 
   /**
    * The main simulation function.
    *
+   * The generated data are taken from the cache if a previous run generated
+   * the same particles (see DataCache).
+   *
    * @param particlesNumber the number of particles to be simulated.
    */
   void runSimulation(int particlesNumber);
 
+  /**
+   * The main simulation function, with memory bounded by the chunk size.
+   *
+   * The particles flow in chunks through a pipeline of stages running on
+   * different threads: generation, reconstruction (filter and smoother) and
+   * output. The stages are connected by bounded queues, hence only a few
+   * chunks are in memory at any time whatever the number of particles. The
+   * particles are the same as those of runSimulation, and the measures of each
+   * chunk are divided by the event builder together with the ones of its
+   * neighbours that overlap in time. The results are the same as those of
+   * runSimulation, except that the measures of the detectors without time are
+   * only matched among the particles of a chunk.
+   *
+   * @param particlesNumber the number of particles to be simulated.
+   * @param particlesPerChunk the number of particles of each chunk.
+   */
+  void runSimulationStreaming(int particlesNumber, int particlesPerChunk = STREAMING_CHUNK_SIZE);
+
   /**
    * The main simulation function.
    *
@@ -27,10 +66,121 @@ public:
    */
   void testDetector(int particlesNumber, int detectorId);
 
+  /**
+   * Test the detectors masking them one or two at a time.
+   *
+   * For each mask, the particles are fitted without the measures of the
+   * masked detectors, as in testDetector, and the measures of those
+   * detectors are compared with the extrapolation of the smoothed states.
+   * All the masks are fitted concurrently on the same measures, and the mean
+   * and the standard deviation of the pulls are printed.
+   *
+   * @param particlesNumber the number of particles to be simulated.
+   * @param maskedDetectorsNumber the number of detectors masked together (1 or 2).
+   */
+  void scanDetectors(int particlesNumber, int maskedDetectorsNumber = 1);
+
+  /**
+   * Test all the detectors at once.
+   *
+   * Each particle is fitted once with all its measures, and the measure of
+   * each detector is compared with the unbiased estimate of the other
+   * measures (see Tracker::computeUnbiasedStates). The mean and the standard
+   * deviation of the pulls of each detector are printed.
+   *
+   * @param particlesNumber the number of particles to be simulated.
+   */
+  void testAllDetectors(int particlesNumber);
+
+  /**
+   * Compare the reconstruction of the particles by the track finder with the
+   * one by the event builder followed by the Kalman filter of each particle.
+   *
+   * The time taken by each one and the number of particles whose measures
+   * are found exactly are printed.
+   *
+   * @param particlesNumber the number of particles to be simulated.
+   */
+  void runTrackFinding(int particlesNumber);
+
+  /**
+   * Reconstruct the measures of a data file, without generating them.
+   *
+   * The measures are divided into the particles by the event builder and
+   * fitted as in runSimulation. If the truth of the measures is given, the
+   * results are those of runSimulation. Otherwise, since the true states are
+   * not known, the results are binary with only the measures and the
+   * estimated states (see Utils::reconstructionResultColumns).
+   *
+   * NOTE: the data file must come from an experiment with the same detectors.
+   *
+   * @param dataFileName the name of the file with the measures (e.g. the
+   *                     GeneratedData_runN.root of a previous run).
+   * @param truthFileName the name of their truth sidecar (if empty, the
+   *                      sidecar of the data file, if it exists).
+   */
+  void reconstructData(const std::string &dataFileName, const std::string &truthFileName = "");
+
+  /**
+   * Reconstruct the cached data that runSimulation would generate, without
+   * generating them (std::invalid_argument if they are not in the cache).
+   *
+   * @param particlesNumber the number of particles of the data.
+   */
+  void reconstructData(int particlesNumber);
+
+  /**
+   * Compare the reconstruction of the same particles with different
+   * evolution sigmas of the Kalman filter.
+   *
+   * The particles are generated once (or taken from the cache) and kept in memory, then they are
+   * fitted concurrently by one tracker for each pair of sigmas. For each
+   * pair, the chi2/ndf of the filter and the mean and the standard deviation
+   * of the pulls of the smoothed states from the real ones are printed and
+   * saved in "Run N Tracker sweep.csv".
+   *
+   * NOTE: the measures are taken as generated, without the event builder,
+   * so that only the tracker changes between the settings.
+   *
+   * @param particlesNumber the number of particles to be simulated.
+   * @param velocitySigmas the velocity evolution sigmas tried.
+   * @param directionSigmas the direction evolution sigmas tried.
+   */
+  void sweepTrackerParameters(int particlesNumber, const std::vector<double> &velocitySigmas,
+                              const std::vector<double> &directionSigmas);
+
 private:
   static int runCounter;
+  std::uint64_t seed;
+  OutputFormat outputFormat;
+  std::string dataCacheDirectory;
   std::vector<Detector> detectors;
 
   Tracker tracker;
+  FilterAbortPolicy abortPolicy;
+  EventBuilder eventBuilder;
+  TrackFinder trackFinder;
   DataGenerator dataGenerator;
+  ThreadPool threadPool;
+
+  /**
+   * Generate the data of a run, or read them from the cache, and save them.
+   *
+   * Without the cache, the measures and their truth are saved in
+   * GeneratedData_runN.root and GeneratedData_runN.truth.
+   *
+   * @param particlesNumber the number of particles to be simulated.
+   * @param allMeasures the measures of all the particles, in the order of the data file.
+   * @return the data generated.
+   */
+  GeneratedData generateData(int particlesNumber, std::vector<Measurement> &allMeasures);
+
+  /**
+   * Divide the measures into the particles, fit them and save the results.
+   *
+   * @param allMeasures the measures of all the particles.
+   * @param truth the data generated, if known (otherwise only the binary results without truth are saved).
+   * @param resultName the name of the files of the results, without extension.
+   */
+  void reconstructMeasures(const std::vector<Measurement> &allMeasures, const GeneratedData *truth, const std::string &resultName);
 };
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "FixedMatrix.hpp"
+#include "MeasuresAndStates.hpp"
+#include "PhysicalParameters.hpp"
+
+#include <array>
+#include <cmath>
+
+/**
+ * The tunable parameters of the evolution model of the Kalman filter.
+ *
+ * The sigmas are the noise of the speed (in m/s, propagated to the inverse velocity) and of the directions added
+ * at each step. They should be a bit larger than the ones of the data generation.
+ */
+struct TrackerParameters {
+  double velocityEvolutionSigma = V_EVOLUTION_SIGMA_KALMAN;
+  double directionEvolutionSigma = DIRECTION_EVOLUTION_SIGMA;
+};
+
+/**
+ * The estimate of a state of a model with StateDimension parameters.
+ */
+template <int StateDimension>
+struct ModelStateEstimate {
+  FixedMatrix<StateDimension, 1> value;
+  FixedMatrix<StateDimension, StateDimension> uncertainty;
+};
+
+/**
+ * The base of the state models, used as policies by ModelTracker.
+ *
+ * The state of a model is made of the measured quantities, followed by the
+ * derivatives along z of some of them. The quantities of a measure are numbered
+ * as in the measures of the detectors (0 = t, 1 = x, 2 = y). A model supplies:
+ *  - measuredQuantities: the quantities of the first components of the state;
+ *  - slopeQuantities: the quantities whose derivatives are the other components;
+ *  - evolve(value, deltaZ): the value of the state after a distance deltaZ;
+ *  - evolutionJacobian(deltaZ): the jacobian of evolve;
+ *  - evolutionUncertainty(predictedValue, parameters): the noise added to the
+ *    evolved state, with the sigmas of the tracker parameters.
+ */
+template <int StateDim, int MeasureDim>
+struct StateModel {
+  static_assert(MeasureDim <= StateDim, "A model cannot measure more quantities than its parameters");
+
+  static constexpr int stateDimension = StateDim;
+  static constexpr int measureDimension = MeasureDim;
+
+  using Vector = FixedMatrix<StateDim, 1>;
+  using Covariance = FixedMatrix<StateDim, StateDim>;
+  using Jacobian = FixedMatrix<StateDim, StateDim>;
+
+  /**
+   * Return a quantity of a measure.
+   *
+   * @param measure the measure.
+   * @param quantity the index of the quantity (0 = t, 1 = x, 2 = y).
+   * @return the value of the quantity.
+   */
+  static double measuredValue(const Measurement &measure, int quantity) {
+    return quantity == 0 ? measure.t : quantity == 1 ? measure.x : measure.y;
+  }
+};
+
+/**
+ * The straight line model in space and time, the one of Tracker.
+ *
+ * State (t, x, y, 1/v, xz, yz), measures (t, x, y).
+ */
+struct StraightLine4DModel : StateModel<6, 3> {
+  static constexpr std::array<int, 3> measuredQuantities = {0, 1, 2};
+  static constexpr std::array<int, 3> slopeQuantities = {0, 1, 2};
+
+  static Jacobian evolutionJacobian(double deltaZ) {
+    double jacobianData[36] = {
+        1., 0., 0., deltaZ, 0.,     0.,
+        0., 1., 0., 0.,     deltaZ, 0.,
+        0., 0., 1., 0.,     0.,     deltaZ,
+        0., 0., 0., 1.,     0.,     0.,
+        0., 0., 0., 0.,     1.,     0.,
+        0., 0., 0., 0.,     0.,     1.};
+    return Jacobian(jacobianData);
+  }
+
+  static Vector evolve(const Vector &value, double deltaZ) { return evolutionJacobian(deltaZ) * value; }
+
+  static Covariance evolutionUncertainty(const Vector &predictedValue, const TrackerParameters &parameters) {
+    const double inverseVelocityEvolutionSigma = parameters.velocityEvolutionSigma * pow(predictedValue(3, 0), 2);
+
+    Covariance uncertainty;
+    uncertainty(0, 0) = TIME_EVOLUTION_SIGMA * TIME_EVOLUTION_SIGMA;
+    uncertainty(1, 1) = SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA;
+    uncertainty(2, 2) = SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA;
+    uncertainty(3, 3) = inverseVelocityEvolutionSigma * inverseVelocityEvolutionSigma;
+    uncertainty(4, 4) = parameters.directionEvolutionSigma * parameters.directionEvolutionSigma;
+    uncertainty(5, 5) = parameters.directionEvolutionSigma * parameters.directionEvolutionSigma;
+    return uncertainty;
+  }
+};
+
+/**
+ * The straight line model with a known velocity, for fast pre-fits.
+ *
+ * State (t, x, y, xz, yz), measures (t, x, y). The inverse velocity along z is
+ * fixed to PREFIT_INVERSE_VELOCITY.
+ */
+struct FixedVelocityModel : StateModel<5, 3> {
+  static constexpr std::array<int, 3> measuredQuantities = {0, 1, 2};
+  static constexpr std::array<int, 2> slopeQuantities = {1, 2};
+
+  static Jacobian evolutionJacobian(double deltaZ) {
+    double jacobianData[25] = {
+        1., 0., 0., 0.,     0.,
+        0., 1., 0., deltaZ, 0.,
+        0., 0., 1., 0.,     deltaZ,
+        0., 0., 0., 1.,     0.,
+        0., 0., 0., 0.,     1.};
+    return Jacobian(jacobianData);
+  }
+
+  static Vector evolve(const Vector &value, double deltaZ) {
+    Vector evolved = evolutionJacobian(deltaZ) * value;
+    evolved(0, 0) += deltaZ * PREFIT_INVERSE_VELOCITY;
+    return evolved;
+  }
+
+  static Covariance evolutionUncertainty(const Vector &, const TrackerParameters &parameters) {
+    Covariance uncertainty;
+    uncertainty(0, 0) = TIME_EVOLUTION_SIGMA * TIME_EVOLUTION_SIGMA;
+    uncertainty(1, 1) = SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA;
+    uncertainty(2, 2) = SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA;
+    uncertainty(3, 3) = parameters.directionEvolutionSigma * parameters.directionEvolutionSigma;
+    uncertainty(4, 4) = parameters.directionEvolutionSigma * parameters.directionEvolutionSigma;
+    return uncertainty;
+  }
+};
+
+/**
+ * The straight line model in space only, for fast pre-fits.
+ *
+ * State (x, y, xz, yz), measures (x, y): the times are ignored.
+ */
+struct SpatialModel : StateModel<4, 2> {
+  static constexpr std::array<int, 2> measuredQuantities = {1, 2};
+  static constexpr std::array<int, 2> slopeQuantities = {1, 2};
+
+  static Jacobian evolutionJacobian(double deltaZ) {
+    double jacobianData[16] = {
+        1., 0., deltaZ, 0.,
+        0., 1., 0.,     deltaZ,
+        0., 0., 1.,     0.,
+        0., 0., 0.,     1.};
+    return Jacobian(jacobianData);
+  }
+
+  static Vector evolve(const Vector &value, double deltaZ) { return evolutionJacobian(deltaZ) * value; }
+
+  static Covariance evolutionUncertainty(const Vector &, const TrackerParameters &parameters) {
+    Covariance uncertainty;
+    uncertainty(0, 0) = SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA;
+    uncertainty(1, 1) = SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA;
+    uncertainty(2, 2) = parameters.directionEvolutionSigma * parameters.directionEvolutionSigma;
+    uncertainty(3, 3) = parameters.directionEvolutionSigma * parameters.directionEvolutionSigma;
+    return uncertainty;
+  }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * The thread pool class.
+ *
+ * It keeps a fixed set of worker threads alive for the whole life of the
+ * object and uses them to run loops over independent items (e.g. particles).
+ * The items are split into chunks which are handed out dynamically: every
+ * thread, the calling one included, keeps taking the next free chunk until
+ * none is left, so that expensive chunks do not stall the others.
+ */
+class ThreadPool {
+public:
+  /**
+   * The constructor.
+   *
+   * @param threadsNumber the total number of threads used by parallelFor,
+   *                      the calling thread included. If it is not positive
+   *                      the number of hardware threads is used.
+   */
+  explicit ThreadPool(int threadsNumber = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int getThreadsNumber() const { return (int)workers.size() + 1; }
+
+  /**
+   * Run a task over the range [0, itemsNumber) split into chunks.
+   *
+   * The function returns when all the chunks have been processed. Different
+   * chunks may run concurrently, hence the task must only write to data
+   * belonging to its own range. If a task throws, the remaining chunks are
+   * skipped and the first exception is rethrown to the caller.
+   *
+   * @param itemsNumber the number of items to be processed.
+   * @param chunkSize the number of consecutive items given to a task at once.
+   * @param task the function called with the [begin, end) range of a chunk.
+   */
+  void parallelFor(int itemsNumber, int chunkSize, const std::function<void(int, int)> &task);
+
+  /**
+   * The index of the calling thread within the pool.
+   *
+   * Since the jobs of a pool never overlap, it tells apart the threads running
+   * the chunks of a job, e.g. to give each of them its own buffers.
+   *
+   * @return from 1 to getThreadsNumber() - 1 in a worker of this pool, 0 in
+   * any other thread (e.g. the one calling parallelFor).
+   */
+  int getThreadIndex() const;
+
+private:
+  std::vector<std::thread> workers;
+
+  std::mutex poolMutex;
+  std::condition_variable jobAvailable;
+  std::condition_variable jobFinished;
+
+  // State of the current job, guarded by poolMutex
+  const std::function<void(int, int)> *currentTask = nullptr;
+  int jobItemsNumber = 0;
+  int jobChunkSize = 1;
+  int nextItem = 0;
+  int runningChunks = 0;
+  long jobCounter = 0;
+  bool stopping = false;
+  std::exception_ptr firstException;
+
+  void workerLoop(int index);
+  void runChunks(std::unique_lock<std::mutex> &lock);
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Detector.hpp"
+#include "HitIndex.hpp"
+#include "MeasuresAndStates.hpp"
+#include "ThreadPool.hpp"
+#include "Tracker.hpp"
+
+#include <TVector3.h>
+#include <vector>
+
+// NOTE: ndf is the number of degrees of freedom of chi2, i.e. the number of measured coordinates after the first hit
+struct FoundTrack {
+  std::vector<Measurement> measures;
+  double chi2;
+  int ndf;
+};
+
+/**
+ * The track finder class.
+ *
+ * It finds the tracks of the particles with a combinatorial Kalman filter, for
+ * events where the particles are too many to be divided by time alone. Each
+ * hit on the first detector is the seed of a track, whose state is propagated
+ * detector after detector with the Tracker. All the hits compatible with the
+ * prediction (i.e. with a chi squared below TRACK_FINDING_CHI2_GATE) start a
+ * new candidate, and only the TRACK_FINDING_MAX_CANDIDATES best candidates of
+ * each seed are kept after each detector. The candidates are ranked by length
+ * and then by chi squared, and the best ones are the possible tracks of the
+ * seed. Finally, the seeds take their tracks from the best one, each choosing
+ * its possible track with most hits not taken yet, cut before the first hit
+ * already taken.
+ *
+ * The seeds are independent of each other, hence they are followed in
+ * parallel, each thread storing its candidates in its own arena.
+ *
+ * NOTE: the first state of a seed points to the origin of the particles. A
+ * candidate stops at the first detector without a compatible hit, since the
+ * measures of a particle must be on consecutive detectors. On the detectors
+ * that do not measure the time the hits are compatible by position only.
+ */
+class TrackFinder {
+public:
+  TrackFinder(){};
+
+  /**
+   * The constructor.
+   *
+   * @param detectors the detectors of the experiment, ordered along z. The first one must measure the time.
+   * @param originPosition the point where the particles come from (e.g. the particle gun).
+   * @param trackerParameters the parameters of the Kalman filter that follows the candidates.
+   */
+  TrackFinder(const std::vector<Detector> &detectors, TVector3 originPosition = TVector3(),
+              const TrackerParameters &trackerParameters = TrackerParameters());
+
+  /**
+   * Find the tracks of the particles.
+   *
+   * @param measures the measures of all the particles, in any order.
+   * @param threadPool the threads used for the seeds (serial finding if nullptr).
+   * @return the tracks with at least TRACK_FINDING_MIN_MEASURES measures, ordered by
+   *         the time of their first measure.
+   */
+  std::vector<FoundTrack> findTracks(const std::vector<Measurement> &measures, ThreadPool *threadPool = nullptr) const;
+
+private:
+  TVector3 originPosition;
+  Tracker tracker;
+  std::vector<double> layersZ;
+  std::vector<bool> layersTimeMeasured;
+
+  // The grids of the detectors, copied and filled for each call
+  HitIndex emptyHitIndex;
+
+  // A possible track of a seed: the index of its hit on each layer (in the layer index), with the chi squared up to it
+  struct SeedTrack {
+    std::vector<int> hits;
+    std::vector<double> chi2s;
+    std::vector<int> ndfs;
+  };
+
+  // The hits of the candidates are stored as a tree, each node pointing to the node of the preavious layer
+  struct CandidateNode {
+    int parent;
+    int hit;
+    double chi2;
+    int ndf;
+  };
+
+  struct Candidate {
+    MatrixStateEstimate state;
+    int node;
+    int length;
+  };
+
+  struct CandidateArena {
+    std::vector<CandidateNode> nodes;
+    std::vector<Candidate> currentCandidates;
+    std::vector<Candidate> nextCandidates;
+    std::vector<Candidate> finishedCandidates;
+    std::vector<int> hitIndices;
+  };
+
+  MatrixStateEstimate seedState(const Measurement &seed) const;
+  std::vector<SeedTrack> followSeed(const HitIndex &hitIndex, int seedHit, CandidateArena &arena) const;
+  std::vector<FoundTrack> resolveSharedHits(const HitIndex &hitIndex, const std::vector<std::vector<SeedTrack>> &seedsTracks) const;
+};
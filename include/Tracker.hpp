@@ -1,27 +1,108 @@
 #pragma once
 
+#include "BatchStateEstimates.hpp"
 #include "Detector.hpp"
 #include "MeasuresAndStates.hpp"
+#include "PhysicalParameters.hpp"
+#include "StateModels.hpp"
 
 #include <TMatrixD.h>
+#include <limits>
 #include <vector>
 
+// NOTE: the predicted states from firstPredictedLayer on are the evolution of the previous filtered states, while the
+// ones before come from the initialization of the filter. The chi2 is the sum over the updates of the residuals from
+// the predicted states, weighted by their covariance, and ndf its number of degrees of freedom
 struct kalmanFilterResult {
   std::vector<MatrixStateEstimate> predictedStates;
   std::vector<MatrixStateEstimate> filteredStates;
+  int firstPredictedLayer;
+  double chi2 = 0.;
+  int ndf = 0;
+  bool aborted = false;
+};
+
+struct kalmanFilterBatchResult {
+  BatchStateEstimates predictedStates;
+  BatchStateEstimates filteredStates;
+  int firstPredictedLayer;
+  std::vector<double> chi2s;
+  std::vector<int> ndfs;
+  std::vector<bool> aborted;
+};
+
+/**
+ * The limits beyond which the Kalman filter gives up a track, e.g. a wrong candidate of the track finding.
+ *
+ * The filter stops at the first update whose chi2 is above maxStepChi2, or after which the total chi2 per degree
+ * of freedom is above maxChi2PerNdf. The states of the track end before that update, and the chi2 includes it.
+ * By default no track is given up, unless the covariance of a residual is singular: the scalar filter then stops
+ * before that update too, without adding its chi2.
+ */
+struct FilterAbortPolicy {
+  double maxStepChi2 = std::numeric_limits<double>::infinity();
+  double maxChi2PerNdf = std::numeric_limits<double>::infinity();
+
+  bool isHopeless(double stepChi2, double chi2, int ndf) const { return stepChi2 > maxStepChi2 || chi2 > maxChi2PerNdf * ndf; }
+};
+
+/**
+ * The quantities of a layer that depend only on the geometry, computed once for all the tracks.
+ *
+ * The layer i is the one reached from the state of index i (i.e. from the previous layer, or from the particle
+ * gun for the first one), as in the states returned by the kalman filter.
+ */
+struct LayerGeometry {
+  double deltaZ;
+  EvolutionMatrix evolutionMatrix;
+  // NOTE: the term of the inverse velocity is missing, since it depends on the state
+  StateCovariance evolutionUncertainty;
+  MeasureCovariance measureUncertainty;
+  MeasureCovariance measureUncertaintyInverted;
+  // NOTE: without a time measure, the time row of the measures is left out of the updates
+  bool timeMeasured = true;
 };
 
 struct Chi2Variables {
   double tChi2, xChi2, yChi2, vChi2, xzChi2, yzChi2;
 };
 
+// Residual of a measure from the estimate of the other measures, divided by its uncertainty (as in the detector test)
+struct PullVariables {
+  double tPull, xPull, yPull;
+};
+
 class Tracker {
 public:
   Tracker(){};
-  Tracker(const std::vector<Detector> &detectors) : allDetectors(detectors), consideredDetectors(detectors) {}
+  Tracker(const std::vector<Detector> &detectors, const TrackerParameters &parameters = TrackerParameters());
+
+  /**
+   * Return the parameters of the evolution model of the tracker
+   *
+   * @return the parameters given to the constructor
+   */
+  const TrackerParameters &getParameters() const { return parameters; }
 
-  void ignoreDetector(int detectorIndex) { consideredDetectors.erase(consideredDetectors.begin() + detectorIndex); }
-  void resetDetectors() { consideredDetectors = allDetectors; }
+  /**
+   * Return the geometry of the layers considered by a fit that ignores some detectors
+   *
+   * The layers are passed to the overloads of the filter and of the smoother, which never change the tracker, hence
+   * fits ignoring different detectors can run concurrently. The measures given to them must belong to the considered
+   * detectors, in order.
+   *
+   * @param maskedDetectors the indices of the ignored detectors
+   * @return the geometry of the other layers, in order
+   */
+  std::vector<LayerGeometry> getConsideredLayers(const std::vector<int> &maskedDetectors) const;
+
+  /**
+   * Return the geometry of a layer of the whole experiment
+   *
+   * @param detectorIndex the index of the detector of the layer
+   * @return the geometry of the layer
+   */
+  const LayerGeometry &getLayerGeometry(int detectorIndex) const { return allLayers[detectorIndex]; }
 
   /**
    * Estimate the next state of the particle after a distance deltaZ from a state preaviousState.
@@ -37,17 +118,46 @@ public:
   estimateNextState(const MatrixStateEstimate &preaviousState,
                     double deltaZ) const;
 
+  /**
+   * Estimate the state of the particle on a layer from the state on the preavious one.
+   *
+   * @param preaviousState the state of the particle at the preavious measure.
+   * @param layer the geometry of the layer reached by the particle.
+   * @return the estimated new state of the particle.
+   */
+  MatrixStateEstimate
+  estimateNextState(const MatrixStateEstimate &preaviousState,
+                    const LayerGeometry &layer) const;
+
   /**
    * Apply the Kalman filter
    *
    * @param measures the vector containing the measures
    * @param logging whether or not to show logs to stdout
    * @param realTime whether or not to initialize the state as if the kalman filter was executed in real time
-   * @return a kalmanFilterResult object containing predicted states and filtered states
+   * @param abortPolicy the limits of the chi2 beyond which the track is given up
+   * @return a kalmanFilterResult object containing predicted states, filtered states and chi2
    */
   kalmanFilterResult kalmanFilter(const std::vector<Measurement> &measures,
                                   bool logging = false,
-                                  bool realTime = false) const;
+                                  bool realTime = false,
+                                  const FilterAbortPolicy &abortPolicy = FilterAbortPolicy()) const;
+
+  /**
+   * Apply the Kalman filter on some layers only
+   *
+   * @param measures the vector containing the measures
+   * @param layers the geometry of the considered layers, as returned by getConsideredLayers
+   * @param logging whether or not to show logs to stdout
+   * @param realTime whether or not to initialize the state as if the kalman filter was executed in real time
+   * @param abortPolicy the limits of the chi2 beyond which the track is given up
+   * @return a kalmanFilterResult object containing predicted states, filtered states and chi2
+   */
+  kalmanFilterResult kalmanFilter(const std::vector<Measurement> &measures,
+                                  const std::vector<LayerGeometry> &layers,
+                                  bool logging = false,
+                                  bool realTime = false,
+                                  const FilterAbortPolicy &abortPolicy = FilterAbortPolicy()) const;
 
   /**
    * Apply the Kalman smoother
@@ -60,6 +170,148 @@ public:
   kalmanSmoother(const std::vector<MatrixStateEstimate> &filteredStates,
                  bool looging = false) const;
 
+  /**
+   * Apply the Kalman smoother reusing the predictions of the filter
+   *
+   * @param filterResult the predicted and filtered states obtained from the kalman filter
+   * @param logging whether or not to show logs to stdout
+   * @return a vector containing the smoothed states
+   */
+  std::vector<MatrixStateEstimate>
+  kalmanSmoother(const kalmanFilterResult &filterResult,
+                 bool logging = false) const;
+
+  /**
+   * Apply the Kalman smoother on some layers only, reusing the predictions of the filter
+   *
+   * @param filterResult the predicted and filtered states obtained from the kalman filter on the same layers
+   * @param layers the geometry of the considered layers, as returned by getConsideredLayers
+   * @param logging whether or not to show logs to stdout
+   * @return a vector containing the smoothed states
+   */
+  std::vector<MatrixStateEstimate>
+  kalmanSmoother(const kalmanFilterResult &filterResult,
+                 const std::vector<LayerGeometry> &layers,
+                 bool logging = false) const;
+
+  /**
+   * Apply the Kalman filter to many tracks at once
+   *
+   * The tracks are stored in structure-of-arrays layout and every step of the filter is applied
+   * to blocks of tracks in lockstep, so that the compiler can map consecutive tracks onto SIMD lanes.
+   * The measures of each track must belong to the first considered detectors, in order; tracks with
+   * fewer measures (e.g. particles that left the acceptance) are masked out of the later layers.
+   *
+   * @param allMeasures the vector containing the measures of each track
+   * @param realTime whether or not to initialize the state as if the kalman filter was executed in real time
+   * @param abortPolicy the limits of the chi2 beyond which a track is given up (its later layers are masked out)
+   * @return a kalmanFilterBatchResult object containing predicted states, filtered states and chi2 of all the tracks
+   */
+  kalmanFilterBatchResult kalmanFilterBatch(const std::vector<std::vector<Measurement>> &allMeasures,
+                                            bool realTime = false,
+                                            const FilterAbortPolicy &abortPolicy = FilterAbortPolicy()) const;
+
+  /**
+   * Apply the Kalman filter to many tracks at once, on some layers only
+   *
+   * @param allMeasures the vector containing the measures of each track
+   * @param layers the geometry of the considered layers, as returned by getConsideredLayers
+   * @param realTime whether or not to initialize the state as if the kalman filter was executed in real time
+   * @param abortPolicy the limits of the chi2 beyond which a track is given up (its later layers are masked out)
+   * @return a kalmanFilterBatchResult object containing predicted states, filtered states and chi2 of all the tracks
+   */
+  kalmanFilterBatchResult kalmanFilterBatch(const std::vector<std::vector<Measurement>> &allMeasures,
+                                            const std::vector<LayerGeometry> &layers,
+                                            bool realTime = false,
+                                            const FilterAbortPolicy &abortPolicy = FilterAbortPolicy()) const;
+
+  /**
+   * Apply the Kalman smoother to many tracks at once
+   *
+   * @param filteredStates the filtered states of all the tracks, as returned by kalmanFilterBatch
+   * @return the smoothed states of all the tracks
+   */
+  BatchStateEstimates kalmanSmootherBatch(const BatchStateEstimates &filteredStates) const;
+
+  /**
+   * Apply the Kalman smoother to many tracks at once, reusing the predictions of the filter
+   *
+   * @param filterResult the predicted and filtered states of all the tracks, as returned by kalmanFilterBatch
+   * @return the smoothed states of all the tracks
+   */
+  BatchStateEstimates kalmanSmootherBatch(const kalmanFilterBatchResult &filterResult) const;
+
+  /**
+   * Apply the Kalman smoother to many tracks at once on some layers only, reusing the predictions of the filter
+   *
+   * @param filterResult the predicted and filtered states of all the tracks, as returned by kalmanFilterBatch on the same layers
+   * @param layers the geometry of the considered layers, as returned by getConsideredLayers
+   * @return the smoothed states of all the tracks
+   */
+  BatchStateEstimates kalmanSmootherBatch(const kalmanFilterBatchResult &filterResult,
+                                          const std::vector<LayerGeometry> &layers) const;
+
+  /**
+   * Compute the unbiased estimate of the state on each layer, i.e. the estimate from all the measures but the one
+   * of the layer
+   *
+   * The measure of each layer is removed from its smoothed state (the inverse of the update of the filter), hence
+   * the layers are evaluated with the filter and smoother pass of the track, instead of a fit for each layer. On the
+   * last layer, where the removal is numerically unstable, the unbiased state is the prediction of the filter. On the
+   * first layer, whose filtered state is initialized from its own measure and from the next one, it is the estimate
+   * carried backwards by the smoother, i.e. the smoothed state without the information of the filtered state. A track
+   * given up by the filter has unbiased states only on the layers of its states. A measure that cannot be removed (a
+   * singular covariance) throws std::runtime_error.
+   *
+   * @param measures the vector containing the measures
+   * @param filterResult the predicted and filtered states obtained from the kalman filter (not initialized in real time)
+   * @param smoothedStates the smoothed states obtained from the kalman smoother
+   * @return the unbiased states on the layers reached by the track (without the state at the particle gun)
+   */
+  std::vector<MatrixStateEstimate>
+  computeUnbiasedStates(const std::vector<Measurement> &measures,
+                        const kalmanFilterResult &filterResult,
+                        const std::vector<MatrixStateEstimate> &smoothedStates) const;
+
+  /**
+   * Compute the unbiased estimate of the state on each layer, on some layers only
+   *
+   * @param measures the vector containing the measures
+   * @param filterResult the predicted and filtered states obtained from the kalman filter on the same layers
+   * @param smoothedStates the smoothed states obtained from the kalman smoother on the same layers
+   * @param layers the geometry of the considered layers, as returned by getConsideredLayers
+   * @return the unbiased states on the layers reached by the track (without the state at the particle gun)
+   */
+  std::vector<MatrixStateEstimate>
+  computeUnbiasedStates(const std::vector<Measurement> &measures,
+                        const kalmanFilterResult &filterResult,
+                        const std::vector<MatrixStateEstimate> &smoothedStates,
+                        const std::vector<LayerGeometry> &layers) const;
+
+  /**
+   * Compute the pulls of the measures from their unbiased estimates
+   *
+   * @param measures the vector containing the measures
+   * @param unbiasedStates the unbiased states on the layers of the measures, as returned by computeUnbiasedStates
+   * @return the pulls of each measure with an unbiased state (with a zero time pull on the detectors without a time measure)
+   */
+  std::vector<PullVariables>
+  computePulls(const std::vector<Measurement> &measures,
+               const std::vector<MatrixStateEstimate> &unbiasedStates) const;
+
+  /**
+   * Compute the pulls of the measures from their unbiased estimates, on some layers only
+   *
+   * @param measures the vector containing the measures
+   * @param unbiasedStates the unbiased states on the layers of the measures, as returned by computeUnbiasedStates
+   * @param layers the geometry of the considered layers, as returned by getConsideredLayers
+   * @return the pulls of each measure (with a zero time pull on the detectors without a time measure)
+   */
+  std::vector<PullVariables>
+  computePulls(const std::vector<Measurement> &measures,
+               const std::vector<MatrixStateEstimate> &unbiasedStates,
+               const std::vector<LayerGeometry> &layers) const;
+
   /**
    * Compute the chi squared between two set of data
    *
@@ -72,15 +324,34 @@ public:
                bool logging = false, bool skipFirst = false) const;
 
 private:
+  TrackerParameters parameters;
+
+  // Evolution uncertainty of the parameters, except the term of the inverse velocity which depends on the state
+  StateCovariance evolutionUncertaintyBase;
+
   std::vector<Detector> allDetectors;
-  std::vector<Detector> consideredDetectors;
+
+  // Geometry of the layers of allDetectors
+  std::vector<LayerGeometry> allLayers;
+
+  std::vector<LayerGeometry> computeLayers(const std::vector<Detector> &detectors) const;
 
   void initializeFilterRealTime(
       const std::vector<Measurement> &measures,
+      const std::vector<LayerGeometry> &layers,
       std::vector<MatrixStateEstimate> &predictedStates,
       std::vector<MatrixStateEstimate> &filteredStates) const;
   void initializeFilter(
       const std::vector<Measurement> &measures,
+      const std::vector<LayerGeometry> &layers,
       std::vector<MatrixStateEstimate> &predictedStates,
       std::vector<MatrixStateEstimate> &filteredStates) const;
+
+  std::vector<MatrixStateEstimate>
+  smoothStates(const std::vector<MatrixStateEstimate> &filteredStates,
+               const std::vector<MatrixStateEstimate> &predictedStates,
+               int firstPredictedLayer, const std::vector<LayerGeometry> &layers, bool logging) const;
+  BatchStateEstimates smoothStatesBatch(const BatchStateEstimates &filteredStates,
+                                        const BatchStateEstimates *predictedStates,
+                                        int firstPredictedLayer, const std::vector<LayerGeometry> &layers) const;
 };
@@ -1,9 +1,15 @@
 #pragma once
 
+#include "BatchStateEstimates.hpp"
+#include "BinaryResultFile.hpp"
 #include "Detector.hpp"
+#include "FixedMatrix.hpp"
 #include "MeasuresAndStates.hpp"
 
 #include <TMatrixD.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
 
 namespace Utils {
 
@@ -11,28 +17,42 @@ namespace Utils {
  * Print a TMatrixD to stdout.
  *
  * @param matrix the matrix to be printed.
+ * @param stream the stream to print to (stdout by default).
  */
-void printMatrix(TMatrixD matrix);
+void printMatrix(TMatrixD matrix, std::ostream &stream = std::cout);
 
 /**
- * Divide the measurement Vector into a vector of vectors containing measures
- * from a single particle for each vector.
+ * Print a FixedMatrix to stdout.
  *
- * It first orders the measures based on the time they occour. Then devides them
- * based on the detector id: if the detector of a measure is lower than that of
- * the preavious measure, this is registered as a new particle.
- *
- * NOTE: This algorithm assumes that before a particle is shot the preavious one
- * has already passed through all the detectors
+ * @param matrix the matrix to be printed.
+ * @param stream the stream to print to (stdout by default).
+ */
+template <int Rows, int Cols>
+void printMatrix(const FixedMatrix<Rows, Cols> &matrix, std::ostream &stream = std::cout) {
+  // Printout settings
+  stream << std::scientific << std::setprecision(2);
+
+  // Printout the matrix
+  for (int i = 0; i < Rows; i++) {
+    stream << (i == 0 ? "[" : " ");
+
+    for (int j = 0; j < Cols; j++) {
+      stream << matrix(i, j) << ", ";
+    }
+
+    stream << (i == Rows - 1 ? "]" : "") << std::endl;
+  }
+}
+
+/**
+ * Write a block of text to stdout as a whole.
  *
- * @param allMeasures the vector containing the complete sequence of
- *                    measurements.
- * @param (out)(optional) particlesNumber the number of the particles
+ * Concurrent calls are serialized, so that the logs produced by different
+ * threads (e.g. one per particle) are never interleaved.
  *
- * @return a vector of vector each one representing a single particle
+ * @param text the text to be written.
  */
-std::vector<std::vector<Measurement>>
-separateMeasuresInParticles(const std::vector<Measurement> &allMeasures);
+void printLog(const std::string &text);
 
 /**
  * Concatenates a vector of vectors into one single vector.
@@ -55,6 +75,8 @@ std::vector<Measurement> concatenateMeasures(
  * @param filteredStates the states filtered by the kalman filter.
  * @param smoothedStates the states smoothed by the kalman smoother.
  * @param runCounter the index of the run used in the name of the file.
+ * @param firstParticleIndex the index in the run of the first particle given
+ *                           (when the run is saved in chunks).
  */
 void saveDataToCSV(
     const std::vector<Detector> &detectors,
@@ -64,7 +86,7 @@ void saveDataToCSV(
     const std::vector<std::vector<MatrixStateEstimate>> &predictedStates,
     const std::vector<std::vector<MatrixStateEstimate>> &filteredStates,
     const std::vector<std::vector<MatrixStateEstimate>> &smoothedStates,
-    const int runCounter = 0);
+    const int runCounter = 0, const int firstParticleIndex = 0);
 
 /**
  * Save all the produced and filtered data to a csv file.
@@ -87,6 +109,148 @@ void saveDataToCSV(
     const std::vector<std::vector<MatrixStateEstimate>> &smoothedStates,
     const int runCounter = 0);
 
+/**
+ * The names of the columns of the results of the tracking.
+ *
+ * They follow the order of the CSV files: z, theoretical and real states,
+ * measure, then predicted, filtered and smoothed states with their sigmas.
+ *
+ * @return the names of the columns saved by saveDataToBinary.
+ */
+std::vector<std::string> trackingResultColumns();
+
+/**
+ * The names of the columns of the results of the detector test.
+ *
+ * @return the names of the columns saved by saveDataToBinary for the detector
+ * test.
+ */
+std::vector<std::string> detectorTestResultColumns();
+
+/**
+ * The names of the columns of the results of a reconstruction without the
+ * true states (i.e. of measures read from a data file).
+ *
+ * @return the names of the columns saved by saveDataToBinary for the
+ * reconstruction of a data file.
+ */
+std::vector<std::string> reconstructionResultColumns();
+
+/**
+ * Append all the produced and filtered data to a binary result file.
+ *
+ * The rows are the same of the CSV files, one particle after the other. A
+ * particle without measures has no rows.
+ *
+ * @param resultFile the file, with the columns of trackingResultColumns.
+ * @param detectors the detectors of the experiment.
+ * @param theoreticalStates the theoretical states of the particles (i.e. the
+ *                          states if multiple scattering was inactive).
+ * @param realStates the states of the particles with multiple scattering
+ *                   active.
+ * @param measures the registered measures.
+ * @param predictedStates the states predicted by the kalman filter.
+ * @param filteredStates the states filtered by the kalman filter.
+ * @param smoothedStates the states smoothed by the kalman smoother.
+ */
+void saveDataToBinary(
+    BinaryResultFile &resultFile,
+    const std::vector<Detector> &detectors,
+    const std::vector<std::vector<ParticleState>> &theoreticalStates,
+    const std::vector<std::vector<ParticleState>> &realStates,
+    const std::vector<std::vector<Measurement>> &measures,
+    const std::vector<std::vector<MatrixStateEstimate>> &predictedStates,
+    const std::vector<std::vector<MatrixStateEstimate>> &filteredStates,
+    const std::vector<std::vector<MatrixStateEstimate>> &smoothedStates);
+
+/**
+ * Append the produced data and the states of a batch of tracks to a binary
+ * result file.
+ *
+ * The rows are the ones of the overload above, read directly from the
+ * structure-of-arrays states of the batch Kalman filter and smoother. Track k
+ * of the batch is the particle firstParticle + k.
+ *
+ * @param resultFile the file, with the columns of trackingResultColumns.
+ * @param detectors the detectors of the experiment.
+ * @param theoreticalStates the theoretical states of all the particles.
+ * @param realStates the states of all the particles with multiple scattering
+ *                   active.
+ * @param measures the registered measures of all the particles.
+ * @param firstParticle the index of the particle of the first track.
+ * @param predictedStates the states predicted by the batch kalman filter.
+ * @param filteredStates the states filtered by the batch kalman filter.
+ * @param smoothedStates the states smoothed by the batch kalman smoother.
+ */
+void saveDataToBinary(
+    BinaryResultFile &resultFile,
+    const std::vector<Detector> &detectors,
+    const std::vector<std::vector<ParticleState>> &theoreticalStates,
+    const std::vector<std::vector<ParticleState>> &realStates,
+    const std::vector<std::vector<Measurement>> &measures,
+    int firstParticle,
+    const BatchStateEstimates &predictedStates,
+    const BatchStateEstimates &filteredStates,
+    const BatchStateEstimates &smoothedStates);
+
+/**
+ * Append the data of the detector test to a binary result file.
+ *
+ * @param resultFile the file, with the columns of detectorTestResultColumns.
+ * @param detectors the detectors of the experiment.
+ * @param realStates the states of the particles with multiple scattering
+ *                   active.
+ * @param measures the registered measures.
+ * @param smoothedStates the states smoothed by the kalman smoother.
+ */
+void saveDataToBinary(
+    BinaryResultFile &resultFile,
+    const std::vector<Detector> &detectors,
+    const std::vector<std::vector<ParticleState>> &realStates,
+    const std::vector<std::vector<Measurement>> &measures,
+    const std::vector<std::vector<MatrixStateEstimate>> &smoothedStates);
+
+/**
+ * Append the reconstruction of the measures of a data file to a binary result file.
+ *
+ * The rows are the ones of saveDataToBinary, without the true states.
+ *
+ * @param resultFile the file, with the columns of reconstructionResultColumns.
+ * @param detectors the detectors of the experiment.
+ * @param measures the registered measures.
+ * @param predictedStates the states predicted by the kalman filter.
+ * @param filteredStates the states filtered by the kalman filter.
+ * @param smoothedStates the states smoothed by the kalman smoother.
+ */
+void saveDataToBinary(
+    BinaryResultFile &resultFile,
+    const std::vector<Detector> &detectors,
+    const std::vector<std::vector<Measurement>> &measures,
+    const std::vector<std::vector<MatrixStateEstimate>> &predictedStates,
+    const std::vector<std::vector<MatrixStateEstimate>> &filteredStates,
+    const std::vector<std::vector<MatrixStateEstimate>> &smoothedStates);
+
+/**
+ * Append the reconstruction of a batch of tracks of a data file to a binary
+ * result file, reading the structure-of-arrays states directly.
+ *
+ * @param resultFile the file, with the columns of reconstructionResultColumns.
+ * @param detectors the detectors of the experiment.
+ * @param measures the registered measures of all the particles.
+ * @param firstParticle the index of the particle of the first track.
+ * @param predictedStates the states predicted by the batch kalman filter.
+ * @param filteredStates the states filtered by the batch kalman filter.
+ * @param smoothedStates the states smoothed by the batch kalman smoother.
+ */
+void saveDataToBinary(
+    BinaryResultFile &resultFile,
+    const std::vector<Detector> &detectors,
+    const std::vector<std::vector<Measurement>> &measures,
+    int firstParticle,
+    const BatchStateEstimates &predictedStates,
+    const BatchStateEstimates &filteredStates,
+    const BatchStateEstimates &smoothedStates);
+
 /**
  * Print elapsed time in human readable format
  * 
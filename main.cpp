@@ -1,30 +1,86 @@
 // Interfaces
+#include "Configuration.hpp"
 #include "PhysicalParameters.hpp"
 #include "Simulation.hpp"
 #include "Utils.hpp"
 
 // Other libraries
-#include <ctime> 
+#include <ctime>
 #include <chrono>
+#include <exception>
+#include <iostream>
 
 // Namespaces
 using namespace std;
 using namespace Utils;
 
-int main() {
+int main(int argc, char *argv[]) {
+  // --- Configuration (see Configuration.hpp, or run with --help)
+  Configuration configuration;
+  try {
+    configuration = Configuration::fromArguments(argc, argv);
+  } catch (const exception &error) {
+    cerr << error.what() << endl << "Run with --help for the list of the options" << endl;
+    return 1;
+  }
+  if (configuration.helpRequested)
+    return 0;
+
   // --- Execution time
   cout << "\n--------------------------------------------------------------------------" << endl;
   auto now = chrono::system_clock::to_time_t(chrono::system_clock::now());
   cout << " Beginning simulation at: " << ctime(&now) << endl;
   float begintime = ((float)clock())/CLOCKS_PER_SEC;
+  configuration.print();
+
+  try {
+    // --- Simulation
+    auto simulation = Simulation(configuration);
+    switch (configuration.mode) {
+    case RunMode::SIMULATE:
+      if (configuration.particlesPerChunk > 0)
+        simulation.runSimulationStreaming(configuration.particlesNumber, configuration.particlesPerChunk);
+      else
+        simulation.runSimulation(configuration.particlesNumber);
+      break;
+
+    // --- Simulation of layers testing
+    case RunMode::DETECTOR_TEST:
+      simulation.testDetector(configuration.particlesNumber, configuration.testedDetector);
+      break;
+
+    // --- Reconstruction of the measures of a previous run
+    case RunMode::RECONSTRUCT_ONLY:
+      if (configuration.dataFileName.empty())
+        simulation.reconstructData(configuration.particlesNumber);
+      else
+        simulation.reconstructData(configuration.dataFileName, configuration.truthFileName);
+      break;
+
+    // --- Tuning of the Kalman filter on the same particles
+    case RunMode::SWEEP:
+      simulation.sweepTrackerParameters(configuration.particlesNumber, configuration.sweepVelocitySigmas, configuration.sweepDirectionSigmas);
+      break;
+
+    // --- Pulls of every detector against the unbiased estimates of the others
+    case RunMode::UNBIASED_PULLS:
+      simulation.testAllDetectors(configuration.particlesNumber);
+      break;
 
-  // --- Simulation
-  auto simulation = Simulation();
-  // simulation.runSimulation(NUMBER_OF_PARTICLES);
+    // --- Simulation of layers testing, masking each detector (or pair of detectors) in turn
+    case RunMode::DETECTOR_SCAN:
+      simulation.scanDetectors(configuration.particlesNumber, configuration.maskedDetectorsNumber);
+      break;
 
-  // --- Simulation of layers testing
-  simulation.testDetector(NUMBER_OF_PARTICLES, 5);
-  simulation.testDetector(1, 5);
+    // --- Comparison of the track finder with the event builder
+    case RunMode::TRACK_FINDING:
+      simulation.runTrackFinding(configuration.particlesNumber);
+      break;
+    }
+  } catch (const exception &error) {
+    cerr << error.what() << endl;
+    return 1;
+  }
 
   // --- Execution time
   now = chrono::system_clock::to_time_t(chrono::system_clock::now());
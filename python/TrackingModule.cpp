@@ -0,0 +1,325 @@
+// Header files needed
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Custom classes
+#include "BatchStateEstimates.hpp"
+#include "DataGenerator.hpp"
+#include "MeasuresAndStates.hpp"
+#include "SetupFactory.hpp"
+#include "ThreadPool.hpp"
+#include "Tracker.hpp"
+
+// Namespaces
+using namespace std;
+namespace py = pybind11;
+
+// NOTE: the estimates of a track are bound as a class, instead of being converted to a list
+PYBIND11_MAKE_OPAQUE(std::vector<MatrixStateEstimate>)
+
+// NOTE: the arrays returned to Python are read-only views of buffers owned by C++ objects. Each view keeps its
+// owner alive through its base object, so no value is copied when crossing the language boundary.
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Packed generated data
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Number of columns of the packed states: z, t, x, y, speed, xz, yz (as in the result files)
+static constexpr int STATE_COLUMNS = 7;
+
+/**
+ * The generated data of many particles, in contiguous buffers.
+ *
+ * The rows of particle j are those in [offsets[j], offsets[j + 1]), as in the
+ * binary result files.
+ */
+struct PackedGeneratedData {
+  std::vector<double> theoreticalStates;
+  std::vector<double> realStates;
+  std::vector<std::uint64_t> statesOffsets;
+
+  std::vector<double> measures;
+  std::vector<int> measuresDetectorIds;
+  std::vector<std::uint64_t> measuresOffsets;
+};
+
+static void packStates(const vector<vector<ParticleState>> &allParticlesStates, vector<double> &states, vector<uint64_t> &offsets) {
+  offsets.assign(1, 0);
+  for (const vector<ParticleState> &particleStates : allParticlesStates) {
+    for (const ParticleState &state : particleStates)
+      states.insert(states.end(), {state.position.Z(), state.position.T(), state.position.X(), state.position.Y(), 1. / state.velocity.Z(),
+                                   state.velocity.X() / state.velocity.Z(), state.velocity.Y() / state.velocity.Z()});
+    offsets.push_back(states.size() / STATE_COLUMNS);
+  }
+}
+
+static PackedGeneratedData packGeneratedData(const GeneratedData &generatedData) {
+  PackedGeneratedData packedData;
+  packStates(generatedData.allParticlesTheoreticalStates, packedData.theoreticalStates, packedData.statesOffsets);
+
+  // NOTE: the real states have the same number of rows of the theoretical ones
+  vector<uint64_t> realStatesOffsets;
+  packStates(generatedData.allParticlesRealStates, packedData.realStates, realStatesOffsets);
+  if (realStatesOffsets != packedData.statesOffsets)
+    throw std::logic_error("packGeneratedData: theoretical and real states of different size");
+
+  packedData.measuresOffsets.assign(1, 0);
+  for (const vector<Measurement> &particleMeasures : generatedData.allParticlesMeasures) {
+    for (const Measurement &measure : particleMeasures) {
+      packedData.measures.insert(packedData.measures.end(), {measure.t, measure.x, measure.y});
+      packedData.measuresDetectorIds.push_back(measure.detectorID);
+    }
+    packedData.measuresOffsets.push_back(packedData.measuresDetectorIds.size());
+  }
+
+  return packedData;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Views
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Read-only view of a buffer owned by the object base (strides in bytes)
+template <typename T>
+static py::array_t<T> makeView(const T *data, vector<py::ssize_t> shape, vector<py::ssize_t> strides, py::handle base) {
+  py::array_t<T> view(std::move(shape), std::move(strides), data, base);
+  view.attr("setflags")(py::arg("write") = false);
+  return view;
+}
+
+// View of the rows of a packed vector
+template <typename T>
+static py::array_t<T> makeRowsView(const vector<T> &values, py::ssize_t columnsNumber, py::handle base) {
+  const py::ssize_t rowsNumber = values.size() / columnsNumber;
+  if (columnsNumber == 1)
+    return makeView(values.data(), {rowsNumber}, {(py::ssize_t)sizeof(T)}, base);
+  return makeView(values.data(), {rowsNumber, columnsNumber}, {columnsNumber * (py::ssize_t)sizeof(T), (py::ssize_t)sizeof(T)}, base);
+}
+
+// Views of the estimates of a track, which are laid out one after the other in the vector
+static py::array_t<double> makeValuesView(const vector<MatrixStateEstimate> &states, py::handle base) {
+  const py::ssize_t stride = sizeof(MatrixStateEstimate);
+  const double *data = states.empty() ? nullptr : states.front().value.getArray();
+  return makeView(data, {(py::ssize_t)states.size(), STATE_DIMENSION}, {stride, (py::ssize_t)sizeof(double)}, base);
+}
+
+static py::array_t<double> makeUncertaintiesView(const vector<MatrixStateEstimate> &states, py::handle base) {
+  const py::ssize_t stride = sizeof(MatrixStateEstimate);
+  const py::ssize_t rowStride = STATE_DIMENSION * sizeof(double);
+  const double *data = states.empty() ? nullptr : states.front().uncertainty.getArray();
+  return makeView(data, {(py::ssize_t)states.size(), STATE_DIMENSION, STATE_DIMENSION}, {stride, rowStride, (py::ssize_t)sizeof(double)}, base);
+}
+
+// Views of the structure of arrays of the batch estimates: value k of track i at layer l is at [l, k, i]
+static py::array_t<double> makeValuesView(const BatchStateEstimates &states, py::handle base) {
+  const py::ssize_t stride = states.getStride() * sizeof(double);
+  const double *data = states.getLayersNumber() == 0 ? nullptr : states.getValues(0);
+  return makeView(data, {states.getLayersNumber(), STATE_DIMENSION, states.getTracksNumber()}, {STATE_DIMENSION * stride, stride, (py::ssize_t)sizeof(double)},
+                  base);
+}
+
+static py::array_t<double> makeUncertaintiesView(const BatchStateEstimates &states, py::handle base) {
+  const py::ssize_t stride = states.getStride() * sizeof(double);
+  const double *data = states.getLayersNumber() == 0 ? nullptr : states.getUncertainties(0);
+  return makeView(data, {states.getLayersNumber(), STATE_DIMENSION, STATE_DIMENSION, states.getTracksNumber()},
+                  {STATE_DIMENSION * STATE_DIMENSION * stride, STATE_DIMENSION * stride, stride, (py::ssize_t)sizeof(double)}, base);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Measures conversion
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+using InputValues = py::array_t<double, py::array::c_style | py::array::forcecast>;
+using InputIds = py::array_t<int, py::array::c_style | py::array::forcecast>;
+using InputOffsets = py::array_t<std::uint64_t, py::array::c_style | py::array::forcecast>;
+
+static vector<Measurement> toMeasures(const InputValues &values, const InputIds &detectorIds, size_t begin, size_t end) {
+  auto valuesView = values.unchecked<2>();
+  auto detectorIdsView = detectorIds.unchecked<1>();
+
+  vector<Measurement> measures;
+  measures.reserve(end - begin);
+  for (size_t i = begin; i < end; i++)
+    measures.push_back(Measurement{valuesView(i, 0), valuesView(i, 1), valuesView(i, 2), detectorIdsView(i)});
+  return measures;
+}
+
+static void checkMeasures(const InputValues &values, const InputIds &detectorIds) {
+  if (values.ndim() != 2 || values.shape(1) != MEASURE_DIMENSION)
+    throw std::invalid_argument("The measures must be an array of shape (n, 3) with t, x, y");
+  if (detectorIds.ndim() != 1 || detectorIds.shape(0) != values.shape(0))
+    throw std::invalid_argument("There must be a detector id for each measure");
+}
+
+static vector<vector<Measurement>> toParticlesMeasures(const InputValues &values, const InputIds &detectorIds, const InputOffsets &offsets) {
+  checkMeasures(values, detectorIds);
+  if (offsets.ndim() != 1 || offsets.shape(0) == 0)
+    throw std::invalid_argument("The offsets must be an array of shape (particles + 1,)");
+
+  auto offsetsView = offsets.unchecked<1>();
+  vector<vector<Measurement>> allParticlesMeasures;
+  for (py::ssize_t j = 0; j + 1 < offsets.shape(0); j++) {
+    if (offsetsView(j) > offsetsView(j + 1) || offsetsView(j + 1) > (uint64_t)values.shape(0))
+      throw std::invalid_argument("The offsets must be non decreasing and within the measures");
+    allParticlesMeasures.push_back(toMeasures(values, detectorIds, offsetsView(j), offsetsView(j + 1)));
+  }
+  return allParticlesMeasures;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Module
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+PYBIND11_MODULE(tracking, module) {
+  module.doc() = "Simulation and Kalman filter reconstruction of the 4D tracking, without files in between";
+
+  // --- Setup
+  py::class_<Detector>(module, "Detector")
+      .def_property_readonly("id", &Detector::getId)
+      .def_property_readonly("z", [](const Detector &detector) { return detector.getBottmLeftPosition().Z(); })
+      .def_property_readonly("width", &Detector::getWidth)
+      .def_property_readonly("height", &Detector::getHeight);
+
+  py::class_<SimulationSetup>(module, "SimulationSetup")
+      .def_readonly("detectors", &SimulationSetup::detectors);
+
+  py::class_<ExperimentParameters>(module, "ExperimentParameters")
+      .def(py::init<>())
+      .def_readwrite("detectorsNumber", &ExperimentParameters::detectorsNumber)
+      .def_readwrite("distanceBetweenDetectors", &ExperimentParameters::distanceBetweenDetectors)
+      .def_readwrite("detectorWidth", &ExperimentParameters::detectorWidth)
+      .def_readwrite("detectorHeight", &ExperimentParameters::detectorHeight)
+      .def_readwrite("detectorSpaceUncertainty", &ExperimentParameters::detectorSpaceUncertainty)
+      .def_readwrite("detectorTimeUncertainty", &ExperimentParameters::detectorTimeUncertainty)
+      .def_readwrite("detectorWithoutTime", &ExperimentParameters::detectorWithoutTime);
+
+  py::class_<SetupFactory>(module, "SetupFactory")
+      .def(py::init<>())
+      .def(py::init<const ExperimentParameters &>(), py::arg("parameters"))
+      .def("generateExperiment", &SetupFactory::generateExperiment);
+
+  // --- Data generation
+  py::class_<PackedGeneratedData>(module, "GeneratedData",
+                                  "Generated particles. The states have columns z, t, x, y, speed, xz, yz and the rows of particle j are in "
+                                  "[offsets[j], offsets[j + 1]); the measures have columns t, x, y.")
+      .def_property_readonly("theoreticalStates",
+                             [](py::object self) { return makeRowsView(self.cast<const PackedGeneratedData &>().theoreticalStates, STATE_COLUMNS, self); })
+      .def_property_readonly("realStates",
+                             [](py::object self) { return makeRowsView(self.cast<const PackedGeneratedData &>().realStates, STATE_COLUMNS, self); })
+      .def_property_readonly("statesOffsets", [](py::object self) { return makeRowsView(self.cast<const PackedGeneratedData &>().statesOffsets, 1, self); })
+      .def_property_readonly("measures",
+                             [](py::object self) { return makeRowsView(self.cast<const PackedGeneratedData &>().measures, MEASURE_DIMENSION, self); })
+      .def_property_readonly("measuresDetectorIds",
+                             [](py::object self) { return makeRowsView(self.cast<const PackedGeneratedData &>().measuresDetectorIds, 1, self); })
+      .def_property_readonly("measuresOffsets",
+                             [](py::object self) { return makeRowsView(self.cast<const PackedGeneratedData &>().measuresOffsets, 1, self); })
+      .def("__len__", [](const PackedGeneratedData &data) { return data.measuresOffsets.size() - 1; });
+
+  py::class_<DataGenerator>(module, "DataGenerator")
+      .def(py::init<SimulationSetup, std::uint64_t>(), py::arg("simulationSetup"), py::arg("seed") = RANDOM_SEED)
+      .def_property("seed", &DataGenerator::getSeed, &DataGenerator::setSeed)
+      .def(
+          "generateAllData",
+          [](const DataGenerator &dataGenerator, int numberOfParticles, bool useMultipleScattering, int threadsNumber) {
+            ThreadPool threadPool(threadsNumber);
+            return packGeneratedData(dataGenerator.generateAllData(numberOfParticles, false, useMultipleScattering, &threadPool));
+          },
+          py::arg("numberOfParticles"), py::arg("useMultipleScattering") = true, py::arg("threadsNumber") = NUMBER_OF_THREADS,
+          py::call_guard<py::gil_scoped_release>());
+
+  // --- Reconstruction
+  py::class_<vector<MatrixStateEstimate>>(module, "TrackEstimates", "Estimated states of a track: values (layers, 6) and uncertainties (layers, 6, 6).")
+      .def_property_readonly("values", [](py::object self) { return makeValuesView(self.cast<const vector<MatrixStateEstimate> &>(), self); })
+      .def_property_readonly("uncertainties", [](py::object self) { return makeUncertaintiesView(self.cast<const vector<MatrixStateEstimate> &>(), self); })
+      .def("__len__", [](const vector<MatrixStateEstimate> &states) { return states.size(); });
+
+  py::class_<kalmanFilterResult>(module, "FilterResult")
+      .def_readonly("predictedStates", &kalmanFilterResult::predictedStates)
+      .def_readonly("filteredStates", &kalmanFilterResult::filteredStates)
+      .def_readonly("firstPredictedLayer", &kalmanFilterResult::firstPredictedLayer)
+      .def_readonly("chi2", &kalmanFilterResult::chi2)
+      .def_readonly("ndf", &kalmanFilterResult::ndf)
+      .def_readonly("aborted", &kalmanFilterResult::aborted);
+
+  py::class_<BatchStateEstimates>(module, "BatchEstimates",
+                                  "Estimated states of many tracks: values (layers, 6, tracks) and uncertainties (layers, 6, 6, tracks).")
+      .def_property_readonly("values", [](py::object self) { return makeValuesView(self.cast<const BatchStateEstimates &>(), self); })
+      .def_property_readonly("uncertainties", [](py::object self) { return makeUncertaintiesView(self.cast<const BatchStateEstimates &>(), self); })
+      .def_property_readonly("statesNumbers",
+                             [](const BatchStateEstimates &states) {
+                               py::array_t<int> statesNumbers(states.getTracksNumber());
+                               for (int track = 0; track < states.getTracksNumber(); track++)
+                                 statesNumbers.mutable_at(track) = states.getStatesNumber(track);
+                               return statesNumbers;
+                             })
+      .def("getTrackStates", &BatchStateEstimates::getTrackStates)
+      .def("__len__", &BatchStateEstimates::getTracksNumber);
+
+  py::class_<kalmanFilterBatchResult>(module, "BatchFilterResult")
+      .def_readonly("predictedStates", &kalmanFilterBatchResult::predictedStates)
+      .def_readonly("filteredStates", &kalmanFilterBatchResult::filteredStates)
+      .def_readonly("firstPredictedLayer", &kalmanFilterBatchResult::firstPredictedLayer)
+      .def_property_readonly("chi2s", [](py::object self) { return makeRowsView(self.cast<const kalmanFilterBatchResult &>().chi2s, 1, self); })
+      .def_property_readonly("ndfs", [](py::object self) { return makeRowsView(self.cast<const kalmanFilterBatchResult &>().ndfs, 1, self); })
+      // NOTE: std::vector<bool> is packed in bits, hence the flags are copied
+      .def_property_readonly("aborted", [](const kalmanFilterBatchResult &filterResult) {
+        py::array_t<bool> aborted((py::ssize_t)filterResult.aborted.size());
+        for (py::ssize_t track = 0; track < aborted.shape(0); track++)
+          aborted.mutable_at(track) = filterResult.aborted[track];
+        return aborted;
+      });
+
+  py::class_<TrackerParameters>(module, "TrackerParameters")
+      .def(py::init<>())
+      .def_readwrite("velocityEvolutionSigma", &TrackerParameters::velocityEvolutionSigma)
+      .def_readwrite("directionEvolutionSigma", &TrackerParameters::directionEvolutionSigma);
+
+  py::class_<Tracker>(module, "Tracker")
+      .def(py::init<const vector<Detector> &, const TrackerParameters &>(), py::arg("detectors"), py::arg("parameters") = TrackerParameters())
+      .def_property_readonly("parameters", &Tracker::getParameters)
+      .def(
+          "kalmanFilter",
+          [](const Tracker &tracker, const InputValues &measures, const InputIds &detectorIds, bool realTime, const vector<int> &maskedDetectors) {
+            checkMeasures(measures, detectorIds);
+            const vector<Measurement> particleMeasures = toMeasures(measures, detectorIds, 0, measures.shape(0));
+
+            py::gil_scoped_release release;
+            return tracker.kalmanFilter(particleMeasures, tracker.getConsideredLayers(maskedDetectors), false, realTime);
+          },
+          py::arg("measures"), py::arg("detectorIds"), py::arg("realTime") = false, py::arg("maskedDetectors") = vector<int>())
+      .def(
+          "kalmanSmoother",
+          [](const Tracker &tracker, const vector<MatrixStateEstimate> &filteredStates) { return tracker.kalmanSmoother(filteredStates); },
+          py::arg("filteredStates"), py::call_guard<py::gil_scoped_release>())
+      .def(
+          "kalmanSmoother",
+          [](const Tracker &tracker, const kalmanFilterResult &filterResult, const vector<int> &maskedDetectors) {
+            return tracker.kalmanSmoother(filterResult, tracker.getConsideredLayers(maskedDetectors));
+          },
+          py::arg("filterResult"), py::arg("maskedDetectors") = vector<int>(), py::call_guard<py::gil_scoped_release>())
+      .def(
+          "kalmanFilterBatch",
+          [](const Tracker &tracker, const InputValues &measures, const InputIds &detectorIds, const InputOffsets &offsets, bool realTime) {
+            const vector<vector<Measurement>> allParticlesMeasures = toParticlesMeasures(measures, detectorIds, offsets);
+
+            py::gil_scoped_release release;
+            return tracker.kalmanFilterBatch(allParticlesMeasures, realTime);
+          },
+          py::arg("measures"), py::arg("detectorIds"), py::arg("offsets"), py::arg("realTime") = false)
+      .def("kalmanSmootherBatch", py::overload_cast<const BatchStateEstimates &>(&Tracker::kalmanSmootherBatch, py::const_), py::arg("filteredStates"),
+           py::call_guard<py::gil_scoped_release>())
+      .def("kalmanSmootherBatch", py::overload_cast<const kalmanFilterBatchResult &>(&Tracker::kalmanSmootherBatch, py::const_),
+           py::arg("filterResult"), py::call_guard<py::gil_scoped_release>());
+}
@@ -0,0 +1,92 @@
+// Header files needed
+#include <algorithm>
+#include <vector>
+
+// Custom classes
+#include "BatchStateEstimates.hpp"
+#include "FixedMatrix.hpp"
+#include "MeasuresAndStates.hpp"
+
+// Namespaces
+using namespace std;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BatchStateEstimates (constructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+BatchStateEstimates::BatchStateEstimates(int tracksNumber, int layersNumber)
+    : tracksNumber{tracksNumber}, layersNumber{layersNumber},
+      stride{(tracksNumber + BATCH_BLOCK_SIZE - 1) / BATCH_BLOCK_SIZE * BATCH_BLOCK_SIZE},
+      statesNumber(tracksNumber, 0),
+      values((size_t)layersNumber * STATE_DIMENSION * stride, 0.),
+      uncertainties((size_t)layersNumber * STATE_DIMENSION * STATE_DIMENSION * stride, 0.) {}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// setState
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void BatchStateEstimates::setState(int layer, int track, const MatrixStateEstimate &state) {
+  double *layerValues = getValues(layer);
+  double *layerUncertainties = getUncertainties(layer);
+
+  for (int i = 0; i < STATE_DIMENSION; i++) {
+    layerValues[i * stride + track] = state.value(i, 0);
+
+    for (int j = 0; j < STATE_DIMENSION; j++)
+      layerUncertainties[(i * STATE_DIMENSION + j) * stride + track] = state.uncertainty(i, j);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// fillLayer
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void BatchStateEstimates::fillLayer(int layer, const MatrixStateEstimate &state) {
+  double *layerValues = getValues(layer);
+  double *layerUncertainties = getUncertainties(layer);
+
+  for (int i = 0; i < STATE_DIMENSION; i++) {
+    fill_n(&layerValues[i * stride], stride, state.value(i, 0));
+
+    for (int j = 0; j < STATE_DIMENSION; j++)
+      fill_n(&layerUncertainties[(i * STATE_DIMENSION + j) * stride], stride, state.uncertainty(i, j));
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// getState
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+MatrixStateEstimate BatchStateEstimates::getState(int layer, int track) const {
+  const double *layerValues = getValues(layer);
+  const double *layerUncertainties = getUncertainties(layer);
+  MatrixStateEstimate state;
+
+  for (int i = 0; i < STATE_DIMENSION; i++) {
+    state.value(i, 0) = layerValues[i * stride + track];
+
+    for (int j = 0; j < STATE_DIMENSION; j++)
+      state.uncertainty(i, j) = layerUncertainties[(i * STATE_DIMENSION + j) * stride + track];
+  }
+
+  return state;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// getTrackStates
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<MatrixStateEstimate> BatchStateEstimates::getTrackStates(int track) const {
+  vector<MatrixStateEstimate> states;
+  states.reserve(statesNumber[track]);
+
+  for (int layer = 0; layer < statesNumber[track]; layer++)
+    states.push_back(getState(layer, track));
+
+  return states;
+}
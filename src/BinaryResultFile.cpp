@@ -0,0 +1,237 @@
+// Header files needed
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Custom classes
+#include "BinaryResultFile.hpp"
+
+// Namespaces
+using namespace std;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Global variables
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static constexpr char MAGIC[8] = {'T', '4', 'D', 'C', 'O', 'L', 'S', '1'};
+static constexpr uint32_t VERSION = 1;
+static constexpr size_t COLUMN_NAME_SIZE = 32;
+
+// Size of the fixed part of the header: magic, version, columns, particles, rows, capacity, positions
+static constexpr uint64_t HEADER_SIZE = 8 + 4 + 4 + 8 + 8 + 8 + 8 + 8;
+
+// NOTE: the columns start at a page boundary, and are written in blocks of this many rows (64 KiB)
+static constexpr uint64_t PAGE_SIZE = 4096;
+static constexpr uint64_t BUFFER_ROWS = 8192;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BinaryResultFile (constructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+BinaryResultFile::BinaryResultFile(const string &fileName, const vector<string> &columnNames, uint64_t particlesCapacity, uint64_t rowsCapacity)
+    : file(fileName, ios::binary | ios::out | ios::trunc), columnNames(columnNames), particlesCapacity(particlesCapacity), rowsCapacity(rowsCapacity),
+      columnBuffers(columnNames.size()) {
+  if (!file)
+    throw std::invalid_argument("Cannot open the result file " + fileName);
+  if (columnNames.empty())
+    throw std::invalid_argument("A result file needs at least one column");
+  for (const string &name : columnNames)
+    if (name.empty() || name.size() >= COLUMN_NAME_SIZE)
+      throw std::invalid_argument("Invalid column name: " + name);
+
+  // Layout of the file
+  offsetsPosition = HEADER_SIZE + columnNames.size() * COLUMN_NAME_SIZE;
+  const uint64_t offsetsEnd = offsetsPosition + (particlesCapacity + 1) * sizeof(uint64_t);
+  dataPosition = (offsetsEnd + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+
+  for (vector<double> &buffer : columnBuffers)
+    buffer.reserve(BUFFER_ROWS);
+  offsetsBuffer.reserve(BUFFER_ROWS);
+  offsetsBuffer.push_back(0);
+
+  // NOTE: the header is written also now, so that an interrupted run leaves a readable (empty) file
+  writeHeader();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// BinaryResultFile (destructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+BinaryResultFile::~BinaryResultFile() {
+  // NOTE: the errors can be caught only closing the file explicitly
+  try {
+    if (file.is_open())
+      close();
+  } catch (const std::exception &) {
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// addParticle
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void BinaryResultFile::addParticle(const vector<double> &rows) {
+  const size_t columnsNumber = columnNames.size();
+  if (rows.size() % columnsNumber != 0)
+    throw std::invalid_argument("The values of a particle are not a whole number of rows");
+
+  const uint64_t particleRows = rows.size() / columnsNumber;
+  if (particlesNumber + 1 > particlesCapacity || rowsNumber + particleRows > rowsCapacity)
+    throw std::length_error("The result file is full");
+
+  // Transposition of the rows into the column buffers
+  for (uint64_t i = 0; i < particleRows; i++)
+    for (size_t j = 0; j < columnsNumber; j++)
+      columnBuffers[j].push_back(rows[i * columnsNumber + j]);
+
+  particlesNumber++;
+  rowsNumber += particleRows;
+  offsetsBuffer.push_back(rowsNumber);
+
+  if (columnBuffers[0].size() >= BUFFER_ROWS || offsetsBuffer.size() >= BUFFER_ROWS)
+    flush();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// flush
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void BinaryResultFile::flush() {
+  // Columns
+  const uint64_t bufferedRows = columnBuffers[0].size();
+  if (bufferedRows > 0) {
+    for (size_t j = 0; j < columnBuffers.size(); j++) {
+      file.seekp(dataPosition + (j * rowsCapacity + writtenRows) * sizeof(double));
+      file.write(reinterpret_cast<const char *>(columnBuffers[j].data()), bufferedRows * sizeof(double));
+      columnBuffers[j].clear();
+    }
+    writtenRows += bufferedRows;
+  }
+
+  // Offsets
+  if (!offsetsBuffer.empty()) {
+    file.seekp(offsetsPosition + writtenOffsets * sizeof(uint64_t));
+    file.write(reinterpret_cast<const char *>(offsetsBuffer.data()), offsetsBuffer.size() * sizeof(uint64_t));
+    writtenOffsets += offsetsBuffer.size();
+    offsetsBuffer.clear();
+  }
+
+  if (!file)
+    throw std::runtime_error("Error while writing the result file");
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// writeHeader
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void BinaryResultFile::writeHeader() {
+  const uint32_t columnsNumber = columnNames.size();
+
+  file.seekp(0);
+  file.write(MAGIC, sizeof(MAGIC));
+  file.write(reinterpret_cast<const char *>(&VERSION), sizeof(VERSION));
+  file.write(reinterpret_cast<const char *>(&columnsNumber), sizeof(columnsNumber));
+  file.write(reinterpret_cast<const char *>(&particlesNumber), sizeof(particlesNumber));
+  file.write(reinterpret_cast<const char *>(&rowsNumber), sizeof(rowsNumber));
+  file.write(reinterpret_cast<const char *>(&rowsCapacity), sizeof(rowsCapacity));
+  file.write(reinterpret_cast<const char *>(&offsetsPosition), sizeof(offsetsPosition));
+  file.write(reinterpret_cast<const char *>(&dataPosition), sizeof(dataPosition));
+
+  for (const string &name : columnNames) {
+    char paddedName[COLUMN_NAME_SIZE] = {};
+    memcpy(paddedName, name.data(), name.size());
+    file.write(paddedName, COLUMN_NAME_SIZE);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// close
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void BinaryResultFile::close() {
+  flush();
+  writeHeader();
+  file.close();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// read
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+BinaryResultData BinaryResultFile::read(const string &fileName) {
+  ifstream file(fileName, ios::binary);
+  if (!file)
+    throw std::invalid_argument("Cannot open the result file " + fileName);
+
+  // Header
+  char magic[sizeof(MAGIC)];
+  uint32_t version = 0;
+  uint32_t columnsNumber = 0;
+  uint64_t particlesNumber = 0;
+  uint64_t rowsNumber = 0;
+  uint64_t rowsCapacity = 0;
+  uint64_t offsetsPosition = 0;
+  uint64_t dataPosition = 0;
+
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char *>(&version), sizeof(version));
+  file.read(reinterpret_cast<char *>(&columnsNumber), sizeof(columnsNumber));
+  file.read(reinterpret_cast<char *>(&particlesNumber), sizeof(particlesNumber));
+  file.read(reinterpret_cast<char *>(&rowsNumber), sizeof(rowsNumber));
+  file.read(reinterpret_cast<char *>(&rowsCapacity), sizeof(rowsCapacity));
+  file.read(reinterpret_cast<char *>(&offsetsPosition), sizeof(offsetsPosition));
+  file.read(reinterpret_cast<char *>(&dataPosition), sizeof(dataPosition));
+
+  if (!file || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION)
+    throw std::invalid_argument("Not a result file of this version: " + fileName);
+  if (rowsNumber > rowsCapacity)
+    throw std::invalid_argument("Corrupted result file: " + fileName);
+
+  BinaryResultData data;
+  for (uint32_t j = 0; j < columnsNumber; j++) {
+    char paddedName[COLUMN_NAME_SIZE];
+    file.read(paddedName, COLUMN_NAME_SIZE);
+    data.columnNames.emplace_back(paddedName, strnlen(paddedName, COLUMN_NAME_SIZE));
+  }
+
+  // Offsets and columns
+  data.offsets.resize(particlesNumber + 1);
+  file.seekg(offsetsPosition);
+  file.read(reinterpret_cast<char *>(data.offsets.data()), data.offsets.size() * sizeof(uint64_t));
+
+  data.columns.assign(columnsNumber, vector<double>(rowsNumber));
+  for (uint32_t j = 0; j < columnsNumber; j++) {
+    file.seekg(dataPosition + j * rowsCapacity * sizeof(double));
+    file.read(reinterpret_cast<char *>(data.columns[j].data()), rowsNumber * sizeof(double));
+  }
+
+  if (!file || data.offsets.back() != rowsNumber)
+    throw std::invalid_argument("Corrupted result file: " + fileName);
+
+  return data;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// getColumn
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+const vector<double> &BinaryResultData::getColumn(const string &name) const {
+  const auto column = find(columnNames.begin(), columnNames.end(), name);
+  if (column == columnNames.end())
+    throw std::invalid_argument("Missing column " + name);
+
+  return columns[column - columnNames.begin()];
+}
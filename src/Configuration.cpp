@@ -0,0 +1,419 @@
+// Header files needed
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Custom classes
+#include "Configuration.hpp"
+
+// Namespaces
+using namespace std;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Conversion functions
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Remove the blanks at the beginning and at the end of a string
+static string trim(const string &text) {
+  const size_t begin = text.find_first_not_of(" \t\r\n");
+  if (begin == string::npos)
+    return "";
+
+  const size_t end = text.find_last_not_of(" \t\r\n");
+  return text.substr(begin, end - begin + 1);
+}
+
+static int toInt(const string &key, const string &value) {
+  size_t parsed = 0;
+  int result = 0;
+  try {
+    result = stoi(value, &parsed);
+  } catch (const exception &) {
+    parsed = 0;
+  }
+
+  if (parsed == 0 || parsed != value.size())
+    throw invalid_argument("Configuration: the value of " + key + " is not an integer: " + value);
+  return result;
+}
+
+static uint64_t toUnsigned(const string &key, const string &value) {
+  size_t parsed = 0;
+  uint64_t result = 0;
+  try {
+    result = stoull(value, &parsed);
+  } catch (const exception &) {
+    parsed = 0;
+  }
+
+  if (parsed == 0 || parsed != value.size() || value[0] == '-')
+    throw invalid_argument("Configuration: the value of " + key + " is not a non negative integer: " + value);
+  return result;
+}
+
+static double toDouble(const string &key, const string &value) {
+  size_t parsed = 0;
+  double result = 0.;
+  try {
+    result = stod(value, &parsed);
+  } catch (const exception &) {
+    parsed = 0;
+  }
+
+  if (parsed == 0 || parsed != value.size())
+    throw invalid_argument("Configuration: the value of " + key + " is not a number: " + value);
+  return result;
+}
+
+// Comma separated list of numbers
+static vector<double> toDoubles(const string &key, const string &value) {
+  vector<double> result;
+  size_t begin = 0;
+  while (true) {
+    const size_t comma = value.find(',', begin);
+    result.push_back(toDouble(key, trim(value.substr(begin, comma == string::npos ? string::npos : comma - begin))));
+    if (comma == string::npos)
+      return result;
+    begin = comma + 1;
+  }
+}
+
+static string toString(const vector<double> &values) {
+  string result;
+  for (double value : values) {
+    ostringstream valueStream;
+    valueStream << value;
+    result += (result.empty() ? "" : ",") + valueStream.str();
+  }
+  return result;
+}
+
+static string toString(RunMode mode) {
+  switch (mode) {
+  case RunMode::SIMULATE:
+    return "simulate";
+  case RunMode::DETECTOR_TEST:
+    return "detector-test";
+  case RunMode::RECONSTRUCT_ONLY:
+    return "reconstruct-only";
+  case RunMode::SWEEP:
+    return "sweep";
+  case RunMode::UNBIASED_PULLS:
+    return "unbiased-pulls";
+  case RunMode::DETECTOR_SCAN:
+    return "detector-scan";
+  case RunMode::TRACK_FINDING:
+    return "track-finding";
+  }
+  return "";
+}
+
+static string toString(OutputFormat outputFormat) {
+  switch (outputFormat) {
+  case OutputFormat::BINARY:
+    return "binary";
+  case OutputFormat::CSV:
+    return "csv";
+  case OutputFormat::ROOT:
+    return "root";
+  }
+  return "";
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// fromArguments
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Configuration Configuration::fromArguments(int argc, const char *const argv[]) {
+  // Options as (key, value) pairs, the value of "--key=value" being in the same argument
+  vector<pair<string, string>> options;
+  for (int i = 1; i < argc; i++) {
+    const string argument = argv[i];
+    if (argument.size() < 3 || argument.compare(0, 2, "--") != 0)
+      throw invalid_argument("Configuration: unexpected argument " + argument + " (the options are --key value)");
+
+    const size_t equal = argument.find('=');
+    if (equal != string::npos) {
+      options.emplace_back(argument.substr(2, equal - 2), argument.substr(equal + 1));
+    } else if (argument == "--help") {
+      options.emplace_back("help", "");
+    } else {
+      if (i + 1 == argc)
+        throw invalid_argument("Configuration: missing value of " + argument);
+      options.emplace_back(argument.substr(2), argv[++i]);
+    }
+  }
+
+  Configuration configuration;
+  for (const pair<string, string> &option : options) {
+    if (option.first == "help") {
+      printUsage(argc > 0 ? argv[0] : "Tracking_simulation");
+      configuration.helpRequested = true;
+      return configuration;
+    }
+  }
+
+  // NOTE: the file is read first, so that the command line overrides it
+  for (const pair<string, string> &option : options) {
+    if (option.first == "config")
+      configuration.readFile(option.second);
+  }
+  for (const pair<string, string> &option : options) {
+    if (option.first != "config")
+      configuration.set(option.first, option.second);
+  }
+
+  configuration.validate();
+  return configuration;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// readFile
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Configuration::readFile(const string &fileName) {
+  ifstream file(fileName);
+  if (!file)
+    throw invalid_argument("Configuration: cannot open " + fileName);
+
+  string line;
+  int lineNumber = 0;
+  while (getline(file, line)) {
+    lineNumber++;
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty())
+      continue;
+
+    const size_t equal = line.find('=');
+    if (equal == string::npos)
+      throw invalid_argument("Configuration: missing \"=\" at line " + to_string(lineNumber) + " of " + fileName);
+
+    set(trim(line.substr(0, equal)), trim(line.substr(equal + 1)));
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// set
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Configuration::set(const string &key, const string &value) {
+  // Run
+  if (key == "mode") {
+    if (value == "simulate")
+      mode = RunMode::SIMULATE;
+    else if (value == "detector-test")
+      mode = RunMode::DETECTOR_TEST;
+    else if (value == "reconstruct-only")
+      mode = RunMode::RECONSTRUCT_ONLY;
+    else if (value == "sweep")
+      mode = RunMode::SWEEP;
+    else if (value == "unbiased-pulls")
+      mode = RunMode::UNBIASED_PULLS;
+    else if (value == "detector-scan")
+      mode = RunMode::DETECTOR_SCAN;
+    else if (value == "track-finding")
+      mode = RunMode::TRACK_FINDING;
+    else
+      throw invalid_argument("Configuration: unknown mode " + value +
+                             " (simulate, detector-test, reconstruct-only, sweep, unbiased-pulls, detector-scan or track-finding)");
+  } else if (key == "particles") {
+    particlesNumber = toInt(key, value);
+  } else if (key == "threads") {
+    threadsNumber = toInt(key, value);
+  } else if (key == "seed") {
+    seed = toUnsigned(key, value);
+  } else if (key == "output") {
+    if (value == "binary")
+      outputFormat = OutputFormat::BINARY;
+    else if (value == "csv")
+      outputFormat = OutputFormat::CSV;
+    else if (value == "root")
+      outputFormat = OutputFormat::ROOT;
+    else
+      throw invalid_argument("Configuration: unknown output format " + value + " (binary, csv or root)");
+  } else if (key == "chunk") {
+    particlesPerChunk = toInt(key, value);
+  } else if (key == "tested-detector") {
+    testedDetector = toInt(key, value);
+  } else if (key == "masked-detectors") {
+    maskedDetectorsNumber = toInt(key, value);
+  } else if (key == "data-file") {
+    dataFileName = value;
+  } else if (key == "truth-file") {
+    truthFileName = value;
+  } else if (key == "data-cache") {
+    dataCacheDirectory = value;
+  }
+
+  // Experiment
+  else if (key == "detectors") {
+    experiment.detectorsNumber = toInt(key, value);
+  } else if (key == "detector-distance") {
+    experiment.distanceBetweenDetectors = toDouble(key, value);
+  } else if (key == "detector-width") {
+    experiment.detectorWidth = toDouble(key, value);
+  } else if (key == "detector-height") {
+    experiment.detectorHeight = toDouble(key, value);
+  } else if (key == "space-uncertainty") {
+    experiment.detectorSpaceUncertainty = toDouble(key, value);
+  } else if (key == "time-uncertainty") {
+    experiment.detectorTimeUncertainty = toDouble(key, value);
+  } else if (key == "detector-without-time") {
+    experiment.detectorWithoutTime = toInt(key, value);
+  }
+
+  // Tracker
+  else if (key == "kalman-velocity-sigma") {
+    tracker.velocityEvolutionSigma = toDouble(key, value);
+  } else if (key == "kalman-direction-sigma") {
+    tracker.directionEvolutionSigma = toDouble(key, value);
+  } else if (key == "max-step-chi2") {
+    abortPolicy.maxStepChi2 = toDouble(key, value);
+  } else if (key == "max-chi2-ndf") {
+    abortPolicy.maxChi2PerNdf = toDouble(key, value);
+  } else if (key == "sweep-velocity-sigmas") {
+    sweepVelocitySigmas = toDoubles(key, value);
+  } else if (key == "sweep-direction-sigmas") {
+    sweepDirectionSigmas = toDoubles(key, value);
+  } else {
+    throw invalid_argument("Configuration: unknown key " + key);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// validate
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Configuration::validate() const {
+  // NOTE: the number of particles of a data file is that of the file
+  if (particlesNumber <= 0 && !(mode == RunMode::RECONSTRUCT_ONLY && !dataFileName.empty()))
+    throw invalid_argument("Configuration: the number of particles must be positive");
+  if (particlesPerChunk > 0 && mode != RunMode::SIMULATE)
+    throw invalid_argument("Configuration: only the simulation can run in chunks");
+  if (mode == RunMode::DETECTOR_TEST && outputFormat == OutputFormat::ROOT)
+    throw invalid_argument("Configuration: the detector test saves only binary or CSV results");
+  if (mode == RunMode::RECONSTRUCT_ONLY && dataFileName.empty() && dataCacheDirectory.empty())
+    throw invalid_argument("Configuration: the reconstruct-only mode needs a data file or the data cache");
+  if (!truthFileName.empty() && dataFileName.empty())
+    throw invalid_argument("Configuration: a truth file needs its data file");
+
+  // NOTE: the track reconstruction needs at least two measures, with the time measured by the first detector
+  if (experiment.detectorsNumber < 2)
+    throw invalid_argument("Configuration: at least two detectors are needed");
+  if (!(experiment.distanceBetweenDetectors > 0.) || !(experiment.detectorWidth > 0.) || !(experiment.detectorHeight > 0.))
+    throw invalid_argument("Configuration: the distance and the dimensions of the detectors must be positive");
+  if (!(experiment.detectorSpaceUncertainty > 0.) || !(experiment.detectorTimeUncertainty > 0.))
+    throw invalid_argument("Configuration: the uncertainties of the detectors must be positive");
+  if (experiment.detectorWithoutTime == 0)
+    throw invalid_argument("Configuration: the first detector must measure the time");
+  if (experiment.detectorWithoutTime >= experiment.detectorsNumber)
+    throw invalid_argument("Configuration: the detector without time does not exist");
+  if (mode == RunMode::DETECTOR_TEST && (testedDetector < 0 || testedDetector >= experiment.detectorsNumber))
+    throw invalid_argument("Configuration: the tested detector does not exist");
+  if (mode == RunMode::DETECTOR_SCAN && maskedDetectorsNumber != 1 && maskedDetectorsNumber != 2)
+    throw invalid_argument("Configuration: the detector scan masks the detectors one or two at a time");
+
+  if (!(tracker.velocityEvolutionSigma >= 0.) || !(tracker.directionEvolutionSigma >= 0.) || std::isinf(tracker.velocityEvolutionSigma) ||
+      std::isinf(tracker.directionEvolutionSigma))
+    throw invalid_argument("Configuration: the evolution sigmas of the Kalman filter must be finite and non negative");
+  if (!(abortPolicy.maxStepChi2 > 0.) || !(abortPolicy.maxChi2PerNdf > 0.))
+    throw invalid_argument("Configuration: the limits of the chi2 of the Kalman filter must be positive");
+
+  if (mode == RunMode::SWEEP) {
+    if (sweepVelocitySigmas.empty() || sweepDirectionSigmas.empty())
+      throw invalid_argument("Configuration: the sweep needs at least one value of each sigma");
+    for (const vector<double> *sigmas : {&sweepVelocitySigmas, &sweepDirectionSigmas}) {
+      for (double sigma : *sigmas) {
+        if (!(sigma >= 0.) || std::isinf(sigma))
+          throw invalid_argument("Configuration: the sigmas of the sweep must be finite and non negative");
+      }
+    }
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// print
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Configuration::print() const {
+  cout << " Configuration:" << endl;
+  cout << "  mode = " << toString(mode) << endl;
+  cout << "  particles = " << particlesNumber << endl;
+  cout << "  threads = " << threadsNumber << endl;
+  cout << "  seed = " << seed << endl;
+  cout << "  output = " << toString(outputFormat) << endl;
+  cout << "  chunk = " << particlesPerChunk << endl;
+  cout << "  tested-detector = " << testedDetector << endl;
+  cout << "  masked-detectors = " << maskedDetectorsNumber << endl;
+  cout << "  data-file = " << dataFileName << endl;
+  cout << "  truth-file = " << truthFileName << endl;
+  cout << "  data-cache = " << dataCacheDirectory << endl;
+  cout << "  detectors = " << experiment.detectorsNumber << endl;
+  cout << "  detector-distance = " << experiment.distanceBetweenDetectors << endl;
+  cout << "  detector-width = " << experiment.detectorWidth << endl;
+  cout << "  detector-height = " << experiment.detectorHeight << endl;
+  cout << "  space-uncertainty = " << experiment.detectorSpaceUncertainty << endl;
+  cout << "  time-uncertainty = " << experiment.detectorTimeUncertainty << endl;
+  cout << "  detector-without-time = " << experiment.detectorWithoutTime << endl;
+  cout << "  kalman-velocity-sigma = " << tracker.velocityEvolutionSigma << endl;
+  cout << "  kalman-direction-sigma = " << tracker.directionEvolutionSigma << endl;
+  cout << "  max-step-chi2 = " << abortPolicy.maxStepChi2 << endl;
+  cout << "  max-chi2-ndf = " << abortPolicy.maxChi2PerNdf << endl;
+  cout << "  sweep-velocity-sigmas = " << toString(sweepVelocitySigmas) << endl;
+  cout << "  sweep-direction-sigmas = " << toString(sweepDirectionSigmas) << endl;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// printUsage
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Configuration::printUsage(const string &programName) {
+  cout << "Usage: " << programName << " [--config file] [--key value]..." << endl
+       << endl
+       << "The options override the configuration file, which has one \"key = value\" per line." << endl
+       << endl
+       << "Run:" << endl
+       << "  mode                    simulate, detector-test, reconstruct-only, sweep, unbiased-pulls, detector-scan or track-finding" << endl
+       << "                          (default detector-test)" << endl
+       << "  particles               number of particles (default " << NUMBER_OF_PARTICLES << ")" << endl
+       << "  threads                 number of threads, one per hardware thread if not positive (default " << NUMBER_OF_THREADS << ")" << endl
+       << "  seed                    seed of the random numbers (default " << RANDOM_SEED << ")" << endl
+       << "  output                  binary, csv or root (default binary)" << endl
+       << "  chunk                   particles of each chunk of the streaming simulation, all at once if not positive (default 0)" << endl
+       << "  tested-detector         detector masked by the detector test (default " << DETECTOR_WITHOUT_TIME << ")" << endl
+       << "  masked-detectors        detectors masked together by the detector scan, 1 or 2 (default 1)" << endl
+       << "  data-file               measures reconstructed by the reconstruct-only mode, the cached data of the run if empty" << endl
+       << "  truth-file              truth of the measures, by default their .truth sidecar if it exists" << endl
+       << "  data-cache              directory of the cache of the generated data, no cache if empty (default " << DATA_CACHE_DIRECTORY << ")" << endl
+       << endl
+       << "Experiment:" << endl
+       << "  detectors               number of detectors (default " << NUMBER_OF_DETECTORS << ")" << endl
+       << "  detector-distance       distance between the detectors [m] (default " << DISTANCE_BETWEEN_DETECTORS << ")" << endl
+       << "  detector-width          width of the detectors [m] (default " << DETECTOR_DIMENSION_WIDTH << ")" << endl
+       << "  detector-height         height of the detectors [m] (default " << DETECTOR_DIMENSION_HEIGHT << ")" << endl
+       << "  space-uncertainty       space resolution of the detectors [m] (default " << DETECTOR_SPACE_UNCERTAINTY << ")" << endl
+       << "  time-uncertainty        time resolution of the detectors [s] (default " << DETECTOR_TIME_UNCERTAINTY << ")" << endl
+       << "  detector-without-time   detector with a broken clock, none if negative (default " << DETECTOR_WITHOUT_TIME << ")" << endl
+       << endl
+       << "Tracker:" << endl
+       << "  kalman-velocity-sigma   velocity noise of the Kalman filter [m/s] (default " << V_EVOLUTION_SIGMA_KALMAN << ")" << endl
+       << "  kalman-direction-sigma  direction noise of the Kalman filter (default " << DIRECTION_EVOLUTION_SIGMA << ")" << endl
+       << "  max-step-chi2           chi2 of an update beyond which the reconstruction gives a track up (default inf, never)" << endl
+       << "  max-chi2-ndf            chi2/ndf beyond which the reconstruction gives a track up (default inf, never)" << endl
+       << endl
+       << "Sweep (every pair of values is tried on the same particles):" << endl
+       << "  sweep-velocity-sigmas   comma separated velocity noises of the Kalman filter [m/s]" << endl
+       << "  sweep-direction-sigmas  comma separated direction noises of the Kalman filter" << endl;
+}
@@ -0,0 +1,235 @@
+// Header files needed
+#include <TLorentzVector.h>
+#include <TVector3.h>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Custom classes
+#include "DataCache.hpp"
+#include "BinaryResultFile.hpp"
+#include "DataFile.hpp"
+#include "DataGenerator.hpp"
+#include "Detector.hpp"
+#include "MeasuresAndStates.hpp"
+#include "ParticleGun.hpp"
+#include "PhysicalParameters.hpp"
+#include "Utils.hpp"
+
+// Namespaces
+using namespace std;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Global variables
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// NOTE: to be increased whenever the generation changes the data of the same parameters (see DataCache.hpp)
+static constexpr int GENERATED_DATA_VERSION = 2;
+
+// Columns of the truth sidecar: the theoretical and the real states, the detector of the state and the index of its measure
+static const vector<string> TRUTH_COLUMNS = {"the_t", "the_x", "the_y", "the_z", "the_vx", "the_vy", "the_vz",
+                                             "rea_t", "rea_x", "rea_y", "rea_z", "rea_vx", "rea_vy", "rea_vz",
+                                             "detector", "measure"};
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// DataCache (constructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+DataCache::DataCache(const string &directory) : directory(directory) {
+  if (directory.empty())
+    throw std::invalid_argument("DataCache: no directory");
+
+  filesystem::create_directories(directory);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// computeKey
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+string DataCache::computeKey(const DataGenerator &dataGenerator, int particlesNumber, bool useMultipleScattering) {
+  const SimulationSetup &setup = dataGenerator.getSimulationSetup();
+
+  // Description of everything the data depend on, with all the digits of the doubles
+  ostringstream description;
+  description << setprecision(17);
+  description << "version " << GENERATED_DATA_VERSION << "\nseed " << dataGenerator.getSeed() << "\nparticles " << particlesNumber
+              << "\nmultiple scattering " << useMultipleScattering << "\n";
+
+  // NOTE: the ids of the detectors are not included, since they depend on the detectors created before
+  for (const Detector &detector : setup.detectors) {
+    const TVector3 position = detector.getBottmLeftPosition();
+    description << "detector " << position.X() << " " << position.Y() << " " << position.Z() << " "
+                << detector.getWidth() << " " << detector.getHeight() << " " << detector.getSpaceUncertainty() << " "
+                << detector.getTimeUncertainty() << " " << detector.isTimeMeasured() << "\n";
+  }
+
+  const ParticleGun &particleGun = setup.particleGun;
+  const TVector3 gunPosition = particleGun.getPosition();
+  description << "gun " << gunPosition.X() << " " << gunPosition.Y() << " " << gunPosition.Z() << " " << particleGun.getTimeOfEmission()
+              << " " << particleGun.getTimeBetweenParticles() << " " << particleGun.getMaxColatitude() << "\n";
+
+  description << "physics " << MIN_PARTICLE_MASS << " " << MAX_PARTICLE_MASS << " " << MIN_BETA << " " << MAX_BETA << " "
+              << TIME_EVOLUTION_SIGMA << " " << SPACE_EVOLUTION_SIGMA << " " << VELOCITY_EVOLUTION_SIGMA << " "
+              << DIRECTION_EVOLUTION_SIGMA << " " << LIGHT_SPEED << "\n";
+
+  // 64 bit FNV-1a hash of the description
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char character : description.str()) {
+    hash ^= (unsigned char)character;
+    hash *= 1099511628211ULL;
+  }
+
+  ostringstream key;
+  key << hex << setw(16) << setfill('0') << hash;
+  return key.str();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// contains
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+bool DataCache::contains(const string &key) const {
+  return filesystem::exists(getTruthFileName(key)) && filesystem::exists(getMeasuresFileName(key));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// store
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void DataCache::store(const string &key, const GeneratedData &generatedData) const {
+  // NOTE: the sidecar is renamed only once both files are complete, so that an interrupted run leaves no entry
+  const string temporaryTruthFileName = getTruthFileName(key) + ".tmp";
+  saveData(getMeasuresFileName(key), temporaryTruthFileName, generatedData);
+  filesystem::rename(temporaryTruthFileName, getTruthFileName(key));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// saveData
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void DataCache::saveData(const string &measuresFileName, const string &truthFileName, const GeneratedData &generatedData) {
+  const vector<vector<ParticleState>> &allTheoreticalStates = generatedData.allParticlesTheoreticalStates;
+  const vector<vector<ParticleState>> &allRealStates = generatedData.allParticlesRealStates;
+  const vector<vector<Measurement>> &allMeasures = generatedData.allParticlesMeasures;
+  const int particlesNumber = (int)allMeasures.size();
+  if ((int)allTheoreticalStates.size() != particlesNumber || (int)allRealStates.size() != particlesNumber)
+    throw std::invalid_argument("DataCache::saveData: vectors of different size");
+
+  // Measures
+  {
+    DataFile dataFile(measuresFileName.c_str(), "DataTree", false);
+    dataFile.SaveMultipleMeasures(Utils::concatenateMeasures(allMeasures));
+  }
+
+  // Truth sidecar
+  uint64_t rowsNumber = 0;
+  for (const vector<ParticleState> &states : allRealStates)
+    rowsNumber += states.size();
+
+  BinaryResultFile truthFile(truthFileName, TRUTH_COLUMNS, particlesNumber, rowsNumber);
+  vector<double> rows;
+  double measureIndex = 0;
+  for (int j = 0; j < particlesNumber; j++) {
+    const vector<ParticleState> &theoreticalStates = allTheoreticalStates[j];
+    const vector<ParticleState> &realStates = allRealStates[j];
+    if (theoreticalStates.size() != realStates.size())
+      throw std::invalid_argument("DataCache::saveData: particle " + to_string(j) + " with states of different size");
+
+    // NOTE: the measures of a particle are those of its first states on a detector, in the same order
+    rows.clear();
+    int measuresLeft = (int)allMeasures[j].size();
+    for (int i = 0; i < (int)realStates.size(); i++) {
+      for (const ParticleState *state : {&theoreticalStates[i], &realStates[i]}) {
+        rows.insert(rows.end(), {state->position.T(), state->position.X(), state->position.Y(), state->position.Z(), state->velocity.X(),
+                                 state->velocity.Y(), state->velocity.Z()});
+      }
+
+      const bool measured = realStates[i].detectorID && measuresLeft > 0;
+      rows.push_back(realStates[i].detectorID ? realStates[i].detectorID.value() : -1.);
+      rows.push_back(measured ? measureIndex : -1.);
+      if (measured) {
+        measureIndex++;
+        measuresLeft--;
+      }
+    }
+    if (measuresLeft > 0)
+      throw std::invalid_argument("DataCache::saveData: particle " + to_string(j) + " with more measures than detectors");
+
+    truthFile.addParticle(rows);
+  }
+
+  truthFile.close();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// loadData
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+GeneratedData DataCache::loadData(const string &measuresFileName, const string &truthFileName, vector<Measurement> &allMeasures) {
+  {
+    DataFile dataFile(measuresFileName.c_str(), "DataTree", true);
+    allMeasures = dataFile.readMeasures();
+  }
+  const BinaryResultData truth = BinaryResultFile::read(truthFileName);
+
+  // Columns of the states, in the order of TRUTH_COLUMNS
+  vector<const vector<double> *> columns;
+  for (const string &name : TRUTH_COLUMNS)
+    columns.push_back(&truth.getColumn(name));
+
+  auto getState = [&](int firstColumn, uint64_t row, optional<int> detectorID) {
+    const TLorentzVector position((*columns[firstColumn + 1])[row], (*columns[firstColumn + 2])[row], (*columns[firstColumn + 3])[row],
+                                  (*columns[firstColumn])[row]);
+    const TVector3 velocity((*columns[firstColumn + 4])[row], (*columns[firstColumn + 5])[row], (*columns[firstColumn + 6])[row]);
+    return ParticleState{position, velocity, detectorID};
+  };
+
+  const int particlesNumber = (int)truth.offsets.size() - 1;
+  GeneratedData generatedData;
+  generatedData.allParticlesTheoreticalStates.resize(particlesNumber);
+  generatedData.allParticlesRealStates.resize(particlesNumber);
+  generatedData.allParticlesMeasures.resize(particlesNumber);
+
+  const vector<double> &detectors = *columns[14];
+  const vector<double> &measures = *columns[15];
+  size_t measuresNumber = 0;
+  for (int j = 0; j < particlesNumber; j++) {
+    for (uint64_t row = truth.offsets[j]; row < truth.offsets[j + 1]; row++) {
+      const optional<int> detectorID = detectors[row] >= 0 ? optional<int>((int)detectors[row]) : nullopt;
+      generatedData.allParticlesTheoreticalStates[j].push_back(getState(0, row, detectorID));
+      generatedData.allParticlesRealStates[j].push_back(getState(7, row, detectorID));
+
+      if (measures[row] >= 0) {
+        if (measures[row] >= (double)allMeasures.size())
+          throw std::invalid_argument("DataCache::loadData: " + truthFileName + " is not the truth of " + measuresFileName);
+        generatedData.allParticlesMeasures[j].push_back(allMeasures[(size_t)measures[row]]);
+        measuresNumber++;
+      }
+    }
+  }
+  if (measuresNumber != allMeasures.size())
+    throw std::invalid_argument("DataCache::loadData: " + truthFileName + " is not the truth of " + measuresFileName);
+
+  return generatedData;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// getTruthFileNameOf
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+string DataCache::getTruthFileNameOf(const string &measuresFileName) {
+  return filesystem::path(measuresFileName).replace_extension(".truth").string();
+}
@@ -1,33 +1,61 @@
 #include "DataFile.hpp"
+#include "Profiler.hpp"
 
+#include <TBranch.h>
 #include <TFile.h>
 #include <TTree.h>
+#include <algorithm>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 DataFile::DataFile(const char *fileName, const char *treeName, bool exists)
     : tBuffer(0), xBuffer(0), yBuffer(0), idBuffer(1), treeName(treeName),
       writable(!exists) {
   rootFile = exists ? TFile::Open(fileName) : TFile::Open(fileName, "RECREATE");
+  if (!rootFile || rootFile->IsZombie()) {
+    delete rootFile;
+    throw std::invalid_argument("DataFile: cannot open " + std::string(fileName));
+  }
+
   dataTree =
       exists ? rootFile->Get<TTree>(treeName) : new TTree(treeName, treeName);
+  if (!dataTree) {
+    delete rootFile;
+    throw std::invalid_argument("DataFile: no tree " + std::string(treeName) + " in " + std::string(fileName));
+  }
   if (exists) {
     dataTree->SetBranchAddress("t", &tBuffer);
     dataTree->SetBranchAddress("x", &xBuffer);
     dataTree->SetBranchAddress("y", &yBuffer);
     dataTree->SetBranchAddress("id", &idBuffer);
+    tBranch = dataTree->GetBranch("t");
+    xBranch = dataTree->GetBranch("x");
+    yBranch = dataTree->GetBranch("y");
+    idBranch = dataTree->GetBranch("id");
+
+    // NOTE: the cache prefetches whole clusters of all the branches and decompresses the baskets in parallel
+    dataTree->SetParallelUnzip(true);
+    dataTree->SetCacheSize(DATA_FILE_CACHE_SIZE);
+    dataTree->AddBranchToCache("*", true);
+    dataTree->StopCacheLearningPhase();
+    dataTree->SetClusterPrefetch(true);
   } else {
-    dataTree->Branch("t", &tBuffer);
-    dataTree->Branch("x", &xBuffer);
-    dataTree->Branch("y", &yBuffer);
-    dataTree->Branch("id", &idBuffer);
+    tBranch = dataTree->Branch("t", &tBuffer);
+    xBranch = dataTree->Branch("x", &xBuffer);
+    yBranch = dataTree->Branch("y", &yBuffer);
+    idBranch = dataTree->Branch("id", &idBuffer);
   }
 }
 
 DataFile::~DataFile() {
+  PROFILE_SCOPE("DataFile: closing");
+
   if (writable)
     rootFile->WriteObject(dataTree, treeName);
   rootFile->Close();
+  PROFILE_COUNT("DataFile: bytes written", rootFile->GetBytesWritten());
+  PROFILE_COUNT("DataFile: bytes read", rootFile->GetBytesRead());
   delete rootFile;
   /* NOTE: There is a memory leak here since I don't delete the TTree, however i
    * get an error if I do. Since there is only one instance, and it gets cleared
@@ -38,6 +66,7 @@ DataFile::~DataFile() {
 void DataFile::SaveSingleMeasure(Measurement measure) {
   if (!writable)
     throw std::invalid_argument("You cannot write data to a readonly file");
+  PROFILE_COUNT("DataFile: measures written", 1);
   tBuffer = measure.t;
   xBuffer = measure.x;
   yBuffer = measure.y;
@@ -48,6 +77,8 @@ void DataFile::SaveSingleMeasure(Measurement measure) {
 void DataFile::SaveMultipleMeasures(const std::vector<Measurement> &measures) {
   if (!writable)
     throw std::invalid_argument("You cannot write data to a readonly file");
+  PROFILE_SCOPE("DataFile::SaveMultipleMeasures");
+  PROFILE_COUNT("DataFile: measures written", measures.size());
   for (const Measurement measure : measures) {
     tBuffer = measure.t;
     xBuffer = measure.x;
@@ -57,13 +88,53 @@ void DataFile::SaveMultipleMeasures(const std::vector<Measurement> &measures) {
   }
 }
 
-std::vector<Measurement> DataFile::readMeasures() {
+std::vector<Measurement> DataFile::readMeasures(Long64_t entriesPerChunk) {
   std::vector<Measurement> measures;
-  for (int iEntry = 0; dataTree->LoadTree(iEntry) >= 0; ++iEntry) {
-    dataTree->GetEntry(iEntry);
+  measures.reserve(getEntriesNumber());
+  for (const MeasuresColumns &columns : readMeasuresChunks(entriesPerChunk))
+    for (std::size_t i = 0; i < columns.size(); i++)
+      measures.push_back(columns.getMeasure(i));
+  return measures;
+}
+
+MeasuresColumns DataFile::readMeasuresColumns(Long64_t firstEntry, Long64_t entriesNumber) {
+  PROFILE_SCOPE("DataFile::readMeasuresColumns");
+
+  const Long64_t totalEntries = dataTree->GetEntries();
+  if (firstEntry < 0 || firstEntry > totalEntries)
+    throw std::invalid_argument("DataFile::readMeasuresColumns: first entry out of range");
+  const Long64_t lastEntry = entriesNumber < 0 ? totalEntries : std::min(totalEntries, firstEntry + entriesNumber);
 
-    // measures.push_back(Measurement{t, x, y, id});
-    measures.push_back(Measurement{tBuffer, xBuffer, yBuffer, idBuffer});
+  MeasuresColumns columns;
+  columns.firstEntry = firstEntry;
+  columns.t.reserve(lastEntry - firstEntry);
+  columns.x.reserve(lastEntry - firstEntry);
+  columns.y.reserve(lastEntry - firstEntry);
+  columns.id.reserve(lastEntry - firstEntry);
+
+  // NOTE: only the branches are read, skipping the bookkeeping of TTree::GetEntry for each entry
+  if (!writable)
+    dataTree->SetCacheEntryRange(firstEntry, lastEntry);
+  for (Long64_t entry = firstEntry; entry < lastEntry; entry++) {
+    const Long64_t localEntry = dataTree->LoadTree(entry);
+    tBranch->GetEntry(localEntry);
+    xBranch->GetEntry(localEntry);
+    yBranch->GetEntry(localEntry);
+    idBranch->GetEntry(localEntry);
+
+    columns.t.push_back(tBuffer);
+    columns.x.push_back(xBuffer);
+    columns.y.push_back(yBuffer);
+    columns.id.push_back(idBuffer);
   }
-  return measures;
+
+  PROFILE_COUNT("DataFile: measures read", lastEntry - firstEntry);
+
+  return columns;
+}
+
+MeasuresChunks DataFile::readMeasuresChunks(Long64_t entriesPerChunk) {
+  if (entriesPerChunk <= 0)
+    throw std::invalid_argument("DataFile::readMeasuresChunks: the chunks must have a positive number of entries");
+  return MeasuresChunks(this, entriesPerChunk);
 }
@@ -1,11 +1,14 @@
 // Header files needed
 #include <iomanip>
+#include <string>
 #include <vector>
 
 // Custom classes
 #include "DataGenerator.hpp"
 #include "PhysicalParameters.hpp"
 #include "MeasuresAndStates.hpp"
+#include "Profiler.hpp"
+#include "Utils.hpp"
 
 // Namespaces
 using namespace std;
@@ -15,7 +18,16 @@ using namespace std;
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // generateParticleStates
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-vector<ParticleState> DataGenerator::generateParticleStates(Particle particle, bool multipleScattering) const {
+vector<ParticleState> DataGenerator::generateParticleStates(Particle particle, int particleIndex, bool multipleScattering) const {
+  // Random numbers of the multiple scattering of the particle, all drawn at once
+  const int detectorsNumber = (int)simulationSetup.detectors.size();
+  vector<double> gaussians;
+  if (multipleScattering) {
+    RandomGenerator randomGenerator(seed, particleIndex, RandomStream::EVOLUTION);
+    gaussians.resize(detectorsNumber * EVOLUTION_GAUSSIANS_NUMBER);
+    randomGenerator.fillGaussian(gaussians.data(), gaussians.size());
+  }
+
   // Vector of the state of the particle on the particle gun and the detectors
   vector<ParticleState> particleStates;
   particleStates.reserve(simulationSetup.detectors.size() + 1);
@@ -24,8 +36,10 @@ vector<ParticleState> DataGenerator::generateParticleStates(Particle particle, b
   particleStates.push_back(particle.getInitialState());
 
   // For each detector, propagate the particle
-  for (const Detector &detector : simulationSetup.detectors) {
-    const ParticleState newState = particle.zSpaceEvolve(particleStates.back(), detector.getBottmLeftPosition().z(), multipleScattering, detector.getId());
+  for (int i = 0; i < detectorsNumber; i++) {
+    const Detector &detector = simulationSetup.detectors[i];
+    const double *stepGaussians = multipleScattering ? gaussians.data() + i * EVOLUTION_GAUSSIANS_NUMBER : nullptr;
+    const ParticleState newState = particle.zSpaceEvolve(particleStates.back(), detector.getBottmLeftPosition().z(), stepGaussians, detector.getId());
     particleStates.push_back(newState);
   }
 
@@ -38,7 +52,14 @@ vector<ParticleState> DataGenerator::generateParticleStates(Particle particle, b
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // generateParticleMeasures
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-vector<Measurement> DataGenerator::generateParticleMeasures(vector<ParticleState> &particleStates) const {
+vector<Measurement> DataGenerator::generateParticleMeasures(vector<ParticleState> &particleStates, int particleIndex) const {
+  // Random numbers of the smearing of the measures of the particle, all drawn at once
+  // NOTE: the numbers of each measure are the same as if they were drawn one measure at a time
+  RandomGenerator randomGenerator(seed, particleIndex, RandomStream::MEASURE);
+  vector<double> gaussians(simulationSetup.detectors.size() * MEASURE_GAUSSIANS_NUMBER);
+  randomGenerator.fillGaussian(gaussians.data(), gaussians.size());
+  const double *measureGaussians = gaussians.data();
+
   // Vector of the measurements of the particle on the detectors
   vector<Measurement> measureVector;
   measureVector.reserve(simulationSetup.detectors.size());
@@ -50,13 +71,14 @@ vector<Measurement> DataGenerator::generateParticleMeasures(vector<ParticleState
       continue;
 
     // Simulate the measurement
-    std::optional<Measurement> measure = simulationSetup.detectors[state.detectorID.value()].measure(state);
+    std::optional<Measurement> measure = simulationSetup.detectors[state.detectorID.value()].measure(state.position, measureGaussians);
+    measureGaussians += MEASURE_GAUSSIANS_NUMBER;
 
     // If measurement exits the detector, print out
     if (!measure) {
       if (LOGS){
         const int id = state.detectorID.value();
-        cout << "Particle went out of detector line at detector " << id + 1 << " (id = " << id << ")" << endl;
+        Utils::printLog("Particle went out of detector line at detector " + to_string(id + 1) + " (id = " + to_string(id) + ")\n");
       }
 
       break;
@@ -72,31 +94,52 @@ vector<Measurement> DataGenerator::generateParticleMeasures(vector<ParticleState
 
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// generateAllData
+// generateParticlesData
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-GeneratedData DataGenerator::generateAllData(int particlesNumber, bool enableLogging, bool useMultipleScattering) {
+GeneratedData DataGenerator::generateParticlesData(int firstParticleIndex, int particlesNumber, bool useMultipleScattering, ThreadPool *threadPool) const {
+  PROFILE_SCOPE("DataGenerator::generateParticlesData");
+
   // Vectors to store the states, measurements, and theoretical states of the particles
-  vector<vector<ParticleState>> allParticlesTheoreticalStates;
-  allParticlesTheoreticalStates.reserve(particlesNumber);
-  vector<vector<ParticleState>> allParticlesRealStates;
-  allParticlesRealStates.reserve(particlesNumber);
-  vector<vector<Measurement>> allParticlesMeasures;
-  allParticlesMeasures.reserve(particlesNumber);
-
-  // For each particle, generate and store the data
-  for (int i = 0; i < particlesNumber; i++) {
-    Particle particle = generateParticle();
-
-    vector<ParticleState> theoreticalParticleStates = generateParticleStates(particle, false);
-    vector<ParticleState> realParticleStates = generateParticleStates(particle, useMultipleScattering);
-    vector<Measurement> particleMeasures = generateParticleMeasures(realParticleStates);
-
-    allParticlesTheoreticalStates.push_back(theoreticalParticleStates);
-    allParticlesRealStates.push_back(realParticleStates);
-    allParticlesMeasures.push_back(particleMeasures);
-  }
+  // NOTE: they are preallocated, so that every particle is written into its own slot whatever thread generates it
+  GeneratedData results;
+  results.allParticlesTheoreticalStates.resize(particlesNumber);
+  results.allParticlesRealStates.resize(particlesNumber);
+  results.allParticlesMeasures.resize(particlesNumber);
+
+  // Generation of the particles in the range [begin, end)
+  auto generateParticles = [&](int begin, int end) {
+    PROFILE_SCOPE("DataGenerator: particles generation");
+
+    for (int i = begin; i < end; i++) {
+      const int particleIndex = firstParticleIndex + i;
+      Particle particle = generateParticle(particleIndex);
+
+      results.allParticlesTheoreticalStates[i] = generateParticleStates(particle, particleIndex, false);
+      results.allParticlesRealStates[i] = generateParticleStates(particle, particleIndex, useMultipleScattering);
+      results.allParticlesMeasures[i] = generateParticleMeasures(results.allParticlesRealStates[i], particleIndex);
+      PROFILE_COUNT("DataGenerator: hits generated", results.allParticlesMeasures[i].size());
+    }
+
+    PROFILE_COUNT("DataGenerator: particles generated", end - begin);
+  };
+
+  constexpr int particlesPerTask = 1024;
+  if (threadPool != nullptr)
+    threadPool->parallelFor(particlesNumber, particlesPerTask, generateParticles);
+  else
+    generateParticles(0, particlesNumber);
+
+  return results;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// generateAllData
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+GeneratedData DataGenerator::generateAllData(int particlesNumber, bool enableLogging, bool useMultipleScattering, ThreadPool *threadPool) const {
+  GeneratedData results = generateParticlesData(0, particlesNumber, useMultipleScattering, threadPool);
 
-  const GeneratedData results{allParticlesTheoreticalStates, allParticlesRealStates, allParticlesMeasures};
   if (enableLogging)
     logData(results);
 
@@ -23,8 +23,9 @@ int Detector::counter = 0;
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // Detector (constructor)
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-Detector::Detector(double zPosition, double width, double height)
-    : id{counter}, width{width}, height{height}, bottomLeftPosition{-width / 2., -height / 2., zPosition} {
+Detector::Detector(double zPosition, double width, double height, double spaceUncertainty, double timeUncertainty)
+    : id{counter}, width{width}, height{height}, bottomLeftPosition{-width / 2., -height / 2., zPosition}, spaceUncertainty{spaceUncertainty},
+      timeUncertainty{timeUncertainty} {
   counter++;
 }
 
@@ -33,7 +34,18 @@ Detector::Detector(double zPosition, double width, double height)
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // Measure - from TLotentzVector
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-std::optional<Measurement> Detector::measure(TLorentzVector particlePosition) const {
+std::optional<Measurement> Detector::measure(TLorentzVector particlePosition, RandomGenerator &randomGenerator) const {
+  double gaussians[MEASURE_GAUSSIANS_NUMBER];
+  randomGenerator.fillGaussian(gaussians, MEASURE_GAUSSIANS_NUMBER);
+  return measure(particlePosition, gaussians);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Measure - from TLotentzVector, with the random numbers already drawn
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::optional<Measurement> Detector::measure(TLorentzVector particlePosition, const double *gaussians) const {
   // Measurement of the generated particle to be measured
   const double x = particlePosition.X();
   const double y = particlePosition.Y();
@@ -45,12 +57,11 @@ std::optional<Measurement> Detector::measure(TLorentzVector particlePosition) co
   const bool zConstrain = deltaZ == 0;
 
   // Gaussian smearing based on detector uncertainty
-  RandomGenerator &randomGenerator = RandomGenerator::getInstance();
-  double measuredT = randomGenerator.generateGaussian(particlePosition.T(), DETECTOR_TIME_UNCERTAINTY);
-  const double measuredX = randomGenerator.generateGaussian(x, DETECTOR_SPACE_UNCERTAINTY);
-  const double measuredY = randomGenerator.generateGaussian(y, DETECTOR_SPACE_UNCERTAINTY);
+  double measuredT = particlePosition.T() + timeUncertainty * gaussians[0];
+  const double measuredX = x + spaceUncertainty * gaussians[1];
+  const double measuredY = y + spaceUncertainty * gaussians[2];
 
-  if(id == 5){
+  if (!timeMeasured) {
     measuredT = 0.0;
   }
 
@@ -63,7 +74,7 @@ std::optional<Measurement> Detector::measure(TLorentzVector particlePosition) co
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // Measure - from TMatrixD
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-std::optional<Measurement> Detector::measure(TMatrixD particleState) const {
+std::optional<Measurement> Detector::measure(TMatrixD particleState, RandomGenerator &randomGenerator) const {
   // Measurement of the generated particle to be measured
   const double t = particleState(0, 0);
   const double x = particleState(1, 0);
@@ -73,7 +84,7 @@ std::optional<Measurement> Detector::measure(TMatrixD particleState) const {
   const TLorentzVector particlePosition{x, y, this->bottomLeftPosition.z(), t};
 
   // Calling the other "measure" function to get the measurement
-  return measure(particlePosition);
+  return measure(particlePosition, randomGenerator);
 }
 
 
@@ -81,9 +92,9 @@ std::optional<Measurement> Detector::measure(TMatrixD particleState) const {
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // Measure - from ParticleState
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-std::optional<Measurement> Detector::measure(ParticleState particleState) const {
+std::optional<Measurement> Detector::measure(ParticleState particleState, RandomGenerator &randomGenerator) const {
   // Calling the other "measure" function to get the measurement
-  return measure(particleState.position);
+  return measure(particleState.position, randomGenerator);
 }
 
 
@@ -91,15 +102,15 @@ std::optional<Measurement> Detector::measure(ParticleState particleState) const
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // getMeasureUncertainty
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-TMatrixD Detector::getMeasureUncertainty() const {
+MeasureCovariance Detector::getMeasureUncertainty() const {
   // Vector with evaluated uncertainties
-  double sdata[36] = {
-      DETECTOR_TIME_UNCERTAINTY * DETECTOR_TIME_UNCERTAINTY,   0., 0.,
-      0., DETECTOR_SPACE_UNCERTAINTY * DETECTOR_SPACE_UNCERTAINTY, 0.,
-      0., 0., DETECTOR_SPACE_UNCERTAINTY * DETECTOR_SPACE_UNCERTAINTY};
+  double sdata[9] = {
+      timeUncertainty * timeUncertainty,   0., 0.,
+      0., spaceUncertainty * spaceUncertainty, 0.,
+      0., 0., spaceUncertainty * spaceUncertainty};
 
-  // Creating the TMatrixD object
-  TMatrixD uncertainty(3, 3, sdata);
+  // Creating the covariance matrix
+  const MeasureCovariance uncertainty(sdata);
 
   // Returning the uncertainty matrix
   return uncertainty;
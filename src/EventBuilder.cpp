@@ -0,0 +1,478 @@
+// Header files needed
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+// Custom classes
+#include "EventBuilder.hpp"
+#include "Detector.hpp"
+#include "HitIndex.hpp"
+#include "MeasuresAndStates.hpp"
+#include "PhysicalParameters.hpp"
+#include "Profiler.hpp"
+#include "ThreadPool.hpp"
+
+// Namespaces
+using namespace std;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Local helpers
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+namespace {
+// Placeholder of the measures on the detectors without time, until they are associated
+constexpr int MISSING_MEASURE = -1;
+
+// Bits of the digits of the radix sort
+constexpr int RADIX_BITS = 8;
+constexpr int RADIX_BUCKETS = 1 << RADIX_BITS;
+
+// Minimum number of measures sorted by each task of the radix sort
+constexpr int RADIX_MIN_TASK_SIZE = 1 << 14;
+
+// Map a double to an unsigned integer with the same ordering
+uint64_t timeKey(double time) {
+  uint64_t bits;
+  memcpy(&bits, &time, sizeof(bits));
+  return (bits & (1ULL << 63)) ? ~bits : bits | (1ULL << 63);
+}
+
+// Position expected on a detector from two measures of the same particle, and its uncertainty
+struct PredictedPosition {
+  double x;
+  double y;
+  double sigma;
+};
+
+PredictedPosition predictPosition(const Measurement &first, double firstZ, double firstSigma, const Measurement &second,
+                                  double secondZ, double secondSigma, double z) {
+  const double ratio = (z - secondZ) / (secondZ - firstZ);
+  const double scatteringSigma = DIRECTION_EVOLUTION_SIGMA * min(fabs(z - secondZ), fabs(z - firstZ));
+
+  const double sigma2 = pow((1. + ratio) * secondSigma, 2) + pow(ratio * firstSigma, 2) + pow(scatteringSigma, 2);
+
+  return PredictedPosition{second.x + ratio * (second.x - first.x), second.y + ratio * (second.y - first.y), sqrt(sigma2)};
+}
+
+// A measure searched on a detector without time, and the measures of that detector found near the expected position
+struct UntimedSearch {
+  int event;
+  int layer;
+  PredictedPosition expected;
+};
+
+struct UntimedCandidate {
+  double distance2;
+  int search;
+  int measure;
+};
+
+} // namespace
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// EventBuilder (constructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+EventBuilder::EventBuilder(const vector<Detector> &detectors, TVector3 originPosition)
+    : originPosition(originPosition), emptyHitIndex(detectors) {
+  if (detectors.empty())
+    throw invalid_argument("EventBuilder: no detector");
+  if (!detectors[0].isTimeMeasured())
+    throw invalid_argument("EventBuilder: the first detector must measure the time");
+
+  double maxTimeWindow = 0.;
+
+  for (int i = 0; i < (int)detectors.size(); i++) {
+    const Detector &detector = detectors[i];
+    const MeasureCovariance uncertainty = detector.getMeasureUncertainty();
+
+    layersZ.push_back(detector.getBottmLeftPosition().Z());
+    layersTimeMeasured.push_back(detector.isTimeMeasured());
+    layersTimeSigma.push_back(sqrt(uncertainty(0, 0)));
+    layersSpaceSigma.push_back(sqrt(uncertainty(1, 1)));
+
+    maxTimeWindow = max(maxTimeWindow, EVENT_WINDOW_SIGMAS * sqrt(2.) * layersTimeSigma.back());
+  }
+
+  // The time of flight of the slowest particle, plus the tolerance of each step from a detector to the next
+  timeOfFlightWindow = (layersZ.back() - layersZ.front()) / EVENT_MIN_SPEED + (detectors.size() - 1) * maxTimeWindow;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// sortByTime
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void EventBuilder::sortByTime(vector<Measurement> &measures, ThreadPool *threadPool) {
+  const int measuresNumber = (int)measures.size();
+  if (measuresNumber < 2)
+    return;
+
+  // NOTE: the keys are sorted together with the position of their measure, then the measures are moved only once
+  vector<uint64_t> keys(measuresNumber), keysBuffer(measuresNumber);
+  vector<int> order(measuresNumber), orderBuffer(measuresNumber);
+  for (int i = 0; i < measuresNumber; i++) {
+    keys[i] = timeKey(measures[i].t);
+    order[i] = i;
+  }
+
+  const int threadsNumber = threadPool ? threadPool->getThreadsNumber() : 1;
+  const int tasksNumber = max(1, min(threadsNumber, measuresNumber / RADIX_MIN_TASK_SIZE));
+  const int taskSize = (measuresNumber + tasksNumber - 1) / tasksNumber;
+
+  const auto runTasks = [&](const function<void(int, int)> &task) {
+    if (threadPool && tasksNumber > 1)
+      threadPool->parallelFor(tasksNumber, 1, task);
+    else
+      task(0, tasksNumber);
+  };
+
+  vector<array<int, RADIX_BUCKETS>> taskOffsets(tasksNumber);
+
+  for (int shift = 0; shift < 64; shift += RADIX_BITS) {
+    // Histogram of the digits of each task
+    runTasks([&](int firstTask, int lastTask) {
+      for (int task = firstTask; task < lastTask; task++) {
+        array<int, RADIX_BUCKETS> &counts = taskOffsets[task];
+        counts.fill(0);
+        for (int i = task * taskSize; i < min(measuresNumber, (task + 1) * taskSize); i++)
+          counts[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+      }
+    });
+
+    // Starting position of each digit of each task (digit major, task minor, to keep the sort stable)
+    int offset = 0;
+    bool singleDigit = false;
+    for (int digit = 0; digit < RADIX_BUCKETS; digit++) {
+      int digitCount = 0;
+      for (int task = 0; task < tasksNumber; task++) {
+        const int count = taskOffsets[task][digit];
+        taskOffsets[task][digit] = offset;
+        offset += count;
+        digitCount += count;
+      }
+      singleDigit = singleDigit || digitCount == measuresNumber;
+    }
+
+    // All the keys have the same digit, the pass would not change the order
+    if (singleDigit)
+      continue;
+
+    runTasks([&](int firstTask, int lastTask) {
+      for (int task = firstTask; task < lastTask; task++) {
+        array<int, RADIX_BUCKETS> &offsets = taskOffsets[task];
+        for (int i = task * taskSize; i < min(measuresNumber, (task + 1) * taskSize); i++) {
+          const int position = offsets[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+          keysBuffer[position] = keys[i];
+          orderBuffer[position] = order[i];
+        }
+      }
+    });
+
+    keys.swap(keysBuffer);
+    order.swap(orderBuffer);
+  }
+
+  vector<Measurement> sortedMeasures(measuresNumber);
+  for (int i = 0; i < measuresNumber; i++)
+    sortedMeasures[i] = measures[order[i]];
+
+  measures.swap(sortedMeasures);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// buildEvents
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<vector<Measurement>> EventBuilder::buildEvents(vector<Measurement> measures, ThreadPool *threadPool) const {
+  return buildEvents(move(measures), -INFINITY, INFINITY, threadPool);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// buildEvents
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<vector<Measurement>> EventBuilder::buildEvents(vector<Measurement> measures, double seedsBegin, double seedsEnd,
+                                                      ThreadPool *threadPool) const {
+  PROFILE_SCOPE("EventBuilder::buildEvents");
+
+  if (measures.empty())
+    throw invalid_argument("EventBuilder::buildEvents: no measures given");
+
+  // The measures without time cannot be ordered, they are associated afterwards by position
+  vector<Measurement> untimedMeasures;
+  const auto timedEnd = stable_partition(measures.begin(), measures.end(),
+                                         [this](const Measurement &measure) { return layersTimeMeasured[emptyHitIndex.getLayerIndex(measure)]; });
+  untimedMeasures.assign(timedEnd, measures.end());
+  measures.erase(timedEnd, measures.end());
+
+  sortByTime(measures, threadPool);
+
+  // NOTE: each slice builds the particles starting in its time interval, taking also the measures up to a time of flight
+  // later. It also rebuilds the particles starting a time of flight earlier, which belong to the preavious slice, so
+  // that the measures they take are not given to the particles of the slice
+  vector<vector<vector<Measurement>>> slicesEvents;
+  const double firstTime = measures.empty() ? INFINITY : max(seedsBegin, measures.front().t);
+  const double lastTime = measures.empty() ? -INFINITY : min(seedsEnd, measures.back().t);
+  if (firstTime <= lastTime) {
+    const int slicesNumber = (int)((lastTime - firstTime) / EVENT_SLICE_DURATION) + 1;
+    slicesEvents.resize(slicesNumber);
+
+    const auto buildSlices = [&](int begin, int end) {
+      for (int slice = begin; slice < end; slice++) {
+        const double sliceBegin = firstTime + slice * EVENT_SLICE_DURATION;
+        const double sliceEnd = slice == slicesNumber - 1 ? seedsEnd : sliceBegin + EVENT_SLICE_DURATION;
+        slicesEvents[slice] = buildSliceEvents(measures, sliceBegin, sliceEnd);
+      }
+    };
+
+    if (threadPool)
+      threadPool->parallelFor(slicesNumber, 1, buildSlices);
+    else
+      buildSlices(0, slicesNumber);
+  }
+
+  vector<vector<Measurement>> events;
+  for (vector<vector<Measurement>> &sliceEvents : slicesEvents)
+    for (vector<Measurement> &event : sliceEvents)
+      events.push_back(move(event));
+
+  addUntimedMeasures(events, untimedMeasures);
+
+  return events;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// selectTimedMeasures
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<Measurement> EventBuilder::selectTimedMeasures(const vector<Measurement> &measures, double begin, double end) const {
+  vector<Measurement> selectedMeasures;
+  copy_if(measures.begin(), measures.end(), back_inserter(selectedMeasures), [&](const Measurement &measure) {
+    return layersTimeMeasured[emptyHitIndex.getLayerIndex(measure)] && measure.t >= begin && measure.t < end;
+  });
+  return selectedMeasures;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// buildSliceEvents
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<vector<Measurement>> EventBuilder::buildSliceEvents(const vector<Measurement> &sortedMeasures, double sliceBegin,
+                                                           double sliceEnd) const {
+  const int layersNumber = (int)layersZ.size();
+  const auto isBefore = [](const Measurement &measure, double time) { return measure.t < time; };
+  const auto firstAfter = [&](double time) {
+    return (int)(lower_bound(sortedMeasures.begin(), sortedMeasures.end(), time, isBefore) - sortedMeasures.begin());
+  };
+
+  // Measures of the slice
+  const int measuresBegin = firstAfter(sliceBegin - timeOfFlightWindow);
+  const int measuresEnd = firstAfter(sliceEnd + timeOfFlightWindow);
+  const vector<Measurement> sliceMeasures(sortedMeasures.begin() + measuresBegin, sortedMeasures.begin() + measuresEnd);
+
+  HitIndex hitIndex = emptyHitIndex;
+  hitIndex.build(sliceMeasures);
+
+  // NOTE: the measures of the first detector are only used as seeds, hence they are never taken by other particles
+  vector<vector<char>> layersUsed(layersNumber);
+  for (int layer = 1; layer < layersNumber; layer++)
+    layersUsed[layer].assign(hitIndex.getLayer(layer).getHitsNumber(), false);
+
+  vector<vector<Measurement>> events;
+  vector<int> candidates;
+
+  // The seeds are taken in order of time
+  for (const Measurement &seedMeasure : sliceMeasures) {
+    if (seedMeasure.t >= sliceEnd)
+      break;
+    if (hitIndex.getLayerIndex(seedMeasure) != 0)
+      continue;
+
+    vector<Measurement> event{seedMeasure};
+    vector<int> presentLayers{0};
+
+    for (int layer = 1; layer < layersNumber; layer++) {
+      if (!layersTimeMeasured[layer]) {
+        event.push_back(Measurement{0., 0., 0., MISSING_MEASURE});
+        continue;
+      }
+
+      // Time window allowed by the speed of the particles
+      const int preaviousLayer = presentLayers.back();
+      const Measurement &preaviousMeasure = event[preaviousLayer];
+      const double deltaZ = layersZ[layer] - layersZ[preaviousLayer];
+      const double timeTolerance = EVENT_WINDOW_SIGMAS * hypot(layersTimeSigma[preaviousLayer], layersTimeSigma[layer]);
+      const double minTime = preaviousMeasure.t + deltaZ / (MAX_BETA * LIGHT_SPEED) - timeTolerance;
+      const double maxTime = preaviousMeasure.t + deltaZ / EVENT_MIN_SPEED + timeTolerance;
+
+      // Expected position: on the straight line through the last two measures, or through the origin and the first one
+      PredictedPosition expected;
+      if (presentLayers.size() > 1) {
+        const int firstLayer = presentLayers[presentLayers.size() - 2];
+        expected = predictPosition(event[firstLayer], layersZ[firstLayer], layersSpaceSigma[firstLayer], preaviousMeasure,
+                                   layersZ[preaviousLayer], layersSpaceSigma[preaviousLayer], layersZ[layer]);
+      } else {
+        const Measurement origin{0., originPosition.X(), originPosition.Y(), MISSING_MEASURE};
+        expected = predictPosition(origin, originPosition.Z(), 0., preaviousMeasure, layersZ[preaviousLayer],
+                                   layersSpaceSigma[preaviousLayer], layersZ[layer]);
+      }
+      expected.sigma = hypot(expected.sigma, layersSpaceSigma[layer]);
+      const double maxDistance = EVENT_WINDOW_SIGMAS * expected.sigma;
+      const double maxDistance2 = maxDistance * maxDistance;
+
+      const LayerHitIndex &layerHits = hitIndex.getLayer(layer);
+      candidates.clear();
+      layerHits.findInWindow(HitWindow{expected.x - maxDistance, expected.x + maxDistance, expected.y - maxDistance,
+                                       expected.y + maxDistance, minTime, maxTime},
+                             candidates);
+
+      int chosen = -1;
+      double chosenDistance2 = maxDistance2;
+      for (int i : candidates) {
+        const Measurement &candidate = layerHits.getHit(i);
+        const double distance2 = pow(candidate.x - expected.x, 2) + pow(candidate.y - expected.y, 2);
+        if (!layersUsed[layer][i] && distance2 < chosenDistance2) {
+          chosen = i;
+          chosenDistance2 = distance2;
+        }
+      }
+
+      if (chosen < 0)
+        break;
+
+      layersUsed[layer][chosen] = true;
+      event.push_back(layerHits.getHit(chosen));
+      presentLayers.push_back(layer);
+    }
+
+    // The detectors without time after the last measure are considered again by addUntimedMeasures
+    event.resize(presentLayers.back() + 1);
+
+    // The particles of the preavious slice only reserve their measures
+    if (seedMeasure.t >= sliceBegin)
+      events.push_back(move(event));
+  }
+
+  return events;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// addUntimedMeasures
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void EventBuilder::addUntimedMeasures(vector<vector<Measurement>> &events, const vector<Measurement> &untimedMeasures) const {
+  const int layersNumber = (int)layersZ.size();
+
+  HitIndex hitIndex = emptyHitIndex;
+  hitIndex.build(untimedMeasures);
+
+  vector<vector<char>> layersUsed(layersNumber);
+  for (int layer = 0; layer < layersNumber; layer++)
+    layersUsed[layer].assign(hitIndex.getLayer(layer).getHitsNumber(), false);
+
+  // NOTE: the searches are matched to the measures starting from the closest pairs, so that the result does not
+  // depend on the order of the particles
+  const auto compareCandidates = [](const UntimedCandidate &a, const UntimedCandidate &b) {
+    return a.distance2 != b.distance2 ? a.distance2 < b.distance2
+                                      : (a.search != b.search ? a.search < b.search : a.measure < b.measure);
+  };
+
+  const auto matchSearches = [&](const vector<UntimedSearch> &searches) {
+    vector<UntimedCandidate> candidates;
+    vector<int> hitIndices;
+    for (int search = 0; search < (int)searches.size(); search++) {
+      const LayerHitIndex &layerHits = hitIndex.getLayer(searches[search].layer);
+      const PredictedPosition &expected = searches[search].expected;
+      const double maxDistance = EVENT_WINDOW_SIGMAS * expected.sigma;
+
+      hitIndices.clear();
+      layerHits.findInWindow(HitWindow::around(expected.x, expected.y, 0., maxDistance, 0.), hitIndices);
+
+      for (int i : hitIndices) {
+        const double distance2 = pow(layerHits.getHit(i).x - expected.x, 2) + pow(layerHits.getHit(i).y - expected.y, 2);
+        if (distance2 <= maxDistance * maxDistance)
+          candidates.push_back(UntimedCandidate{distance2, search, i});
+      }
+    }
+
+    sort(candidates.begin(), candidates.end(), compareCandidates);
+
+    vector<int> matchedMeasures(searches.size(), -1);
+    for (const UntimedCandidate &candidate : candidates) {
+      const int layer = searches[candidate.search].layer;
+      if (matchedMeasures[candidate.search] < 0 && !layersUsed[layer][candidate.measure]) {
+        matchedMeasures[candidate.search] = candidate.measure;
+        layersUsed[layer][candidate.measure] = true;
+      }
+    }
+
+    return matchedMeasures;
+  };
+
+  const auto expectedPosition = [&](const vector<Measurement> &event, int layer, int firstLayer, int secondLayer) {
+    PredictedPosition expected =
+        predictPosition(event[firstLayer], layersZ[firstLayer], layersSpaceSigma[firstLayer], event[secondLayer],
+                        layersZ[secondLayer], layersSpaceSigma[secondLayer], layersZ[layer]);
+    expected.sigma = hypot(expected.sigma, layersSpaceSigma[layer]);
+    return expected;
+  };
+
+  // The detectors between two measures are filled first, interpolating between the closest measures with time
+  vector<UntimedSearch> searches;
+  for (int event = 0; event < (int)events.size(); event++) {
+    const vector<Measurement> &measures = events[event];
+    for (int layer = 1; layer < (int)measures.size() - 1; layer++) {
+      if (measures[layer].detectorID != MISSING_MEASURE)
+        continue;
+
+      int preaviousLayer = layer - 1;
+      while (measures[preaviousLayer].detectorID == MISSING_MEASURE)
+        preaviousLayer--;
+      int nextLayer = layer + 1;
+      while (measures[nextLayer].detectorID == MISSING_MEASURE)
+        nextLayer++;
+
+      searches.push_back(UntimedSearch{event, layer, expectedPosition(measures, layer, preaviousLayer, nextLayer)});
+    }
+  }
+
+  vector<int> matchedMeasures = matchSearches(searches);
+  for (int search = 0; search < (int)searches.size(); search++)
+    if (matchedMeasures[search] >= 0)
+      events[searches[search].event][searches[search].layer] = hitIndex.getLayer(searches[search].layer).getHit(matchedMeasures[search]);
+
+  // A particle without one of its measures ends before it
+  for (vector<Measurement> &event : events)
+    for (int layer = 1; layer < (int)event.size(); layer++)
+      if (event[layer].detectorID == MISSING_MEASURE) {
+        event.resize(layer);
+        break;
+      }
+
+  // Then the detectors right after the last measure, extrapolating from the last two measures
+  searches.clear();
+  for (int event = 0; event < (int)events.size(); event++) {
+    const int layer = (int)events[event].size();
+    if (layer >= 2 && layer < layersNumber && !layersTimeMeasured[layer])
+      searches.push_back(UntimedSearch{event, layer, expectedPosition(events[event], layer, layer - 2, layer - 1)});
+  }
+
+  matchedMeasures = matchSearches(searches);
+  for (int search = 0; search < (int)searches.size(); search++)
+    if (matchedMeasures[search] >= 0)
+      events[searches[search].event].push_back(hitIndex.getLayer(searches[search].layer).getHit(matchedMeasures[search]));
+}
@@ -0,0 +1,158 @@
+// Header files needed
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+// Custom classes
+#include "HitIndex.hpp"
+#include "Detector.hpp"
+#include "MeasuresAndStates.hpp"
+
+// Namespaces
+using namespace std;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// LayerHitIndex (constructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+LayerHitIndex::LayerHitIndex(const Detector &detector, double cellSize)
+    : xOrigin(detector.getBottmLeftPosition().X()), yOrigin(detector.getBottmLeftPosition().Y()), cellSize(cellSize),
+      timeMeasured(detector.isTimeMeasured()) {
+  if (cellSize <= 0.)
+    throw invalid_argument("LayerHitIndex: the size of the cells must be positive");
+
+  columnsNumber = max(1, (int)ceil(detector.getWidth() / cellSize));
+  rowsNumber = max(1, (int)ceil(detector.getHeight() / cellSize));
+  cellsBegin.assign(columnsNumber * rowsNumber + 1, 0);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// build
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void LayerHitIndex::build(const vector<Measurement> &measures) {
+  const int cellsNumber = columnsNumber * rowsNumber;
+
+  // NOTE: the hits are placed with a counting sort, which keeps their order within each cell
+  vector<int> hitsCell(measures.size());
+  fill(cellsBegin.begin(), cellsBegin.end(), 0);
+  for (int i = 0; i < (int)measures.size(); i++) {
+    hitsCell[i] = getRow(measures[i].y) * columnsNumber + getColumn(measures[i].x);
+    cellsBegin[hitsCell[i] + 1]++;
+  }
+
+  for (int cell = 0; cell < cellsNumber; cell++)
+    cellsBegin[cell + 1] += cellsBegin[cell];
+
+  vector<int> cellsEnd(cellsBegin.begin(), cellsBegin.end() - 1);
+  hits.resize(measures.size());
+  for (int i = 0; i < (int)measures.size(); i++)
+    hits[cellsEnd[hitsCell[i]]++] = measures[i];
+
+  if (!timeMeasured)
+    return;
+
+  const auto isEarlier = [](const Measurement &a, const Measurement &b) { return a.t < b.t; };
+  for (int cell = 0; cell < cellsNumber; cell++) {
+    const auto cellBegin = hits.begin() + cellsBegin[cell];
+    const auto cellEnd = hits.begin() + cellsBegin[cell + 1];
+    if (!is_sorted(cellBegin, cellEnd, isEarlier))
+      stable_sort(cellBegin, cellEnd, isEarlier);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// findInWindow
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void LayerHitIndex::findInWindow(const HitWindow &window, vector<int> &hitIndices) const {
+  if (window.xMin > window.xMax || window.yMin > window.yMax || (timeMeasured && window.tMin > window.tMax))
+    return;
+
+  const int firstColumn = getColumn(window.xMin);
+  const int lastColumn = getColumn(window.xMax);
+  const int firstRow = getRow(window.yMin);
+  const int lastRow = getRow(window.yMax);
+
+  const auto isBefore = [](const Measurement &hit, double time) { return hit.t < time; };
+
+  for (int row = firstRow; row <= lastRow; row++) {
+    for (int column = firstColumn; column <= lastColumn; column++) {
+      const int cell = row * columnsNumber + column;
+      int i = cellsBegin[cell];
+      const int cellEnd = cellsBegin[cell + 1];
+
+      if (timeMeasured)
+        i = (int)(lower_bound(hits.begin() + i, hits.begin() + cellEnd, window.tMin, isBefore) - hits.begin());
+
+      for (; i < cellEnd; i++) {
+        const Measurement &hit = hits[i];
+        if (timeMeasured && hit.t > window.tMax)
+          break;
+
+        if (hit.x >= window.xMin && hit.x <= window.xMax && hit.y >= window.yMin && hit.y <= window.yMax)
+          hitIndices.push_back(i);
+      }
+    }
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// getColumn and getRow
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int LayerHitIndex::getColumn(double x) const {
+  const double column = floor((x - xOrigin) / cellSize);
+  return column < 0. ? 0 : column >= columnsNumber ? columnsNumber - 1 : (int)column;
+}
+
+int LayerHitIndex::getRow(double y) const {
+  const double row = floor((y - yOrigin) / cellSize);
+  return row < 0. ? 0 : row >= rowsNumber ? rowsNumber - 1 : (int)row;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// HitIndex (constructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+HitIndex::HitIndex(const vector<Detector> &detectors, double cellSize) {
+  for (int i = 0; i < (int)detectors.size(); i++) {
+    layers.push_back(LayerHitIndex(detectors[i], cellSize));
+
+    if (detectors[i].getId() >= (int)layerOfDetectorId.size())
+      layerOfDetectorId.resize(detectors[i].getId() + 1, -1);
+    layerOfDetectorId[detectors[i].getId()] = i;
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// build
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void HitIndex::build(const vector<Measurement> &measures) {
+  vector<vector<Measurement>> layersMeasures(layers.size());
+  for (const Measurement &measure : measures)
+    layersMeasures[getLayerIndex(measure)].push_back(measure);
+
+  for (int layer = 0; layer < (int)layers.size(); layer++)
+    layers[layer].build(layersMeasures[layer]);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// getLayerIndex
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int HitIndex::getLayerIndex(const Measurement &measure) const {
+  if (measure.detectorID < 0 || measure.detectorID >= (int)layerOfDetectorId.size() || layerOfDetectorId[measure.detectorID] < 0)
+    throw invalid_argument("HitIndex: measure of an unknown detector");
+
+  return layerOfDetectorId[measure.detectorID];
+}
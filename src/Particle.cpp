@@ -21,9 +21,23 @@ Particle::Particle(const TLorentzVector initialPosition, const TVector3 initialV
 
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// zSpaceEvolve
+// zSpaceEvolve - drawing the random numbers
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-ParticleState Particle::zSpaceEvolve(ParticleState preaviousState, double finalZ, bool multipleScattering, std::optional<int> detectorId) const {
+ParticleState Particle::zSpaceEvolve(ParticleState preaviousState, double finalZ, RandomGenerator &randomGenerator, bool multipleScattering, std::optional<int> detectorId) const {
+  if (!multipleScattering)
+    return zSpaceEvolve(preaviousState, finalZ, nullptr, detectorId);
+
+  double gaussians[EVOLUTION_GAUSSIANS_NUMBER];
+  randomGenerator.fillGaussian(gaussians, EVOLUTION_GAUSSIANS_NUMBER);
+  return zSpaceEvolve(preaviousState, finalZ, gaussians, detectorId);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// zSpaceEvolve - with the random numbers already drawn
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ParticleState Particle::zSpaceEvolve(ParticleState preaviousState, double finalZ, const double *gaussians, std::optional<int> detectorId) const {
   // Starting position and velocity
   const TLorentzVector lastPosition = preaviousState.position;
   const TVector3 lastVelocity = preaviousState.velocity;
@@ -41,7 +55,7 @@ ParticleState Particle::zSpaceEvolve(ParticleState preaviousState, double finalZ
   const double deltaT = deltaZ / lastVZ;
 
   // Activation of multiple scattering if necessary
-  if (!multipleScattering) {
+  if (!gaussians) {
     // Evolution of position and velocity according to the motion equation
     const TLorentzVector newPosition{lastPosition.X() + lastXZ * deltaZ, lastPosition.Y() + lastYZ * deltaZ, finalZ, lastPosition.T() + deltaT};
     const TVector3 newVelocity{lastXZ * lastVZ, lastYZ * lastVZ, lastVZ};
@@ -49,16 +63,13 @@ ParticleState Particle::zSpaceEvolve(ParticleState preaviousState, double finalZ
     return ParticleState{newPosition, newVelocity, detectorId};
   }
   else{
-    // Getting the random generator instance
-    RandomGenerator &randomGenerator = RandomGenerator::getInstance();
-
     // Random variations
-    const double variationT = fabs(randomGenerator.generateGaussian(0., TIME_EVOLUTION_SIGMA));
-    const double variationX = randomGenerator.generateGaussian(0., SPACE_EVOLUTION_SIGMA);
-    const double variationY = randomGenerator.generateGaussian(0., SPACE_EVOLUTION_SIGMA);
-    const double variationVZ = -fabs(randomGenerator.generateGaussian(0., VELOCITY_EVOLUTION_SIGMA));
-    const double variationXZ = randomGenerator.generateGaussian(0., DIRECTION_EVOLUTION_SIGMA);
-    const double variationYZ = randomGenerator.generateGaussian(0., DIRECTION_EVOLUTION_SIGMA);
+    const double variationT = fabs(TIME_EVOLUTION_SIGMA * gaussians[0]);
+    const double variationX = SPACE_EVOLUTION_SIGMA * gaussians[1];
+    const double variationY = SPACE_EVOLUTION_SIGMA * gaussians[2];
+    const double variationVZ = -fabs(VELOCITY_EVOLUTION_SIGMA * gaussians[3]);
+    const double variationXZ = DIRECTION_EVOLUTION_SIGMA * gaussians[4];
+    const double variationYZ = DIRECTION_EVOLUTION_SIGMA * gaussians[5];
 
     // Evolution of position according to the motion equation
     const TLorentzVector newPosition{lastPosition.X() + lastXZ * deltaZ + variationX, lastPosition.Y() + lastYZ * deltaZ + variationY, finalZ, lastPosition.T() + deltaT + variationT};
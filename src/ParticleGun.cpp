@@ -68,10 +68,7 @@ ParticleGun::ParticleGun(TVector3 position, const std::vector<Detector> &detecto
 // generateParticle
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // TODO: Change to a more accurate handling of the approximation
-Particle ParticleGun::generateParticle() {
-  // Getting the random generator instance
-  RandomGenerator &randomGenerator = RandomGenerator::getInstance();
-
+Particle ParticleGun::generateParticle(RandomGenerator &randomGenerator, int particleIndex) const {
   // Generation of particle's direction
   const double phy = randomGenerator.generateLongitude(0., 2. * M_PI);
   const double theta = randomGenerator.generateColatitude(0., maxColatitude);
@@ -88,7 +85,8 @@ Particle ParticleGun::generateParticle() {
   const double charge = FOUNDAMENTAL_CHARGE;
 
   // Generation of the particle
-  const Particle newParticle({position, timeOfEmission}, velocity, mass, charge);
+  const double particleTimeOfEmission = timeOfEmission + particleIndex * timeBetweenParticles;
+  const Particle newParticle({position, particleTimeOfEmission}, velocity, mass, charge);
 
   return newParticle;
 }
@@ -0,0 +1,129 @@
+#ifdef TRACKING_PROFILING
+
+// Header files needed
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Custom classes
+#include "Profiler.hpp"
+
+// Namespaces
+using namespace std;
+
+// Largest number of timers and counters
+constexpr int PROFILER_MAX_ENTRIES = 128;
+
+// The accumulators of a thread, written by that thread only
+struct ThreadAccumulators {
+  atomic<int64_t> values[PROFILER_MAX_ENTRIES] = {};
+  atomic<int64_t> calls[PROFILER_MAX_ENTRIES] = {};
+};
+
+// NOTE: the accumulators of a thread are kept after its end, so that its values are still in the next report
+static mutex registryMutex;
+static vector<string> entriesNames;
+static vector<Profiler::EntryType> entriesTypes;
+static vector<unique_ptr<ThreadAccumulators>> allThreadsAccumulators;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// registerEntry
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int Profiler::registerEntry(const char *name, EntryType type) {
+  lock_guard<mutex> lock(registryMutex);
+
+  const auto entry = find(entriesNames.begin(), entriesNames.end(), name);
+  if (entry != entriesNames.end()) {
+    if (entriesTypes[entry - entriesNames.begin()] != type)
+      throw std::invalid_argument("Profiler::registerEntry: " + string(name) + " is both a timer and a counter");
+    return (int)(entry - entriesNames.begin());
+  }
+
+  if ((int)entriesNames.size() == PROFILER_MAX_ENTRIES)
+    throw std::invalid_argument("Profiler::registerEntry: too many timers and counters");
+
+  entriesNames.push_back(name);
+  entriesTypes.push_back(type);
+  return (int)entriesNames.size() - 1;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// add
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Profiler::add(int entry, int64_t value) {
+  thread_local ThreadAccumulators *threadAccumulators = [] {
+    lock_guard<mutex> lock(registryMutex);
+    allThreadsAccumulators.push_back(make_unique<ThreadAccumulators>());
+    return allThreadsAccumulators.back().get();
+  }();
+
+  threadAccumulators->values[entry].fetch_add(value, memory_order_relaxed);
+  threadAccumulators->calls[entry].fetch_add(1, memory_order_relaxed);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// report
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Profiler::report(const string &fileName) {
+  lock_guard<mutex> lock(registryMutex);
+
+  // Sums over the threads, resetting the accumulators
+  const int entriesNumber = (int)entriesNames.size();
+  vector<int64_t> values(entriesNumber, 0);
+  vector<int64_t> calls(entriesNumber, 0);
+  for (const unique_ptr<ThreadAccumulators> &threadAccumulators : allThreadsAccumulators) {
+    for (int entry = 0; entry < entriesNumber; entry++) {
+      values[entry] += threadAccumulators->values[entry].exchange(0, memory_order_relaxed);
+      calls[entry] += threadAccumulators->calls[entry].exchange(0, memory_order_relaxed);
+    }
+  }
+
+  // NOTE: the entries are sorted by name, since their registration order depends on the threads
+  vector<int> order(entriesNumber);
+  for (int entry = 0; entry < entriesNumber; entry++)
+    order[entry] = entry;
+  sort(order.begin(), order.end(), [](int first, int second) { return entriesNames[first] < entriesNames[second]; });
+
+  ostringstream reportStream;
+  reportStream << fixed << setprecision(3);
+  reportStream << "STAGES (time summed over the threads)" << endl;
+  reportStream << left << setw(48) << "stage" << right << setw(12) << "calls" << setw(16) << "total [ms]" << setw(16) << "mean [us]" << endl;
+  for (int entry : order) {
+    if (entriesTypes[entry] != EntryType::TIMER || calls[entry] == 0)
+      continue;
+
+    reportStream << left << setw(48) << entriesNames[entry] << right << setw(12) << calls[entry] << setw(16) << values[entry] * 1e-6
+                 << setw(16) << values[entry] * 1e-3 / calls[entry] << endl;
+  }
+
+  reportStream << endl << "COUNTERS" << endl;
+  for (int entry : order) {
+    if (entriesTypes[entry] != EntryType::COUNTER || calls[entry] == 0)
+      continue;
+
+    reportStream << left << setw(48) << entriesNames[entry] << right << setw(16) << values[entry] << endl;
+  }
+
+  cout << endl << reportStream.str();
+
+  if (!fileName.empty()) {
+    ofstream reportFile(fileName);
+    reportFile << reportStream.str();
+  }
+}
+
+#endif
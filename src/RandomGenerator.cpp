@@ -1,25 +1,163 @@
 // Header files needed
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstddef>
-#include <ctime>
+#include <cstdint>
 
 // Custom classes
 #include "RandomGenerator.hpp"
 
+// Namespaces
+using namespace std;
+
 
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// RandomGenerator
+// Philox4x32-10
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-RandomGenerator::RandomGenerator() : rootGenerator(std::time(NULL)) {}
+// Constants from Salmon et al., "Parallel random numbers: as easy as 1, 2, 3" (SC11)
+static constexpr uint32_t PHILOX_M0 = 0xD2511F53;
+static constexpr uint32_t PHILOX_M1 = 0xCD9E8D57;
+static constexpr uint32_t PHILOX_W0 = 0x9E3779B9;
+static constexpr uint32_t PHILOX_W1 = 0xBB67AE85;
+static constexpr int PHILOX_ROUNDS = 10;
+
+static array<uint32_t, 4> philox(array<uint32_t, 4> counter, array<uint32_t, 2> key) {
+  for (int round = 0; round < PHILOX_ROUNDS; round++) {
+    const uint64_t product0 = (uint64_t)PHILOX_M0 * counter[0];
+    const uint64_t product1 = (uint64_t)PHILOX_M1 * counter[2];
+
+    counter = {(uint32_t)(product1 >> 32) ^ counter[1] ^ key[0], (uint32_t)product1,
+               (uint32_t)(product0 >> 32) ^ counter[3] ^ key[1], (uint32_t)product0};
+
+    key[0] += PHILOX_W0;
+    key[1] += PHILOX_W1;
+  }
+
+  return counter;
+}
+
+// NOTE: the blocks of consecutive counters are computed PHILOX_LANES at a time, one lane per block, so that every
+// operation of a round is the same on all the lanes and the loops over the lanes are vectorized
+static constexpr size_t PHILOX_LANES = 8;
+
+static void philoxBlocks(const array<uint32_t, 4> &counter, const array<uint32_t, 2> &key, size_t blocksNumber, uint32_t *values) {
+  for (size_t firstBlock = 0; firstBlock < blocksNumber; firstBlock += PHILOX_LANES) {
+    uint32_t counter0[PHILOX_LANES], counter1[PHILOX_LANES], counter2[PHILOX_LANES], counter3[PHILOX_LANES];
+    for (size_t lane = 0; lane < PHILOX_LANES; lane++) {
+      counter0[lane] = counter[0] + (uint32_t)(firstBlock + lane);
+      counter1[lane] = counter[1];
+      counter2[lane] = counter[2];
+      counter3[lane] = counter[3];
+    }
+
+    uint32_t key0 = key[0];
+    uint32_t key1 = key[1];
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+      for (size_t lane = 0; lane < PHILOX_LANES; lane++) {
+        const uint64_t product0 = (uint64_t)PHILOX_M0 * counter0[lane];
+        const uint64_t product1 = (uint64_t)PHILOX_M1 * counter2[lane];
+
+        counter0[lane] = (uint32_t)(product1 >> 32) ^ counter1[lane] ^ key0;
+        counter1[lane] = (uint32_t)product1;
+        counter2[lane] = (uint32_t)(product0 >> 32) ^ counter3[lane] ^ key1;
+        counter3[lane] = (uint32_t)product0;
+      }
+
+      key0 += PHILOX_W0;
+      key1 += PHILOX_W1;
+    }
+
+    // The lanes past the last block are computed anyway, but they are not copied
+    const size_t lanesNumber = min(PHILOX_LANES, blocksNumber - firstBlock);
+    for (size_t lane = 0; lane < lanesNumber; lane++) {
+      uint32_t *blockValues = values + 4 * (firstBlock + lane);
+      blockValues[0] = counter0[lane];
+      blockValues[1] = counter1[lane];
+      blockValues[2] = counter2[lane];
+      blockValues[3] = counter3[lane];
+    }
+  }
+}
+
+// Uniform number in [0, 1) with the full 53 bits of precision of a double, from two raw numbers
+static inline double toUnit(uint32_t first, uint32_t second) {
+  return ((first >> 5) * 67108864. + (second >> 6)) * (1. / 9007199254740992.);
+}
 
 
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// getInstance
+// RandomGenerator (constructor)
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-RandomGenerator &RandomGenerator::getInstance() {
-  static RandomGenerator instance;
-  return instance;
+// NOTE: the counter is (block index, stream, particle index low, particle index high), the key is the seed
+RandomGenerator::RandomGenerator(uint64_t seed, uint64_t particleIndex, RandomStream stream)
+    : key{(uint32_t)seed, (uint32_t)(seed >> 32)},
+      counter{0, (uint32_t)stream, (uint32_t)particleIndex, (uint32_t)(particleIndex >> 32)},
+      block{}, blockPosition{4}, hasSpareGaussian{false}, spareGaussian{0.} {}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// deriveSeed
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// NOTE: it is the SplitMix64 finalizer, so that close seeds and indices give unrelated keys
+uint64_t RandomGenerator::deriveSeed(uint64_t seed, uint64_t index) {
+  uint64_t mixed = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+  mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBULL;
+  return mixed ^ (mixed >> 31);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// generateRaw
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+uint32_t RandomGenerator::generateRaw() {
+  // Every evaluation of Philox gives four numbers: a new block is computed when they are exhausted
+  if (blockPosition == 4) {
+    block = philox(counter, key);
+    counter[0]++;
+    blockPosition = 0;
+  }
+
+  return block[blockPosition++];
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// fillRaw
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void RandomGenerator::fillRaw(uint32_t *values, size_t count) {
+  // The numbers left in the current block
+  size_t filled = 0;
+  while (filled < count && blockPosition < 4)
+    values[filled++] = block[blockPosition++];
+
+  // The whole blocks, computed together
+  const size_t blocksNumber = (count - filled) / 4;
+  philoxBlocks(counter, key, blocksNumber, values + filled);
+  counter[0] += (uint32_t)blocksNumber;
+  filled += 4 * blocksNumber;
+
+  // The beginning of the last block, whose other numbers are left for the next calls
+  while (filled < count)
+    values[filled++] = generateRaw();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// generateUnit
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Uniform number in [0, 1) with the full 53 bits of precision of a double
+double RandomGenerator::generateUnit() {
+  const uint32_t first = generateRaw();
+  const uint32_t second = generateRaw();
+  return toUnit(first, second);
 }
 
 
@@ -28,7 +166,7 @@ RandomGenerator &RandomGenerator::getInstance() {
 // generateUniform
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 double RandomGenerator::generateUniform(double minimumValue, double maximumValue) {
-  return rootGenerator.Uniform(minimumValue, maximumValue);
+  return minimumValue + (maximumValue - minimumValue) * generateUnit();
 }
 
 
@@ -37,7 +175,71 @@ double RandomGenerator::generateUniform(double minimumValue, double maximumValue
 // generateGaussian
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 double RandomGenerator::generateGaussian(double mean, double sigma) {
-  return rootGenerator.Gaus(mean, sigma);
+  if (hasSpareGaussian) {
+    hasSpareGaussian = false;
+    return mean + sigma * spareGaussian;
+  }
+
+  // Box-Muller transform (1 - u is in (0, 1], hence the logarithm is finite)
+  const double radius = sqrt(-2. * log(1. - generateUnit()));
+  const double angle = 2. * M_PI * generateUnit();
+
+  spareGaussian = radius * sin(angle);
+  hasSpareGaussian = true;
+  return mean + sigma * (radius * cos(angle));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// fillUniform
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void RandomGenerator::fillUniform(double *values, size_t count) {
+  // NOTE: the raw numbers are drawn in chunks, so that the buffer stays on the stack
+  constexpr size_t CHUNK_SIZE = 256;
+  uint32_t raw[2 * CHUNK_SIZE];
+
+  for (size_t first = 0; first < count; first += CHUNK_SIZE) {
+    const size_t chunkSize = min(CHUNK_SIZE, count - first);
+    fillRaw(raw, 2 * chunkSize);
+    for (size_t i = 0; i < chunkSize; i++)
+      values[first + i] = toUnit(raw[2 * i], raw[2 * i + 1]);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// fillGaussian
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void RandomGenerator::fillGaussian(double *values, size_t count) {
+  size_t filled = 0;
+  if (count > 0 && hasSpareGaussian) {
+    values[filled++] = spareGaussian;
+    hasSpareGaussian = false;
+  }
+
+  // Box-Muller transform of pairs of uniform numbers, as in generateGaussian
+  constexpr size_t CHUNK_PAIRS = 128;
+  double units[2 * CHUNK_PAIRS];
+
+  while (filled < count) {
+    const size_t pairsNumber = min(CHUNK_PAIRS, (count - filled + 1) / 2);
+    fillUniform(units, 2 * pairsNumber);
+
+    for (size_t i = 0; i < pairsNumber; i++) {
+      const double radius = sqrt(-2. * log(1. - units[2 * i]));
+      const double angle = 2. * M_PI * units[2 * i + 1];
+
+      values[filled++] = radius * cos(angle);
+      if (filled < count) {
+        values[filled++] = radius * sin(angle);
+      } else {
+        spareGaussian = radius * sin(angle);
+        hasSpareGaussian = true;
+      }
+    }
+  }
 }
 
 
@@ -46,7 +248,7 @@ double RandomGenerator::generateGaussian(double mean, double sigma) {
 // generateLongitude
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 double RandomGenerator::generateLongitude(double minimumAngle, double maximumAngle) {
-  return rootGenerator.Uniform(minimumAngle, maximumAngle);
+  return generateUniform(minimumAngle, maximumAngle);
 }
 
 
@@ -56,7 +258,7 @@ double RandomGenerator::generateLongitude(double minimumAngle, double maximumAng
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 double RandomGenerator::generateColatitude(double minimumAngle, double maximumAngle) {
   // Extraction of theta
-  const double uniform_theta = rootGenerator.Uniform(0., 1.);
+  const double uniform_theta = generateUniform(0., 1.);
 
   return 2. * asin(sqrt(uniform_theta * (1 - cos(maximumAngle)) / 2.)) - 2. * asin(sqrt(uniform_theta * (1 - cos(minimumAngle)) / 2.));
-}
\ No newline at end of file
+}
@@ -1,13 +1,22 @@
 #include "ResultFile.hpp"
 #include "MeasuresAndStates.hpp"
 
+#include <ROOT/TBufferMerger.hxx>
 #include <TFile.h>
 #include <TTree.h>
 #include <cmath>
 
-ResultFile::ResultFile(const char *fileName, const char *treeName) {
-  rootFile = TFile::Open(fileName, "RECREATE");
-  dataTree = new TTree(treeName, treeName);
+ResultFile::ResultFile(const char *fileName, const char *treeName)
+    : treeName(treeName), merger(fileName, "RECREATE") {}
+
+ResultFileWriter::ResultFileWriter(ResultFile &resultFile)
+    : file(resultFile.merger.GetFile()), hasPendingRows(false) {
+  // NOTE: the tree belongs to the in-memory file of this writer, which sends
+  // it to the merger at each Write
+  dataTree = new TTree(resultFile.treeName.c_str(), resultFile.treeName.c_str());
+  dataTree->SetDirectory(file.get());
+  dataTree->Branch("particle", &particleBuffer);
+
   double *pointers[] = {
       &zBuffer,   &ttBuffer,   &txBuffer,  &tyBuffer,   &tvBuffer, &txzBuffer,
       &tyzBuffer, &rtBuffer,   &rxBuffer,  &ryBuffer,   &rvBuffer, &rxzBuffer,
@@ -31,21 +40,25 @@ ResultFile::ResultFile(const char *fileName, const char *treeName) {
   }
 }
 
-ResultFile::~ResultFile() {
-  rootFile->WriteObject(dataTree, treeName);
-  rootFile->Close();
-  delete rootFile;
-  /* NOTE: There is a memory leak here since I don't delete the TTree, however i
-   * get an error if I do. Since there is only one instance, and it gets cleared
-   * a few instruction later I can live with that.
-   */
+ResultFileWriter::~ResultFileWriter() {
+  flush();
+}
+
+void ResultFileWriter::flush() {
+  if (!hasPendingRows)
+    return;
+  file->Write();
+  hasPendingRows = false;
 }
 
-void ResultFile::SaveSingleValue(double z, ParticleState theoreticalState,
-                                 ParticleState realState, Measurement measure,
-                                 MatrixStateEstimate predictedState,
-                                 MatrixStateEstimate filteredState,
-                                 MatrixStateEstimate smoothedState) {
+void ResultFileWriter::SaveSingleValue(int particleIndex, double z,
+                                       const ParticleState &theoreticalState,
+                                       const ParticleState &realState,
+                                       const Measurement &measure,
+                                       const MatrixStateEstimate &predictedState,
+                                       const MatrixStateEstimate &filteredState,
+                                       const MatrixStateEstimate &smoothedState) {
+  particleBuffer = particleIndex;
   zBuffer = z;
 
   ttBuffer = theoreticalState.position.T();
@@ -106,10 +119,11 @@ void ResultFile::SaveSingleValue(double z, ParticleState theoreticalState,
   ssyzBuffer = sqrt(smoothedState.uncertainty(5, 5));
 
   dataTree->Fill();
+  hasPendingRows = true;
 }
 
-void ResultFile::SaveMultipleValues(
-    const std::vector<Detector> &detectors,
+void ResultFileWriter::SaveMultipleValues(
+    int particleIndex, const std::vector<Detector> &detectors,
     const std::vector<ParticleState> &theoreticalStates,
     const std::vector<ParticleState> &realStates,
     const std::vector<Measurement> &measures,
@@ -119,11 +133,11 @@ void ResultFile::SaveMultipleValues(
   for (int i = 0; i < (int)smoothedStates.size(); i++) {
     if (i == 0) {
       const Measurement measure{NAN, NAN, NAN, -1};
-      SaveSingleValue(0., theoreticalStates[i], realStates[i], measure,
+      SaveSingleValue(particleIndex, 0., theoreticalStates[i], realStates[i], measure,
                       predictedStates[i], filteredStates[i], smoothedStates[i]);
       continue;
     }
-    SaveSingleValue(detectors[i - 1].getBottmLeftPosition().Z(),
+    SaveSingleValue(particleIndex, detectors[i - 1].getBottmLeftPosition().Z(),
                     theoreticalStates[i], realStates[i], measures[i - 1],
                     predictedStates[i], filteredStates[i], smoothedStates[i]);
   }
@@ -15,14 +15,20 @@
 SimulationSetup SetupFactory::generateExperiment() const {
   // Creation of the detectors acording to their geometry
   std::vector<Detector> detectors;
-  detectors.reserve(NUMBER_OF_DETECTORS);
+  detectors.reserve(parameters.detectorsNumber);
 
-  for (int i = 1; i < NUMBER_OF_DETECTORS + 1; i++) {
-    detectors.push_back(Detector(i * DISTANCE_BETWEEN_DETECTORS, DETECTOR_DIMENSION_WIDTH, DETECTOR_DIMENSION_HEIGHT));
+  for (int i = 1; i < parameters.detectorsNumber + 1; i++) {
+    detectors.push_back(Detector(i * parameters.distanceBetweenDetectors, parameters.detectorWidth, parameters.detectorHeight,
+                                 parameters.detectorSpaceUncertainty, parameters.detectorTimeUncertainty));
   }
 
+  if (parameters.detectorWithoutTime >= 0 && parameters.detectorWithoutTime < parameters.detectorsNumber)
+    detectors[parameters.detectorWithoutTime].setTimeMeasured(false);
+
   // Creating the point of interaction
-  const ParticleGun gun({0, 0, 0}, detectors);
+  // NOTE: the particles are shot after the preavious one has crossed all the detectors, as in MIN_TIME_BETWEEN_PARTICLE
+  ParticleGun gun({0, 0, 0}, detectors);
+  gun.setTimeBetweenParticles((parameters.detectorsNumber * parameters.distanceBetweenDetectors * 1.1) / LIGHT_SPEED);
   
   return SimulationSetup{gun, detectors};
 }
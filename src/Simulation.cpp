@@ -3,17 +3,41 @@
 #include <TLorentzVector.h>
 #include <TMatrixD.h>
 #include <TMatrixDfwd.h>
+#include <TROOT.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 // Custom classes
 #include "Simulation.hpp"
+#include "BinaryResultFile.hpp"
+#include "BoundedQueue.hpp"
+#include "Configuration.hpp"
+#include "DataCache.hpp"
 #include "DataFile.hpp"
 #include "DataGenerator.hpp"
+#include "EventBuilder.hpp"
 #include "MeasuresAndStates.hpp"
 #include "PhysicalParameters.hpp"
+#include "Profiler.hpp"
+#include "RandomGenerator.hpp"
+#include "ResultFile.hpp"
 #include "SetupFactory.hpp"
+#include "TrackFinder.hpp"
 #include "Tracker.hpp"
 #include "Utils.hpp"
 
@@ -33,13 +57,20 @@ int Simulation::runCounter = 0;
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // Simulation (constructor)
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-Simulation::Simulation() 
-: detectors() {
-  SetupFactory factory{};
+Simulation::Simulation(const Configuration &configuration)
+: seed(configuration.seed), outputFormat(configuration.outputFormat), dataCacheDirectory(configuration.dataCacheDirectory), detectors(),
+  threadPool(configuration.threadsNumber) {
+  // NOTE: ROOT objects are created concurrently during the generation and the reconstruction
+  ROOT::EnableThreadSafety();
+
+  SetupFactory factory(configuration.experiment);
   const SimulationSetup experiment = factory.generateExperiment();
   detectors = experiment.detectors;
-  dataGenerator = DataGenerator(experiment);
-  tracker = Tracker(experiment.detectors);
+  dataGenerator = DataGenerator(experiment, seed);
+  tracker = Tracker(experiment.detectors, configuration.tracker);
+  abortPolicy = configuration.abortPolicy;
+  eventBuilder = EventBuilder(experiment.detectors, experiment.particleGun.getPosition());
+  trackFinder = TrackFinder(experiment.detectors, experiment.particleGun.getPosition(), configuration.tracker);
 
   if (detectors.size() == 0) {
     throw std::invalid_argument("No detector");
@@ -53,60 +84,378 @@ Simulation::Simulation()
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void Simulation::runSimulation(int particlesNumber) {
   // --- Data creation
-  GeneratedData generatedData = dataGenerator.generateAllData(particlesNumber, false, true);
-  vector<Measurement> allMeasures = Utils::concatenateMeasures(generatedData.allParticlesMeasures);
+  vector<Measurement> allMeasures;
+  const GeneratedData generatedData = generateData(particlesNumber, allMeasures);
 
-  // --- Data saving
-  string dataFileName = "../data/GeneratedData_run" + to_string(runCounter) + ".root";
-  DataFile dataFile = DataFile(dataFileName.c_str(), "DataTree", false);
-  dataFile.SaveMultipleMeasures(allMeasures);
+  // --- Data elaboration and export
+  reconstructMeasures(allMeasures, &generatedData, "../results/Run " + to_string(runCounter));
+  PROFILE_REPORT("../results/Run " + to_string(runCounter) + " Profile.txt");
+  runCounter++;
+}
 
-  // --- Data elaboration
-  allMeasures = dataFile.readMeasures();
-  vector<vector<Measurement>> allParticlesMeasures = Utils::separateMeasuresInParticles(allMeasures);
 
-  // Vector for reconstructing the track
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// generateData
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+GeneratedData Simulation::generateData(int particlesNumber, vector<Measurement> &allMeasures) {
+  dataGenerator.setSeed(RandomGenerator::deriveSeed(seed, runCounter));
+
+  // Without the cache, the data are generated and saved with the number of the run
+  if (dataCacheDirectory.empty()) {
+    GeneratedData generatedData = dataGenerator.generateAllData(particlesNumber, false, true, &threadPool);
+    const string dataFileName = "../data/GeneratedData_run" + to_string(runCounter) + ".root";
+    DataCache::saveData(dataFileName, DataCache::getTruthFileNameOf(dataFileName), generatedData);
+    allMeasures = Utils::concatenateMeasures(generatedData.allParticlesMeasures);
+    return generatedData;
+  }
+
+  // NOTE: the key depends on the seed of the run, hence the same run of the same configuration hits the cache
+  const DataCache dataCache(dataCacheDirectory);
+  const string key = DataCache::computeKey(dataGenerator, particlesNumber, true);
+  if (dataCache.contains(key)) {
+    PROFILE_SCOPE("Simulation: cached data reading");
+    cout << "Generated data read from the cache: " << dataCache.getMeasuresFileName(key) << endl;
+    return DataCache::loadData(dataCache.getMeasuresFileName(key), dataCache.getTruthFileName(key), allMeasures);
+  }
+
+  GeneratedData generatedData = dataGenerator.generateAllData(particlesNumber, false, true, &threadPool);
+  dataCache.store(key, generatedData);
+  cout << "Generated data saved in the cache: " << dataCache.getMeasuresFileName(key) << endl;
+  allMeasures = Utils::concatenateMeasures(generatedData.allParticlesMeasures);
+  return generatedData;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// reconstructMeasures
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Simulation::reconstructMeasures(const vector<Measurement> &allMeasures, const GeneratedData *truth, const string &resultName) {
+  if (!truth && outputFormat != OutputFormat::BINARY)
+    throw std::invalid_argument("Simulation: the results without the truth of the measures are only binary");
+
+  vector<vector<Measurement>> allParticlesMeasures = eventBuilder.buildEvents(allMeasures, &threadPool);
+
+  // NOTE: the results pair each event with the particle of the same index in the truth
+  if (truth && allParticlesMeasures.size() != truth->allParticlesTheoreticalStates.size())
+    throw std::runtime_error("Simulation: the " + to_string(allParticlesMeasures.size()) + " events built do not match the " +
+                             to_string(truth->allParticlesTheoreticalStates.size()) + " particles of the truth");
+
+  // NOTE: the particles are reconstructed in chunks on the thread pool. Each chunk is fitted with the batch
+  // Kalman filter and keeps its states in the structure-of-arrays layout, saved in the slot of its task to
+  // preserve the order
+  constexpr int particlesPerTask = 8 * BATCH_BLOCK_SIZE;
+  const int reconstructedNumber = (int)allParticlesMeasures.size();
+  const int tasksNumber = (reconstructedNumber + particlesPerTask - 1) / particlesPerTask;
+
+  vector<kalmanFilterBatchResult> allTasksFilterResults(tasksNumber);
+  vector<BatchStateEstimates> allTasksSmoothedStates(tasksNumber);
+
+  // NOTE: the states of each track are only extracted for the formats that save them one particle at a time
+  const bool extractTrackStates = truth && outputFormat != OutputFormat::BINARY;
+  vector<vector<MatrixStateEstimate>> allParticlesPredictedStates(extractTrackStates ? reconstructedNumber : 0);
+  vector<vector<MatrixStateEstimate>> allParticlesFilteredStates(extractTrackStates ? reconstructedNumber : 0);
+  vector<vector<MatrixStateEstimate>> allParticlesSmoothedStates(extractTrackStates ? reconstructedNumber : 0);
+
+  // NOTE: each thread of the pool saves its particles in the ROOT file through its own writer, created at its first
+  // task, so that the threads do not wait for each other
+  unique_ptr<ResultFile> rootResultFile;
+  vector<unique_ptr<ResultFileWriter>> rootResultWriters;
+  if (outputFormat == OutputFormat::ROOT) {
+    const string rootFileName = resultName + ".root";
+    rootResultFile = make_unique<ResultFile>(rootFileName.c_str(), "ResultsTree");
+    rootResultWriters.resize(threadPool.getThreadsNumber());
+  }
+
+  // NOTE: the states of a track given up by the filter end before the measure of its hopeless update
+  atomic<int> abortedNumber{0};
+
+  threadPool.parallelFor(reconstructedNumber, particlesPerTask, [&](int begin, int end) {
+    PROFILE_SCOPE("Simulation: reconstruction");
+    const vector<vector<Measurement>> taskMeasures(allParticlesMeasures.begin() + begin, allParticlesMeasures.begin() + end);
+
+    // Kalman filter and smoother, applied to all the particles of the task at once
+    kalmanFilterBatchResult &filterResults = allTasksFilterResults[begin / particlesPerTask];
+    BatchStateEstimates &smoothedStates = allTasksSmoothedStates[begin / particlesPerTask];
+    filterResults = tracker.kalmanFilterBatch(taskMeasures, false, abortPolicy);
+    smoothedStates = tracker.kalmanSmootherBatch(filterResults);
+    abortedNumber += (int)count(filterResults.aborted.begin(), filterResults.aborted.end(), true);
+
+    if (extractTrackStates) {
+      for (int i = begin; i < end; i++) {
+        allParticlesPredictedStates[i] = filterResults.predictedStates.getTrackStates(i - begin);
+        allParticlesFilteredStates[i] = filterResults.filteredStates.getTrackStates(i - begin);
+        allParticlesSmoothedStates[i] = smoothedStates.getTrackStates(i - begin);
+      }
+    }
+
+    if (rootResultFile) {
+      unique_ptr<ResultFileWriter> &writer = rootResultWriters[threadPool.getThreadIndex()];
+      if (!writer)
+        writer = make_unique<ResultFileWriter>(*rootResultFile);
+      for (int i = begin; i < end; i++)
+        writer->SaveMultipleValues(i, detectors, truth->allParticlesTheoreticalStates[i], truth->allParticlesRealStates[i],
+                                  allParticlesMeasures[i], allParticlesPredictedStates[i], allParticlesFilteredStates[i],
+                                  allParticlesSmoothedStates[i]);
+    }
+  });
+
+  // NOTE: the writers are flushed and destroyed before their file
+  for (unique_ptr<ResultFileWriter> &writer : rootResultWriters) {
+    if (writer)
+      writer->flush();
+  }
+  rootResultWriters.clear();
+  rootResultFile.reset();
+
+  if (abortedNumber > 0)
+    cout << abortedNumber << " of " << reconstructedNumber << " tracks given up by the Kalman filter" << endl;
+
+  // --- Data export
+  if (!truth) {
+    BinaryResultFile resultFile(resultName + ".t4d", Utils::reconstructionResultColumns(), reconstructedNumber,
+                                (uint64_t)reconstructedNumber * (detectors.size() + 1));
+    for (int t = 0; t < tasksNumber; t++)
+      Utils::saveDataToBinary(resultFile, detectors, allParticlesMeasures, t * particlesPerTask, allTasksFilterResults[t].predictedStates,
+                              allTasksFilterResults[t].filteredStates, allTasksSmoothedStates[t]);
+    resultFile.close();
+  } else if (outputFormat == OutputFormat::BINARY) {
+    BinaryResultFile resultFile(resultName + ".t4d", Utils::trackingResultColumns(), reconstructedNumber,
+                                (uint64_t)reconstructedNumber * (detectors.size() + 1));
+    for (int t = 0; t < tasksNumber; t++)
+      Utils::saveDataToBinary(resultFile, detectors, truth->allParticlesTheoreticalStates, truth->allParticlesRealStates,
+                              allParticlesMeasures, t * particlesPerTask, allTasksFilterResults[t].predictedStates,
+                              allTasksFilterResults[t].filteredStates, allTasksSmoothedStates[t]);
+    resultFile.close();
+  } else if (outputFormat == OutputFormat::CSV) {
+    Utils::saveDataToCSV(detectors, truth->allParticlesTheoreticalStates, truth->allParticlesRealStates, allParticlesMeasures,
+                         allParticlesPredictedStates, allParticlesFilteredStates, allParticlesSmoothedStates, runCounter);
+  }
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// runSimulationStreaming
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Chunk of particles flowing through the stages of the pipeline
+struct SimulationChunk {
+  int index;
+  int firstParticleIndex;
+  GeneratedData generatedData;
+
+  // The measures given to the event builder, with the ones of the neighbouring chunks that overlap in time, and the
+  // interval of the particles of the chunk
+  vector<Measurement> allMeasures;
+  double seedsBegin;
+  double seedsEnd;
+
+  vector<vector<Measurement>> allParticlesMeasures;
+  kalmanFilterBatchResult filterResults;
+  BatchStateEstimates smoothedStates;
   vector<vector<MatrixStateEstimate>> allParticlesPredictedStates;
-  allParticlesPredictedStates.reserve(particlesNumber);
   vector<vector<MatrixStateEstimate>> allParticlesFilteredStates;
-  allParticlesFilteredStates.reserve(particlesNumber);
   vector<vector<MatrixStateEstimate>> allParticlesSmoothedStates;
-  allParticlesSmoothedStates.reserve(particlesNumber);
-
-  for (int i = 0; i < (int)allParticlesMeasures.size(); i++) {
-    // Kalman filter
-    kalmanFilterResult filterResults = tracker.kalmanFilter(allParticlesMeasures[i], false, false);
-    vector<MatrixStateEstimate> predictedStates = filterResults.predictedStates;
-    vector<MatrixStateEstimate> filteredStates = filterResults.filteredStates;
-
-    // Kalman smoother
-    vector<MatrixStateEstimate> smoothedStates = tracker.kalmanSmoother(filteredStates, false);
-    allParticlesPredictedStates.push_back(predictedStates);
-    allParticlesFilteredStates.push_back(filteredStates);
-    allParticlesSmoothedStates.push_back(smoothedStates);
-
-    /*cout << "Filtered Chi2" << endl;*/
-    /*tracker.computeChi2s(generatedData.allParticlesRealStates[i],*/
-    /*                     filteredStates, true, true);*/
-    /*cout << "\nSmoothed Chi2" << endl;*/
-    /*tracker.computeChi2s(generatedData.allParticlesRealStates[i],*/
-    /*                     smoothedStates, true, true);*/
-
-    /*string fileName("../results/Particle ");*/
-    /*fileName += to_string(i);*/
-    /*fileName += ".root";*/
-    /**/
-    /*ResultFile resultFile(fileName.c_str(), "ResultsTree");*/
-    /*resultFile.SaveMultipleValues(detectors,
-     * generatedData.allParticlesTheoreticalStates[i],
-     * generatedData.allParticlesRealStates[i], allParticlesMeasures[i],
-     * predictedStates, filteredStates, smoothedStates);*/
+};
+
+void Simulation::runSimulationStreaming(int particlesNumber, int particlesPerChunk) {
+  if (particlesPerChunk <= 0)
+    throw std::invalid_argument("The number of particles per chunk must be positive");
+
+  const int chunksNumber = (particlesNumber + particlesPerChunk - 1) / particlesPerChunk;
+  dataGenerator.setSeed(RandomGenerator::deriveSeed(seed, runCounter));
+
+  // NOTE: the generation is the slowest stage and it uses the thread pool, while a few dedicated threads are
+  // enough for the reconstruction. The queues hold at most two chunks each, bounding the memory used
+  const int fittingThreadsNumber = max(1, threadPool.getThreadsNumber() / 4);
+  BoundedQueue<SimulationChunk> generatedChunks(2);
+  BoundedQueue<SimulationChunk> fittedChunks(2);
+
+  // The first error of any stage stops the whole pipeline
+  mutex errorMutex;
+  exception_ptr firstError;
+  auto stopPipeline = [&](exception_ptr error) {
+    {
+      lock_guard<mutex> lock(errorMutex);
+      if (!firstError)
+        firstError = error;
+    }
+    generatedChunks.close();
+    fittedChunks.close();
+  };
+
+  // --- Data creation
+  // NOTE: the chunks are cut halfway between the emissions of the particles at their border. The last particles of a
+  // chunk can reach the detectors after the first ones of the next chunk, hence a chunk is sent to the event builder
+  // once the next one is generated, together with the measures with time of both its neighbours within a time of
+  // flight window
+  thread generationThread([&]() {
+    try {
+      const double timeOfFlightWindow = eventBuilder.getTimeOfFlightWindow();
+      vector<Measurement> preaviousChunkMeasures;
+      optional<SimulationChunk> chunk;
+
+      for (int i = 0; i <= chunksNumber; i++) {
+        optional<SimulationChunk> nextChunk;
+        if (i < chunksNumber) {
+          const int firstParticleIndex = i * particlesPerChunk;
+          const int chunkParticlesNumber = min(particlesPerChunk, particlesNumber - firstParticleIndex);
+
+          nextChunk.emplace();
+          nextChunk->index = i;
+          nextChunk->firstParticleIndex = firstParticleIndex;
+          nextChunk->generatedData = dataGenerator.generateParticlesData(firstParticleIndex, chunkParticlesNumber, true, &threadPool);
+          nextChunk->allMeasures = Utils::concatenateMeasures(nextChunk->generatedData.allParticlesMeasures);
+          nextChunk->seedsBegin = -INFINITY;
+          nextChunk->seedsEnd = INFINITY;
+
+          if (chunk) {
+            const double lastEmission = chunk->generatedData.allParticlesRealStates.back()[0].position.T();
+            const double nextEmission = nextChunk->generatedData.allParticlesRealStates.front()[0].position.T();
+            chunk->seedsEnd = nextChunk->seedsBegin = (lastEmission + nextEmission) / 2.;
+          }
+        }
+
+        if (chunk) {
+          vector<Measurement> chunkMeasures = chunk->allMeasures;
+
+          const vector<Measurement> preaviousMeasures =
+              eventBuilder.selectTimedMeasures(preaviousChunkMeasures, chunk->seedsBegin - timeOfFlightWindow, INFINITY);
+          chunk->allMeasures.insert(chunk->allMeasures.end(), preaviousMeasures.begin(), preaviousMeasures.end());
+          if (nextChunk) {
+            const vector<Measurement> nextMeasures =
+                eventBuilder.selectTimedMeasures(nextChunk->allMeasures, -INFINITY, chunk->seedsEnd + timeOfFlightWindow);
+            chunk->allMeasures.insert(chunk->allMeasures.end(), nextMeasures.begin(), nextMeasures.end());
+          }
+
+          preaviousChunkMeasures = std::move(chunkMeasures);
+          if (!generatedChunks.push(std::move(*chunk)))
+            break;
+        }
+
+        chunk = std::move(nextChunk);
+      }
+
+      generatedChunks.close();
+    } catch (...) {
+      stopPipeline(current_exception());
+    }
+  });
+
+  // --- Data elaboration
+  atomic<int> runningFittingThreads{fittingThreadsNumber};
+  vector<thread> fittingThreads;
+  fittingThreads.reserve(fittingThreadsNumber);
+
+  for (int t = 0; t < fittingThreadsNumber; t++) {
+    fittingThreads.emplace_back([&]() {
+      try {
+        while (optional<SimulationChunk> chunk = generatedChunks.pop()) {
+          PROFILE_SCOPE("Simulation: chunk reconstruction");
+
+          // NOTE: the thread pool is busy with the generation, hence the events are built by this thread
+          chunk->allParticlesMeasures = eventBuilder.buildEvents(std::move(chunk->allMeasures), chunk->seedsBegin, chunk->seedsEnd);
+          chunk->allMeasures.clear();
+          const int chunkParticlesNumber = (int)chunk->allParticlesMeasures.size();
+          if (chunkParticlesNumber != (int)chunk->generatedData.allParticlesMeasures.size())
+            throw std::runtime_error("Simulation: the events of chunk " + to_string(chunk->index) + " do not match its particles");
+
+          // Kalman filter and smoother, applied to all the particles of the chunk at once
+          chunk->filterResults = tracker.kalmanFilterBatch(chunk->allParticlesMeasures, false, abortPolicy);
+          chunk->smoothedStates = tracker.kalmanSmootherBatch(chunk->filterResults);
+
+          // NOTE: the states of each track are only extracted for the formats that save them one particle at a time
+          if (outputFormat != OutputFormat::BINARY) {
+            chunk->allParticlesPredictedStates.resize(chunkParticlesNumber);
+            chunk->allParticlesFilteredStates.resize(chunkParticlesNumber);
+            chunk->allParticlesSmoothedStates.resize(chunkParticlesNumber);
+            for (int i = 0; i < chunkParticlesNumber; i++) {
+              chunk->allParticlesPredictedStates[i] = chunk->filterResults.predictedStates.getTrackStates(i);
+              chunk->allParticlesFilteredStates[i] = chunk->filterResults.filteredStates.getTrackStates(i);
+              chunk->allParticlesSmoothedStates[i] = chunk->smoothedStates.getTrackStates(i);
+            }
+          }
+
+          if (!fittedChunks.push(std::move(*chunk)))
+            break;
+        }
+      } catch (...) {
+        stopPipeline(current_exception());
+      }
+
+      if (--runningFittingThreads == 0)
+        fittedChunks.close();
+    });
   }
 
-  // --- Data export
-  Utils::saveDataToCSV(detectors, generatedData.allParticlesTheoreticalStates, generatedData.allParticlesRealStates,
-                       allParticlesMeasures, allParticlesPredictedStates, allParticlesFilteredStates, allParticlesSmoothedStates,
-                       runCounter);
+  // --- Data saving and export
+  // NOTE: the chunks may be reconstructed out of order, hence they are buffered until their turn comes
+  try {
+    string dataFileName = "../data/GeneratedData_run" + to_string(runCounter) + ".root";
+    DataFile dataFile = DataFile(dataFileName.c_str(), "DataTree", false);
+
+    // NOTE: only the file of the chosen format is created
+    unique_ptr<BinaryResultFile> resultFile;
+    unique_ptr<ResultFile> rootResultFile;
+    unique_ptr<ResultFileWriter> rootResultWriter;
+    if (outputFormat == OutputFormat::BINARY) {
+      const string resultFileName = "../results/Run " + to_string(runCounter) + ".t4d";
+      resultFile = make_unique<BinaryResultFile>(resultFileName, Utils::trackingResultColumns(), particlesNumber,
+                                                 (uint64_t)particlesNumber * (detectors.size() + 1));
+    } else if (outputFormat == OutputFormat::ROOT) {
+      const string rootFileName = "../results/Run " + to_string(runCounter) + ".root";
+      rootResultFile = make_unique<ResultFile>(rootFileName.c_str(), "ResultsTree");
+      rootResultWriter = make_unique<ResultFileWriter>(*rootResultFile);
+    }
+
+    map<int, SimulationChunk> pendingChunks;
+    int nextChunkIndex = 0;
+
+    while (optional<SimulationChunk> chunk = fittedChunks.pop()) {
+      pendingChunks.emplace(chunk->index, std::move(*chunk));
+
+      for (auto next = pendingChunks.find(nextChunkIndex); next != pendingChunks.end(); next = pendingChunks.find(nextChunkIndex)) {
+        PROFILE_SCOPE("Simulation: chunk output");
+        const SimulationChunk &readyChunk = next->second;
+        const GeneratedData &generatedData = readyChunk.generatedData;
+
+        dataFile.SaveMultipleMeasures(Utils::concatenateMeasures(generatedData.allParticlesMeasures));
+        if (resultFile) {
+          Utils::saveDataToBinary(*resultFile, detectors, generatedData.allParticlesTheoreticalStates, generatedData.allParticlesRealStates,
+                                  readyChunk.allParticlesMeasures, 0, readyChunk.filterResults.predictedStates,
+                                  readyChunk.filterResults.filteredStates, readyChunk.smoothedStates);
+        } else if (rootResultWriter) {
+          for (int i = 0; i < (int)readyChunk.allParticlesMeasures.size(); i++)
+            rootResultWriter->SaveMultipleValues(readyChunk.firstParticleIndex + i, detectors, generatedData.allParticlesTheoreticalStates[i],
+                                                 generatedData.allParticlesRealStates[i], readyChunk.allParticlesMeasures[i],
+                                                 readyChunk.allParticlesPredictedStates[i], readyChunk.allParticlesFilteredStates[i],
+                                                 readyChunk.allParticlesSmoothedStates[i]);
+        } else {
+          Utils::saveDataToCSV(detectors, generatedData.allParticlesTheoreticalStates, generatedData.allParticlesRealStates,
+                               readyChunk.allParticlesMeasures, readyChunk.allParticlesPredictedStates, readyChunk.allParticlesFilteredStates,
+                               readyChunk.allParticlesSmoothedStates, runCounter, readyChunk.firstParticleIndex);
+        }
+
+        pendingChunks.erase(next);
+        nextChunkIndex++;
+      }
+    }
+
+    if (resultFile)
+      resultFile->close();
+    rootResultWriter.reset();
+  } catch (...) {
+    stopPipeline(current_exception());
+  }
+
+  generationThread.join();
+  for (thread &fittingThread : fittingThreads)
+    fittingThread.join();
+
+  if (firstError)
+    rethrow_exception(firstError);
+
+  PROFILE_REPORT("../results/Run " + to_string(runCounter) + " Profile.txt");
   runCounter++;
 }
 
@@ -117,64 +466,561 @@ void Simulation::runSimulation(int particlesNumber) {
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void Simulation::testDetector(int particlesNumber, int detectorId) {
   // Data creation
-  GeneratedData generatedData = dataGenerator.generateAllData(particlesNumber, false, true);
-  vector<Measurement> allMeasures = Utils::concatenateMeasures(generatedData.allParticlesMeasures);
+  vector<Measurement> allMeasures;
+  GeneratedData generatedData = generateData(particlesNumber, allMeasures);
 
-  // Data saving
-  string dataFileName = "../data/GeneratedData_run" + to_string(runCounter) + ".root";
-  DataFile dataFile = DataFile(dataFileName.c_str(), "DataTree", false);
-  dataFile.SaveMultipleMeasures(allMeasures);
+  // Data elaboration
+  vector<vector<Measurement>> allParticlesMeasures = eventBuilder.buildEvents(allMeasures, &threadPool);
+
+  // NOTE: the tested detector is masked only in the fits of this test, the tracker is not changed
+  const vector<LayerGeometry> consideredLayers = tracker.getConsideredLayers({detectorId});
+  const MeasureCovariance &measureUncertainty = tracker.getLayerGeometry(detectorId).measureUncertainty;
+
+  // NOTE: the particles are reconstructed concurrently, each one writing into its own slot. Also the
+  // printouts are collected per particle and written afterwards, to keep them in the original order
+  constexpr int particlesPerTask = 64;
+  const int reconstructedNumber = (int)allParticlesMeasures.size();
+  vector<vector<MatrixStateEstimate>> allParticlesSmoothedStates(reconstructedNumber);
+  vector<string> allParticlesReports(reconstructedNumber);
+
+  threadPool.parallelFor(reconstructedNumber, particlesPerTask, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      // NOTE: the event builder can stop a particle before the tested detector, such a particle is not tested
+      if ((int)allParticlesMeasures[i].size() <= detectorId) {
+        allParticlesMeasures[i].clear();
+        continue;
+      }
+
+      vector<Measurement> givenMeasures = allParticlesMeasures[i];
+      const Measurement detectorMeasurement = givenMeasures[detectorId];
+      givenMeasures.erase(givenMeasures.begin() + detectorId);
+
+      kalmanFilterResult filterResults = tracker.kalmanFilter(givenMeasures, consideredLayers, false, false);
+
+      vector<MatrixStateEstimate> smoothedStates = tracker.kalmanSmoother(filterResults, consideredLayers, false);
+
+      MatrixStateEstimate preaviousStateEstimate = smoothedStates[detectorId];
+      MatrixStateEstimate estimatedNextState = tracker.estimateNextState(preaviousStateEstimate, tracker.getLayerGeometry(detectorId));
+      const StateVector estimatedValue = estimatedNextState.value;
+      const StateCovariance estimatedError = estimatedNextState.uncertainty;
+
+      ostringstream report;
+      report << "DIFFERENCE CALCULATED AT THE DETECTOR WITH ID " << detectorId << endl;
+
+      report << "Detector measurement: t=" << detectorMeasurement.t << "±"<< sqrt(measureUncertainty(0, 0))
+             << " |   x = " << detectorMeasurement.x << "±" << sqrt(measureUncertainty(1, 1))
+             << " |   y =" << detectorMeasurement.y << "±" << sqrt(measureUncertainty(2, 2)) << endl;
+
+      report << "Smoother estimate: t=" << estimatedValue(0, 0) << "±" << sqrt(estimatedError(0, 0))
+             << " |   x = " << estimatedValue(1, 0) << "±" << sqrt(estimatedError(1, 1))
+             << " |   y = " << estimatedValue(2, 0) << "±" << sqrt(estimatedError(2, 2)) << endl;
+
+      double Zt = (detectorMeasurement.t - estimatedValue(0, 0)) / sqrt(measureUncertainty(0, 0) + estimatedError(0, 0));
+      double Zx = (detectorMeasurement.x - estimatedValue(1, 0)) / sqrt(measureUncertainty(1, 1) + estimatedError(1, 1));
+      double Zy = (detectorMeasurement.y - estimatedValue(2, 0)) / sqrt(measureUncertainty(2, 2) + estimatedError(2, 2));
+
+      // NOTE: a detector without a time measure has no time pull
+      if (detectors[detectorId].isTimeMeasured())
+        report << "Z_t = " << Zt << "    Z_x = " << Zx << "    Z_y = " << Zy << endl;
+      else
+        report << "Z_t = -    Z_x = " << Zx << "    Z_y = " << Zy << endl;
+      allParticlesReports[i] = report.str();
+
+      smoothedStates.insert(smoothedStates.begin() + detectorId + 1, estimatedNextState);
+      allParticlesSmoothedStates[i] = std::move(smoothedStates);
+    }
+  });
+
+  for (const string &report : allParticlesReports)
+    cout << report;
+
+  // --- Data export
+  if (outputFormat == OutputFormat::CSV) {
+    Utils::saveDataToCSV(detectors, generatedData.allParticlesRealStates, allParticlesMeasures, allParticlesSmoothedStates, runCounter);
+  } else {
+    const string resultFileName = "../results/Run " + to_string(runCounter) + " Detector test.t4d";
+    BinaryResultFile resultFile(resultFileName, Utils::detectorTestResultColumns(), allParticlesMeasures.size(),
+                                allParticlesMeasures.size() * (detectors.size() + 1));
+    Utils::saveDataToBinary(resultFile, detectors, generatedData.allParticlesRealStates, allParticlesMeasures, allParticlesSmoothedStates);
+    resultFile.close();
+  }
+  PROFILE_REPORT("../results/Run " + to_string(runCounter) + " Profile.txt");
+  runCounter++;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// scanDetectors
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Simulation::scanDetectors(int particlesNumber, int maskedDetectorsNumber) {
+  if (maskedDetectorsNumber != 1 && maskedDetectorsNumber != 2)
+    throw std::invalid_argument("Simulation::scanDetectors: the detectors must be masked one or two at a time");
+
+  // Data creation
+  vector<Measurement> allMeasures;
+  GeneratedData generatedData = generateData(particlesNumber, allMeasures);
 
   // Data elaboration
-  allMeasures = dataFile.readMeasures();
-  vector<vector<Measurement>> allParticlesMeasures = Utils::separateMeasuresInParticles(allMeasures);
+  const vector<vector<Measurement>> allParticlesMeasures = eventBuilder.buildEvents(allMeasures, &threadPool);
 
-  tracker.ignoreDetector(detectorId);
-  vector<vector<MatrixStateEstimate>> allParticlesSmoothedStates;
+  // The masks of the scan (each detector, or each pair of detectors) and the geometry of the layers they leave
+  const int detectorsNumber = (int)detectors.size();
+  vector<vector<int>> allMaskedDetectors;
+  for (int first = 0; first < detectorsNumber; first++) {
+    if (maskedDetectorsNumber == 1)
+      allMaskedDetectors.push_back({first});
+    else
+      for (int second = first + 1; second < detectorsNumber; second++)
+        allMaskedDetectors.push_back({first, second});
+  }
+
+  vector<vector<LayerGeometry>> allConsideredLayers;
+  for (const vector<int> &maskedDetectors : allMaskedDetectors)
+    allConsideredLayers.push_back(tracker.getConsideredLayers(maskedDetectors));
+
+  // NOTE: every mask is applied to the same measures, and each task fits a chunk of particles with a mask. The pulls
+  // are collected per particle and summed afterwards, to keep the sums independent of the threads
+  constexpr int particlesPerTask = 8 * BATCH_BLOCK_SIZE;
+  const int reconstructedNumber = (int)allParticlesMeasures.size();
+  const int chunksNumber = (reconstructedNumber + particlesPerTask - 1) / particlesPerTask;
+  const int masksNumber = (int)allMaskedDetectors.size();
+  vector<vector<vector<PullVariables>>> allMasksPulls(masksNumber, vector<vector<PullVariables>>(reconstructedNumber));
+
+  threadPool.parallelFor(masksNumber * chunksNumber, 1, [&](int firstTask, int lastTask) {
+    for (int task = firstTask; task < lastTask; task++) {
+      const int mask = task / chunksNumber;
+      const int begin = (task % chunksNumber) * particlesPerTask;
+      const int end = min(reconstructedNumber, begin + particlesPerTask);
+      const vector<int> &maskedDetectors = allMaskedDetectors[mask];
+      const vector<LayerGeometry> &consideredLayers = allConsideredLayers[mask];
+
+      // NOTE: a particle stopped before a masked detector is not tested
+      vector<int> testedParticles;
+      vector<vector<Measurement>> taskMeasures;
+      for (int i = begin; i < end; i++) {
+        if ((int)allParticlesMeasures[i].size() <= maskedDetectors.back())
+          continue;
+
+        vector<Measurement> givenMeasures;
+        for (int layer = 0; layer < (int)allParticlesMeasures[i].size(); layer++) {
+          if (find(maskedDetectors.begin(), maskedDetectors.end(), layer) == maskedDetectors.end())
+            givenMeasures.push_back(allParticlesMeasures[i][layer]);
+        }
+
+        testedParticles.push_back(i);
+        taskMeasures.push_back(std::move(givenMeasures));
+      }
+
+      if (taskMeasures.empty())
+        continue;
+
+      kalmanFilterBatchResult filterResults = tracker.kalmanFilterBatch(taskMeasures, consideredLayers, false);
+      BatchStateEstimates smoothedStates = tracker.kalmanSmootherBatch(filterResults, consideredLayers);
+
+      for (int j = 0; j < (int)testedParticles.size(); j++) {
+        const vector<MatrixStateEstimate> trackSmoothedStates = smoothedStates.getTrackStates(j);
+        const vector<Measurement> &particleMeasures = allParticlesMeasures[testedParticles[j]];
+        vector<PullVariables> &pulls = allMasksPulls[mask][testedParticles[j]];
 
-  for (int i = 0; i < (int)allParticlesMeasures.size(); i++) {
-    vector<Measurement> givenMeasures = allParticlesMeasures[i];
-    const Measurement detectorMeasurement = givenMeasures[detectorId];
-    givenMeasures.erase(givenMeasures.begin() + detectorId);
+        for (int maskedDetector : maskedDetectors) {
+          // The smoothed state on the closest considered detector before the masked one. The masked detectors before
+          // all the considered ones are reached backwards from the first considered detector
+          auto isMasked = [&](int detector) { return find(maskedDetectors.begin(), maskedDetectors.end(), detector) != maskedDetectors.end(); };
+          int closestLayer = maskedDetector - 1;
+          while (closestLayer >= 0 && isMasked(closestLayer))
+            closestLayer--;
+          if (closestLayer < 0) {
+            closestLayer = maskedDetector + 1;
+            while (isMasked(closestLayer))
+              closestLayer++;
+          }
 
-    kalmanFilterResult filterResults = tracker.kalmanFilter(givenMeasures, false, false);
-    vector<MatrixStateEstimate> predictedStates = filterResults.predictedStates;
-    vector<MatrixStateEstimate> filteredStates = filterResults.filteredStates;
+          // NOTE: the first smoothed state is the one at the particle gun
+          const int closestStateIndex = closestLayer + 1 - (int)count_if(maskedDetectors.begin(), maskedDetectors.end(),
+                                                                          [&](int detector) { return detector < closestLayer; });
+          const double deltaZ = detectors[maskedDetector].getBottmLeftPosition().Z() - detectors[closestLayer].getBottmLeftPosition().Z();
 
-    vector<MatrixStateEstimate> smoothedStates = tracker.kalmanSmoother(filteredStates, false);
+          const MatrixStateEstimate estimatedState = tracker.estimateNextState(trackSmoothedStates[closestStateIndex], deltaZ);
+          const Measurement &detectorMeasurement = particleMeasures[maskedDetector];
+          const MeasureCovariance &measureError = tracker.getLayerGeometry(maskedDetector).measureUncertainty;
 
-    MatrixStateEstimate preaviousStateEstimate = smoothedStates[detectorId];
-    double deltaZ =
-        (detectorId == 0)
-            ? detectors[detectorId].getBottmLeftPosition().Z()
-            : detectors[detectorId].getBottmLeftPosition().Z() - detectors[detectorId - 1].getBottmLeftPosition().Z();
-    
-    MatrixStateEstimate estimatedNextState = tracker.estimateNextState(preaviousStateEstimate, deltaZ);
-    TMatrixD estimatedValue = estimatedNextState.value;
-    TMatrixD estimatedError = estimatedNextState.uncertainty;
+          pulls.push_back(PullVariables{
+              (detectorMeasurement.t - estimatedState.value(0, 0)) / sqrt(measureError(0, 0) + estimatedState.uncertainty(0, 0)),
+              (detectorMeasurement.x - estimatedState.value(1, 0)) / sqrt(measureError(1, 1) + estimatedState.uncertainty(1, 1)),
+              (detectorMeasurement.y - estimatedState.value(2, 0)) / sqrt(measureError(2, 2) + estimatedState.uncertainty(2, 2))});
+        }
+      }
+    }
+  });
 
-    cout << "DIFFERENCE CALCULATED AT THE DETECTOR WITH ID " << detectorId << endl;
+  // Mean and standard deviation of the pulls of each masked detector
+  cout << "PULLS OF THE MASKED DETECTORS" << endl;
+  for (int mask = 0; mask < masksNumber; mask++) {
+    const vector<int> &maskedDetectors = allMaskedDetectors[mask];
 
-    cout << "Detector measurement: t=" << detectorMeasurement.t << "±"<< DETECTOR_TIME_UNCERTAINTY
-              << " |   x = " << detectorMeasurement.x << "±" << DETECTOR_SPACE_UNCERTAINTY
-              << " |   y =" << detectorMeasurement.y << "±" << DETECTOR_SPACE_UNCERTAINTY << endl;
+    for (int k = 0; k < (int)maskedDetectors.size(); k++) {
+      int pullsNumber = 0;
+      PullVariables pullsSum{0., 0., 0.};
+      PullVariables pullsSquaresSum{0., 0., 0.};
 
-    cout << "Smoother estimate: t=" << estimatedValue(0, 0) << "±" << sqrt(estimatedError(0, 0))
-              << " |   x = " << estimatedValue(1, 0) << "±" << sqrt(estimatedError(1, 1))
-              << " |   y = " << estimatedValue(2, 0) << "±" << sqrt(estimatedError(2, 2)) << endl;
+      for (const vector<PullVariables> &pulls : allMasksPulls[mask]) {
+        if (pulls.empty())
+          continue;
 
-    double Zt = (detectorMeasurement.t - estimatedValue(0, 0)) / sqrt(DETECTOR_TIME_UNCERTAINTY * DETECTOR_TIME_UNCERTAINTY + estimatedError(0, 0));
-    double Zx = (detectorMeasurement.x - estimatedValue(1, 0)) / sqrt(DETECTOR_SPACE_UNCERTAINTY * DETECTOR_SPACE_UNCERTAINTY + estimatedError(1, 1));
-    double Zy = (detectorMeasurement.y - estimatedValue(2, 0)) / sqrt(DETECTOR_SPACE_UNCERTAINTY * DETECTOR_SPACE_UNCERTAINTY + estimatedError(2, 2));
+        pullsNumber++;
+        pullsSum.tPull += pulls[k].tPull;
+        pullsSum.xPull += pulls[k].xPull;
+        pullsSum.yPull += pulls[k].yPull;
+        pullsSquaresSum.tPull += pulls[k].tPull * pulls[k].tPull;
+        pullsSquaresSum.xPull += pulls[k].xPull * pulls[k].xPull;
+        pullsSquaresSum.yPull += pulls[k].yPull * pulls[k].yPull;
+      }
 
-    cout << "Z_t = " << Zt << "    Z_x = " << Zx << "    Z_y = " << Zy << endl;
+      if (pullsNumber == 0)
+        continue;
 
-    smoothedStates.insert(smoothedStates.begin() + detectorId + 1, estimatedNextState);
-    allParticlesSmoothedStates.push_back(smoothedStates);
+      const PullVariables mean{pullsSum.tPull / pullsNumber, pullsSum.xPull / pullsNumber, pullsSum.yPull / pullsNumber};
+      const PullVariables deviation{sqrt(max(0., pullsSquaresSum.tPull / pullsNumber - mean.tPull * mean.tPull)),
+                                    sqrt(max(0., pullsSquaresSum.xPull / pullsNumber - mean.xPull * mean.xPull)),
+                                    sqrt(max(0., pullsSquaresSum.yPull / pullsNumber - mean.yPull * mean.yPull))};
+
+      cout << "Masked detectors";
+      for (int maskedDetector : maskedDetectors)
+        cout << " " << maskedDetector;
+      cout << ", detector " << maskedDetectors[k] << " (" << pullsNumber << " measures):   Z_t = ";
+      if (detectors[maskedDetectors[k]].isTimeMeasured())
+        cout << mean.tPull << " ± " << deviation.tPull;
+      else
+        cout << "-";
+      cout << " |   Z_x = " << mean.xPull << " ± " << deviation.xPull
+           << " |   Z_y = " << mean.yPull << " ± " << deviation.yPull << endl;
+    }
   }
 
-  // --- Data export
-  tracker.resetDetectors();
-  Utils::saveDataToCSV(detectors, generatedData.allParticlesRealStates, allParticlesMeasures, allParticlesSmoothedStates, runCounter);
+  PROFILE_REPORT("../results/Run " + to_string(runCounter) + " Profile.txt");
+  runCounter++;
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// testAllDetectors
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Simulation::testAllDetectors(int particlesNumber) {
+  // Data creation
+  vector<Measurement> allMeasures;
+  GeneratedData generatedData = generateData(particlesNumber, allMeasures);
+
+  // Data elaboration
+  const vector<vector<Measurement>> allParticlesMeasures = eventBuilder.buildEvents(allMeasures, &threadPool);
+
+  // NOTE: the pulls are collected per particle and summed afterwards, to keep the sums independent of the threads
+  constexpr int particlesPerTask = 8 * BATCH_BLOCK_SIZE;
+  const int reconstructedNumber = (int)allParticlesMeasures.size();
+  vector<vector<PullVariables>> allParticlesPulls(reconstructedNumber);
+
+  threadPool.parallelFor(reconstructedNumber, particlesPerTask, [&](int begin, int end) {
+    PROFILE_SCOPE("Simulation: reconstruction");
+    const vector<vector<Measurement>> taskMeasures(allParticlesMeasures.begin() + begin, allParticlesMeasures.begin() + end);
+
+    kalmanFilterBatchResult filterResults = tracker.kalmanFilterBatch(taskMeasures, false);
+    BatchStateEstimates smoothedStates = tracker.kalmanSmootherBatch(filterResults);
+
+    for (int i = begin; i < end; i++) {
+      const kalmanFilterResult trackFilterResult{filterResults.predictedStates.getTrackStates(i - begin),
+                                                 filterResults.filteredStates.getTrackStates(i - begin), filterResults.firstPredictedLayer};
+      const vector<MatrixStateEstimate> unbiasedStates =
+          tracker.computeUnbiasedStates(allParticlesMeasures[i], trackFilterResult, smoothedStates.getTrackStates(i - begin));
+      allParticlesPulls[i] = tracker.computePulls(allParticlesMeasures[i], unbiasedStates);
+    }
+  });
+
+  // Mean and standard deviation of the pulls of each detector
+  const int detectorsNumber = (int)detectors.size();
+  vector<int> pullsNumber(detectorsNumber, 0);
+  vector<PullVariables> pullsSum(detectorsNumber, PullVariables{0., 0., 0.});
+  vector<PullVariables> pullsSquaresSum(detectorsNumber, PullVariables{0., 0., 0.});
+
+  for (const vector<PullVariables> &pulls : allParticlesPulls) {
+    for (int i = 0; i < (int)pulls.size(); i++) {
+      pullsNumber[i]++;
+      pullsSum[i].tPull += pulls[i].tPull;
+      pullsSum[i].xPull += pulls[i].xPull;
+      pullsSum[i].yPull += pulls[i].yPull;
+      pullsSquaresSum[i].tPull += pulls[i].tPull * pulls[i].tPull;
+      pullsSquaresSum[i].xPull += pulls[i].xPull * pulls[i].xPull;
+      pullsSquaresSum[i].yPull += pulls[i].yPull * pulls[i].yPull;
+    }
+  }
+
+  cout << "PULLS OF THE MEASURES FROM THE UNBIASED ESTIMATES" << endl;
+  for (int i = 0; i < detectorsNumber; i++) {
+    if (pullsNumber[i] == 0)
+      continue;
+
+    const double n = pullsNumber[i];
+    const PullVariables mean{pullsSum[i].tPull / n, pullsSum[i].xPull / n, pullsSum[i].yPull / n};
+    const PullVariables deviation{sqrt(max(0., pullsSquaresSum[i].tPull / n - mean.tPull * mean.tPull)),
+                                  sqrt(max(0., pullsSquaresSum[i].xPull / n - mean.xPull * mean.xPull)),
+                                  sqrt(max(0., pullsSquaresSum[i].yPull / n - mean.yPull * mean.yPull))};
+
+    cout << "Detector " << i << " (" << pullsNumber[i] << " measures):   Z_t = ";
+    if (detectors[i].isTimeMeasured())
+      cout << mean.tPull << " ± " << deviation.tPull;
+    else
+      cout << "-";
+    cout << " |   Z_x = " << mean.xPull << " ± " << deviation.xPull
+         << " |   Z_y = " << mean.yPull << " ± " << deviation.yPull << endl;
+  }
+
+  PROFILE_REPORT("../results/Run " + to_string(runCounter) + " Profile.txt");
+  runCounter++;
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// runTrackFinding
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Simulation::runTrackFinding(int particlesNumber) {
+  // Data creation
+  dataGenerator.setSeed(RandomGenerator::deriveSeed(seed, runCounter));
+  GeneratedData generatedData = dataGenerator.generateAllData(particlesNumber, false, true, &threadPool);
+  const vector<Measurement> allMeasures = Utils::concatenateMeasures(generatedData.allParticlesMeasures);
+
+  // NOTE: a particle is found exactly if its measures are all found, in a single track starting from its first measure
+  map<pair<double, double>, int> particleOfFirstMeasure;
+  for (int i = 0; i < particlesNumber; i++) {
+    if (!generatedData.allParticlesMeasures[i].empty())
+      particleOfFirstMeasure[{generatedData.allParticlesMeasures[i][0].t, generatedData.allParticlesMeasures[i][0].x}] = i;
+  }
+
+  auto isFoundExactly = [&](const vector<Measurement> &measures) {
+    if (measures.empty())
+      return false;
+
+    const auto particle = particleOfFirstMeasure.find({measures[0].t, measures[0].x});
+    if (particle == particleOfFirstMeasure.end())
+      return false;
+
+    const vector<Measurement> &particleMeasures = generatedData.allParticlesMeasures[particle->second];
+    return equal(measures.begin(), measures.end(), particleMeasures.begin(), particleMeasures.end(),
+                 [](const Measurement &a, const Measurement &b) { return a.t == b.t && a.x == b.x && a.y == b.y; });
+  };
+
+  // Event building, then the Kalman filter of one particle at a time
+  constexpr int particlesPerTask = 64;
+  auto beginTime = chrono::steady_clock::now();
+  const vector<vector<Measurement>> allParticlesMeasures = eventBuilder.buildEvents(allMeasures, &threadPool);
+  threadPool.parallelFor((int)allParticlesMeasures.size(), particlesPerTask, [&](int begin, int end) {
+    for (int i = begin; i < end; i++)
+      tracker.kalmanFilter(allParticlesMeasures[i], false, false, abortPolicy);
+  });
+  const chrono::duration<double> eventBuilderTime = chrono::steady_clock::now() - beginTime;
+
+  // Combinatorial Kalman filter, which fits the tracks while it finds them
+  beginTime = chrono::steady_clock::now();
+  const vector<FoundTrack> foundTracks = trackFinder.findTracks(allMeasures, &threadPool);
+  const chrono::duration<double> trackFinderTime = chrono::steady_clock::now() - beginTime;
+
+  const int eventBuilderFound = (int)count_if(allParticlesMeasures.begin(), allParticlesMeasures.end(), isFoundExactly);
+  const int trackFinderFound = (int)count_if(foundTracks.begin(), foundTracks.end(),
+                                             [&](const FoundTrack &track) { return isFoundExactly(track.measures); });
+
+  double chi2 = 0.;
+  long long ndf = 0;
+  for (const FoundTrack &track : foundTracks) {
+    chi2 += track.chi2;
+    ndf += track.ndf;
+  }
+
+  cout << "TRACK FINDING OF " << particleOfFirstMeasure.size() << " PARTICLES" << endl;
+  cout << "Event builder and Kalman filter: " << allParticlesMeasures.size() << " particles, " << eventBuilderFound
+       << " found exactly, in " << eventBuilderTime.count() << " s" << endl;
+  cout << "Track finder: " << foundTracks.size() << " tracks, " << trackFinderFound << " found exactly, in "
+       << trackFinderTime.count() << " s (chi2/ndf = " << (ndf > 0 ? chi2 / ndf : 0.) << ")" << endl;
+  PROFILE_REPORT("../results/Run " + to_string(runCounter) + " Profile.txt");
+  runCounter++;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// reconstructData - from a data file
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Simulation::reconstructData(const string &dataFileName, const string &truthFileName) {
+  // --- Data reading
+  // NOTE: a truth file given explicitly must exist, while the sidecar of the data file is optional
+  const string truthName = truthFileName.empty() ? DataCache::getTruthFileNameOf(dataFileName) : truthFileName;
+  vector<Measurement> allMeasures;
+  optional<GeneratedData> truth;
+  if (!truthFileName.empty() || filesystem::exists(truthName)) {
+    truth = DataCache::loadData(dataFileName, truthName, allMeasures);
+  } else {
+    DataFile dataFile = DataFile(dataFileName.c_str(), "DataTree", true);
+    allMeasures = dataFile.readMeasures();
+  }
+
+  cout << "Reconstructing " << allMeasures.size() << " measures of " << dataFileName
+       << (truth ? " with the truth of " + truthName : " without truth") << endl;
+
+  // --- Data elaboration and export
+  reconstructMeasures(allMeasures, truth ? &truth.value() : nullptr, "../results/Run " + to_string(runCounter) + " Reconstruction");
+  PROFILE_REPORT("../results/Run " + to_string(runCounter) + " Profile.txt");
+  runCounter++;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// reconstructData - from the cache
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Simulation::reconstructData(int particlesNumber) {
+  if (dataCacheDirectory.empty())
+    throw std::invalid_argument("Simulation::reconstructData: no data cache");
+
+  dataGenerator.setSeed(RandomGenerator::deriveSeed(seed, runCounter));
+  const DataCache dataCache(dataCacheDirectory);
+  const string key = DataCache::computeKey(dataGenerator, particlesNumber, true);
+  if (!dataCache.contains(key))
+    throw std::invalid_argument("Simulation::reconstructData: the data of " + to_string(particlesNumber) + " particles of run " +
+                                to_string(runCounter) + " are not in the cache " + dataCacheDirectory + " (run the simulation first)");
+
+  reconstructData(dataCache.getMeasuresFileName(key), dataCache.getTruthFileName(key));
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// sweepTrackerParameters
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Sums over the tracks of a chunk fitted with one setting of the tracker
+struct SweepSums {
+  int tracksNumber = 0;
+  double chi2 = 0.;
+  long long ndf = 0;
+  long long pullsNumber = 0;
+  double pullsSum[STATE_DIMENSION] = {};
+  double pullsSquaresSum[STATE_DIMENSION] = {};
+
+  void add(const SweepSums &other) {
+    tracksNumber += other.tracksNumber;
+    chi2 += other.chi2;
+    ndf += other.ndf;
+    pullsNumber += other.pullsNumber;
+    for (int k = 0; k < STATE_DIMENSION; k++) {
+      pullsSum[k] += other.pullsSum[k];
+      pullsSquaresSum[k] += other.pullsSquaresSum[k];
+    }
+  }
+};
+
+void Simulation::sweepTrackerParameters(int particlesNumber, const vector<double> &velocitySigmas, const vector<double> &directionSigmas) {
+  if (velocitySigmas.empty() || directionSigmas.empty())
+    throw std::invalid_argument("Simulation::sweepTrackerParameters: no sigma to be tried");
+
+  // Data creation
+  vector<Measurement> allMeasures;
+  const GeneratedData generatedData = generateData(particlesNumber, allMeasures);
+
+  // NOTE: a particle that missed the first detector has no measure, hence nothing to be reconstructed
+  vector<int> reconstructedIndices;
+  vector<vector<Measurement>> reconstructedMeasures;
+  for (int i = 0; i < (int)generatedData.allParticlesMeasures.size(); i++) {
+    if (generatedData.allParticlesMeasures[i].empty())
+      continue;
+    reconstructedIndices.push_back(i);
+    reconstructedMeasures.push_back(generatedData.allParticlesMeasures[i]);
+  }
+
+  // One tracker for each setting
+  vector<TrackerParameters> allParameters;
+  vector<Tracker> allTrackers;
+  for (double velocitySigma : velocitySigmas) {
+    for (double directionSigma : directionSigmas) {
+      allParameters.push_back(TrackerParameters{velocitySigma, directionSigma});
+      allTrackers.push_back(Tracker(detectors, allParameters.back()));
+    }
+  }
+
+  // NOTE: each task fits a chunk of particles with a setting. The sums of each task are added afterwards in order,
+  // to keep them independent of the threads
+  constexpr int particlesPerTask = 8 * BATCH_BLOCK_SIZE;
+  const int reconstructedNumber = (int)reconstructedMeasures.size();
+  const int chunksNumber = (reconstructedNumber + particlesPerTask - 1) / particlesPerTask;
+  const int settingsNumber = (int)allTrackers.size();
+  vector<SweepSums> allTasksSums(settingsNumber * chunksNumber);
+
+  threadPool.parallelFor(settingsNumber * chunksNumber, 1, [&](int firstTask, int lastTask) {
+    for (int task = firstTask; task < lastTask; task++) {
+      PROFILE_SCOPE("Simulation: sweep reconstruction");
+      const Tracker &settingTracker = allTrackers[task / chunksNumber];
+      const int begin = (task % chunksNumber) * particlesPerTask;
+      const int end = min(reconstructedNumber, begin + particlesPerTask);
+      const vector<vector<Measurement>> taskMeasures(reconstructedMeasures.begin() + begin, reconstructedMeasures.begin() + end);
+
+      kalmanFilterBatchResult filterResults = settingTracker.kalmanFilterBatch(taskMeasures, false);
+      BatchStateEstimates smoothedStates = settingTracker.kalmanSmootherBatch(filterResults);
+
+      SweepSums &sums = allTasksSums[task];
+      for (int j = 0; j < end - begin; j++) {
+        sums.tracksNumber++;
+        sums.chi2 += filterResults.chi2s[j];
+        sums.ndf += filterResults.ndfs[j];
+
+        // NOTE: the first state, at the particle gun, is the initialization of the filter and is not compared
+        const vector<MatrixStateEstimate> trackSmoothedStates = smoothedStates.getTrackStates(j);
+        const vector<ParticleState> &realStates = generatedData.allParticlesRealStates[reconstructedIndices[begin + j]];
+        const int statesNumber = min((int)trackSmoothedStates.size(), (int)realStates.size());
+        for (int i = 1; i < statesNumber; i++) {
+          const ParticleState &realState = realStates[i];
+          const double realValues[STATE_DIMENSION] = {realState.position.T(), realState.position.X(), realState.position.Y(),
+                                                      1. / realState.velocity.Z(), realState.velocity.X() / realState.velocity.Z(),
+                                                      realState.velocity.Y() / realState.velocity.Z()};
+
+          sums.pullsNumber++;
+          for (int k = 0; k < STATE_DIMENSION; k++) {
+            const double pull = (trackSmoothedStates[i].value(k, 0) - realValues[k]) / sqrt(trackSmoothedStates[i].uncertainty(k, k));
+            sums.pullsSum[k] += pull;
+            sums.pullsSquaresSum[k] += pull * pull;
+          }
+        }
+      }
+    }
+  });
+
+  // Chi2/ndf and mean and standard deviation of the pulls of each setting
+  const string sweepFileName = "../results/Run " + to_string(runCounter) + " Tracker sweep.csv";
+  ofstream sweepFile(sweepFileName);
+  sweepFile << "velocitySigma, directionSigma, tracks, chi2/ndf, t mean, t std, x mean, x std, y mean, y std, "
+               "1/v mean, 1/v std, xz mean, xz std, yz mean, yz std\n";
+
+  cout << "TRACKER SWEEP ON " << reconstructedNumber << " PARTICLES (standard deviation of the pulls of the smoothed states)" << endl;
+  cout << left << setw(14) << "velocity" << setw(14) << "direction" << right << setw(12) << "chi2/ndf" << setw(10) << "t" << setw(10) << "x"
+       << setw(10) << "y" << setw(10) << "1/v" << setw(10) << "xz" << setw(10) << "yz" << endl;
+
+  for (int setting = 0; setting < settingsNumber; setting++) {
+    SweepSums sums;
+    for (int chunk = 0; chunk < chunksNumber; chunk++)
+      sums.add(allTasksSums[setting * chunksNumber + chunk]);
+
+    const double chi2PerNdf = sums.ndf > 0 ? sums.chi2 / sums.ndf : 0.;
+    sweepFile << allParameters[setting].velocityEvolutionSigma << ", " << allParameters[setting].directionEvolutionSigma << ", "
+              << sums.tracksNumber << ", " << chi2PerNdf;
+    cout << left << setw(14) << allParameters[setting].velocityEvolutionSigma << setw(14) << allParameters[setting].directionEvolutionSigma
+         << right << setw(12) << chi2PerNdf;
+
+    for (int k = 0; k < STATE_DIMENSION; k++) {
+      const double mean = sums.pullsNumber > 0 ? sums.pullsSum[k] / sums.pullsNumber : 0.;
+      const double variance = sums.pullsNumber > 0 ? sums.pullsSquaresSum[k] / sums.pullsNumber - mean * mean : 0.;
+      // NOTE: a NaN (i.e. a fit that diverged with this setting) is kept, so that it is noticed
+      const double deviation = std::isnan(variance) ? variance : sqrt(max(0., variance));
+      sweepFile << ", " << mean << ", " << deviation;
+      cout << setw(10) << deviation;
+    }
+    sweepFile << "\n";
+    cout << endl;
+  }
+
+  PROFILE_REPORT("../results/Run " + to_string(runCounter) + " Profile.txt");
   runCounter++;
 }
@@ -0,0 +1,150 @@
+// Header files needed
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+// Custom classes
+#include "ThreadPool.hpp"
+
+// Namespaces
+using namespace std;
+
+// The pool and the index of the worker running in the current thread, if any
+static thread_local const ThreadPool *currentPool = nullptr;
+static thread_local int currentWorkerIndex = 0;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ThreadPool (constructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ThreadPool::ThreadPool(int threadsNumber) {
+  if (threadsNumber <= 0)
+    threadsNumber = max(1, (int)thread::hardware_concurrency());
+
+  // NOTE: the calling thread also works during parallelFor, hence one thread less is spawned
+  workers.reserve(threadsNumber - 1);
+  for (int i = 0; i < threadsNumber - 1; i++)
+    workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ThreadPool (destructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<std::mutex> lock(poolMutex);
+    stopping = true;
+  }
+  jobAvailable.notify_all();
+
+  for (thread &worker : workers)
+    worker.join();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// parallelFor
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void ThreadPool::parallelFor(int itemsNumber, int chunkSize, const function<void(int, int)> &task) {
+  if (chunkSize <= 0)
+    throw std::invalid_argument("The chunk size must be positive");
+  if (itemsNumber <= 0)
+    return;
+
+  // Without workers, or with a single chunk, there is nothing to share
+  if (workers.empty() || itemsNumber <= chunkSize) {
+    for (int begin = 0; begin < itemsNumber; begin += chunkSize)
+      task(begin, min(begin + chunkSize, itemsNumber));
+    return;
+  }
+
+  unique_lock<std::mutex> lock(poolMutex);
+  if (currentTask != nullptr)
+    throw std::logic_error("ThreadPool::parallelFor is not reentrant");
+
+  currentTask = &task;
+  jobItemsNumber = itemsNumber;
+  jobChunkSize = chunkSize;
+  nextItem = 0;
+  runningChunks = 0;
+  firstException = nullptr;
+  jobCounter++;
+  jobAvailable.notify_all();
+
+  runChunks(lock);
+  jobFinished.wait(lock, [this] { return runningChunks == 0; });
+
+  currentTask = nullptr;
+  exception_ptr exception = firstException;
+  firstException = nullptr;
+  lock.unlock();
+
+  if (exception)
+    rethrow_exception(exception);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// getThreadIndex
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int ThreadPool::getThreadIndex() const {
+  return currentPool == this ? currentWorkerIndex : 0;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// runChunks
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void ThreadPool::runChunks(unique_lock<std::mutex> &lock) {
+  while (currentTask != nullptr && nextItem < jobItemsNumber && !firstException) {
+    const int begin = nextItem;
+    const int end = min(begin + jobChunkSize, jobItemsNumber);
+    const function<void(int, int)> &task = *currentTask;
+    nextItem = end;
+    runningChunks++;
+
+    lock.unlock();
+    try {
+      task(begin, end);
+    } catch (...) {
+      lock.lock();
+      if (!firstException)
+        firstException = current_exception();
+      lock.unlock();
+    }
+    lock.lock();
+
+    runningChunks--;
+  }
+
+  if (runningChunks == 0)
+    jobFinished.notify_all();
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// workerLoop
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void ThreadPool::workerLoop(int index) {
+  currentPool = this;
+  currentWorkerIndex = index;
+
+  unique_lock<std::mutex> lock(poolMutex);
+  long lastJob = 0;
+
+  while (true) {
+    jobAvailable.wait(lock, [this, lastJob] { return stopping || jobCounter != lastJob; });
+    if (stopping)
+      return;
+
+    lastJob = jobCounter;
+    runChunks(lock);
+  }
+}
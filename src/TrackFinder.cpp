@@ -0,0 +1,314 @@
+// Header files needed
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+// Custom classes
+#include "TrackFinder.hpp"
+#include "Detector.hpp"
+#include "HitIndex.hpp"
+#include "MeasuresAndStates.hpp"
+#include "PhysicalParameters.hpp"
+#include "Profiler.hpp"
+#include "ThreadPool.hpp"
+#include "Tracker.hpp"
+
+// Namespaces
+using namespace std;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Global variables
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Projection of the state on the measured quantities (t, x, y)
+static constexpr double projectionData[18] = {
+    1., 0., 0., 0., 0., 0.,
+    0., 1., 0., 0., 0., 0.,
+    0., 0., 1., 0., 0., 0.};
+static const ProjectionMatrix projectionMatrix(projectionData);
+
+// Number of seeds followed by each task
+static constexpr int SEEDS_PER_TASK = 64;
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// TrackFinder (constructor)
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+TrackFinder::TrackFinder(const vector<Detector> &detectors, TVector3 originPosition, const TrackerParameters &trackerParameters)
+    : originPosition(originPosition), tracker(detectors, trackerParameters), emptyHitIndex(detectors) {
+  if (detectors.empty())
+    throw invalid_argument("TrackFinder: no detector");
+  if (!detectors[0].isTimeMeasured())
+    throw invalid_argument("TrackFinder: the first detector must measure the time");
+
+  for (const Detector &detector : detectors) {
+    layersZ.push_back(detector.getBottmLeftPosition().Z());
+    layersTimeMeasured.push_back(detector.isTimeMeasured());
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// findTracks
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<FoundTrack> TrackFinder::findTracks(const vector<Measurement> &measures, ThreadPool *threadPool) const {
+  PROFILE_SCOPE("TrackFinder::findTracks");
+
+  if (measures.empty())
+    throw invalid_argument("TrackFinder::findTracks: no measures given");
+
+  HitIndex hitIndex = emptyHitIndex;
+  hitIndex.build(measures);
+
+  // The seeds are the hits of the first layer, ordered by time
+  const LayerHitIndex &firstLayer = hitIndex.getLayer(0);
+  vector<int> seeds(firstLayer.getHitsNumber());
+  iota(seeds.begin(), seeds.end(), 0);
+  stable_sort(seeds.begin(), seeds.end(), [&](int a, int b) { return firstLayer.getHit(a).t < firstLayer.getHit(b).t; });
+
+  // NOTE: the arenas are kept by the threads from a call to the next, so their memory is allocated only once
+  vector<vector<SeedTrack>> seedsTracks(seeds.size());
+  const auto followSeeds = [&](int begin, int end) {
+    thread_local CandidateArena arena;
+    for (int i = begin; i < end; i++)
+      seedsTracks[i] = followSeed(hitIndex, seeds[i], arena);
+  };
+
+  if (threadPool)
+    threadPool->parallelFor((int)seeds.size(), SEEDS_PER_TASK, followSeeds);
+  else
+    followSeeds(0, (int)seeds.size());
+
+  return resolveSharedHits(hitIndex, seedsTracks);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// seedState
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+MatrixStateEstimate TrackFinder::seedState(const Measurement &seed) const {
+  const MeasureCovariance &measureError = tracker.getLayerGeometry(0).measureUncertainty;
+  const double deltaZ = layersZ[0] - originPosition.Z();
+
+  // NOTE: the direction is the one from the origin, changed by the scattering on the first detector. The inverse
+  // velocity is anywhere between the ones of the speed of light and of EVENT_MIN_SPEED
+  const double minInverseVelocity = 1. / (MAX_BETA * LIGHT_SPEED);
+  const double maxInverseVelocity = 1. / EVENT_MIN_SPEED;
+  const double inverseVelocitySigma = (maxInverseVelocity - minInverseVelocity) / 2.;
+
+  double stateData[6] = {seed.t, seed.x, seed.y, (minInverseVelocity + maxInverseVelocity) / 2.,
+                         (seed.x - originPosition.X()) / deltaZ, (seed.y - originPosition.Y()) / deltaZ};
+
+  const double xError = measureError(1, 1);
+  const double yError = measureError(2, 2);
+  const double scatteringError = tracker.getParameters().directionEvolutionSigma * tracker.getParameters().directionEvolutionSigma;
+
+  double stateSData[36] = {
+    measureError(0, 0), 0., 0., 0., 0., 0.,
+    0., xError, 0., 0., xError / deltaZ, 0.,
+    0., 0., yError, 0., 0., yError / deltaZ,
+    0., 0., 0., inverseVelocitySigma * inverseVelocitySigma, 0., 0.,
+    0., xError / deltaZ, 0., 0., xError / (deltaZ * deltaZ) + scatteringError, 0.,
+    0., 0., yError / deltaZ, 0., 0., yError / (deltaZ * deltaZ) + scatteringError};
+
+  return MatrixStateEstimate{StateVector(stateData), StateCovariance(stateSData)};
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// followSeed
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<TrackFinder::SeedTrack> TrackFinder::followSeed(const HitIndex &hitIndex, int seedHit, CandidateArena &arena) const {
+  vector<CandidateNode> &nodes = arena.nodes;
+  vector<Candidate> &currentCandidates = arena.currentCandidates;
+  vector<Candidate> &nextCandidates = arena.nextCandidates;
+  vector<Candidate> &finishedCandidates = arena.finishedCandidates;
+  nodes.clear();
+  currentCandidates.clear();
+  finishedCandidates.clear();
+
+  nodes.push_back(CandidateNode{-1, seedHit, 0., 0});
+  currentCandidates.push_back(Candidate{seedState(hitIndex.getLayer(0).getHit(seedHit)), 0, 1});
+
+  for (int layer = 1; layer < hitIndex.getLayersNumber() && !currentCandidates.empty(); layer++) {
+    const LayerGeometry &geometry = tracker.getLayerGeometry(layer);
+    const LayerHitIndex &layerIndex = hitIndex.getLayer(layer);
+    const bool timeMeasured = layersTimeMeasured[layer];
+
+    // NOTE: without a time measure, the predicted time is taken as measured with a negligible weight
+    MeasureCovariance measureError = geometry.measureUncertainty;
+    if (!timeMeasured)
+      measureError(0, 0) = VERY_HIGH_TIME_ERROR * VERY_HIGH_TIME_ERROR;
+
+    nextCandidates.clear();
+
+    for (const Candidate &candidate : currentCandidates) {
+      const MatrixStateEstimate predictedState = tracker.estimateNextState(candidate.state, geometry);
+      const StateVector &predictedValue = predictedState.value;
+
+      const KalmanGain projectedStateError = multiplyTranspose(predictedState.uncertainty, projectionMatrix);
+      MeasureCovariance residualError = projectionMatrix * projectedStateError;
+      residualError += measureError;
+
+      MeasureCovariance residualErrorInverted = residualError;
+      PROFILE_COUNT("Tracker: matrix inversions", 1);
+      if (!residualErrorInverted.invert(DETERMINANT_TOLERANCE)) {
+        finishedCandidates.push_back(candidate);
+        continue;
+      }
+
+      // The hits compatible with the prediction are inside the bounding box of the gate
+      const HitWindow window{predictedValue(1, 0) - sqrt(TRACK_FINDING_CHI2_GATE * residualError(1, 1)),
+                             predictedValue(1, 0) + sqrt(TRACK_FINDING_CHI2_GATE * residualError(1, 1)),
+                             predictedValue(2, 0) - sqrt(TRACK_FINDING_CHI2_GATE * residualError(2, 2)),
+                             predictedValue(2, 0) + sqrt(TRACK_FINDING_CHI2_GATE * residualError(2, 2)),
+                             predictedValue(0, 0) - sqrt(TRACK_FINDING_CHI2_GATE * residualError(0, 0)),
+                             predictedValue(0, 0) + sqrt(TRACK_FINDING_CHI2_GATE * residualError(0, 0))};
+      arena.hitIndices.clear();
+      layerIndex.findInWindow(window, arena.hitIndices);
+
+      // NOTE: the gain and the filtered uncertainty do not depend on the hit, they are computed with the first one
+      KalmanGain kalmanGain;
+      StateCovariance filteredStateError;
+      bool extended = false;
+
+      for (int hit : arena.hitIndices) {
+        const Measurement &measure = layerIndex.getHit(hit);
+        double residualData[3] = {timeMeasured ? measure.t - predictedValue(0, 0) : 0., measure.x - predictedValue(1, 0),
+                                  measure.y - predictedValue(2, 0)};
+        const MeasureVector residual(residualData);
+
+        double chi2 = 0.;
+        for (int row = 0; row < MEASURE_DIMENSION; row++)
+          for (int col = 0; col < MEASURE_DIMENSION; col++)
+            chi2 += residual(row, 0) * residualErrorInverted(row, col) * residual(col, 0);
+
+        if (!(chi2 < TRACK_FINDING_CHI2_GATE))
+          continue;
+
+        if (!extended) {
+          kalmanGain = projectedStateError * residualErrorInverted;
+          filteredStateError = predictedState.uncertainty - kalmanGain * (projectionMatrix * predictedState.uncertainty);
+          extended = true;
+        }
+
+        StateVector filteredValue = kalmanGain * residual;
+        filteredValue += predictedValue;
+
+        const CandidateNode &parent = nodes[candidate.node];
+        nodes.push_back(CandidateNode{candidate.node, hit, parent.chi2 + chi2, parent.ndf + (timeMeasured ? 3 : 2)});
+        nextCandidates.push_back(Candidate{MatrixStateEstimate{filteredValue, filteredStateError}, (int)nodes.size() - 1, candidate.length + 1});
+      }
+
+      if (!extended)
+        finishedCandidates.push_back(candidate);
+    }
+
+    // Only the best candidates go on (all of them have the same length)
+    if ((int)nextCandidates.size() > TRACK_FINDING_MAX_CANDIDATES) {
+      const auto isBetter = [&](const Candidate &a, const Candidate &b) { return nodes[a.node].chi2 < nodes[b.node].chi2; };
+      partial_sort(nextCandidates.begin(), nextCandidates.begin() + TRACK_FINDING_MAX_CANDIDATES, nextCandidates.end(), isBetter);
+      nextCandidates.resize(TRACK_FINDING_MAX_CANDIDATES);
+    }
+
+    currentCandidates.swap(nextCandidates);
+  }
+
+  finishedCandidates.insert(finishedCandidates.end(), currentCandidates.begin(), currentCandidates.end());
+
+  // The possible tracks of the seed are its longest candidates, with the lowest chi squared
+  const int tracksNumber = min((int)finishedCandidates.size(), TRACK_FINDING_MAX_CANDIDATES);
+  partial_sort(finishedCandidates.begin(), finishedCandidates.begin() + tracksNumber, finishedCandidates.end(),
+               [&](const Candidate &a, const Candidate &b) {
+                 return a.length != b.length ? a.length > b.length : nodes[a.node].chi2 < nodes[b.node].chi2;
+               });
+
+  vector<SeedTrack> seedTracks;
+  seedTracks.reserve(tracksNumber);
+  for (int i = 0; i < tracksNumber; i++) {
+    const Candidate &candidate = finishedCandidates[i];
+    SeedTrack seedTrack{vector<int>(candidate.length), vector<double>(candidate.length), vector<int>(candidate.length)};
+    for (int node = candidate.node, layer = candidate.length - 1; node >= 0; node = nodes[node].parent, layer--) {
+      seedTrack.hits[layer] = nodes[node].hit;
+      seedTrack.chi2s[layer] = nodes[node].chi2;
+      seedTrack.ndfs[layer] = nodes[node].ndf;
+    }
+    seedTracks.push_back(std::move(seedTrack));
+  }
+
+  return seedTracks;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// resolveSharedHits
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<FoundTrack> TrackFinder::resolveSharedHits(const HitIndex &hitIndex, const vector<vector<SeedTrack>> &seedsTracks) const {
+  // NOTE: the seeds take their hits in the order of their best track, from the longest to the shortest one, and the
+  // one with the lowest chi squared first for the same length
+  vector<int> order(seedsTracks.size());
+  iota(order.begin(), order.end(), 0);
+  stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    const SeedTrack &first = seedsTracks[a][0];
+    const SeedTrack &second = seedsTracks[b][0];
+    if (first.hits.size() != second.hits.size())
+      return first.hits.size() > second.hits.size();
+    return first.chi2s.back() < second.chi2s.back();
+  });
+
+  vector<vector<bool>> usedHits(hitIndex.getLayersNumber());
+  for (int layer = 0; layer < hitIndex.getLayersNumber(); layer++)
+    usedHits[layer].assign(hitIndex.getLayer(layer).getHitsNumber(), false);
+
+  // Chosen track of each seed and its length (zero if none)
+  vector<int> chosenTracks(seedsTracks.size(), 0);
+  vector<int> tracksLength(seedsTracks.size(), 0);
+
+  for (int seed : order) {
+    for (int track = 0; track < (int)seedsTracks[seed].size(); track++) {
+      const vector<int> &hits = seedsTracks[seed][track].hits;
+
+      int length = 0;
+      while (length < (int)hits.size() && !usedHits[length][hits[length]])
+        length++;
+
+      if (length > tracksLength[seed]) {
+        chosenTracks[seed] = track;
+        tracksLength[seed] = length;
+      }
+    }
+
+    if (tracksLength[seed] < TRACK_FINDING_MIN_MEASURES) {
+      tracksLength[seed] = 0;
+      continue;
+    }
+
+    for (int layer = 0; layer < tracksLength[seed]; layer++)
+      usedHits[layer][seedsTracks[seed][chosenTracks[seed]].hits[layer]] = true;
+  }
+
+  vector<FoundTrack> foundTracks;
+  for (int seed = 0; seed < (int)seedsTracks.size(); seed++) {
+    const int length = tracksLength[seed];
+    if (length == 0)
+      continue;
+
+    const SeedTrack &seedTrack = seedsTracks[seed][chosenTracks[seed]];
+    FoundTrack foundTrack{{}, seedTrack.chi2s[length - 1], seedTrack.ndfs[length - 1]};
+    foundTrack.measures.reserve(length);
+    for (int layer = 0; layer < length; layer++)
+      foundTrack.measures.push_back(hitIndex.getLayer(layer).getHit(seedTrack.hits[layer]));
+
+    foundTracks.push_back(std::move(foundTrack));
+  }
+
+  return foundTracks;
+}
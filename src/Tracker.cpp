@@ -1,13 +1,19 @@
 // Header files needed
-#include <TMatrixD.h>
-#include <TMatrixDfwd.h>
+#include <TMath.h>
+#include <algorithm>
 #include <cmath>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
 #include <vector>
 
 // Custom classes
 #include "Tracker.hpp"
 #include "MeasuresAndStates.hpp"
 #include "PhysicalParameters.hpp"
+#include "Profiler.hpp"
+#include "StateModels.hpp"
 #include "Utils.hpp"
 
 // Namespaces
@@ -34,42 +40,139 @@ static constexpr double initialStateSData[36] = {
     0., 0., 0., 0., bigDirection, 0.,
     0., 0., 0., 0., 0., bigDirection};
 
-static const TMatrixD initialStateValue(6, 1, initialStateData);
-static const TMatrixD initialStateError(6, 6, initialStateSData);
+static const StateVector initialStateValue(initialStateData);
+static const StateCovariance initialStateError(initialStateSData);
+
+// Projection of the state on the measured quantities (t, x, y)
+static constexpr double projectionData[18] = {
+    1., 0., 0., 0., 0., 0.,
+    0., 1., 0., 0., 0., 0.,
+    0., 0., 1., 0., 0., 0.};
+static const ProjectionMatrix projectionMatrix(projectionData);
 static const MatrixStateEstimate initialState{initialStateValue, initialStateError};
 
+// Evolution uncertainty, except the term of the inverse velocity which depends on the state
+static StateCovariance computeEvolutionUncertainty(const TrackerParameters &parameters) {
+  const double evolutionUncertaintyData[36] = {
+      TIME_EVOLUTION_SIGMA * TIME_EVOLUTION_SIGMA, 0., 0., 0., 0., 0.,
+      0., SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA, 0., 0., 0., 0.,
+      0., 0., SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA, 0., 0., 0.,
+      0., 0., 0., 0., 0., 0.,
+      0., 0., 0., 0., parameters.directionEvolutionSigma * parameters.directionEvolutionSigma, 0.,
+      0., 0., 0., 0., 0., parameters.directionEvolutionSigma * parameters.directionEvolutionSigma};
+  return StateCovariance(evolutionUncertaintyData);
+}
+
+// Inverse of the covariance of a residual. Without a time measure the time row is left out of the update, hence the
+// inverse is the one of the space block, with zeros in the time row and column
+static bool invertResidualCovariance(MeasureCovariance &residualCovariance, bool timeMeasured) {
+  if (timeMeasured)
+    return residualCovariance.invert(DETERMINANT_TOLERANCE);
+
+  residualCovariance(0, 0) = 1.;
+  for (int i = 1; i < MEASURE_DIMENSION; i++) {
+    residualCovariance(0, i) = 0.;
+    residualCovariance(i, 0) = 0.;
+  }
+
+  const bool inverted = residualCovariance.invert(DETERMINANT_TOLERANCE);
+  residualCovariance(0, 0) = 0.;
+  return inverted;
+}
+
+
+// Estimate of the smoother without the information of the filtered state, i.e. from the following measures only, with
+// the initial state of the filter as prior (the following measures may not determine all the parameters):
+// P = (Ps^-1 - Pf^-1 + P0^-1)^-1 and x = P * (Ps^-1 * xs - Pf^-1 * xf + P0^-1 * x0)
+static bool removeFilteredState(const MatrixStateEstimate &smoothedState, const MatrixStateEstimate &filteredState,
+                                MatrixStateEstimate &result) {
+  StateCovariance smoothedInformation = smoothedState.uncertainty;
+  StateCovariance filteredInformation = filteredState.uncertainty;
+  StateCovariance initialInformation = initialStateError;
+  if (!smoothedInformation.invert(DETERMINANT_TOLERANCE) || !filteredInformation.invert(DETERMINANT_TOLERANCE) ||
+      !initialInformation.invert(DETERMINANT_TOLERANCE))
+    return false;
+
+  StateCovariance uncertainty = smoothedInformation - filteredInformation;
+  uncertainty += initialInformation;
+  if (!uncertainty.invert(DETERMINANT_TOLERANCE))
+    return false;
+
+  StateVector value = smoothedInformation * smoothedState.value - filteredInformation * filteredState.value;
+  value += initialInformation * initialStateValue;
+  result = MatrixStateEstimate{uncertainty * value, uncertainty};
+  return true;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Tracker
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Tracker::Tracker(const vector<Detector> &detectors, const TrackerParameters &parameters)
+    : parameters(parameters), evolutionUncertaintyBase(computeEvolutionUncertainty(parameters)), allDetectors(detectors),
+      allLayers(computeLayers(detectors)) {
+  if (!(parameters.velocityEvolutionSigma >= 0.) || !(parameters.directionEvolutionSigma >= 0.))
+    throw std::invalid_argument("Tracker: the evolution sigmas must be non negative");
+}
+
+vector<LayerGeometry> Tracker::getConsideredLayers(const vector<int> &maskedDetectors) const {
+  vector<Detector> consideredDetectors;
+  for (int i = 0; i < (int)allDetectors.size(); i++) {
+    if (find(maskedDetectors.begin(), maskedDetectors.end(), i) == maskedDetectors.end())
+      consideredDetectors.push_back(allDetectors[i]);
+  }
+
+  return computeLayers(consideredDetectors);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// computeLayers
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<LayerGeometry> Tracker::computeLayers(const vector<Detector> &detectors) const {
+  vector<LayerGeometry> layers;
+  layers.reserve(detectors.size());
+
+  for (int i = 0; i < (int)detectors.size(); i++) {
+    // NOTE: the first layer is reached from the particle gun, at z=0
+    const double deltaZ = i != 0
+                            ? detectors[i].getBottmLeftPosition().Z() - detectors[i - 1].getBottmLeftPosition().Z()
+                            : detectors[i].getBottmLeftPosition().Z();
+
+    const MeasureCovariance measureUncertainty = detectors[i].getMeasureUncertainty();
+    MeasureCovariance measureUncertaintyInverted = measureUncertainty;
+    measureUncertaintyInverted.invert(DETERMINANT_TOLERANCE);
+
+    layers.push_back(LayerGeometry{deltaZ, StraightLine4DModel::evolutionJacobian(deltaZ), evolutionUncertaintyBase, measureUncertainty,
+                                   measureUncertaintyInverted, detectors[i].isTimeMeasured()});
+  }
+
+  return layers;
+}
+
 
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // estimateNextState
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 MatrixStateEstimate Tracker::estimateNextState(const MatrixStateEstimate& preaviousState, double deltaZ) const {
-  // Evolution matrix
-  double evolutionMatrixData[36] = {
-            1., 0., 0., deltaZ, 0.,     0.,
-            0., 1., 0., 0.,     deltaZ, 0.,
-            0., 0., 1., 0.,     0.,     deltaZ,
-            0., 0., 0., 1.,     0.,     0.,
-            0., 0., 0., 0.,     1.,     0.,
-            0., 0., 0., 0.,     0.,     1.};
-
-  TMatrixD evolutionMatrix(6, 6, evolutionMatrixData);
-  TMatrixD estimatedStateValue = TMatrixD(evolutionMatrix, TMatrixD::kMult, preaviousState.value);
+  return estimateNextState(preaviousState, LayerGeometry{deltaZ, StraightLine4DModel::evolutionJacobian(deltaZ), evolutionUncertaintyBase, {}, {}});
+}
+
+MatrixStateEstimate Tracker::estimateNextState(const MatrixStateEstimate& preaviousState, const LayerGeometry &layer) const {
+  const EvolutionMatrix &evolutionMatrix = layer.evolutionMatrix;
+  const StateVector estimatedStateValue = evolutionMatrix * preaviousState.value;
 
   // Evolution of inverse velocity
-  double inverseVelocityEvolutionSigma = V_EVOLUTION_SIGMA_KALMAN * pow(estimatedStateValue(3,0), 2);
+  const double inverseVelocityEvolutionSigma = parameters.velocityEvolutionSigma * pow(estimatedStateValue(3,0), 2);
 
   // Evolution of uncertainty
-  double evolutionUncertaintyData[36] = {
-        TIME_EVOLUTION_SIGMA * TIME_EVOLUTION_SIGMA, 0., 0., 0., 0., 0.,
-        0., SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA, 0., 0., 0., 0.,
-        0., 0., SPACE_EVOLUTION_SIGMA* SPACE_EVOLUTION_SIGMA, 0., 0., 0.,
-        0., 0., 0., inverseVelocityEvolutionSigma * inverseVelocityEvolutionSigma, 0., 0.,
-        0., 0., 0., 0., DIRECTION_EVOLUTION_SIGMA * DIRECTION_EVOLUTION_SIGMA, 0.,
-        0., 0., 0., 0., 0., DIRECTION_EVOLUTION_SIGMA * DIRECTION_EVOLUTION_SIGMA};
-
-  TMatrixD evolutionUncertainty(6, 6, evolutionUncertaintyData);
-  TMatrixD estimatedStateError = TMatrixD(evolutionMatrix, TMatrixD::kMult, TMatrixD(preaviousState.uncertainty, TMatrixD::kMultTranspose, evolutionMatrix));
+  StateCovariance evolutionUncertainty = layer.evolutionUncertainty;
+  evolutionUncertainty(3, 3) = inverseVelocityEvolutionSigma * inverseVelocityEvolutionSigma;
+
+  StateCovariance estimatedStateError = evolutionMatrix * multiplyTranspose(preaviousState.uncertainty, evolutionMatrix);
   estimatedStateError += evolutionUncertainty;
 
   return MatrixStateEstimate{estimatedStateValue, estimatedStateError};
@@ -80,23 +183,27 @@ MatrixStateEstimate Tracker::estimateNextState(const MatrixStateEstimate& preavi
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // initializeFilterRealTime
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void Tracker::initializeFilterRealTime(const vector<Measurement> &measures, vector<MatrixStateEstimate> &predictedStates, vector<MatrixStateEstimate> &filteredStates) const {
+void Tracker::initializeFilterRealTime(const vector<Measurement> &measures, const vector<LayerGeometry> &layers, vector<MatrixStateEstimate> &predictedStates,
+                                       vector<MatrixStateEstimate> &filteredStates) const {
+  // NOTE: without a time measure, the time is unknown
+  const bool timeMeasured = layers[0].timeMeasured;
+
   // Predicted state
-  double predictedData[6] = {measures[0].t, measures[0].x, measures[0].y, 1. / LIGHT_SPEED, 0., 0.};
-  TMatrixD stateValue(6, 1, predictedData);
+  double predictedData[6] = {timeMeasured ? measures[0].t : 0., measures[0].x, measures[0].y, 1. / LIGHT_SPEED, 0., 0.};
+  StateVector stateValue(predictedData);
 
   // Measure uncertainty
-  TMatrixD measureError = consideredDetectors[0].getMeasureUncertainty();
+  const MeasureCovariance &firstMeasureError = layers[0].measureUncertainty;
 
   double firstSdata[36] = {
-    measureError(0, 0), 0., 0., 0., 0., 0.,
-    0., measureError(1, 1), 0., 0., 0., 0.,
-    0., 0., measureError(2, 2), 0., 0., 0.,
+    timeMeasured ? firstMeasureError(0, 0) : bigT, 0., 0., 0., 0., 0.,
+    0., firstMeasureError(1, 1), 0., 0., 0., 0.,
+    0., 0., firstMeasureError(2, 2), 0., 0., 0.,
     0., 0., 0., bigVInv, 0., 0.,
     0., 0., 0., 0., bigDirection, 0.,
     0., 0., 0., 0., 0., bigDirection};
 
-  TMatrixD stateError(6, 6, firstSdata);
+  StateCovariance stateError(firstSdata);
 
   // Predicted and filtered states
   predictedStates.push_back(MatrixStateEstimate{initialStateValue, initialStateError});
@@ -105,36 +212,40 @@ void Tracker::initializeFilterRealTime(const vector<Measurement> &measures, vect
   if (measures.size() == 1) return;
 
   // State
-  const double deltaZ = consideredDetectors[1].getBottmLeftPosition().Z() - consideredDetectors[0].getBottmLeftPosition().Z();
+  const double deltaZ = layers[1].deltaZ;
   const double t = measures[1].t;
   const double x = measures[1].x;
   const double y = measures[1].y;
 
   // Variations
-  TMatrixD preaviousStateValue = TMatrixD(filteredStates[1].value);
+  const StateVector preaviousStateValue = filteredStates[1].value;
   const double deltaT = t - preaviousStateValue(0, 0);
   const double deltaX = x - preaviousStateValue(1, 0);
   const double deltaY = y - preaviousStateValue(2, 0);
 
-  double data[6] = {t, x, y, deltaT / deltaZ, deltaX / deltaZ, deltaY / deltaZ};
-  stateValue.SetMatrixArray(data);
+  // NOTE: the inverse velocity is unknown without the time measures of both layers
+  const bool nextTimeMeasured = layers[1].timeMeasured;
+  const bool velocityMeasured = timeMeasured && nextTimeMeasured;
+
+  double data[6] = {nextTimeMeasured ? t : 0., x, y, velocityMeasured ? deltaT / deltaZ : 1. / LIGHT_SPEED, deltaX / deltaZ, deltaY / deltaZ};
+  stateValue = StateVector(data);
 
   // Uncertainties
-  measureError = consideredDetectors[1].getMeasureUncertainty();
-  TMatrixD preaviousStateError = TMatrixD(filteredStates[1].uncertainty);
+  const MeasureCovariance &measureError = layers[1].measureUncertainty;
+  const StateCovariance preaviousStateError = filteredStates[1].uncertainty;
   const double sDeltaT2 = measureError(0, 0) + preaviousStateError(0, 0);
   const double sDeltaX2 = measureError(1, 1) + preaviousStateError(1, 1);
   const double sDeltaY2 = measureError(2, 2) + preaviousStateError(2, 2);
 
   double secondSdata[36] = {
-    measureError(0, 0), 0., 0., 0., 0., 0.,
+    nextTimeMeasured ? measureError(0, 0) : bigT, 0., 0., 0., 0., 0.,
     0., measureError(1, 1), 0., 0., 0., 0.,
     0., 0., measureError(2, 2), 0., 0., 0.,
-    0., 0., 0., sDeltaT2 / (deltaZ * deltaZ), 0., 0.,
+    0., 0., 0., velocityMeasured ? sDeltaT2 / (deltaZ * deltaZ) : bigVInv, 0., 0.,
     0., 0., 0., 0., sDeltaX2 / (deltaZ * deltaZ), 0.,
     0., 0., 0., 0., 0., sDeltaY2 / (deltaZ * deltaZ)};
 
-  stateError.SetMatrixArray(secondSdata);
+  stateError = StateCovariance(secondSdata);
   predictedStates.push_back(MatrixStateEstimate{initialStateValue, initialStateError});
   filteredStates.push_back(MatrixStateEstimate{stateValue, stateError});
 }
@@ -144,9 +255,10 @@ void Tracker::initializeFilterRealTime(const vector<Measurement> &measures, vect
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // initializeFilter
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void Tracker::initializeFilter(const vector<Measurement> &measures, vector<MatrixStateEstimate> &predictedStates, vector<MatrixStateEstimate> &filteredStates) const {
+void Tracker::initializeFilter(const vector<Measurement> &measures, const vector<LayerGeometry> &layers, vector<MatrixStateEstimate> &predictedStates,
+                               vector<MatrixStateEstimate> &filteredStates) const {
   if (measures.size() == 1) {
-    initializeFilterRealTime(measures, predictedStates, filteredStates);
+    initializeFilterRealTime(measures, layers, predictedStates, filteredStates);
     return;
   }
 
@@ -162,26 +274,30 @@ void Tracker::initializeFilter(const vector<Measurement> &measures, vector<Matri
   const double deltaT = nextT - t;
   const double deltaX = nextX - x;
   const double deltaY = nextY - y;
-  const double deltaZ = consideredDetectors[1].getBottmLeftPosition().Z() - consideredDetectors[0].getBottmLeftPosition().Z();
+  const double deltaZ = layers[1].deltaZ;
+
+  // NOTE: without a time measure the time is unknown, and so is the inverse velocity without the time measures of both layers
+  const bool timeMeasured = layers[0].timeMeasured;
+  const bool velocityMeasured = timeMeasured && layers[1].timeMeasured;
 
   // State
-  double data[6] = {measures[0].t,   measures[0].x,   measures[0].y, deltaT / deltaZ, deltaX / deltaZ, deltaY / deltaZ};
-  TMatrixD stateValue(6, 1, data);
+  double data[6] = {timeMeasured ? t : 0., x, y, velocityMeasured ? deltaT / deltaZ : 1. / LIGHT_SPEED, deltaX / deltaZ, deltaY / deltaZ};
+  const StateVector stateValue(data);
 
   // Uncertainties
-  TMatrixD measureError = consideredDetectors[0].getMeasureUncertainty();
-  TMatrixD nextMeasureError = consideredDetectors[1].getMeasureUncertainty();
+  const MeasureCovariance &measureError = layers[0].measureUncertainty;
+  const MeasureCovariance &nextMeasureError = layers[1].measureUncertainty;
   const double sDeltaT2 = measureError(0, 0) + nextMeasureError(0, 0);
   const double sDeltaX2 = measureError(1, 1) + nextMeasureError(1, 1);
   const double sDeltaY2 = measureError(2, 2) + nextMeasureError(2, 2);
 
-  double sdata[36] = {measureError(0, 0),           0., 0., 0., 0., 0., 0.,
-                      measureError(1, 1),           0., 0., 0., 0., 0., 0.,
-                      measureError(2, 2),           0., 0., 0., 0., 0., 0.,
-                      sDeltaT2 / (deltaZ * deltaZ), 0., 0., 0., 0., 0., 0.,
-                      sDeltaX2 / (deltaZ * deltaZ), 0., 0., 0., 0., 0., 0.,
+  double sdata[36] = {timeMeasured ? measureError(0, 0) : bigT,                   0., 0., 0., 0., 0., 0.,
+                      measureError(1, 1),                                          0., 0., 0., 0., 0., 0.,
+                      measureError(2, 2),                                          0., 0., 0., 0., 0., 0.,
+                      velocityMeasured ? sDeltaT2 / (deltaZ * deltaZ) : bigVInv,  0., 0., 0., 0., 0., 0.,
+                      sDeltaX2 / (deltaZ * deltaZ),                                0., 0., 0., 0., 0., 0.,
                       sDeltaY2 / (deltaZ * deltaZ)};
-  TMatrixD stateError(6, 6, sdata);
+  const StateCovariance stateError(sdata);
 
   predictedStates.push_back(MatrixStateEstimate{initialStateValue, initialStateError});
   filteredStates.push_back(MatrixStateEstimate{stateValue, stateError});
@@ -192,10 +308,22 @@ void Tracker::initializeFilter(const vector<Measurement> &measures, vector<Matri
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // kalmanFilter
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-kalmanFilterResult Tracker::kalmanFilter(const vector<Measurement> &measures, bool logging, bool realTime) const {
-  if (logging) cout << "KALMAN FILTER LOGS" << endl;
+kalmanFilterResult Tracker::kalmanFilter(const vector<Measurement> &measures, bool logging, bool realTime,
+                                         const FilterAbortPolicy &abortPolicy) const {
+  return kalmanFilter(measures, allLayers, logging, realTime, abortPolicy);
+}
+
+kalmanFilterResult Tracker::kalmanFilter(const vector<Measurement> &measures, const vector<LayerGeometry> &layers, bool logging,
+                                         bool realTime, const FilterAbortPolicy &abortPolicy) const {
+  PROFILE_SCOPE("Tracker::kalmanFilter");
+
+  // NOTE: the logs are collected and printed at once, so that the logs of tracks fitted concurrently do not mix
+  ostringstream logStream;
+  if (logging) logStream << "KALMAN FILTER LOGS" << endl;
   vector<MatrixStateEstimate> filteredStates;
+  filteredStates.reserve(measures.size() + 1);
   vector<MatrixStateEstimate> predictedStates;
+  predictedStates.reserve(measures.size() + 1);
 
   // State at the particle gun
   // TODO: Consider removing this if using root file to save results
@@ -204,76 +332,98 @@ kalmanFilterResult Tracker::kalmanFilter(const vector<Measurement> &measures, bo
 
   int firstMeasureIndex = realTime ? 2 : 1;
   if (realTime)
-    initializeFilterRealTime(measures, predictedStates, filteredStates);
+    initializeFilterRealTime(measures, layers, predictedStates, filteredStates);
   else 
-    initializeFilter(measures, predictedStates, filteredStates);
+    initializeFilter(measures, layers, predictedStates, filteredStates);
+
+  double chi2 = 0.;
+  int ndf = 0;
+  bool aborted = false;
 
   // Initializing the first state
   for (int i = firstMeasureIndex; i < (int)measures.size(); i++) {
     // Measure
     double measureData[3] = {measures[i].t, measures[i].x, measures[i].y};
-    TMatrixD measure(3, 1, measureData);
-    TMatrixD measureError = consideredDetectors[i].getMeasureUncertainty();
+    const MeasureVector measure(measureData);
+    const MeasureCovariance &measureError = layers[i].measureUncertainty;
 
     // Previous state
-    TMatrixD preaviousStateValue = TMatrixD(filteredStates[i].value);
-    TMatrixD preaviousStateError = TMatrixD(filteredStates[i].uncertainty);
-
-    const double deltaZ = consideredDetectors[i].getBottmLeftPosition().Z() - consideredDetectors[i - 1].getBottmLeftPosition().Z();
-
-    double projectiondata[18] = {1., 0., 0., 0., 0., 0., 0., 1., 0.,
-                                 0., 0., 0., 0., 0., 1., 0., 0., 0.};
-    TMatrixD projectionMatrix(3, 6, projectiondata);
+    const StateCovariance &preaviousStateError = filteredStates[i].uncertainty;
 
     // Estimate next state
-    MatrixStateEstimate estimatedNextState = estimateNextState(filteredStates[i], deltaZ);
-    TMatrixD estimatedStateValue = TMatrixD(estimatedNextState.value);
-    TMatrixD estimatedStateError = TMatrixD(estimatedNextState.uncertainty);
+    const MatrixStateEstimate estimatedNextState = estimateNextState(filteredStates[i], layers[i]);
+    const StateVector &estimatedStateValue = estimatedNextState.value;
+    const StateCovariance &estimatedStateError = estimatedNextState.uncertainty;
 
     // Residual
-    TMatrixD residual = TMatrixD(measure, TMatrixD::kMinus, TMatrixD(projectionMatrix, TMatrixD::kMult, estimatedStateValue));
+    MeasureVector residual = measure - projectionMatrix * estimatedStateValue;
+    if (!layers[i].timeMeasured)
+      residual(0, 0) = 0.;
 
     // Kalman Gain
-    TMatrixD kalmanGainDenominator = TMatrixD(projectionMatrix, TMatrixD::kMult, TMatrixD(estimatedStateError, TMatrixD::kMultTranspose, projectionMatrix));
+    const KalmanGain projectedStateError = multiplyTranspose(estimatedStateError, projectionMatrix);
+    MeasureCovariance kalmanGainDenominator = projectionMatrix * projectedStateError;
 
     kalmanGainDenominator += measureError;
-    kalmanGainDenominator.SetTol(DETERMINANT_TOLERANCE);
-    kalmanGainDenominator.Invert();
+    PROFILE_COUNT("Tracker: matrix inversions", 1);
+    if (!invertResidualCovariance(kalmanGainDenominator, layers[i].timeMeasured)) {
+      if (logging) logStream << "Track given up at measure " << i << ": singular residual covariance" << endl;
+      aborted = true;
+      break;
+    }
+
+    // Chi2 of the residual
+    double stepChi2 = 0.;
+    for (int row = 0; row < MEASURE_DIMENSION; row++)
+      for (int col = 0; col < MEASURE_DIMENSION; col++)
+        stepChi2 += residual(row, 0) * kalmanGainDenominator(row, col) * residual(col, 0);
+
+    // NOTE: without a time measure, the update has a degree of freedom less
+    chi2 += stepChi2;
+    ndf += layers[i].timeMeasured ? MEASURE_DIMENSION : MEASURE_DIMENSION - 1;
+    if (abortPolicy.isHopeless(stepChi2, chi2, ndf)) {
+      if (logging) logStream << "Track given up at measure " << i << ": chi2 = " << stepChi2 << ", total chi2 = " << chi2 << endl;
+      aborted = true;
+      break;
+    }
 
-    TMatrixD kalmanGain = TMatrixD(TMatrixD(estimatedStateError, TMatrixD::kMultTranspose, projectionMatrix), TMatrixD::kMult, kalmanGainDenominator);
+    const KalmanGain kalmanGain = projectedStateError * kalmanGainDenominator;
     
     // Filtered state
-    TMatrixD filteredStateValue = TMatrixD(kalmanGain, TMatrixD::kMult, residual);
+    StateVector filteredStateValue = kalmanGain * residual;
 
     // Printouts for logging
     if (logging) {
-      cout << "Residual: " << endl;
-      Utils::printMatrix(residual);
-      cout << endl;
+      logStream << "Residual: " << endl;
+      Utils::printMatrix(residual, logStream);
+      logStream << endl;
 
-      cout << "Preavious State Error" << endl;
-      Utils::printMatrix(preaviousStateError);
-      cout<<endl;
+      logStream << "Preavious State Error" << endl;
+      Utils::printMatrix(preaviousStateError, logStream);
+      logStream<<endl;
       
-      cout << "Estimated State Error" << endl;
-      Utils::printMatrix(estimatedStateError);
-      cout<< endl;
+      logStream << "Estimated State Error" << endl;
+      Utils::printMatrix(estimatedStateError, logStream);
+      logStream<< endl;
       
-      cout << "Kalman Gain" << endl;
-      Utils::printMatrix(kalmanGain);
-      cout << endl << endl << endl;
+      logStream << "Kalman Gain" << endl;
+      Utils::printMatrix(kalmanGain, logStream);
+      logStream << endl << endl << endl;
     }
 
     // Update filtered state
     filteredStateValue += estimatedStateValue;
-    TMatrixD filteredStateError = TMatrixD(kalmanGain, TMatrixD::kMult, TMatrixD(projectionMatrix, TMatrixD::kMult, estimatedStateError));
-    filteredStateError = TMatrixD(estimatedStateError, TMatrixD::kMinus, filteredStateError);
+    const StateCovariance filteredStateError = estimatedStateError - kalmanGain * (projectionMatrix * estimatedStateError);
 
-    predictedStates.push_back(MatrixStateEstimate{estimatedStateValue, estimatedStateError});
+    predictedStates.push_back(estimatedNextState);
     filteredStates.push_back(MatrixStateEstimate{filteredStateValue, filteredStateError});
   }
 
-  return kalmanFilterResult{predictedStates, filteredStates};
+  PROFILE_COUNT("Tracker: tracks fitted", 1);
+  PROFILE_COUNT("Tracker: hits processed", measures.size());
+
+  if (logging) Utils::printLog(logStream.str());
+  return kalmanFilterResult{std::move(predictedStates), std::move(filteredStates), firstMeasureIndex + 1, chi2, ndf, aborted};
 }
 
 
@@ -282,114 +432,656 @@ kalmanFilterResult Tracker::kalmanFilter(const vector<Measurement> &measures, bo
 // kalmanSmoother
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 vector<MatrixStateEstimate> Tracker::kalmanSmoother(const vector<MatrixStateEstimate> &filteredStates, bool logging) const {
+  // NOTE: without the predictions of the filter, all of them are computed again
+  return smoothStates(filteredStates, {}, (int)filteredStates.size(), allLayers, logging);
+}
+
+vector<MatrixStateEstimate> Tracker::kalmanSmoother(const kalmanFilterResult &filterResult, bool logging) const {
+  return kalmanSmoother(filterResult, allLayers, logging);
+}
+
+vector<MatrixStateEstimate> Tracker::kalmanSmoother(const kalmanFilterResult &filterResult, const vector<LayerGeometry> &layers, bool logging) const {
+  return smoothStates(filterResult.filteredStates, filterResult.predictedStates, filterResult.firstPredictedLayer, layers, logging);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// smoothStates
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<MatrixStateEstimate> Tracker::smoothStates(const vector<MatrixStateEstimate> &filteredStates, const vector<MatrixStateEstimate> &predictedStates,
+                                                  int firstPredictedLayer, const vector<LayerGeometry> &layers, bool logging) const {
+  PROFILE_SCOPE("Tracker::kalmanSmoother");
+
+  ostringstream logStream;
   if (logging) {
-    cout << "KALMAN SMOOTHER LOGS" << endl;
+    logStream << "KALMAN SMOOTHER LOGS" << endl;
   }
   
   // Smoothed state vector
   vector<MatrixStateEstimate> smoothedStates;
+  smoothedStates.reserve(filteredStates.size());
   smoothedStates.push_back(filteredStates.back());
 
-  // Evolution matrix
-  TMatrixD evolutionMatrix(6,6);
-
   // Initializing the first state
   for (int i = (int)filteredStates.size() - 2; i > -1; i--) {
-    TMatrixD smoothedNextStateValue = TMatrixD(smoothedStates.back().value);
-    TMatrixD smoothedNextStateError = TMatrixD(smoothedStates.back().uncertainty);
+    const StateVector &smoothedNextStateValue = smoothedStates.back().value;
+    const StateCovariance &smoothedNextStateError = smoothedStates.back().uncertainty;
 
     // NOTE: This indexes are like this because filteredStates has an element corresponding to the initial state (i.e. at z=0)
-    const double deltaZ = i != 0
-                            ? consideredDetectors[i].getBottmLeftPosition().Z() - consideredDetectors[i - 1].getBottmLeftPosition().Z()
-                            : consideredDetectors[i].getBottmLeftPosition().Z();
-
-    double evolutiondata[36] = {
-            1., 0., 0., deltaZ, 0., 0.,
-            0., 1., 0., 0., deltaZ, 0.,
-            0., 0., 1., 0., 0., deltaZ,
-            0., 0., 0., 1., 0., 0.,
-            0., 0., 0., 0., 1., 0.,
-            0., 0., 0., 0., 0., 1.};
-
-    evolutionMatrix.SetMatrixArray(evolutiondata);
-
-    // Estimation of next state
-    MatrixStateEstimate estimatedNextState = estimateNextState(filteredStates[i], deltaZ);
-    TMatrixD estimatedNextStateValue = TMatrixD(estimatedNextState.value);
-    TMatrixD estimatedNextStateError = TMatrixD(estimatedNextState.uncertainty);
-    TMatrixD estimatedNextStateErrorInverted = TMatrixD(estimatedNextStateError);
-    estimatedNextStateErrorInverted.SetTol(DETERMINANT_TOLERANCE);
+    const LayerGeometry &layer = layers[i];
+    const EvolutionMatrix &evolutionMatrix = layer.evolutionMatrix;
+
+    // Estimation of next state (the prediction of the filter is the same, when available)
+    const MatrixStateEstimate estimatedNextState = i + 1 >= firstPredictedLayer ? predictedStates[i + 1] : estimateNextState(filteredStates[i], layer);
+    const StateVector &estimatedNextStateValue = estimatedNextState.value;
+    const StateCovariance &estimatedNextStateError = estimatedNextState.uncertainty;
 
     // Printouts for logging
     if (logging) {
-      cout << "Evolution Matrix" << endl;
-      Utils::printMatrix(evolutionMatrix);
-      cout << endl;
+      logStream << "Evolution Matrix" << endl;
+      Utils::printMatrix(evolutionMatrix, logStream);
+      logStream << endl;
 
-      cout << "Firtered state" << endl;
-      Utils::printMatrix(filteredStates[i].uncertainty);
-      cout << endl;
+      logStream << "Firtered state" << endl;
+      Utils::printMatrix(filteredStates[i].uncertainty, logStream);
+      logStream << endl;
       
-      cout << "Estimated next state error" << endl;
-      Utils::printMatrix(estimatedNextStateErrorInverted);
-      cout << endl << endl;
+      logStream << "Estimated next state error" << endl;
+      Utils::printMatrix(estimatedNextStateError, logStream);
+      logStream << endl << endl;
     }
 
-    estimatedNextStateErrorInverted.Invert();
-
     // Smoother Gain
-    TMatrixD smootherGain = TMatrixD(filteredStates[i].uncertainty, TMatrixD::kMultTranspose, evolutionMatrix);
-
-    // Printouts for logging
-    if (logging) {
-      cout << "Gain first part" << endl;
-      Utils::printMatrix(smootherGain);
-      cout << endl;
+    // NOTE: the gain is P F^T E^-1, with P and E symmetric, hence its transpose solves E G^T = F P. Solving the system
+    // avoids the explicit inverse of E, which is badly conditioned since its variances span many orders of magnitude
+    const StateCovariance gainSystemRhs = evolutionMatrix * filteredStates[i].uncertainty;
+    StateCovariance smootherGainTransposed;
+
+    if (!estimatedNextStateError.solveSymmetric(gainSystemRhs, smootherGainTransposed)) {
+      PROFILE_COUNT("Tracker: matrix inversions", 1);
+      StateCovariance estimatedNextStateErrorInverted = estimatedNextStateError;
+      estimatedNextStateErrorInverted.invert(DETERMINANT_TOLERANCE);
+      smootherGainTransposed = estimatedNextStateErrorInverted * gainSystemRhs;
     }
 
-    smootherGain = TMatrixD(smootherGain, TMatrixD::kMult, estimatedNextStateErrorInverted);
+    const SmootherGain smootherGain = smootherGainTransposed.transpose();
 
     // Residual
-    TMatrixD residualValue = TMatrixD(smoothedNextStateValue, TMatrixD::kMinus, estimatedNextStateValue);
+    const StateVector residualValue = smoothedNextStateValue - estimatedNextStateValue;
 
     // Smoothed state
-    TMatrixD smoothedStateValue = TMatrixD(smootherGain, TMatrixD::kMult, residualValue);
+    StateVector smoothedStateValue = smootherGain * residualValue;
     smoothedStateValue += filteredStates[i].value;
 
     // Uncertainties
-    TMatrixD residualError = TMatrixD(smoothedNextStateError, TMatrixD::kMinus,estimatedNextStateError);
-    TMatrixD smoothedStateError = TMatrixD(residualError, TMatrixD::kMultTranspose, smootherGain);
-    smoothedStateError = TMatrixD(smootherGain, TMatrixD::kMult, smoothedStateError);
+    const StateCovariance residualError = smoothedNextStateError - estimatedNextStateError;
+    StateCovariance smoothedStateError = smootherGain * multiplyTranspose(residualError, smootherGain);
     smoothedStateError += filteredStates[i].uncertainty;
 
     // Printouts for logging
     if (logging) {
-      cout << "Estimated next state error inverted" << endl;
-      Utils::printMatrix(estimatedNextStateErrorInverted);
-      cout << endl;
+      logStream << "Smoother gain" << endl;
+      Utils::printMatrix(smootherGain, logStream);
+      logStream << endl;
 
-      cout << "Smoother gain" << endl;
-      Utils::printMatrix(smootherGain);
-      cout << endl;
+      logStream << "Residual error" << endl;
+      Utils::printMatrix(residualError, logStream);
+      logStream << endl;
 
-      cout << "Residual error" << endl;
-      Utils::printMatrix(residualError);
-      cout << endl;
-
-      cout << "Residual value" << endl;
-      Utils::printMatrix(residualValue);
-      cout << endl << endl;
+      logStream << "Residual value" << endl;
+      Utils::printMatrix(residualValue, logStream);
+      logStream << endl << endl;
     }
 
     smoothedStates.push_back(MatrixStateEstimate{smoothedStateValue, smoothedStateError});
   }
 
+  if (logging) Utils::printLog(logStream.str());
   std::reverse(smoothedStates.begin(), smoothedStates.end());
   return smoothedStates;
 }
 
 
 
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Batch helpers
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// NOTE: In all the following functions element i of track j of an array is stored at [i * stride + j], and
+// the loops over the BATCH_BLOCK_SIZE tracks of a block are always the innermost ones, with a fixed trip
+// count, so that they can be vectorized by the compiler.
+// The sparse structure of the evolution and projection matrices is exploited explicitly, while keeping the
+// same order of the floating point operations used by the single track filter.
+
+// Index of the element (row, col) of a covariance matrix
+static constexpr int covarianceIndex(int row, int col) { return row * STATE_DIMENSION + col; }
+
+// Same as initializeFilter, applied to the active tracks of a block (i.e. those with at least two measures)
+static void initializeFilterBlock(const double measure[MEASURE_DIMENSION][BATCH_BLOCK_SIZE], const double nextMeasure[MEASURE_DIMENSION][BATCH_BLOCK_SIZE],
+                                  const bool *active, const LayerGeometry &layer, const LayerGeometry &nextLayer,
+                                  double *filteredValue, double *filteredUncertainty, int stride) {
+  const double deltaZ = nextLayer.deltaZ;
+
+  for (int row = 0; row < MEASURE_DIMENSION; row++) {
+    // Whether the measure and its variation are known (the time and the inverse velocity need the time measures)
+    const bool valueMeasured = row != 0 || layer.timeMeasured;
+    const bool variationMeasured = row != 0 || (layer.timeMeasured && nextLayer.timeMeasured);
+
+    // Variances of the measures and of their differences
+    const double sMeasure2 = valueMeasured ? layer.measureUncertainty(row, row) : bigT;
+    const double sDelta2 = layer.measureUncertainty(row, row) + nextLayer.measureUncertainty(row, row);
+    const double sVariation2 = variationMeasured ? sDelta2 / (deltaZ * deltaZ) : bigVInv;
+
+    for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+      if (!active[j])
+        continue;
+
+      filteredValue[row * stride + j] = valueMeasured ? measure[row][j] : 0.;
+      filteredValue[(row + 3) * stride + j] = variationMeasured ? (nextMeasure[row][j] - measure[row][j]) / deltaZ : 1. / LIGHT_SPEED;
+
+      for (int col = 0; col < STATE_DIMENSION; col++) {
+        filteredUncertainty[covarianceIndex(row, col) * stride + j] = col == row ? sMeasure2 : 0.;
+        filteredUncertainty[covarianceIndex(row + 3, col) * stride + j] = col == row + 3 ? sVariation2 : 0.;
+      }
+    }
+  }
+}
+
+// Same as estimateNextState, applied to the tracks of a block
+static void estimateNextStateBlock(const double *value, const double *uncertainty, int stride, double deltaZ,
+                                   double *predictedValue, double *predictedUncertainty, int predictedStride,
+                                   const TrackerParameters &parameters) {
+  // Uncertainty multiplied on the right by the transposed evolution matrix
+  double rightEvolved[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE];
+
+  for (int row = 0; row < STATE_DIMENSION; row++) {
+    for (int col = 0; col < 3; col++) {
+      const double *element = &uncertainty[covarianceIndex(row, col) * stride];
+      const double *shiftedElement = &uncertainty[covarianceIndex(row, col + 3) * stride];
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        rightEvolved[covarianceIndex(row, col)][j] = element[j] + deltaZ * shiftedElement[j];
+    }
+    for (int col = 3; col < STATE_DIMENSION; col++) {
+      const double *element = &uncertainty[covarianceIndex(row, col) * stride];
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        rightEvolved[covarianceIndex(row, col)][j] = element[j];
+    }
+  }
+
+  // Value and uncertainty multiplied on the left by the evolution matrix
+  for (int row = 0; row < 3; row++) {
+    for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+      predictedValue[row * predictedStride + j] = value[row * stride + j] + deltaZ * value[(row + 3) * stride + j];
+
+    for (int col = 0; col < STATE_DIMENSION; col++)
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        predictedUncertainty[covarianceIndex(row, col) * predictedStride + j] = rightEvolved[covarianceIndex(row, col)][j] + deltaZ * rightEvolved[covarianceIndex(row + 3, col)][j];
+  }
+  for (int row = 3; row < STATE_DIMENSION; row++) {
+    for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+      predictedValue[row * predictedStride + j] = value[row * stride + j];
+
+    for (int col = 0; col < STATE_DIMENSION; col++)
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        predictedUncertainty[covarianceIndex(row, col) * predictedStride + j] = rightEvolved[covarianceIndex(row, col)][j];
+  }
+
+  // Evolution of uncertainty
+  for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+    const double inverseVelocityEvolutionSigma = parameters.velocityEvolutionSigma * pow(predictedValue[3 * predictedStride + j], 2);
+
+    predictedUncertainty[covarianceIndex(0, 0) * predictedStride + j] += TIME_EVOLUTION_SIGMA * TIME_EVOLUTION_SIGMA;
+    predictedUncertainty[covarianceIndex(1, 1) * predictedStride + j] += SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA;
+    predictedUncertainty[covarianceIndex(2, 2) * predictedStride + j] += SPACE_EVOLUTION_SIGMA * SPACE_EVOLUTION_SIGMA;
+    predictedUncertainty[covarianceIndex(3, 3) * predictedStride + j] += inverseVelocityEvolutionSigma * inverseVelocityEvolutionSigma;
+    predictedUncertainty[covarianceIndex(4, 4) * predictedStride + j] += parameters.directionEvolutionSigma * parameters.directionEvolutionSigma;
+    predictedUncertainty[covarianceIndex(5, 5) * predictedStride + j] += parameters.directionEvolutionSigma * parameters.directionEvolutionSigma;
+  }
+}
+
+// Kalman update of the tracks of a block. Inactive tracks keep the predicted state.
+// NOTE: without a time measure, the time row is left out as in invertResidualCovariance
+static void updateBlock(const double *predictedValue, const double *predictedUncertainty, int stride,
+                        const double measure[MEASURE_DIMENSION][BATCH_BLOCK_SIZE], const bool *active,
+                        const MeasureCovariance &measureError, bool timeMeasured, double *filteredValue, double *filteredUncertainty,
+                        double *stepChi2) {
+  // Inverse of the residual covariance (H * P * H^T + R) computed with the adjugate matrix
+  double inverse[MEASURE_DIMENSION * MEASURE_DIMENSION][BATCH_BLOCK_SIZE];
+
+  for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+    double s[MEASURE_DIMENSION][MEASURE_DIMENSION];
+    for (int row = 0; row < MEASURE_DIMENSION; row++)
+      for (int col = 0; col < MEASURE_DIMENSION; col++)
+        s[row][col] = predictedUncertainty[covarianceIndex(row, col) * stride + j] + measureError(row, col);
+
+    if (!timeMeasured) {
+      s[0][0] = 1.;
+      s[0][1] = s[0][2] = s[1][0] = s[2][0] = 0.;
+    }
+
+    const double c00 = s[1][1] * s[2][2] - s[1][2] * s[2][1];
+    const double c01 = s[1][2] * s[2][0] - s[1][0] * s[2][2];
+    const double c02 = s[1][0] * s[2][1] - s[1][1] * s[2][0];
+    const double c10 = s[0][2] * s[2][1] - s[0][1] * s[2][2];
+    const double c11 = s[0][0] * s[2][2] - s[0][2] * s[2][0];
+    const double c12 = s[0][1] * s[2][0] - s[0][0] * s[2][1];
+    const double c20 = s[0][1] * s[1][2] - s[0][2] * s[1][1];
+    const double c21 = s[0][2] * s[1][0] - s[0][0] * s[1][2];
+    const double c22 = s[0][0] * s[1][1] - s[0][1] * s[1][0];
+    const double inverseDeterminant = 1. / (s[0][0] * c00 + s[0][1] * c01 + s[0][2] * c02);
+
+    inverse[0][j] = timeMeasured ? c00 * inverseDeterminant : 0.;
+    inverse[1][j] = c10 * inverseDeterminant;
+    inverse[2][j] = c20 * inverseDeterminant;
+    inverse[3][j] = c01 * inverseDeterminant;
+    inverse[4][j] = c11 * inverseDeterminant;
+    inverse[5][j] = c21 * inverseDeterminant;
+    inverse[6][j] = c02 * inverseDeterminant;
+    inverse[7][j] = c12 * inverseDeterminant;
+    inverse[8][j] = c22 * inverseDeterminant;
+  }
+
+  // Kalman gain (P * H^T * inverse), set to zero for the inactive tracks
+  double kalmanGain[STATE_DIMENSION * MEASURE_DIMENSION][BATCH_BLOCK_SIZE];
+
+  for (int row = 0; row < STATE_DIMENSION; row++)
+    for (int col = 0; col < MEASURE_DIMENSION; col++)
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+        double gain = 0.;
+        for (int k = 0; k < MEASURE_DIMENSION; k++)
+          gain += predictedUncertainty[covarianceIndex(row, k) * stride + j] * inverse[k * MEASURE_DIMENSION + col][j];
+        kalmanGain[row * MEASURE_DIMENSION + col][j] = active[j] ? gain : 0.;
+      }
+
+  // Residual
+  double residual[MEASURE_DIMENSION][BATCH_BLOCK_SIZE];
+
+  for (int row = 0; row < MEASURE_DIMENSION; row++)
+    for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+      residual[row][j] = active[j] && (row != 0 || timeMeasured) ? measure[row][j] - predictedValue[row * stride + j] : 0.;
+
+  // Chi2 of the residual (zero for the inactive tracks)
+  for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+    stepChi2[j] = 0.;
+
+  for (int row = 0; row < MEASURE_DIMENSION; row++)
+    for (int col = 0; col < MEASURE_DIMENSION; col++)
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        stepChi2[j] += residual[row][j] * inverse[row * MEASURE_DIMENSION + col][j] * residual[col][j];
+
+  // Filtered state
+  for (int row = 0; row < STATE_DIMENSION; row++)
+    for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+      double correction = 0.;
+      for (int k = 0; k < MEASURE_DIMENSION; k++)
+        correction += kalmanGain[row * MEASURE_DIMENSION + k][j] * residual[k][j];
+      filteredValue[row * stride + j] = correction + predictedValue[row * stride + j];
+    }
+
+  for (int row = 0; row < STATE_DIMENSION; row++)
+    for (int col = 0; col < STATE_DIMENSION; col++)
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+        double correction = 0.;
+        for (int k = 0; k < MEASURE_DIMENSION; k++)
+          correction += kalmanGain[row * MEASURE_DIMENSION + k][j] * predictedUncertainty[covarianceIndex(k, col) * stride + j];
+        filteredUncertainty[covarianceIndex(row, col) * stride + j] = predictedUncertainty[covarianceIndex(row, col) * stride + j] - correction;
+      }
+}
+
+// Solution of systems of symmetric positive definite matrices through their Cholesky decomposition
+// NOTE: as in the single track smoother, the system is solved without the explicit inverse of the matrix, which is badly
+// conditioned when some parameters are unknown (e.g. the time and the inverse velocity before the time measures)
+static void solveCovarianceBlock(const double matrix[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE],
+                                 const double rhs[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE],
+                                 double solution[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE]) {
+  // Lower triangular factor (only the elements with row >= col are used) and inverse of its diagonal
+  double lower[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE];
+  double inverseDiagonal[STATE_DIMENSION][BATCH_BLOCK_SIZE];
+
+  for (int col = 0; col < STATE_DIMENSION; col++) {
+    for (int row = col; row < STATE_DIMENSION; row++) {
+      double *element = lower[covarianceIndex(row, col)];
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        element[j] = matrix[covarianceIndex(row, col)][j];
+      for (int k = 0; k < col; k++)
+        for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+          element[j] -= lower[covarianceIndex(row, k)][j] * lower[covarianceIndex(col, k)][j];
+
+      // NOTE: a non positive pivot only appears in masked tracks, whose result is discarded
+      if (row == col) {
+        for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+          element[j] = element[j] > 0. ? sqrt(element[j]) : 1.;
+          inverseDiagonal[col][j] = 1. / element[j];
+        }
+      } else {
+        for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+          element[j] *= inverseDiagonal[col][j];
+      }
+    }
+  }
+
+  // Forward (L * Y = rhs) and backward (L^T * solution = Y) substitutions, one column of the right hand side at a time
+  for (int col = 0; col < STATE_DIMENSION; col++) {
+    for (int row = 0; row < STATE_DIMENSION; row++) {
+      double *element = solution[covarianceIndex(row, col)];
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        element[j] = rhs[covarianceIndex(row, col)][j];
+      for (int k = 0; k < row; k++)
+        for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+          element[j] -= lower[covarianceIndex(row, k)][j] * solution[covarianceIndex(k, col)][j];
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        element[j] *= inverseDiagonal[row][j];
+    }
+
+    for (int row = STATE_DIMENSION - 1; row >= 0; row--) {
+      double *element = solution[covarianceIndex(row, col)];
+      for (int k = row + 1; k < STATE_DIMENSION; k++)
+        for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+          element[j] -= lower[covarianceIndex(k, row)][j] * solution[covarianceIndex(k, col)][j];
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        element[j] *= inverseDiagonal[row][j];
+    }
+  }
+}
+
+// Kalman smoother step of the tracks of a block. Tracks with useFiltered keep the filtered state.
+// NOTE: the predicted state is computed only if the one of the filter is not given (null pointers)
+static void smoothBlock(const double *filteredValue, const double *filteredUncertainty, const double *predictedValue,
+                        const double *predictedUncertainty, const double *nextSmoothedValue, const double *nextSmoothedUncertainty,
+                        int stride, double deltaZ, const bool *useFiltered, double *smoothedValue, double *smoothedUncertainty,
+                        const TrackerParameters &parameters) {
+  // Estimation of next state
+  double estimatedValue[STATE_DIMENSION][BATCH_BLOCK_SIZE];
+  double estimatedUncertainty[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE];
+  if (predictedValue) {
+    for (int element = 0; element < STATE_DIMENSION; element++)
+      copy_n(predictedValue + element * stride, BATCH_BLOCK_SIZE, estimatedValue[element]);
+    for (int element = 0; element < STATE_DIMENSION * STATE_DIMENSION; element++)
+      copy_n(predictedUncertainty + element * stride, BATCH_BLOCK_SIZE, estimatedUncertainty[element]);
+  } else {
+    estimateNextStateBlock(filteredValue, filteredUncertainty, stride, deltaZ, estimatedValue[0], estimatedUncertainty[0], BATCH_BLOCK_SIZE, parameters);
+  }
+
+  // Smoother gain (filtered uncertainty * F^T * inverted estimated uncertainty), whose transpose solves E * G^T = F * P
+  double gainSystemRhs[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE];
+
+  for (int row = 0; row < STATE_DIMENSION; row++)
+    for (int col = 0; col < STATE_DIMENSION; col++) {
+      const double *element = &filteredUncertainty[covarianceIndex(col, row) * stride];
+      if (row < 3) {
+        const double *shiftedElement = &filteredUncertainty[covarianceIndex(col, row + 3) * stride];
+        for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+          gainSystemRhs[covarianceIndex(row, col)][j] = element[j] + deltaZ * shiftedElement[j];
+      } else {
+        for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+          gainSystemRhs[covarianceIndex(row, col)][j] = element[j];
+      }
+    }
+
+  double smootherGainTransposed[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE];
+  solveCovarianceBlock(estimatedUncertainty, gainSystemRhs, smootherGainTransposed);
+
+  double smootherGain[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE];
+
+  for (int row = 0; row < STATE_DIMENSION; row++)
+    for (int col = 0; col < STATE_DIMENSION; col++)
+      copy_n(smootherGainTransposed[covarianceIndex(col, row)], BATCH_BLOCK_SIZE, smootherGain[covarianceIndex(row, col)]);
+
+  // Smoothed state
+  for (int row = 0; row < STATE_DIMENSION; row++)
+    for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+      double correction = 0.;
+      for (int k = 0; k < STATE_DIMENSION; k++)
+        correction += smootherGain[covarianceIndex(row, k)][j] * (nextSmoothedValue[k * stride + j] - estimatedValue[k][j]);
+      smoothedValue[row * stride + j] = useFiltered[j] ? filteredValue[row * stride + j] : correction + filteredValue[row * stride + j];
+    }
+
+  // Uncertainties (residual error multiplied on the right by the transposed gain first)
+  double rightProduct[STATE_DIMENSION * STATE_DIMENSION][BATCH_BLOCK_SIZE];
+
+  for (int row = 0; row < STATE_DIMENSION; row++)
+    for (int col = 0; col < STATE_DIMENSION; col++) {
+      double *element = rightProduct[covarianceIndex(row, col)];
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        element[j] = 0.;
+      for (int k = 0; k < STATE_DIMENSION; k++)
+        for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+          element[j] += (nextSmoothedUncertainty[covarianceIndex(row, k) * stride + j] - estimatedUncertainty[covarianceIndex(row, k)][j]) *
+                        smootherGain[covarianceIndex(col, k)][j];
+    }
+
+  for (int row = 0; row < STATE_DIMENSION; row++)
+    for (int col = 0; col < STATE_DIMENSION; col++) {
+      double correction[BATCH_BLOCK_SIZE] = {};
+      for (int k = 0; k < STATE_DIMENSION; k++)
+        for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+          correction[j] += smootherGain[covarianceIndex(row, k)][j] * rightProduct[covarianceIndex(k, col)][j];
+
+      const double *filteredElement = &filteredUncertainty[covarianceIndex(row, col) * stride];
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        smoothedUncertainty[covarianceIndex(row, col) * stride + j] = useFiltered[j] ? filteredElement[j] : correction[j] + filteredElement[j];
+    }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// kalmanFilterBatch
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+kalmanFilterBatchResult Tracker::kalmanFilterBatch(const vector<vector<Measurement>> &allMeasures, bool realTime,
+                                                   const FilterAbortPolicy &abortPolicy) const {
+  return kalmanFilterBatch(allMeasures, allLayers, realTime, abortPolicy);
+}
+
+kalmanFilterBatchResult Tracker::kalmanFilterBatch(const vector<vector<Measurement>> &allMeasures, const vector<LayerGeometry> &layers,
+                                                   bool realTime, const FilterAbortPolicy &abortPolicy) const {
+  PROFILE_SCOPE("Tracker::kalmanFilterBatch");
+
+  const int tracksNumber = (int)allMeasures.size();
+
+  // Number of measures of the longest track
+  int maxMeasuresNumber = 0;
+  for (const vector<Measurement> &measures : allMeasures) {
+    if (measures.empty())
+      throw std::invalid_argument("Tracker::kalmanFilterBatch: track without measures");
+    maxMeasuresNumber = max(maxMeasuresNumber, (int)measures.size());
+  }
+
+  if (maxMeasuresNumber > (int)layers.size())
+    throw std::invalid_argument("Tracker::kalmanFilterBatch: more measures than considered detectors");
+
+  BatchStateEstimates predictedStates(tracksNumber, maxMeasuresNumber + 1);
+  BatchStateEstimates filteredStates(tracksNumber, maxMeasuresNumber + 1);
+  const int stride = filteredStates.getStride();
+
+  // Initialization of every track as in the single track filter
+  // NOTE: the initialization from the first two measures is applied to whole blocks, while the real time
+  // initialization and the tracks with a single measure go through the single track code
+  predictedStates.fillLayer(0, initialState);
+  filteredStates.fillLayer(0, initialState);
+  predictedStates.fillLayer(1, initialState);
+
+  vector<MatrixStateEstimate> initialPredictedStates;
+  vector<MatrixStateEstimate> initialFilteredStates;
+
+  for (int track = 0; track < tracksNumber; track++) {
+    predictedStates.setStatesNumber(track, allMeasures[track].size() + 1);
+    filteredStates.setStatesNumber(track, allMeasures[track].size() + 1);
+
+    if (!realTime && allMeasures[track].size() > 1)
+      continue;
+
+    initialPredictedStates.assign(1, initialState);
+    initialFilteredStates.assign(1, initialState);
+
+    if (realTime)
+      initializeFilterRealTime(allMeasures[track], layers, initialPredictedStates, initialFilteredStates);
+    else
+      initializeFilter(allMeasures[track], layers, initialPredictedStates, initialFilteredStates);
+
+    for (int layer = 0; layer < (int)initialFilteredStates.size(); layer++) {
+      predictedStates.setState(layer, track, initialPredictedStates[layer]);
+      filteredStates.setState(layer, track, initialFilteredStates[layer]);
+    }
+  }
+
+  // NOTE: a track given up by the abort policy ends before the measure of its hopeless update
+  vector<int> measuresNumbers(tracksNumber);
+  for (int track = 0; track < tracksNumber; track++)
+    measuresNumbers[track] = (int)allMeasures[track].size();
+
+  vector<double> chi2s(tracksNumber, 0.);
+  vector<int> ndfs(tracksNumber, 0);
+  vector<bool> aborted(tracksNumber, false);
+
+  // Measures of the current layer for a block of tracks
+  double measureBlock[MEASURE_DIMENSION][BATCH_BLOCK_SIZE];
+  double nextMeasureBlock[MEASURE_DIMENSION][BATCH_BLOCK_SIZE];
+  bool activeBlock[BATCH_BLOCK_SIZE];
+  double chi2Block[BATCH_BLOCK_SIZE];
+
+  const int firstMeasureIndex = realTime ? 2 : 1;
+  for (int begin = 0; begin < tracksNumber; begin += BATCH_BLOCK_SIZE) {
+    if (!realTime && maxMeasuresNumber > 1) {
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+        activeBlock[j] = begin + j < tracksNumber && allMeasures[begin + j].size() > 1;
+
+        const Measurement measure = activeBlock[j] ? allMeasures[begin + j][0] : Measurement{0., 0., 0., 0};
+        const Measurement nextMeasure = activeBlock[j] ? allMeasures[begin + j][1] : Measurement{0., 0., 0., 0};
+        measureBlock[0][j] = measure.t;
+        measureBlock[1][j] = measure.x;
+        measureBlock[2][j] = measure.y;
+        nextMeasureBlock[0][j] = nextMeasure.t;
+        nextMeasureBlock[1][j] = nextMeasure.x;
+        nextMeasureBlock[2][j] = nextMeasure.y;
+      }
+
+      initializeFilterBlock(measureBlock, nextMeasureBlock, activeBlock, layers[0], layers[1], filteredStates.getValues(1) + begin,
+                            filteredStates.getUncertainties(1) + begin, stride);
+    }
+
+    for (int i = firstMeasureIndex; i < maxMeasuresNumber; i++) {
+      // Gathering of the measures, masking the tracks that have already ended and the padding
+      int activeNumber = 0;
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+        activeBlock[j] = begin + j < tracksNumber && i < measuresNumbers[begin + j];
+        activeNumber += activeBlock[j];
+
+        measureBlock[0][j] = activeBlock[j] ? allMeasures[begin + j][i].t : 0.;
+        measureBlock[1][j] = activeBlock[j] ? allMeasures[begin + j][i].x : 0.;
+        measureBlock[2][j] = activeBlock[j] ? allMeasures[begin + j][i].y : 0.;
+      }
+
+      if (activeNumber == 0)
+        break;
+
+      const LayerGeometry &layer = layers[i];
+
+      // Prediction and update
+      estimateNextStateBlock(filteredStates.getValues(i) + begin, filteredStates.getUncertainties(i) + begin, stride, layer.deltaZ,
+                             predictedStates.getValues(i + 1) + begin, predictedStates.getUncertainties(i + 1) + begin, stride, parameters);
+      updateBlock(predictedStates.getValues(i + 1) + begin, predictedStates.getUncertainties(i + 1) + begin, stride, measureBlock,
+                  activeBlock, layer.measureUncertainty, layer.timeMeasured, filteredStates.getValues(i + 1) + begin,
+                  filteredStates.getUncertainties(i + 1) + begin, chi2Block);
+      // NOTE: the inverses of the masked tracks are computed too, but they are not counted
+      PROFILE_COUNT("Tracker: matrix inversions", activeNumber);
+
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++) {
+        if (!activeBlock[j])
+          continue;
+
+        const int track = begin + j;
+        chi2s[track] += chi2Block[j];
+        ndfs[track] += layer.timeMeasured ? MEASURE_DIMENSION : MEASURE_DIMENSION - 1;
+        if (abortPolicy.isHopeless(chi2Block[j], chi2s[track], ndfs[track])) {
+          aborted[track] = true;
+          measuresNumbers[track] = i;
+          predictedStates.setStatesNumber(track, i + 1);
+          filteredStates.setStatesNumber(track, i + 1);
+        }
+      }
+    }
+  }
+
+  PROFILE_COUNT("Tracker: tracks fitted", tracksNumber);
+  PROFILE_COUNT("Tracker: hits processed", accumulate(allMeasures.begin(), allMeasures.end(), 0LL,
+                                                      [](long long sum, const vector<Measurement> &measures) { return sum + measures.size(); }));
+
+  return kalmanFilterBatchResult{std::move(predictedStates), std::move(filteredStates), firstMeasureIndex + 1,
+                                 std::move(chi2s), std::move(ndfs), std::move(aborted)};
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// kalmanSmootherBatch
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+BatchStateEstimates Tracker::kalmanSmootherBatch(const BatchStateEstimates &filteredStates) const {
+  return smoothStatesBatch(filteredStates, nullptr, filteredStates.getLayersNumber(), allLayers);
+}
+
+BatchStateEstimates Tracker::kalmanSmootherBatch(const kalmanFilterBatchResult &filterResult) const {
+  return kalmanSmootherBatch(filterResult, allLayers);
+}
+
+BatchStateEstimates Tracker::kalmanSmootherBatch(const kalmanFilterBatchResult &filterResult, const vector<LayerGeometry> &layers) const {
+  return smoothStatesBatch(filterResult.filteredStates, &filterResult.predictedStates, filterResult.firstPredictedLayer, layers);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// smoothStatesBatch
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+BatchStateEstimates Tracker::smoothStatesBatch(const BatchStateEstimates &filteredStates, const BatchStateEstimates *predictedStates,
+                                               int firstPredictedLayer, const vector<LayerGeometry> &layers) const {
+  PROFILE_SCOPE("Tracker::kalmanSmootherBatch");
+
+  const int tracksNumber = filteredStates.getTracksNumber();
+  const int layersNumber = filteredStates.getLayersNumber();
+  const int stride = filteredStates.getStride();
+
+  BatchStateEstimates smoothedStates(tracksNumber, layersNumber);
+  for (int track = 0; track < tracksNumber; track++)
+    smoothedStates.setStatesNumber(track, filteredStates.getStatesNumber(track));
+
+  if (layersNumber == 0)
+    return smoothedStates;
+
+  // Whether the track has its last state on the current layer (or it has already ended)
+  bool useFilteredBlock[BATCH_BLOCK_SIZE];
+
+  for (int begin = 0; begin < tracksNumber; begin += BATCH_BLOCK_SIZE) {
+    // The last layer is the last state of every track that reaches it
+    const int lastLayer = layersNumber - 1;
+    for (int element = 0; element < STATE_DIMENSION; element++)
+      copy_n(filteredStates.getValues(lastLayer) + element * stride + begin, BATCH_BLOCK_SIZE, smoothedStates.getValues(lastLayer) + element * stride + begin);
+    for (int element = 0; element < STATE_DIMENSION * STATE_DIMENSION; element++)
+      copy_n(filteredStates.getUncertainties(lastLayer) + element * stride + begin, BATCH_BLOCK_SIZE, smoothedStates.getUncertainties(lastLayer) + element * stride + begin);
+
+    for (int i = layersNumber - 2; i > -1; i--) {
+      for (int j = 0; j < BATCH_BLOCK_SIZE; j++)
+        useFilteredBlock[j] = begin + j >= tracksNumber || i >= filteredStates.getStatesNumber(begin + j) - 1;
+
+      // NOTE: This indexes are like this because filteredStates has an element corresponding to the initial state (i.e. at z=0)
+      const double deltaZ = layers[i].deltaZ;
+
+      // Prediction of the filter, when available (the tracks that have ended are masked)
+      const bool reusePrediction = i + 1 >= firstPredictedLayer;
+      const double *predictedValue = reusePrediction ? predictedStates->getValues(i + 1) + begin : nullptr;
+      const double *predictedUncertainty = reusePrediction ? predictedStates->getUncertainties(i + 1) + begin : nullptr;
+
+      smoothBlock(filteredStates.getValues(i) + begin, filteredStates.getUncertainties(i) + begin, predictedValue, predictedUncertainty,
+                  smoothedStates.getValues(i + 1) + begin, smoothedStates.getUncertainties(i + 1) + begin, stride, deltaZ, useFilteredBlock,
+                  smoothedStates.getValues(i) + begin, smoothedStates.getUncertainties(i) + begin, parameters);
+    }
+  }
+
+  return smoothedStates;
+}
+
+
+
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // computeChi2s
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -418,14 +1110,123 @@ Chi2Variables Tracker::computeChi2s(const vector<ParticleState> &expectedStates,
   // Printouts for logging
   if (logging) {
     int dof = (skipFirst) ? obtainedStates.size() - 7 : obtainedStates.size() - 6;
-
-    cout <<"t =     " << tChi2 <<  "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(tChi2, dof) << endl;
-    cout <<"x =     " << xChi2 <<  "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(xChi2, dof) << endl;
-    cout <<"y =     " << yChi2 <<  "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(yChi2, dof) << endl;
-    cout <<"1/v_z = " << vChi2 <<  "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(vChi2, dof) << endl;
-    cout <<"xz =    " << xzChi2 << "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(xzChi2, dof) << endl;
-    cout <<"yz =    " << yzChi2 << "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(yzChi2, dof) << endl;
+    ostringstream logStream;
+
+    logStream <<"t =     " << tChi2 <<  "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(tChi2, dof) << endl;
+    logStream <<"x =     " << xChi2 <<  "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(xChi2, dof) << endl;
+    logStream <<"y =     " << yChi2 <<  "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(yChi2, dof) << endl;
+    logStream <<"1/v_z = " << vChi2 <<  "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(vChi2, dof) << endl;
+    logStream <<"xz =    " << xzChi2 << "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(xzChi2, dof) << endl;
+    logStream <<"yz =    " << yzChi2 << "  | dof = " << dof << "  | pvalue = " <<TMath::Prob(yzChi2, dof) << endl;
+    Utils::printLog(logStream.str());
   }
 
   return Chi2Variables{tChi2, xChi2, yChi2, vChi2, xzChi2, yzChi2};
 }
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// computeUnbiasedStates
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<MatrixStateEstimate> Tracker::computeUnbiasedStates(const vector<Measurement> &measures, const kalmanFilterResult &filterResult,
+                                                           const vector<MatrixStateEstimate> &smoothedStates) const {
+  return computeUnbiasedStates(measures, filterResult, smoothedStates, allLayers);
+}
+
+vector<MatrixStateEstimate> Tracker::computeUnbiasedStates(const vector<Measurement> &measures, const kalmanFilterResult &filterResult,
+                                                           const vector<MatrixStateEstimate> &smoothedStates,
+                                                           const vector<LayerGeometry> &layers) const {
+  // NOTE: a track given up by the filter has states only on the layers before its hopeless update
+  const int layersNumber = (int)smoothedStates.size() - 1;
+  if (layersNumber < 1 || layersNumber > (int)measures.size() || filterResult.predictedStates.size() != smoothedStates.size())
+    throw std::invalid_argument("Tracker::computeUnbiasedStates: the states do not match the measures");
+  if (filterResult.firstPredictedLayer > 2)
+    throw std::invalid_argument("Tracker::computeUnbiasedStates: the filter must not be initialized in real time");
+
+  // NOTE: without other measures, the unbiased state of a single layer is the state at the particle gun
+  if (layersNumber == 1)
+    return vector<MatrixStateEstimate>{initialState};
+
+  vector<MatrixStateEstimate> unbiasedStates;
+  unbiasedStates.reserve(layersNumber);
+
+  for (int i = 0; i < layersNumber; i++) {
+    // NOTE: the last prediction of the filter already comes from all the other measures
+    if (i == layersNumber - 1 && i + 1 >= filterResult.firstPredictedLayer) {
+      unbiasedStates.push_back(filterResult.predictedStates[i + 1]);
+      continue;
+    }
+
+    // NOTE: the filtered state on the first layer is initialized from its measure and from the next one, hence the
+    // measure cannot be removed as the others. The estimate from the other measures is the one carried backwards by
+    // the smoother, i.e. the smoothed state without the information of the filtered state
+    if (i == 0) {
+      MatrixStateEstimate unbiasedState;
+      PROFILE_COUNT("Tracker: matrix inversions", 4);
+      if (!removeFilteredState(smoothedStates[1], filterResult.filteredStates[1], unbiasedState))
+        throw std::runtime_error("Tracker::computeUnbiasedStates: singular covariance on the first layer");
+      unbiasedStates.push_back(unbiasedState);
+      continue;
+    }
+
+    const bool timeMeasured = layers[i].timeMeasured;
+    double measureData[3] = {measures[i].t, measures[i].x, measures[i].y};
+    const MeasureVector measure(measureData);
+    const StateVector &smoothedStateValue = smoothedStates[i + 1].value;
+    const StateCovariance &smoothedStateError = smoothedStates[i + 1].uncertainty;
+
+    // NOTE: the measure is removed with the update of the filter with the opposite measure uncertainty, i.e. with the
+    // gain P * H^T * (H * P * H^T - R)^-1, which moves the state away from the measure and increases its uncertainty
+    const KalmanGain projectedStateError = multiplyTranspose(smoothedStateError, projectionMatrix);
+    MeasureCovariance gainDenominator = projectionMatrix * projectedStateError;
+    gainDenominator -= layers[i].measureUncertainty;
+    PROFILE_COUNT("Tracker: matrix inversions", 1);
+    if (!invertResidualCovariance(gainDenominator, timeMeasured))
+      throw std::runtime_error("Tracker::computeUnbiasedStates: singular residual covariance at measure " + std::to_string(i));
+
+    const KalmanGain removalGain = projectedStateError * gainDenominator;
+
+    MeasureVector residual = measure - projectionMatrix * smoothedStateValue;
+    if (!timeMeasured)
+      residual(0, 0) = 0.;
+
+    StateVector unbiasedStateValue = removalGain * residual;
+    unbiasedStateValue += smoothedStateValue;
+    const StateCovariance unbiasedStateError = smoothedStateError - removalGain * (projectionMatrix * smoothedStateError);
+
+    unbiasedStates.push_back(MatrixStateEstimate{unbiasedStateValue, unbiasedStateError});
+  }
+
+  return unbiasedStates;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// computePulls
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<PullVariables> Tracker::computePulls(const vector<Measurement> &measures, const vector<MatrixStateEstimate> &unbiasedStates) const {
+  return computePulls(measures, unbiasedStates, allLayers);
+}
+
+vector<PullVariables> Tracker::computePulls(const vector<Measurement> &measures, const vector<MatrixStateEstimate> &unbiasedStates,
+                                            const vector<LayerGeometry> &layers) const {
+  // NOTE: the unbiased states of a track given up end before some of its measures
+  const int layersNumber = (int)std::min(measures.size(), unbiasedStates.size());
+  vector<PullVariables> pulls;
+  pulls.reserve(layersNumber);
+
+  for (int i = 0; i < layersNumber; i++) {
+    const StateVector &estimatedValue = unbiasedStates[i].value;
+    const StateCovariance &estimatedError = unbiasedStates[i].uncertainty;
+    const MeasureCovariance &measureError = layers[i].measureUncertainty;
+
+    // NOTE: the time of a detector without a time measure has no pull
+    pulls.push_back(PullVariables{layers[i].timeMeasured ? (measures[i].t - estimatedValue(0, 0)) / sqrt(measureError(0, 0) + estimatedError(0, 0)) : 0.,
+                                  (measures[i].x - estimatedValue(1, 0)) / sqrt(measureError(1, 1) + estimatedError(1, 1)),
+                                  (measures[i].y - estimatedValue(2, 0)) / sqrt(measureError(2, 2) + estimatedError(2, 2))});
+  }
+
+  return pulls;
+}
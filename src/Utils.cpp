@@ -1,7 +1,10 @@
 // Header files needed
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 
@@ -9,6 +12,7 @@
 #include "Utils.hpp"
 #include "Detector.hpp"
 #include "MeasuresAndStates.hpp"
+#include "Profiler.hpp"
 
 // Namespaces
 using namespace std;
@@ -18,9 +22,9 @@ using namespace std;
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // printMatrix
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-void Utils::printMatrix(TMatrixD matrix) {
+void Utils::printMatrix(TMatrixD matrix, ostream &stream) {
   // Printout settings
-  cout << std::scientific << setprecision(2);
+  stream << std::scientific << setprecision(2);
 
   // Matrix dimensions
   const int nrows = matrix.GetNrows();
@@ -28,41 +32,25 @@ void Utils::printMatrix(TMatrixD matrix) {
 
   // Printout the matrix
   for (int i = 0; i < nrows; i++) {
-    cout << (i == 0 ? "[" : " ");
+    stream << (i == 0 ? "[" : " ");
 
     for (int j = 0; j < ncols; j++) {
-      cout << matrix(i, j) << ", ";
+      stream << matrix(i, j) << ", ";
     }
 
-    cout << (i == nrows - 1 ? "]" : "") << endl;
+    stream << (i == nrows - 1 ? "]" : "") << endl;
   }
 }
 
 
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// separateMeasuresInParticles
+// printLog
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// TODO: Implement the real definition in the header (increasing the spees should be enough) and uncomment the line in the code. 
-// Othewise change the description.
-vector<vector<Measurement>> Utils::separateMeasuresInParticles(const vector<Measurement> &allMeasures) {
-  if (allMeasures.empty()){
-    throw std::invalid_argument("No measures given");
-  }
-
-  // std::sort(allMeasures.begin(), allMeasures.end(), [](Measurement a,
-  // Measurement b){return a.t < b.t;});
-
-  vector<vector<Measurement>> singleParticleMeasuresVectors;
-
-  for (Measurement measure : allMeasures) {
-    if (singleParticleMeasuresVectors.empty() || measure.detectorID < singleParticleMeasuresVectors.back().back().detectorID) {
-      singleParticleMeasuresVectors.push_back(vector<Measurement>());
-    }
-    singleParticleMeasuresVectors.back().push_back(measure);
-  }
-
-  return singleParticleMeasuresVectors;
+void Utils::printLog(const string &text) {
+  static mutex logMutex;
+  lock_guard<mutex> lock(logMutex);
+  cout << text << flush;
 }
 
 
@@ -87,7 +75,8 @@ vector<Measurement> Utils::concatenateMeasures(const vector<vector<Measurement>>
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void Utils::saveDataToCSV(const vector<Detector> &detectors, const vector<vector<ParticleState>> &theoreticalStates, const vector<vector<ParticleState>> &realStates,
     const vector<vector<Measurement>> &measures, const vector<vector<MatrixStateEstimate>> &predictedStates, const vector<vector<MatrixStateEstimate>> &filteredStates,
-    const vector<vector<MatrixStateEstimate>> &smoothedStates, const int runCounter) {
+    const vector<vector<MatrixStateEstimate>> &smoothedStates, const int runCounter, const int firstParticleIndex) {
+  PROFILE_SCOPE("Utils::saveDataToCSV");
 
   // Check if the vectors are of the same length
   const bool particleLengthCheck = theoreticalStates.size() == realStates.size() && theoreticalStates.size() == predictedStates.size() &&
@@ -99,7 +88,11 @@ void Utils::saveDataToCSV(const vector<Detector> &detectors, const vector<vector
 
   // Particles loop
   for (int j = 0; j < (int)theoreticalStates.size(); j++) {
-    string filename = "../results/Run " + std::to_string(runCounter) + " Particle " + std::to_string(j) + ".csv";
+    // NOTE: a particle without measures has not been reconstructed
+    if (measures[j].empty())
+      continue;
+
+    string filename = "../results/Run " + std::to_string(runCounter) + " Particle " + std::to_string(firstParticleIndex + j) + ".csv";
     std::ofstream csvFile;
     
     // Write header to the CSV file
@@ -116,7 +109,7 @@ void Utils::saveDataToCSV(const vector<Detector> &detectors, const vector<vector
         csvFile << "0.,";
         meas = Measurement{0, 0, 0, 1};
       } 
-      else if (i > (int)measures[j].size()) {
+      else if (i > (int)measures[j].size() || i >= (int)smoothedStates[j].size()) {
         break;
       } 
       else {
@@ -166,6 +159,8 @@ void Utils::saveDataToCSV(const vector<Detector> &detectors, const vector<vector
               << smo.value(5, 0) << "," << sqrt(smo.uncertainty(5, 5)) << "\n";
     }
 
+    PROFILE_COUNT("Utils: CSV files written", 1);
+    PROFILE_COUNT("Utils: CSV bytes written", csvFile.tellp());
     csvFile.close();
   }
 }
@@ -177,6 +172,7 @@ void Utils::saveDataToCSV(const vector<Detector> &detectors, const vector<vector
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void Utils::saveDataToCSV(const vector<Detector> &detectors, const vector<vector<ParticleState>> &realStates, const vector<vector<Measurement>> &measures,
     const vector<vector<MatrixStateEstimate>> &smoothedStates, const int runCounter) {
+  PROFILE_SCOPE("Utils::saveDataToCSV");
 
   // Check if the vectors are of the same length
   const bool particleLengthCheck = realStates.size() == smoothedStates.size() && realStates.size() == measures.size();
@@ -187,6 +183,10 @@ void Utils::saveDataToCSV(const vector<Detector> &detectors, const vector<vector
 
   // Particles loop
   for (int j = 0; j < (int)realStates.size(); j++) {
+    // NOTE: a particle without measures has not been tested
+    if (measures[j].empty())
+      continue;
+
     // File name
     string filename = "../results/Run " + std::to_string(runCounter) + " Detector test part " + std::to_string(j) + ".csv";
     std::ofstream csvFile;
@@ -205,7 +205,7 @@ void Utils::saveDataToCSV(const vector<Detector> &detectors, const vector<vector
         csvFile << "0.,";
         meas = Measurement{0, 0, 0, 1};
       } 
-      else if (i > (int)measures[j].size()) {
+      else if (i > (int)measures[j].size() || i >= (int)smoothedStates[j].size()) {
         break;
       } 
       else {
@@ -235,12 +235,307 @@ void Utils::saveDataToCSV(const vector<Detector> &detectors, const vector<vector
               << smo.value(5, 0) << "," << sqrt(smo.uncertainty(5, 5)) << "\n";
     }
 
+    PROFILE_COUNT("Utils: CSV files written", 1);
+    PROFILE_COUNT("Utils: CSV bytes written", csvFile.tellp());
     csvFile.close();
   }
 }
 
 
 
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Binary result helpers
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Names of the components of a state, as in the headers of the CSV files
+static const vector<string> STATE_COMPONENTS = {"t", "x", "y", "speed", "xz", "yz"};
+
+static void addStateColumns(vector<string> &columns, const string &prefix, bool withSigmas) {
+  for (const string &component : STATE_COMPONENTS) {
+    columns.push_back(prefix + "_" + component);
+    if (withSigmas)
+      columns.push_back(prefix + "_s" + component);
+  }
+}
+
+static void addStateValues(vector<double> &rows, const ParticleState &state) {
+  rows.insert(rows.end(), {state.position.T(), state.position.X(), state.position.Y(), 1. / state.velocity.Z(),
+                           state.velocity.X() / state.velocity.Z(), state.velocity.Y() / state.velocity.Z()});
+}
+
+static void addEstimateValues(vector<double> &rows, const MatrixStateEstimate &estimate) {
+  for (int k = 0; k < 6; k++) {
+    rows.push_back(estimate.value(k, 0));
+    rows.push_back(sqrt(estimate.uncertainty(k, k)));
+  }
+}
+
+static void addEstimateValues(vector<double> &rows, const BatchStateEstimates &estimates, int layer, int track) {
+  const int stride = estimates.getStride();
+  const double *values = estimates.getValues(layer);
+  const double *uncertainties = estimates.getUncertainties(layer);
+  for (int k = 0; k < 6; k++) {
+    rows.push_back(values[k * stride + track]);
+    rows.push_back(sqrt(uncertainties[(k * 6 + k) * stride + track]));
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// trackingResultColumns
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<string> Utils::trackingResultColumns() {
+  vector<string> columns = {"z"};
+  addStateColumns(columns, "the", false);
+  addStateColumns(columns, "rea", false);
+  columns.insert(columns.end(), {"mes_t", "mes_x", "mes_y"});
+  addStateColumns(columns, "pre", true);
+  addStateColumns(columns, "fil", true);
+  addStateColumns(columns, "smo", true);
+  return columns;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// detectorTestResultColumns
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<string> Utils::detectorTestResultColumns() {
+  vector<string> columns = {"z"};
+  addStateColumns(columns, "rea", false);
+  columns.insert(columns.end(), {"mes_t", "mes_x", "mes_y"});
+  addStateColumns(columns, "smo", true);
+  return columns;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// reconstructionResultColumns
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+vector<string> Utils::reconstructionResultColumns() {
+  vector<string> columns = {"z", "mes_t", "mes_x", "mes_y"};
+  addStateColumns(columns, "pre", true);
+  addStateColumns(columns, "fil", true);
+  addStateColumns(columns, "smo", true);
+  return columns;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// saveDataToBinary
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Utils::saveDataToBinary(BinaryResultFile &resultFile, const vector<Detector> &detectors, const vector<vector<ParticleState>> &theoreticalStates,
+    const vector<vector<ParticleState>> &realStates, const vector<vector<Measurement>> &measures, const vector<vector<MatrixStateEstimate>> &predictedStates,
+    const vector<vector<MatrixStateEstimate>> &filteredStates, const vector<vector<MatrixStateEstimate>> &smoothedStates) {
+  PROFILE_SCOPE("Utils::saveDataToBinary");
+
+  // Check if the vectors are of the same length
+  const bool particleLengthCheck = theoreticalStates.size() == realStates.size() && theoreticalStates.size() == predictedStates.size() &&
+      theoreticalStates.size() == filteredStates.size() && theoreticalStates.size() == smoothedStates.size() && theoreticalStates.size() == measures.size();
+
+  if (!particleLengthCheck){
+    throw std::invalid_argument("Utils::saveDataToBinary: vectors of different size");
+  }
+
+  // Particles loop
+  vector<double> rows;
+  for (int j = 0; j < (int)theoreticalStates.size(); j++) {
+    rows.clear();
+
+    // NOTE: a particle without measures has not been reconstructed, it is stored without rows to keep the indices
+    if (!measures[j].empty()) {
+      // NOTE: the states of a track given up by the Kalman filter end before its last measures
+      const int rowsNumber = std::min({theoreticalStates[j].size(), measures[j].size() + 1, smoothedStates[j].size()});
+      for (int i = 0; i < rowsNumber; i++) {
+        const Measurement meas = i == 0 ? Measurement{0, 0, 0, 1} : measures[j][i - 1];
+
+        rows.push_back(i == 0 ? 0. : detectors[i - 1].getBottmLeftPosition().z());
+        addStateValues(rows, theoreticalStates[j][i]);
+        addStateValues(rows, realStates[j][i]);
+        rows.insert(rows.end(), {meas.t, meas.x, meas.y});
+        addEstimateValues(rows, predictedStates[j][i]);
+        addEstimateValues(rows, filteredStates[j][i]);
+        addEstimateValues(rows, smoothedStates[j][i]);
+      }
+    }
+
+    resultFile.addParticle(rows);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// saveDataToBinary
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Utils::saveDataToBinary(BinaryResultFile &resultFile, const vector<Detector> &detectors, const vector<vector<ParticleState>> &theoreticalStates,
+    const vector<vector<ParticleState>> &realStates, const vector<vector<Measurement>> &measures, int firstParticle,
+    const BatchStateEstimates &predictedStates, const BatchStateEstimates &filteredStates, const BatchStateEstimates &smoothedStates) {
+  PROFILE_SCOPE("Utils::saveDataToBinary");
+
+  // Check if the batch is inside the particles
+  const int tracksNumber = smoothedStates.getTracksNumber();
+  const bool particleLengthCheck = theoreticalStates.size() == realStates.size() && theoreticalStates.size() == measures.size() &&
+      firstParticle >= 0 && firstParticle + tracksNumber <= (int)theoreticalStates.size() &&
+      predictedStates.getTracksNumber() == tracksNumber && filteredStates.getTracksNumber() == tracksNumber;
+
+  if (!particleLengthCheck){
+    throw std::invalid_argument("Utils::saveDataToBinary: vectors of different size");
+  }
+
+  // Tracks loop
+  vector<double> rows;
+  for (int k = 0; k < tracksNumber; k++) {
+    const int j = firstParticle + k;
+    rows.clear();
+
+    // NOTE: a particle without measures has not been reconstructed, it is stored without rows to keep the indices
+    if (!measures[j].empty()) {
+      // NOTE: the states of a track given up by the Kalman filter end before its last measures
+      const int rowsNumber = std::min({(int)theoreticalStates[j].size(), (int)measures[j].size() + 1, smoothedStates.getStatesNumber(k)});
+      for (int i = 0; i < rowsNumber; i++) {
+        const Measurement meas = i == 0 ? Measurement{0, 0, 0, 1} : measures[j][i - 1];
+
+        rows.push_back(i == 0 ? 0. : detectors[i - 1].getBottmLeftPosition().z());
+        addStateValues(rows, theoreticalStates[j][i]);
+        addStateValues(rows, realStates[j][i]);
+        rows.insert(rows.end(), {meas.t, meas.x, meas.y});
+        addEstimateValues(rows, predictedStates, i, k);
+        addEstimateValues(rows, filteredStates, i, k);
+        addEstimateValues(rows, smoothedStates, i, k);
+      }
+    }
+
+    resultFile.addParticle(rows);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// saveDataToBinary
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Utils::saveDataToBinary(BinaryResultFile &resultFile, const vector<Detector> &detectors, const vector<vector<ParticleState>> &realStates,
+    const vector<vector<Measurement>> &measures, const vector<vector<MatrixStateEstimate>> &smoothedStates) {
+  PROFILE_SCOPE("Utils::saveDataToBinary");
+
+  // Check if the vectors are of the same length
+  const bool particleLengthCheck = realStates.size() == smoothedStates.size() && realStates.size() == measures.size();
+
+  if (!particleLengthCheck){
+    throw std::invalid_argument("Utils::saveDataToBinary: vectors of different size");
+  }
+
+  // Particles loop
+  vector<double> rows;
+  for (int j = 0; j < (int)realStates.size(); j++) {
+    rows.clear();
+
+    // NOTE: a particle without measures has not been tested, it is stored without rows to keep the indices
+    if (!measures[j].empty()) {
+      const int rowsNumber = std::min(realStates[j].size(), measures[j].size() + 1);
+      for (int i = 0; i < rowsNumber; i++) {
+        const Measurement meas = i == 0 ? Measurement{0, 0, 0, 1} : measures[j][i - 1];
+
+        rows.push_back(i == 0 ? 0. : detectors[i - 1].getBottmLeftPosition().z());
+        addStateValues(rows, realStates[j][i]);
+        rows.insert(rows.end(), {meas.t, meas.x, meas.y});
+        addEstimateValues(rows, smoothedStates[j][i]);
+      }
+    }
+
+    resultFile.addParticle(rows);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// saveDataToBinary
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Utils::saveDataToBinary(BinaryResultFile &resultFile, const vector<Detector> &detectors, const vector<vector<Measurement>> &measures,
+    const vector<vector<MatrixStateEstimate>> &predictedStates, const vector<vector<MatrixStateEstimate>> &filteredStates,
+    const vector<vector<MatrixStateEstimate>> &smoothedStates) {
+  PROFILE_SCOPE("Utils::saveDataToBinary");
+
+  // Check if the vectors are of the same length
+  const bool particleLengthCheck = measures.size() == predictedStates.size() && measures.size() == filteredStates.size() &&
+      measures.size() == smoothedStates.size();
+
+  if (!particleLengthCheck){
+    throw std::invalid_argument("Utils::saveDataToBinary: vectors of different size");
+  }
+
+  // Particles loop
+  vector<double> rows;
+  for (int j = 0; j < (int)measures.size(); j++) {
+    rows.clear();
+
+    // NOTE: the states start at the particle gun, hence a particle has a row more than its measures
+    if (!measures[j].empty()) {
+      const int rowsNumber = std::min(smoothedStates[j].size(), measures[j].size() + 1);
+      for (int i = 0; i < rowsNumber; i++) {
+        const Measurement meas = i == 0 ? Measurement{0, 0, 0, 1} : measures[j][i - 1];
+
+        rows.push_back(i == 0 ? 0. : detectors[i - 1].getBottmLeftPosition().z());
+        rows.insert(rows.end(), {meas.t, meas.x, meas.y});
+        addEstimateValues(rows, predictedStates[j][i]);
+        addEstimateValues(rows, filteredStates[j][i]);
+        addEstimateValues(rows, smoothedStates[j][i]);
+      }
+    }
+
+    resultFile.addParticle(rows);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// saveDataToBinary
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void Utils::saveDataToBinary(BinaryResultFile &resultFile, const vector<Detector> &detectors, const vector<vector<Measurement>> &measures,
+    int firstParticle, const BatchStateEstimates &predictedStates, const BatchStateEstimates &filteredStates,
+    const BatchStateEstimates &smoothedStates) {
+  PROFILE_SCOPE("Utils::saveDataToBinary");
+
+  // Check if the batch is inside the particles
+  const int tracksNumber = smoothedStates.getTracksNumber();
+  const bool particleLengthCheck = firstParticle >= 0 && firstParticle + tracksNumber <= (int)measures.size() &&
+      predictedStates.getTracksNumber() == tracksNumber && filteredStates.getTracksNumber() == tracksNumber;
+
+  if (!particleLengthCheck){
+    throw std::invalid_argument("Utils::saveDataToBinary: vectors of different size");
+  }
+
+  // Tracks loop
+  vector<double> rows;
+  for (int k = 0; k < tracksNumber; k++) {
+    const int j = firstParticle + k;
+    rows.clear();
+
+    // NOTE: the states start at the particle gun, hence a particle has a row more than its measures
+    if (!measures[j].empty()) {
+      const int rowsNumber = std::min(smoothedStates.getStatesNumber(k), (int)measures[j].size() + 1);
+      for (int i = 0; i < rowsNumber; i++) {
+        const Measurement meas = i == 0 ? Measurement{0, 0, 0, 1} : measures[j][i - 1];
+
+        rows.push_back(i == 0 ? 0. : detectors[i - 1].getBottmLeftPosition().z());
+        rows.insert(rows.end(), {meas.t, meas.x, meas.y});
+        addEstimateValues(rows, predictedStates, i, k);
+        addEstimateValues(rows, filteredStates, i, k);
+        addEstimateValues(rows, smoothedStates, i, k);
+      }
+    }
+
+    resultFile.addParticle(rows);
+  }
+}
+
+
+
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // printTime
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -0,0 +1,76 @@
+// Header files needed
+#include <cmath>
+#include <vector>
+
+// Custom classes
+#include "DataGenerator.hpp"
+#include "MeasuresAndStates.hpp"
+#include "SetupFactory.hpp"
+#include "Tracker.hpp"
+#include "TestUtils.hpp"
+
+// Namespaces
+using namespace std;
+
+/**
+ * The batch Kalman filter and smoother give the states, the chi2 and the
+ * degrees of freedom of the scalar ones, with and without tracks given up.
+ */
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// checkBatchMatchesScalar
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void checkBatchMatchesScalar(const Tracker &tracker, const vector<vector<Measurement>> &allTracksMeasures,
+                                    const FilterAbortPolicy &abortPolicy) {
+  constexpr double tolerance = 1e-9;
+
+  const kalmanFilterBatchResult batchResult = tracker.kalmanFilterBatch(allTracksMeasures, false, abortPolicy);
+  const BatchStateEstimates batchSmoothedStates = tracker.kalmanSmootherBatch(batchResult);
+
+  for (int i = 0; i < (int)allTracksMeasures.size(); i++) {
+    const kalmanFilterResult result = tracker.kalmanFilter(allTracksMeasures[i], false, false, abortPolicy);
+    const vector<MatrixStateEstimate> smoothedStates = tracker.kalmanSmoother(result);
+
+    CHECK(TestUtils::maxStatesDifference(result.predictedStates, batchResult.predictedStates.getTrackStates(i)) < tolerance);
+    CHECK(TestUtils::maxStatesDifference(result.filteredStates, batchResult.filteredStates.getTrackStates(i)) < tolerance);
+    // NOTE: the smoothed covariance at the particle gun is almost zero, the difference of nearly equal terms, hence
+    // only the states on the layers are compared
+    CHECK(TestUtils::maxStatesDifference(smoothedStates, batchSmoothedStates.getTrackStates(i), 1) < tolerance);
+    CHECK(abs(result.chi2 - batchResult.chi2s[i]) <= tolerance * max(1., result.chi2));
+    CHECK(result.ndf == batchResult.ndfs[i]);
+    CHECK(result.aborted == batchResult.aborted[i]);
+  }
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// main
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int main() {
+  const SimulationSetup setup = SetupFactory().generateExperiment();
+  const DataGenerator dataGenerator(setup, 11);
+  const Tracker tracker(setup.detectors);
+
+  // NOTE: the particles without measures are left out, as in the reconstruction of the simulation
+  const GeneratedData generatedData = dataGenerator.generateAllData(1000, false, true);
+  vector<vector<Measurement>> allTracksMeasures;
+  for (const vector<Measurement> &measures : generatedData.allParticlesMeasures) {
+    if (!measures.empty())
+      allTracksMeasures.push_back(measures);
+  }
+
+  checkBatchMatchesScalar(tracker, allTracksMeasures, FilterAbortPolicy());
+
+  // The limit gives up most of the tracks, after updates of different layers
+  FilterAbortPolicy abortPolicy;
+  abortPolicy.maxStepChi2 = 4.;
+  checkBatchMatchesScalar(tracker, allTracksMeasures, abortPolicy);
+
+  int abortedNumber = 0;
+  for (const vector<Measurement> &measures : allTracksMeasures)
+    abortedNumber += tracker.kalmanFilter(measures, false, false, abortPolicy).aborted;
+  CHECK(abortedNumber > 0 && abortedNumber < (int)allTracksMeasures.size());
+
+  return TestUtils::testResult();
+}
@@ -0,0 +1,96 @@
+// Header files needed
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Custom classes
+#include "DataGenerator.hpp"
+#include "EventBuilder.hpp"
+#include "MeasuresAndStates.hpp"
+#include "SetupFactory.hpp"
+#include "ThreadPool.hpp"
+#include "Utils.hpp"
+#include "TestUtils.hpp"
+
+// Namespaces
+using namespace std;
+
+/**
+ * The event builder divides the measures of all the particles, mixed
+ * together, back into the measures of each particle, whatever the order of
+ * the measures and the number of threads.
+ *
+ * NOTE: all the detectors measure the time, since the measures of a detector
+ * without time can be exchanged between close particles.
+ */
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// sameMeasures
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static bool sameMeasures(const vector<Measurement> &measures, const vector<Measurement> &otherMeasures) {
+  return equal(measures.begin(), measures.end(), otherMeasures.begin(), otherMeasures.end(),
+               [](const Measurement &measure, const Measurement &otherMeasure) {
+                 return measure.t == otherMeasure.t && measure.x == otherMeasure.x && measure.y == otherMeasure.y &&
+                        measure.detectorID == otherMeasure.detectorID;
+               });
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// checkSameEvents
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+static void checkSameEvents(const vector<vector<Measurement>> &events, const vector<vector<Measurement>> &expectedEvents) {
+  CHECK(events.size() == expectedEvents.size());
+  if (events.size() != expectedEvents.size())
+    return;
+
+  int differentEvents = 0;
+  for (int i = 0; i < (int)events.size(); i++)
+    differentEvents += !sameMeasures(events[i], expectedEvents[i]);
+  CHECK(differentEvents == 0);
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// main
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int main() {
+  ExperimentParameters parameters;
+  parameters.detectorWithoutTime = -1;
+  const SimulationSetup setup = SetupFactory(parameters).generateExperiment();
+  const DataGenerator dataGenerator(setup, 11);
+  const EventBuilder eventBuilder(setup.detectors, setup.particleGun.getPosition());
+
+  // The particles are built in the order of their first measure
+  const GeneratedData generatedData = dataGenerator.generateAllData(2000, false, true);
+  vector<vector<Measurement>> expectedEvents;
+  for (const vector<Measurement> &measures : generatedData.allParticlesMeasures) {
+    if (!measures.empty())
+      expectedEvents.push_back(measures);
+  }
+  stable_sort(expectedEvents.begin(), expectedEvents.end(),
+              [](const vector<Measurement> &measures, const vector<Measurement> &otherMeasures) { return measures[0].t < otherMeasures[0].t; });
+
+  vector<Measurement> allMeasures = Utils::concatenateMeasures(generatedData.allParticlesMeasures);
+  checkSameEvents(eventBuilder.buildEvents(allMeasures), expectedEvents);
+
+  // The measures in any order, divided among the threads
+  shuffle(allMeasures.begin(), allMeasures.end(), mt19937(3));
+  ThreadPool threadPool(4);
+  checkSameEvents(eventBuilder.buildEvents(allMeasures, &threadPool), expectedEvents);
+
+  // The sorting keeps the measures with the same time in their order (the times are rounded to the ns to have ties)
+  vector<Measurement> sortedMeasures = allMeasures;
+  for (Measurement &measure : sortedMeasures)
+    measure.t = floor(measure.t / 1e-9) * 1e-9;
+  vector<Measurement> expectedSortedMeasures = sortedMeasures;
+  stable_sort(expectedSortedMeasures.begin(), expectedSortedMeasures.end(),
+              [](const Measurement &measure, const Measurement &otherMeasure) { return measure.t < otherMeasure.t; });
+  EventBuilder::sortByTime(sortedMeasures, &threadPool);
+  CHECK(sameMeasures(sortedMeasures, expectedSortedMeasures));
+
+  return TestUtils::testResult();
+}
@@ -0,0 +1,88 @@
+// Header files needed
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+// Custom classes
+#include "DataGenerator.hpp"
+#include "MeasuresAndStates.hpp"
+#include "ModelTracker.hpp"
+#include "SetupFactory.hpp"
+#include "StateModels.hpp"
+#include "Tracker.hpp"
+#include "TestUtils.hpp"
+
+// Namespaces
+using namespace std;
+
+/**
+ * The model tracker with the model of Tracker gives the filtered and smoothed
+ * states of Tracker, with the default detector without time measure, with the
+ * states stored in a std::vector or inline.
+ */
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// maxValuesDifference
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// NOTE: the state i of the model tracker is the state i + 1 of Tracker, after the one at the particle gun
+template <typename ModelStates>
+static double maxValuesDifference(const vector<MatrixStateEstimate> &states, const ModelStates &modelStates) {
+  if (states.size() != modelStates.size() + 1)
+    return INFINITY;
+
+  double maxDifference = 0.;
+  for (int i = 0; i < (int)modelStates.size(); i++)
+    for (int k = 0; k < STATE_DIMENSION; k++)
+      maxDifference = max(maxDifference, abs(states[i + 1].value(k, 0) - modelStates[i].value(k, 0)) /
+                                             sqrt(states[i + 1].uncertainty(k, k)));
+
+  return maxDifference;
+}
+
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// main
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int main() {
+  constexpr double tolerance = 1e-6;
+
+  const SimulationSetup setup = SetupFactory().generateExperiment();
+  const DataGenerator dataGenerator(setup, 7);
+  const Tracker tracker(setup.detectors);
+  const ModelTracker<StraightLine4DModel> modelTracker(setup.detectors, tracker.getParameters());
+  const ModelTracker<StraightLine4DModel, NUMBER_OF_DETECTORS> fixedModelTracker(setup.detectors, tracker.getParameters());
+
+  int tracksNumber = 0;
+  const GeneratedData generatedData = dataGenerator.generateAllData(500, false, true);
+  for (const vector<Measurement> &measures : generatedData.allParticlesMeasures) {
+    if (measures.size() < 2)
+      continue;
+
+    const kalmanFilterResult filterResult = tracker.kalmanFilter(measures);
+    const vector<MatrixStateEstimate> smoothedStates = tracker.kalmanSmoother(filterResult);
+
+    const auto modelFilterResult = modelTracker.kalmanFilter(measures);
+    CHECK(!modelFilterResult.aborted);
+    CHECK(maxValuesDifference(filterResult.filteredStates, modelFilterResult.filteredStates) < tolerance);
+    CHECK(maxValuesDifference(smoothedStates, modelTracker.kalmanSmoother(modelFilterResult)) < tolerance);
+
+    const auto fixedFilterResult = fixedModelTracker.kalmanFilter(measures);
+    CHECK(maxValuesDifference(filterResult.filteredStates, fixedFilterResult.filteredStates) < tolerance);
+    CHECK(maxValuesDifference(smoothedStates, fixedModelTracker.kalmanSmoother(fixedFilterResult)) < tolerance);
+    tracksNumber++;
+  }
+  CHECK(tracksNumber > 0);
+
+  // The filter needs at least two measures
+  bool thrown = false;
+  try {
+    modelTracker.kalmanFilter(vector<Measurement>{generatedData.allParticlesMeasures[0][0]});
+  } catch (const invalid_argument &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  return TestUtils::testResult();
+}
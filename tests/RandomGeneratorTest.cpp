@@ -0,0 +1,57 @@
+// Header files needed
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Custom classes
+#include "RandomGenerator.hpp"
+#include "TestUtils.hpp"
+
+// Namespaces
+using namespace std;
+
+/**
+ * The arrays of random numbers are the same numbers drawn one at a time, for
+ * any count and after any number of previous draws, and the streams of
+ * different particles are not the same.
+ */
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// main
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int main() {
+  constexpr uint64_t seed = 5;
+
+  for (uint64_t particleIndex = 0; particleIndex < 20; particleIndex++) {
+    for (size_t count : {1, 2, 3, 4, 7, 33, 100}) {
+      RandomGenerator arrayGenerator(seed, particleIndex, RandomStream::MEASURE);
+      RandomGenerator scalarGenerator(seed, particleIndex, RandomStream::MEASURE);
+      vector<double> values(count);
+
+      // NOTE: the gaussians are drawn in pairs, hence an odd number of previous draws leaves a number for the array
+      for (uint64_t i = 0; i < particleIndex % 3; i++)
+        CHECK(arrayGenerator.generateGaussian() == scalarGenerator.generateGaussian());
+
+      arrayGenerator.fillGaussian(values.data(), count);
+      for (size_t i = 0; i < count; i++)
+        CHECK(values[i] == scalarGenerator.generateGaussian());
+      CHECK(arrayGenerator.generateGaussian() == scalarGenerator.generateGaussian());
+
+      arrayGenerator.fillUniform(values.data(), count);
+      for (size_t i = 0; i < count; i++) {
+        CHECK(values[i] == scalarGenerator.generateUniform(0., 1.));
+        CHECK(values[i] >= 0. && values[i] < 1.);
+      }
+      CHECK(arrayGenerator.generateUniform(0., 1.) == scalarGenerator.generateUniform(0., 1.));
+    }
+  }
+
+  RandomGenerator firstGenerator(seed, 0, RandomStream::EVOLUTION);
+  RandomGenerator secondGenerator(seed, 1, RandomStream::EVOLUTION);
+  RandomGenerator otherStreamGenerator(seed, 0, RandomStream::MEASURE);
+  const double firstValue = firstGenerator.generateGaussian();
+  CHECK(firstValue != secondGenerator.generateGaussian());
+  CHECK(firstValue != otherStreamGenerator.generateGaussian());
+
+  return TestUtils::testResult();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "MeasuresAndStates.hpp"
+
+/**
+ * The checks shared by the behaviour tests.
+ *
+ * Each test is an executable registered in ctest: a failed check prints its
+ * condition and its line and the test goes on, then the exit code of the test
+ * tells ctest whether any check failed.
+ */
+namespace TestUtils {
+inline int failedChecks = 0;
+
+inline void check(bool condition, const char *conditionText, const char *file, int line) {
+  if (!condition) {
+    std::cerr << file << ":" << line << ": check failed: " << conditionText << std::endl;
+    failedChecks++;
+  }
+}
+
+/**
+ * The exit code of a test
+ *
+ * @return 0 if all the checks passed, 1 otherwise
+ */
+inline int testResult() {
+  if (failedChecks != 0)
+    std::cerr << failedChecks << " checks failed" << std::endl;
+  return failedChecks != 0 ? 1 : 0;
+}
+
+/**
+ * The largest difference between two sequences of states
+ *
+ * The values are compared in units of the uncertainty of the first sequence,
+ * the uncertainties in units of the product of the standard deviations.
+ *
+ * @param states the reference states
+ * @param otherStates the states compared with the reference ones
+ * @param firstState the index of the first state compared
+ * @return the largest difference, infinite if the sequences have different sizes
+ */
+inline double maxStatesDifference(const std::vector<MatrixStateEstimate> &states, const std::vector<MatrixStateEstimate> &otherStates,
+                                  int firstState = 0) {
+  if (states.size() != otherStates.size())
+    return INFINITY;
+
+  double maxDifference = 0.;
+  for (int i = firstState; i < (int)states.size(); i++) {
+    for (int row = 0; row < STATE_DIMENSION; row++) {
+      const double rowSigma = std::sqrt(states[i].uncertainty(row, row));
+      maxDifference = std::max(maxDifference, std::abs(states[i].value(row, 0) - otherStates[i].value(row, 0)) / rowSigma);
+
+      for (int col = 0; col < STATE_DIMENSION; col++) {
+        const double colSigma = std::sqrt(states[i].uncertainty(col, col));
+        maxDifference = std::max(maxDifference,
+                                 std::abs(states[i].uncertainty(row, col) - otherStates[i].uncertainty(row, col)) / (rowSigma * colSigma));
+      }
+    }
+  }
+
+  return maxDifference;
+}
+} // namespace TestUtils
+
+#define CHECK(condition) TestUtils::check((condition), #condition, __FILE__, __LINE__)
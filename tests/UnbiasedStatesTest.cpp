@@ -0,0 +1,93 @@
+// Header files needed
+#include <cmath>
+#include <vector>
+
+// Custom classes
+#include "DataGenerator.hpp"
+#include "MeasuresAndStates.hpp"
+#include "SetupFactory.hpp"
+#include "Tracker.hpp"
+#include "TestUtils.hpp"
+
+// Namespaces
+using namespace std;
+
+/**
+ * The pulls of the measures from their unbiased estimates are standard
+ * gaussians on every detector, and the unbiased states of the tracks given up
+ * or with a single measure stop at the layers reached.
+ */
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// main
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+int main() {
+  const SimulationSetup setup = SetupFactory().generateExperiment();
+  const DataGenerator dataGenerator(setup, 7);
+  const Tracker tracker(setup.detectors);
+
+  // Sums of the pulls of each detector, t, x and y
+  const int detectorsNumber = (int)setup.detectors.size();
+  vector<int> pullsNumber(detectorsNumber, 0);
+  vector<vector<double>> pullsSum(detectorsNumber, vector<double>(3, 0.));
+  vector<vector<double>> pullsSquaresSum(detectorsNumber, vector<double>(3, 0.));
+
+  const GeneratedData generatedData = dataGenerator.generateAllData(10000, false, true);
+  for (const vector<Measurement> &measures : generatedData.allParticlesMeasures) {
+    if (measures.size() < 2)
+      continue;
+
+    const kalmanFilterResult filterResult = tracker.kalmanFilter(measures);
+    const vector<MatrixStateEstimate> smoothedStates = tracker.kalmanSmoother(filterResult);
+    const vector<MatrixStateEstimate> unbiasedStates = tracker.computeUnbiasedStates(measures, filterResult, smoothedStates);
+    const vector<PullVariables> pulls = tracker.computePulls(measures, unbiasedStates);
+    CHECK(pulls.size() == measures.size());
+
+    for (int i = 0; i < (int)pulls.size(); i++) {
+      const int detectorID = measures[i].detectorID;
+      const double trackPulls[3] = {pulls[i].tPull, pulls[i].xPull, pulls[i].yPull};
+      pullsNumber[detectorID]++;
+      for (int k = 0; k < 3; k++) {
+        pullsSum[detectorID][k] += trackPulls[k];
+        pullsSquaresSum[detectorID][k] += trackPulls[k] * trackPulls[k];
+      }
+    }
+  }
+
+  // NOTE: with multiple scattering the time pulls of the outer detectors are biased by up to a quarter of their
+  // width, hence only their widths are checked
+  for (int i = 0; i < detectorsNumber; i++) {
+    CHECK(pullsNumber[i] > 1000);
+    for (int k = 0; k < 3; k++) {
+      const double mean = pullsSum[i][k] / pullsNumber[i];
+      const double deviation = sqrt(pullsSquaresSum[i][k] / pullsNumber[i] - mean * mean);
+      if (k == 0 && !setup.detectors[i].isTimeMeasured()) {
+        CHECK(mean == 0. && deviation == 0.);
+      } else if (k == 0) {
+        CHECK(abs(deviation - 1.) < 0.1);
+      } else {
+        CHECK(abs(mean) < 0.05);
+        CHECK(abs(deviation - 1.) < 0.05);
+      }
+    }
+  }
+
+  // A track given up after the first layer has the unbiased state of that layer only
+  const vector<Measurement> &measures = generatedData.allParticlesMeasures[0];
+  FilterAbortPolicy abortPolicy;
+  abortPolicy.maxStepChi2 = -1.;
+  const kalmanFilterResult abortedResult = tracker.kalmanFilter(measures, false, false, abortPolicy);
+  const vector<MatrixStateEstimate> abortedSmoothedStates = tracker.kalmanSmoother(abortedResult);
+  CHECK(abortedResult.aborted);
+  CHECK(tracker.computeUnbiasedStates(measures, abortedResult, abortedSmoothedStates).size() == abortedSmoothedStates.size() - 1);
+
+  // A single measure has the initial state as unbiased state
+  const vector<Measurement> singleMeasure{measures[0]};
+  const kalmanFilterResult singleResult = tracker.kalmanFilter(singleMeasure);
+  const vector<MatrixStateEstimate> singleUnbiasedStates =
+      tracker.computeUnbiasedStates(singleMeasure, singleResult, tracker.kalmanSmoother(singleResult));
+  CHECK(singleUnbiasedStates.size() == 1);
+  CHECK(tracker.computePulls(singleMeasure, singleUnbiasedStates).size() == 1);
+
+  return TestUtils::testResult();
+}